@@ -30,5 +30,25 @@ void pic8259_init();
  */
 void pic8259_eoi(uint8 irq);
 
+/**
+ * enable given IRQ line(0-15) in the mask registers
+ */
+void pic8259_unmask(uint8 irq);
+
+/**
+ * disable given IRQ line(0-15) in the mask registers
+ */
+void pic8259_mask(uint8 irq);
+
+/**
+ * mask registers of both PICs, bit n set means IRQ n is disabled
+ */
+uint16 pic8259_get_mask();
+
+/**
+ * mask every IRQ line, done once the I/O APIC has taken over
+ */
+void pic8259_disable();
+
 #endif
 
@@ -0,0 +1,123 @@
+/**
+ * ACPI table lookup, only the MADT(APIC table) is parsed for now
+ */
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "types.h"
+
+#define ACPI_MAX_CPUS           16
+#define ACPI_MAX_IOAPICS        4
+#define ACPI_ISA_IRQS           16
+
+// where the RSDP may live, see ACPI spec 5.2.5.1
+#define ACPI_EBDA_POINTER       0x40E
+#define ACPI_BIOS_AREA_START    0xE0000
+#define ACPI_BIOS_AREA_END      0x100000
+
+// MADT entry types
+#define ACPI_MADT_LAPIC             0
+#define ACPI_MADT_IOAPIC            1
+#define ACPI_MADT_OVERRIDE          2
+#define ACPI_MADT_LAPIC_ADDRESS     5
+
+#define ACPI_MADT_LAPIC_ENABLED     0x01
+#define ACPI_MADT_LAPIC_ONLINE_CAP  0x02
+#define ACPI_MADT_PCAT_COMPAT       0x01   // MADT flags, a legacy 8259 pair is present
+
+// interrupt source override flags, 0 in a field means the bus default
+#define ACPI_MADT_POLARITY_MASK     0x03
+#define ACPI_MADT_POLARITY_LOW      0x03
+#define ACPI_MADT_TRIGGER_MASK      0x0C
+#define ACPI_MADT_TRIGGER_LEVEL     0x0C
+
+typedef struct {
+    char signature[8];          // "RSD PTR "
+    uint8 checksum;
+    char oem_id[6];
+    uint8 revision;
+    uint32 rsdt_address;
+} __attribute__((packed)) ACPI_RSDP;
+
+typedef struct {
+    char signature[4];
+    uint32 length;              // whole table including this header
+    uint8 revision;
+    uint8 checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32 oem_revision;
+    uint32 creator_id;
+    uint32 creator_revision;
+} __attribute__((packed)) ACPI_SDT_HEADER;
+
+typedef struct {
+    ACPI_SDT_HEADER header;
+    uint32 lapic_address;
+    uint32 flags;
+} __attribute__((packed)) ACPI_MADT;
+
+typedef struct {
+    uint8 type;
+    uint8 length;
+} __attribute__((packed)) ACPI_MADT_ENTRY;
+
+typedef struct {
+    ACPI_MADT_ENTRY entry;
+    uint8 processor_id;
+    uint8 apic_id;
+    uint32 flags;
+} __attribute__((packed)) ACPI_MADT_LAPIC_ENTRY;
+
+typedef struct {
+    ACPI_MADT_ENTRY entry;
+    uint8 ioapic_id;
+    uint8 reserved;
+    uint32 address;
+    uint32 gsi_base;
+} __attribute__((packed)) ACPI_MADT_IOAPIC_ENTRY;
+
+typedef struct {
+    ACPI_MADT_ENTRY entry;
+    uint8 bus;
+    uint8 source;               // ISA IRQ
+    uint32 gsi;
+    uint16 flags;               // polarity & trigger mode
+} __attribute__((packed)) ACPI_MADT_OVERRIDE_ENTRY;
+
+typedef struct {
+    ACPI_MADT_ENTRY entry;
+    uint16 reserved;
+    uint64 address;
+} __attribute__((packed)) ACPI_MADT_LAPIC_ADDRESS_ENTRY;
+
+typedef struct {
+    uint8 id;
+    uint32 address;
+    uint32 gsi_base;
+} ACPI_IOAPIC;
+
+// what the MADT tells about interrupt controllers and processors
+typedef struct {
+    uint32 lapic_address;
+    BOOL legacy_pic;
+    uint32 cpu_count;
+    uint8 cpu_apic_ids[ACPI_MAX_CPUS];
+    uint32 ioapic_count;
+    ACPI_IOAPIC ioapics[ACPI_MAX_IOAPICS];
+    uint32 isa_gsi[ACPI_ISA_IRQS];      // GSI each ISA IRQ is wired to
+    uint16 isa_flags[ACPI_ISA_IRQS];    // override flags, 0 for ISA defaults
+} ACPI_MADT_INFO;
+
+/**
+ * find the RSDP and parse the MADT, returns FALSE when there is none
+ */
+BOOL acpi_init();
+
+/**
+ * MADT contents, valid after acpi_init() returned TRUE
+ */
+const ACPI_MADT_INFO *acpi_madt();
+
+#endif
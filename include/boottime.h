@@ -0,0 +1,43 @@
+/**
+ * Boot phase tracer
+ * entry.asm stores the TSC at _start, boot() and main_loop() add a stamp
+ * after every init step, the table is static so tracing costs one rdtsc a step
+ * and the stamps are turned into time once clock_init() measured the TSC
+ */
+
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include "types.h"
+
+#define BOOTTIME_MAX_PHASES     48
+
+// TSC at _start, written by entry.asm before paging is on
+extern uint64 g_boottime_start;
+
+/**
+ * run call and record the TSC under its text as a phase that ended now
+ */
+#define BOOTTIME_STEP(call)             \
+    do {                                \
+        call;                           \
+        boottime_mark(#call);           \
+    } while (0)
+
+/**
+ * record the TSC as the end of phase, phase must be a string that is never freed,
+ * only the boot CPU records phases, one after another
+ */
+void boottime_mark(const char *phase);
+
+/**
+ * print every phase with its end and length in microseconds since _start
+ */
+void boottime_print();
+
+/**
+ * write the phases as CSV to COM1, returns FALSE when there is no serial port
+ */
+BOOL boottime_serial();
+
+#endif
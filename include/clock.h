@@ -0,0 +1,74 @@
+/**
+ * Kernel time and per-CPU one-shot timer events for tickless idle
+ * time comes from the TSC calibrated against the PIT, events from the
+ * local APIC timer(TSC-deadline mode when available) or the PIT
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "types.h"
+#include "pit.h"
+
+#define CLOCK_HZ                PIT_HZ      // tick rate of clock_ticks() and the scheduler
+#define CLOCK_NEVER             0xFFFFFFFF  // clock_arm() argument to stop the event
+#define CLOCK_CALIBRATE_TICKS   10          // PIT ticks the TSC is measured over
+#define CLOCK_MAX_EVENT_TICKS   100         // longest one-shot, keeps the count math in 32 bits
+#define CLOCK_NS_PER_TICK       (1000000000 / CLOCK_HZ)
+
+typedef enum {
+    CLOCK_EVENT_PIT_PERIODIC,   // before clock_init()
+    CLOCK_EVENT_PIT_ONESHOT,    // no local APIC, boot CPU only
+    CLOCK_EVENT_LAPIC,
+    CLOCK_EVENT_TSC_DEADLINE
+} CLOCK_EVENT_SOURCE;
+
+/**
+ * calibrate the TSC and local APIC timer against the running PIT, then stop
+ * the periodic tick and switch every CPU to one-shot events, called by the
+ * boot CPU with interrupts enabled after pit_init() and smp_init()
+ */
+void clock_init();
+
+/**
+ * ticks since pit_init()
+ */
+uint32 clock_ticks();
+
+/**
+ * nanoseconds since pit_init(), to the TSC cycle once clock_init() ran
+ */
+uint64 clock_ns();
+
+/**
+ * convert milliseconds to ticks, rounded up
+ */
+uint32 clock_ms_to_ticks(uint32 ms);
+
+/**
+ * convert TSC cycles to milliseconds
+ */
+uint32 clock_cycles_to_ms(uint64 cycles);
+
+/**
+ * convert TSC cycles to microseconds, longer than about 71 minutes gives 0xFFFFFFFF
+ */
+uint32 clock_cycles_to_us(uint64 cycles);
+
+/**
+ * arm the one-shot timer event of the calling CPU for tick, CLOCK_NEVER stops it,
+ * nothing is reprogrammed when it is already armed for that tick
+ */
+void clock_arm(uint32 tick);
+
+/**
+ * halt the calling CPU until the next interrupt, with mwait when the CPU has it
+ */
+void clock_idle();
+
+/**
+ * print the clock setup
+ */
+void clock_stats();
+
+#endif
@@ -8,6 +8,9 @@
 #define SCROLL_UP     1
 #define SCROLL_DOWN   2
 
+// receives every character printf() and printf_color() put out
+typedef void (*CONSOLE_OUTPUT)(char ch);
+
 void console_clear(VGA_COLOR_TYPE fore_color, VGA_COLOR_TYPE back_color);
 
 //initialize console
@@ -22,13 +25,13 @@ void console_ungetchar_bound(uint8 n);
 void console_gotoxy(uint16 x, uint16 y);
 
 void console_putstr(const char *str);
+// send printf() and printf_color() output to output instead of the screen
+void console_set_output(CONSOLE_OUTPUT output);
+// printf() straight to the screen, for interrupt handlers and fatal errors
 void console_printf(const char *format, ...);
+void printf(const char *format, ...);
+void printf_color(char vga_color, const char *format, ...);
 
-// read string from console, but no backing
-void getstr(char *buffer);
-
-// read string from console, and erase or go back util bound occurs
-void getstr_bound(char *buffer, uint8 bound);
 uint8 get_cursor_x();
 uint8 get_cursor_y();
 
@@ -0,0 +1,159 @@
+/**
+ * CPU feature detection and boot-time dispatch
+ * every CPUID leaf the kernel cares about is read once at boot into
+ * g_cpu_features, a feature is a register word and bit number like in
+ * the Intel manual, cpu_has() is a load and a bit test
+ * a routine with several implementations is declared with CPU_DISPATCH(),
+ * callers call a five byte jmp that cpu_dispatch_bind() points at the best
+ * implementation, so a call costs one direct jump and no check per call
+ */
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include "types.h"
+
+#define CPU_DISPATCH_MAX        16
+
+// CPUID registers kept in CPU_FEATURES.words
+typedef enum {
+    CPU_WORD_1_EDX,
+    CPU_WORD_1_ECX,
+    CPU_WORD_6_EAX,
+    CPU_WORD_7_EBX,
+    CPU_WORD_7_ECX,
+    CPU_WORD_7_EDX,
+    CPU_WORD_81_EDX,            // leaf 0x80000001
+    CPU_WORD_81_ECX,
+    CPU_WORD_87_EDX,            // leaf 0x80000007
+    CPU_WORDS
+} CPU_WORD;
+
+#define CPU_FEATURE(word, bit)  ((word) * 32 + (bit))
+
+#define CPU_FEATURE_FPU         CPU_FEATURE(CPU_WORD_1_EDX, 0)
+#define CPU_FEATURE_TSC         CPU_FEATURE(CPU_WORD_1_EDX, 4)
+#define CPU_FEATURE_MSR         CPU_FEATURE(CPU_WORD_1_EDX, 5)
+#define CPU_FEATURE_PAE         CPU_FEATURE(CPU_WORD_1_EDX, 6)
+#define CPU_FEATURE_APIC        CPU_FEATURE(CPU_WORD_1_EDX, 9)
+#define CPU_FEATURE_SEP         CPU_FEATURE(CPU_WORD_1_EDX, 11)
+#define CPU_FEATURE_PGE         CPU_FEATURE(CPU_WORD_1_EDX, 13)
+#define CPU_FEATURE_CMOV        CPU_FEATURE(CPU_WORD_1_EDX, 15)
+#define CPU_FEATURE_CLFLUSH     CPU_FEATURE(CPU_WORD_1_EDX, 19)
+#define CPU_FEATURE_MMX         CPU_FEATURE(CPU_WORD_1_EDX, 23)
+#define CPU_FEATURE_FXSR        CPU_FEATURE(CPU_WORD_1_EDX, 24)
+#define CPU_FEATURE_SSE         CPU_FEATURE(CPU_WORD_1_EDX, 25)
+#define CPU_FEATURE_SSE2        CPU_FEATURE(CPU_WORD_1_EDX, 26)
+#define CPU_FEATURE_HTT         CPU_FEATURE(CPU_WORD_1_EDX, 28)
+
+#define CPU_FEATURE_SSE3        CPU_FEATURE(CPU_WORD_1_ECX, 0)
+#define CPU_FEATURE_PCLMULQDQ   CPU_FEATURE(CPU_WORD_1_ECX, 1)
+#define CPU_FEATURE_MWAIT       CPU_FEATURE(CPU_WORD_1_ECX, 3)
+#define CPU_FEATURE_SSSE3       CPU_FEATURE(CPU_WORD_1_ECX, 9)
+#define CPU_FEATURE_FMA         CPU_FEATURE(CPU_WORD_1_ECX, 12)
+#define CPU_FEATURE_CX16        CPU_FEATURE(CPU_WORD_1_ECX, 13)
+#define CPU_FEATURE_PCID        CPU_FEATURE(CPU_WORD_1_ECX, 17)
+#define CPU_FEATURE_SSE41       CPU_FEATURE(CPU_WORD_1_ECX, 19)
+#define CPU_FEATURE_SSE42       CPU_FEATURE(CPU_WORD_1_ECX, 20)
+#define CPU_FEATURE_X2APIC      CPU_FEATURE(CPU_WORD_1_ECX, 21)
+#define CPU_FEATURE_MOVBE       CPU_FEATURE(CPU_WORD_1_ECX, 22)
+#define CPU_FEATURE_POPCNT      CPU_FEATURE(CPU_WORD_1_ECX, 23)
+#define CPU_FEATURE_TSC_DEADLINE CPU_FEATURE(CPU_WORD_1_ECX, 24)
+#define CPU_FEATURE_AES         CPU_FEATURE(CPU_WORD_1_ECX, 25)
+#define CPU_FEATURE_XSAVE       CPU_FEATURE(CPU_WORD_1_ECX, 26)
+#define CPU_FEATURE_AVX         CPU_FEATURE(CPU_WORD_1_ECX, 28)
+#define CPU_FEATURE_F16C        CPU_FEATURE(CPU_WORD_1_ECX, 29)
+#define CPU_FEATURE_RDRAND      CPU_FEATURE(CPU_WORD_1_ECX, 30)
+#define CPU_FEATURE_HYPERVISOR  CPU_FEATURE(CPU_WORD_1_ECX, 31)
+
+#define CPU_FEATURE_ARAT        CPU_FEATURE(CPU_WORD_6_EAX, 2)      // APIC timer keeps running in deep C-states
+
+#define CPU_FEATURE_FSGSBASE    CPU_FEATURE(CPU_WORD_7_EBX, 0)
+#define CPU_FEATURE_BMI1        CPU_FEATURE(CPU_WORD_7_EBX, 3)
+#define CPU_FEATURE_AVX2        CPU_FEATURE(CPU_WORD_7_EBX, 5)
+#define CPU_FEATURE_SMEP        CPU_FEATURE(CPU_WORD_7_EBX, 7)
+#define CPU_FEATURE_BMI2        CPU_FEATURE(CPU_WORD_7_EBX, 8)
+#define CPU_FEATURE_ERMS        CPU_FEATURE(CPU_WORD_7_EBX, 9)      // fast rep movsb/stosb
+#define CPU_FEATURE_INVPCID     CPU_FEATURE(CPU_WORD_7_EBX, 10)
+#define CPU_FEATURE_AVX512F     CPU_FEATURE(CPU_WORD_7_EBX, 16)
+#define CPU_FEATURE_RDSEED      CPU_FEATURE(CPU_WORD_7_EBX, 18)
+#define CPU_FEATURE_SMAP        CPU_FEATURE(CPU_WORD_7_EBX, 20)
+#define CPU_FEATURE_CLFLUSHOPT  CPU_FEATURE(CPU_WORD_7_EBX, 23)
+#define CPU_FEATURE_SHA         CPU_FEATURE(CPU_WORD_7_EBX, 29)
+
+#define CPU_FEATURE_UMIP        CPU_FEATURE(CPU_WORD_7_ECX, 2)
+#define CPU_FEATURE_VAES        CPU_FEATURE(CPU_WORD_7_ECX, 9)
+
+#define CPU_FEATURE_FSRM        CPU_FEATURE(CPU_WORD_7_EDX, 4)      // fast short rep movsb
+
+#define CPU_FEATURE_SYSCALL     CPU_FEATURE(CPU_WORD_81_EDX, 11)
+#define CPU_FEATURE_NX          CPU_FEATURE(CPU_WORD_81_EDX, 20)
+#define CPU_FEATURE_PDPE1GB     CPU_FEATURE(CPU_WORD_81_EDX, 26)
+#define CPU_FEATURE_RDTSCP      CPU_FEATURE(CPU_WORD_81_EDX, 27)
+#define CPU_FEATURE_LM          CPU_FEATURE(CPU_WORD_81_EDX, 29)    // long mode
+
+#define CPU_FEATURE_LAHF_LM     CPU_FEATURE(CPU_WORD_81_ECX, 0)
+#define CPU_FEATURE_LZCNT       CPU_FEATURE(CPU_WORD_81_ECX, 5)
+
+#define CPU_FEATURE_INVARIANT_TSC CPU_FEATURE(CPU_WORD_87_EDX, 8)
+
+typedef struct {
+    uint32 max_leaf;
+    uint32 max_ext_leaf;
+    char vendor[13];
+    char brand[49];
+    uint32 family, model, stepping;     // with the extended family and model added in
+    uint32 signature;                   // leaf 1 eax as it is
+    uint32 words[CPU_WORDS];
+} CPU_FEATURES;
+
+extern CPU_FEATURES g_cpu_features;
+
+/**
+ * run CPUID for leaf and subleaf
+ */
+static inline void cpuid(uint32 leaf, uint32 subleaf, uint32 *eax, uint32 *ebx, uint32 *ecx, uint32 *edx) {
+    asm volatile("cpuid"
+                 : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                 : "0"(leaf), "2"(subleaf));
+}
+
+/**
+ * TRUE if the CPU has feature, one of the CPU_FEATURE_ numbers
+ */
+static inline BOOL cpu_has(uint32 feature) {
+    return (g_cpu_features.words[feature / 32] >> (feature % 32)) & 1;
+}
+
+/**
+ * define name as a routine bound at boot, it runs fallback until cpu_dispatch_bind(),
+ * the jmp is spelled out so the assembler cannot shorten it to two bytes
+ */
+#define CPU_DISPATCH(name, fallback)                \
+    asm(".pushsection .text\n"                      \
+        ".global " #name "\n"                       \
+        ".type " #name ", @function\n"              \
+        ".balign 16\n"                              \
+        #name ":\n"                                 \
+        ".byte 0xE9\n"                              \
+        ".long " #fallback " - . - 4\n"             \
+        ".size " #name ", 5\n"                      \
+        ".popsection")
+
+/**
+ * read the CPUID leaves into g_cpu_features, the first thing boot() does
+ */
+void cpu_features_init();
+
+/**
+ * point the CPU_DISPATCH() routine at site to target and record impl as its
+ * name for cpuinfo, only while no other CPU runs, before smp_init()
+ */
+void cpu_dispatch_bind(void *site, void *target, const char *name, const char *impl);
+
+/**
+ * print vendor, model, features and the implementation every dispatched routine got
+ */
+void cpu_features_print();
+
+#endif
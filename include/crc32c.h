@@ -0,0 +1,30 @@
+/**
+ * CRC32C(Castagnoli) checksums
+ * uses the SSE4.2 crc32 instruction when CPUID reports it, slicing-by-8 tables otherwise
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include "types.h"
+
+#define CRC32C_POLY         0x82F63B78    // reflected polynomial
+
+/**
+ * build the lookup tables and bind crc32c() to the fastest implementation, before smp_init()
+ */
+void crc32c_init();
+
+/**
+ * checksum len bytes of buf, crc is 0 to start or the result of the previous block
+ */
+uint32 crc32c(uint32 crc, const void *buf, uint32 len);
+
+/**
+ * the two kernels behind crc32c(), crc32c_hw() must only be called when crc32c_has_hw()
+ */
+uint32 crc32c_sw(uint32 crc, const void *buf, uint32 len);
+uint32 crc32c_hw(uint32 crc, const void *buf, uint32 len);
+BOOL crc32c_has_hw();
+
+#endif
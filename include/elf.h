@@ -0,0 +1,80 @@
+/**
+ * ELF32 program loader
+ * only the headers are read at exec, segments are paged in from the
+ * file on first touch and pages a program never touches are never read
+ */
+
+#ifndef ELF_H
+#define ELF_H
+
+#include "types.h"
+
+#define ELF_MAGIC               0x464C457F      // "\x7F" "ELF"
+#define ELF_CLASS_32            1
+#define ELF_DATA_LSB            1
+#define ELF_TYPE_EXEC           2
+#define ELF_MACHINE_386         3
+
+#define ELF_PT_LOAD             1
+#define ELF_PF_W                0x2
+
+#define ELF_MAX_SEGMENTS        8
+#define ELF_MAX_ARGS            16
+#define ELF_MAX_RECEIVED        32      // ranges of pages a program received over channels
+
+typedef struct {
+    uint32 magic;
+    uint8 class;
+    uint8 data;
+    uint8 ident_version;
+    uint8 ident_pad[9];
+    uint16 type;
+    uint16 machine;
+    uint32 version;
+    uint32 entry;
+    uint32 phoff;               // file offset of the program headers
+    uint32 shoff;
+    uint32 flags;
+    uint16 ehsize;
+    uint16 phentsize;
+    uint16 phnum;
+    uint16 shentsize;
+    uint16 shnum;
+    uint16 shstrndx;
+} __attribute__((packed)) ELF_HEADER;
+
+typedef struct {
+    uint32 type;
+    uint32 offset;
+    uint32 vaddr;
+    uint32 paddr;
+    uint32 filesz;
+    uint32 memsz;               // the part past filesz is zero filled(bss)
+    uint32 flags;
+    uint32 align;
+} __attribute__((packed)) ELF_PROGRAM_HEADER;
+
+/**
+ * run the program at path in ring 3 with argv and wait until it ends,
+ * argv[0] is the path, returns FALSE with a message when it cannot be loaded
+ */
+BOOL elf_exec(const char *path, int argc, char **argv);
+
+/**
+ * note that the running program opened or closed a channel, calls from
+ * other threads are ignored
+ */
+void elf_note_channel(int id, BOOL open);
+
+/**
+ * TRUE if the caller is the running program and has channel id open
+ */
+BOOL elf_has_channel(int id);
+
+/**
+ * note count pages the running program received at addr, calls from other
+ * threads are ignored
+ */
+void elf_note_pages(uint32 addr, uint32 count);
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * x87 FPU and SSE state with lazy switching
+ * a thread switch only sets CR0.TS, the first FPU or SSE instruction of the
+ * next thread raises Device Not Available and the handler loads its state,
+ * a thread that used the FPU is saved when it is switched out, so threads
+ * that never touch it cost nothing and registers are only reloaded when
+ * another thread used them in between
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include "types.h"
+
+#define FPU_STATE_SIZE          1024        // FXSAVE needs 512 bytes, XSAVE with AVX 832
+#define FPU_NO_CPU              0xFFFFFFFF  // fpu_cpu of a thread whose registers are on no CPU
+#define FPU_MXCSR_DEFAULT       0x1F80      // all SIMD exceptions masked
+
+#define CR0_MP                  (1 << 1)
+#define CR0_EM                  (1 << 2)
+#define CR0_TS                  (1 << 3)
+#define CR0_NE                  (1 << 5)
+#define CR4_OSFXSR              (1 << 9)
+#define CR4_OSXMMEXCPT          (1 << 10)
+#define CR4_OSXSAVE             (1 << 18)
+
+#define XCR0_X87                (1 << 0)
+#define XCR0_SSE                (1 << 1)
+#define XCR0_AVX                (1 << 2)
+
+// FXSAVE or XSAVE image, XSAVE wants it 64 byte aligned
+typedef struct {
+    uint8 data[FPU_STATE_SIZE];
+} __attribute__((aligned(64))) FPU_STATE;
+
+struct THREAD;
+struct CPU;
+
+/**
+ * detect the FPU, enable SSE and lazy switching on the boot CPU, called after idt_init()
+ */
+void fpu_init();
+
+/**
+ * set up the control registers of the calling CPU like fpu_init() did on the boot CPU
+ */
+void fpu_init_cpu();
+
+/**
+ * TRUE once FXSAVE based switching is on, SSE instructions may be used when fpu_has_sse()
+ */
+BOOL fpu_enabled();
+BOOL fpu_has_sse();
+
+/**
+ * save the registers of prev if it used the FPU since it was switched in
+ * and set CR0.TS, being called from thread_switch() with interrupts disabled
+ */
+void fpu_switch(struct CPU *cpu, struct THREAD *prev);
+
+/**
+ * let the kernel use FPU and SSE registers until kernel_fpu_end(), the state of
+ * the current thread is saved first, the thread is not switched out in between
+ * and must not block, not for interrupt handlers
+ */
+void kernel_fpu_begin();
+
+/**
+ * end a kernel_fpu_begin() section, the thread gets its registers back on its next FPU instruction
+ */
+void kernel_fpu_end();
+
+/**
+ * print the save mode and the per-CPU trap and save counts
+ */
+void fpu_print();
+
+#endif
@@ -1,5 +1,6 @@
 /**
  * Global Descriptor Table(GDT) setup
+ * every CPU has its own GDT with its own TSS and per-CPU data segment
  */
 
 #ifndef GDT_H
@@ -9,6 +10,14 @@
 
 #define NO_GDT_DESCRIPTORS     8
 
+// segment selectors of the entries set up by gdt_init_cpu()
+#define GDT_KERNEL_CODE        0x08
+#define GDT_KERNEL_DATA        0x10
+#define GDT_USER_CODE          0x1B   // ring 3 selectors with RPL 3, SYSEXIT expects them
+#define GDT_USER_DATA          0x23   // 16 and 24 bytes after GDT_KERNEL_CODE
+#define GDT_TSS                0x28
+#define GDT_PERCPU             0x30   // loaded into gs, based at the CPU's per-CPU data
+
 typedef struct {
     uint16 segment_limit;  // segment limit first 0-15 bits
     uint16 base_low;       // base first 0-15 bits
@@ -23,15 +32,45 @@ typedef struct {
     uint32 base_address;  // base address of the first GDT segment
 } __attribute__((packed)) GDT_PTR;
 
+// 32 bit Task State Segment, only the ring 0 stack and the I/O map base are used
+typedef struct {
+    uint32 prev_tss;
+    uint32 esp0, ss0;
+    uint32 esp1, ss1;
+    uint32 esp2, ss2;
+    uint32 cr3, eip, eflags;
+    uint32 eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32 es, cs, ss, ds, fs, gs;
+    uint32 ldt;
+    uint16 trap;
+    uint16 iomap_base;
+} __attribute__((packed)) TSS;
+
 // asm gdt functions, define in load_gdt.asm
 extern void load_gdt(uint32 gdt_ptr);
 
 /**
- * fill entries of GDT 
+ * fill entries of the GDT of given CPU
+ */
+void gdt_set_entry(uint32 cpu, int index, uint32 base, uint32 limit, uint8 access, uint8 gran);
+
+/**
+ * build and load the GDT of given CPU, gs is pointed at percpu
  */
-void gdt_set_entry(int index, uint32 base, uint32 limit, uint8 access, uint8 gran);
+void gdt_init_cpu(uint32 cpu, void *percpu, uint32 percpu_size);
 
-// initialize GDT
+// initialize GDT of the boot CPU
 void gdt_init();
 
+/**
+ * set the stack given CPU switches to when an interrupt
+ * or system call enters the kernel from ring 3
+ */
+void gdt_set_kernel_stack(uint32 cpu, uint32 esp0);
+
+/**
+ * esp0 field of the TSS of given CPU, SYSENTER loads the stack pointer from it
+ */
+uint32 *gdt_kernel_stack(uint32 cpu);
+
 #endif
@@ -27,10 +27,17 @@ typedef struct {
 extern void load_idt(uint32 idt_ptr);
 
 /**
- * fill entries of IDT 
+ * fill entries of IDT, flags carry the gate's privilege level,
+ * only gates with DPL 3 can be raised by int from ring 3
  */
 void idt_set_entry(int index, uint32 base, uint16 seg_sel, uint8 flags);
 
 void idt_init();
 
+/**
+ * load the IDT built by idt_init() on an application processor,
+ * all CPUs share the same vectors
+ */
+void idt_load();
+
 #endif
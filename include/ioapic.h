@@ -0,0 +1,59 @@
+/**
+ * I/O APIC, routes the ISA IRQs to the local APICs in place of the 8259 PIC
+ */
+
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+#include "types.h"
+
+// MMIO registers, an indirect register is selected in REGSEL and accessed through WINDOW
+#define IOAPIC_REGSEL           0x00
+#define IOAPIC_WINDOW           0x10
+
+#define IOAPIC_REG_ID           0x00
+#define IOAPIC_REG_VERSION      0x01
+#define IOAPIC_REG_REDTBL       0x10    // entry n is at 0x10 + 2n(low) and 0x11 + 2n(high)
+
+// redirection entry low dword bits
+#define IOAPIC_ACTIVE_LOW       0x02000
+#define IOAPIC_LEVEL            0x08000
+#define IOAPIC_MASKED           0x10000
+
+#define IOAPIC_ISA_IRQS         16
+
+/**
+ * route the ISA IRQs through the I/O APIC listed in the MADT to the boot CPU,
+ * keeping the vectors and the enabled lines of the 8259 which is then masked,
+ * returns FALSE and leaves the 8259 alone when there is no I/O APIC
+ */
+BOOL ioapic_init();
+
+/**
+ * TRUE once the I/O APIC delivers the ISA IRQs
+ */
+BOOL ioapic_active();
+
+/**
+ * enable/disable given ISA IRQ(0-15)
+ */
+void ioapic_unmask(uint8 irq);
+void ioapic_mask(uint8 irq);
+
+/**
+ * deliver given ISA IRQ to CPU index, returns -1 for a bad IRQ or CPU
+ */
+int ioapic_set_affinity(uint8 irq, uint32 cpu);
+
+/**
+ * mask every ISA IRQ and hand the lines back to the 8259, which stays masked,
+ * for a kernel started by kexec that routes them again
+ */
+void ioapic_shutdown();
+
+/**
+ * print routing of all ISA IRQs
+ */
+void ioapic_list();
+
+#endif
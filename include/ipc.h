@@ -0,0 +1,53 @@
+/**
+ * Message passing channels
+ * a message carries a few inline bytes and optionally whole pages of the user
+ * window, which move from the sender to the receiver by rewriting page table
+ * entries, the data itself is never copied
+ */
+
+#ifndef IPC_H
+#define IPC_H
+
+#include "types.h"
+
+#define IPC_MAX_CHANNELS        16
+#define IPC_QUEUE_SIZE          8       // messages a channel holds before senders block
+#define IPC_INLINE_SIZE         64
+#define IPC_MAX_PAGES           16
+
+typedef struct {
+    uint32 len;                         // inline bytes in data
+    uint8 data[IPC_INLINE_SIZE];
+    uint32 pages;                       // page aligned address of the transferred pages
+    uint32 page_count;
+} IPC_MESSAGE;
+
+/**
+ * open a channel, returns its id or -1 when all are in use
+ */
+int ipc_channel_create();
+
+/**
+ * close a channel and free the pages of messages nobody received,
+ * threads blocked on it wake up and their call fails
+ */
+void ipc_channel_destroy(int id);
+
+/**
+ * queue msg on the channel, blocking while it is full, the page_count
+ * writable pages at msg->pages are unmapped from the sender and travel
+ * with the message, returns -1 on a bad channel, size or page and when
+ * the channel is destroyed
+ */
+int ipc_send(int id, const IPC_MESSAGE *msg);
+
+/**
+ * take the next message off the channel, blocking while it is empty,
+ * msg->pages and msg->page_count give the unmapped range to map the pages
+ * at and its size in pages, page_count is set to the pages received,
+ * returns -1 and leaves the message queued when they do not fit, -1 as well
+ * on a bad channel and when the channel is destroyed
+ */
+int ipc_recv(int id, IPC_MESSAGE *msg);
+
+#endif
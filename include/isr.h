@@ -8,6 +8,7 @@
 #include "types.h"
 
 #define NO_INTERRUPT_HANDLERS    256
+#define ISR_STAT_BUCKETS         32      // log2 cycle histogram buckets per vector
 
 typedef struct {
     uint32 ds;
@@ -19,27 +20,97 @@ typedef struct {
 // ISR function prototype
 typedef void (*ISR)(REGISTERS *);
 
+// acknowledge of a vector at the interrupt controller that delivered it
+typedef void (*ISR_EOI)(int num);
+
+#define EFLAGS_IF   0x200
+
+/**
+ * disable interrupts, returns the previous eflags for irq_restore()
+ */
+static inline uint32 irq_save() {
+    uintptr flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
 /**
- * register given handler to interrupt handlers at given num
+ * enable interrupts again if they were enabled at irq_save()
+ */
+static inline void irq_restore(uint32 flags) {
+    if (flags & EFLAGS_IF)
+        asm volatile("sti" ::: "memory");
+}
+
+/**
+ * point every vector at its default handler and acknowledge,
+ * called by idt_init() before interrupts are enabled
+ */
+void isr_init();
+
+/**
+ * pick the acknowledge of every hardware vector for the interrupt controllers
+ * in use, called again when the I/O APIC takes over from the 8259 PIC
+ */
+void isr_route_eoi();
+
+/**
+ * register given handler to interrupt handlers at given num,
+ * NULL restores the default handler
  */
 void isr_register_interrupt_handler(int num, ISR handler);
 
 /*
- * turn off current interrupt
+ * turn off current interrupt, with the I/O APIC active this is
+ * a single local APIC write instead of 8259 port writes
 */
 void isr_end_interrupt(int num);
 
+/**
+ * enable given IRQ line(0-15) at whichever controller delivers it
+ */
+void isr_unmask_irq(uint8 irq);
+
+/**
+ * disable given IRQ line(0-15) at whichever controller delivers it
+ */
+void isr_mask_irq(uint8 irq);
+
+/**
+ * print count, mean, max and log2 histogram of the cycles from entry to
+ * end of interrupt of every vector that fired
+ */
+void isr_stat_print();
+
+/**
+ * write the statistics of isr_stat_print() to the serial port, one
+ * comma separated line per vector, returns FALSE without a serial port
+ */
+BOOL isr_stat_serial();
+
+/**
+ * clear the statistics of all vectors
+ */
+void isr_stat_reset();
+
+/**
+ * print exception message with registers and stop, or end the
+ * thread when it came from ring 3, for faults a registered handler could not resolve
+ */
+void isr_exception_halt(REGISTERS *reg);
+
 /**
  * invoke exception routine,
  * being called in exception.asm
  */
-void isr_exception_handler(REGISTERS reg);
+void isr_exception_handler(REGISTERS *reg);
 
 /**
  * invoke isr routine and send eoi to pic,
- * being called in irq.asm
+ * being called in irq.asm, returns the frame to resume which
+ * belongs to another thread when the scheduler switched
  */
-void isr_irq_handler(REGISTERS *reg);
+REGISTERS *isr_irq_handler(REGISTERS *reg);
 
 
 // defined in exception.asm
@@ -75,7 +146,6 @@ extern void exception_28();
 extern void exception_29();
 extern void exception_30();
 extern void exception_31();
-extern void exception_128();
 
 // defined in irq.asm
 extern void irq_0();
@@ -94,6 +164,12 @@ extern void irq_12();
 extern void irq_13();
 extern void irq_14();
 extern void irq_15();
+extern void irq_yield();
+extern void irq_bench();
+extern void irq_lapic_bench();
+extern void irq_lapic_timer();
+extern void irq_resched();
+extern void irq_spurious();
 
 // IRQ default constants
 #define IRQ_BASE            0x20
@@ -114,5 +190,11 @@ extern void irq_15();
 #define IRQ14_HARD_DISK     0x0E
 #define IRQ15_RESERVED      0x0F
 
+// software interrupt measured by irqbench, see irq_bench in irq.asm
+#define ISR_BENCH_VECTOR    0x82
+
+// exception vectors with registered handlers
+#define EXCEPTION_PAGE_FAULT    14
+
 
 #endif
@@ -0,0 +1,53 @@
+/**
+ * Warm reboot into a new kernel without the firmware
+ * the multiboot ELF image is read into free pages that none of its segments
+ * load to, the devices and other CPUs are stopped and a trampoline in low
+ * memory turns paging off, copies the pages over the old kernel and enters
+ * the new one with a multiboot info built from the one we were booted with
+ */
+
+#ifndef KEXEC_H
+#define KEXEC_H
+
+#include "types.h"
+
+#define KEXEC_TRAMPOLINE_ADDRESS    0x9000      // kexec.asm, the page after the SMP trampoline
+#define KEXEC_INFO_ADDRESS          0xA000      // multiboot info, memory map and command line
+#define KEXEC_CHUNKS_ADDRESS        0xB000      // copy list, up to KEXEC_CHUNKS_END
+#define KEXEC_CHUNKS_END            0x10000
+#define KEXEC_LOAD_MIN              0x100000    // segments may not load below 1MB
+#define KEXEC_MMAP_MAX              32
+#define KEXEC_CMDLINE_SIZE          256
+
+// one piece of the new image, src 0 means zero fill
+typedef struct {
+    uint32 dst;
+    uint32 src;
+    uint32 len;
+} KEXEC_CHUNK;
+
+#define KEXEC_MAX_CHUNKS            ((KEXEC_CHUNKS_END - KEXEC_CHUNKS_ADDRESS) / sizeof(KEXEC_CHUNK))
+
+struct multiboot_info;
+
+/**
+ * keep the memory information of the boot loader for the next kernel,
+ * called before anything is written to low memory
+ */
+void kexec_init(uint32 magic, struct multiboot_info *mbi);
+
+/**
+ * boot the multiboot ELF kernel at path with argv as its command line,
+ * argv[0] is the path, returns FALSE with a message when it cannot be loaded
+ */
+BOOL kexec(const char *path, int argc, char **argv);
+
+// defined in kexec.asm
+extern uint8 kexec_start[];
+extern uint8 kexec_end[];
+extern uint8 kexec_chunks[];
+extern uint8 kexec_count[];
+extern uint8 kexec_entry[];
+extern uint8 kexec_mbi[];
+
+#endif
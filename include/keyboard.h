@@ -95,9 +95,14 @@
 #define SCAN_CODE_KEY_F11         0x57
 #define SCAN_CODE_KEY_F12         0x58
 
+// scan codes and characters buffered between the interrupt handler and readers
+#define KEYBOARD_QUEUE_SIZE     64
 
 void keyboard_init();
 
+// queue a character from another input device as if it was typed, from deferred work or threads
+void kb_input(char ch);
+
 // a blocking character read
 char kb_getchar();
 
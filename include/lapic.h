@@ -0,0 +1,151 @@
+/**
+ * Local APIC, one per CPU, used for inter-processor interrupts and EOIs,
+ * driven through MSRs in x2APIC mode when the CPU has it
+ */
+
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include "types.h"
+
+#define LAPIC_DEFAULT_BASE      0xFEE00000
+
+// IA32_APIC_BASE MSR
+#define LAPIC_MSR_APIC_BASE     0x1B
+#define LAPIC_BASE_X2APIC       0x400
+#define LAPIC_BASE_ENABLE       0x800
+
+// x2APIC registers are MSRs at LAPIC_X2APIC_MSR + offset / 16
+#define LAPIC_X2APIC_MSR        0x800
+
+// register offsets from the MMIO base
+#define LAPIC_ID                0x020
+#define LAPIC_VERSION           0x030
+#define LAPIC_TPR               0x080
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_ESR               0x280
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+#define LAPIC_LVT_TIMER         0x320
+#define LAPIC_TIMER_INITIAL     0x380
+#define LAPIC_TIMER_CURRENT     0x390
+#define LAPIC_TIMER_DIVIDE      0x3E0
+#define LAPIC_LVT_LINT0         0x350
+#define LAPIC_LVT_LINT1         0x360
+#define LAPIC_LVT_ERROR         0x370
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_LVT_NMI           0x00400
+#define LAPIC_LVT_EXTINT        0x00700   // LINT0 as the virtual wire of the 8259
+#define LAPIC_TIMER_TSC_DEADLINE 0x40000  // LVT timer mode, fires when the TSC reaches IA32_TSC_DEADLINE
+#define LAPIC_TIMER_DIVIDE_16   0x3
+
+#define LAPIC_MSR_TSC_DEADLINE  0x6E0
+
+// interrupt command register bits
+#define LAPIC_ICR_FIXED         0x00000
+#define LAPIC_ICR_INIT          0x00500
+#define LAPIC_ICR_STARTUP       0x00600
+#define LAPIC_ICR_PENDING       0x01000
+#define LAPIC_ICR_ASSERT        0x04000
+#define LAPIC_ICR_LEVEL         0x08000
+#define LAPIC_ICR_ALL_BUT_SELF  0xC0000
+
+// vectors from LAPIC_VECTOR_BASE up are delivered by the local APIC and need lapic_eoi()
+#define LAPIC_VECTOR_BASE       0xF0
+#define LAPIC_TIMER_VECTOR      0xF0    // one-shot timer of each CPU, see clock.c
+#define LAPIC_RESCHED_VECTOR    0xF1    // another CPU queued work for this one
+#define LAPIC_BENCH_VECTOR      0xF2    // self IPI measured by irqbench
+#define LAPIC_SPURIOUS_VECTOR   0xFF    // never acknowledged, see irq_spurious in irq.asm
+
+/**
+ * map the local APIC registers at given physical address and enable the boot CPU's
+ */
+void lapic_init(uint32 base);
+
+/**
+ * TRUE once lapic_init() ran
+ */
+BOOL lapic_present();
+
+/**
+ * TRUE when the local APICs are driven in x2APIC mode
+ */
+BOOL lapic_x2apic();
+
+/**
+ * software enable the local APIC of the calling CPU
+ */
+void lapic_enable();
+
+/**
+ * APIC ID of the calling CPU
+ */
+uint8 lapic_id();
+
+/**
+ * signal end of interrupt for a vector delivered by the local APIC,
+ * one register write
+ */
+void lapic_eoi();
+
+/**
+ * mask the LINT0 virtual wire input the 8259 is connected to
+ */
+void lapic_mask_lint0();
+
+/**
+ * TRUE when the local APIC timer supports TSC-deadline mode
+ */
+BOOL lapic_tsc_deadline();
+
+/**
+ * set up the timer of the calling CPU for one-shot interrupts at vector,
+ * counting the bus clock divided by 16 or in TSC-deadline mode
+ */
+void lapic_timer_setup(uint8 vector, BOOL tsc_deadline);
+
+/**
+ * fire once after count timer ticks, 0 stops the timer
+ */
+void lapic_timer_oneshot(uint32 count);
+
+/**
+ * fire once when the TSC reaches deadline, 0 stops the timer
+ */
+void lapic_timer_deadline(uint64 deadline);
+
+/**
+ * remaining count of the timer
+ */
+uint32 lapic_timer_current();
+
+/**
+ * stop the timer of the calling CPU and put LINT0 and LINT1 back in the
+ * virtual wire mode the firmware leaves, for a kernel started by kexec
+ */
+void lapic_shutdown();
+
+/**
+ * send an INIT IPI, the target waits for a startup IPI afterwards
+ */
+void lapic_send_init(uint8 apic_id);
+
+/**
+ * send a startup IPI, the target starts in real mode at page * 4KB
+ */
+void lapic_send_startup(uint8 apic_id, uint8 page);
+
+/**
+ * interrupt the CPU with given APIC ID at vector
+ */
+void lapic_send_ipi(uint8 apic_id, uint8 vector);
+
+/**
+ * interrupt all other CPUs at vector
+ */
+void lapic_broadcast_ipi(uint8 vector);
+
+#endif
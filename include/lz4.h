@@ -0,0 +1,33 @@
+/**
+ * LZ4 block format compression
+ * for format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "types.h"
+
+#define LZ4_MINMATCH        4
+#define LZ4_LASTLITERALS    5     // last 5 bytes are always literals
+#define LZ4_MFLIMIT         12    // last match must start 12 bytes before the end
+#define LZ4_MAX_OFFSET      65535
+#define LZ4_HASH_LOG        11
+
+// scratch memory lz4_compress() needs for its match table
+#define LZ4_WORKMEM_SIZE    ((1 << LZ4_HASH_LOG) * sizeof(uint16))
+
+/**
+ * compress src_len(at most 64KB) bytes of src into dst,
+ * workmem must point to LZ4_WORKMEM_SIZE bytes,
+ * returns compressed size or 0 if it does not fit into dst_capacity
+ */
+uint32 lz4_compress(const uint8 *src, uint32 src_len, uint8 *dst, uint32 dst_capacity, void *workmem);
+
+/**
+ * decompress an LZ4 block into dst, copying literals and matches a word at a time,
+ * returns decompressed size or -1 on malformed input or dst overflow
+ */
+int lz4_decompress(const uint8 *src, uint32 src_len, uint8 *dst, uint32 dst_capacity);
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * Bounded lock-free multi-producer multi-consumer queue
+ * every cell carries a sequence number telling whether it is free for the
+ * producer or filled for the consumer of a given position, so producers and
+ * consumers only contend on their own position counter
+ */
+
+#ifndef MPMC_H
+#define MPMC_H
+
+#include "types.h"
+
+typedef struct {
+    volatile uint32 sequence;
+    void *data;
+} MPMC_CELL;
+
+typedef struct {
+    MPMC_CELL *cells;
+    uint32 mask;                    // size - 1, the size is a power of two
+    uint32 pad0[14];                // keep the counters on their own cache lines
+    volatile uint32 enqueue_pos;
+    uint32 pad1[15];
+    volatile uint32 dequeue_pos;
+    uint32 pad2[15];
+    volatile uint32 full;           // failed pushes
+    volatile uint32 retries;        // lost position races
+} MPMC_QUEUE;
+
+/**
+ * set up a queue on size cells, size must be a power of two,
+ * returns FALSE otherwise
+ */
+BOOL mpmc_init(MPMC_QUEUE *queue, MPMC_CELL *cells, uint32 size);
+
+/**
+ * append data, returns FALSE when the queue is full,
+ * safe from any CPU and from interrupt handlers
+ */
+BOOL mpmc_push(MPMC_QUEUE *queue, void *data);
+
+/**
+ * take the oldest entry into *data, returns FALSE when the queue is empty,
+ * safe from any CPU and from interrupt handlers
+ */
+BOOL mpmc_pop(MPMC_QUEUE *queue, void **data);
+
+#endif
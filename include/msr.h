@@ -0,0 +1,22 @@
+#ifndef MSR_H
+#define MSR_H
+
+#include "types.h"
+
+/**
+ * read a model specific register
+ */
+static inline uint64 rdmsr(uint32 msr) {
+    uint32 lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64)hi << 32) | lo;
+}
+
+/**
+ * write a model specific register
+ */
+static inline void wrmsr(uint32 msr, uint64 value) {
+    asm volatile("wrmsr" :: "c"(msr), "a"((uint32)value), "d"((uint32)(value >> 32)) : "memory");
+}
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * Paging setup, builds on the page directory created in entry.asm
+ */
+
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "types.h"
+
+// page directory & first page table set up by setup_paging in entry.asm
+#define PAGE_DIRECTORY_ADDRESS  0x1000
+#define PAGE_TABLE0_ADDRESS     0x2000
+
+// page directory/table entry flags
+#define PAGE_PRESENT        0x001
+#define PAGE_WRITE          0x002
+#define PAGE_USER           0x004
+#define PAGE_CACHE_DISABLE  0x010
+#define PAGE_ACCESSED       0x020
+#define PAGE_DIRTY          0x040
+#define PAGE_LARGE          0x080   // 4MB page, only in directory entries
+
+#define LARGE_PAGE_SIZE     0x400000
+
+// CR4 bits
+#define CR4_PSE             0x010
+
+// CR0 bits, ring 0 writes honour PAGE_WRITE too
+#define CR0_WP              0x10000
+
+/**
+ * identity map physical memory up to mem_end with 4MB pages,
+ * the first 4MB keeps the 4KB page table from entry.asm
+ */
+void paging_init(uint32 mem_end);
+
+/**
+ * return page table entry for given virtual address,
+ * a page table is allocated when create is set and none exists,
+ * NULL if address is covered by a 4MB page or no table exists
+ */
+uint32 *paging_get_pte(uint32 virt, BOOL create);
+
+/**
+ * map 4KB page at virt to phys with given flags, returns -1 when
+ * no page table could be allocated
+ */
+int paging_map_page(uint32 virt, uint32 phys, uint32 flags);
+
+/**
+ * identity map the physical range base..base+size, pages that are
+ * already mapped(including 4MB pages) are left alone, returns -1 when
+ * no page table could be allocated
+ */
+int paging_identity_map(uint32 base, uint32 size, uint32 flags);
+
+/**
+ * remove mapping of 4KB page at virt
+ */
+void paging_unmap_page(uint32 virt);
+
+/**
+ * flush TLB entry of given virtual address
+ */
+void paging_invalidate(uint32 virt);
+
+/**
+ * faulting address of the last page fault
+ */
+uint32 paging_fault_address();
+
+#endif
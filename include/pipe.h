@@ -0,0 +1,67 @@
+/**
+ * Pipes between the commands of a shell pipeline
+ * a pipe is a ring buffer with one writing and one reading thread, each end
+ * only moves its own position so neither takes a lock, a thread blocks when
+ * the ring is full or empty and the other end wakes it after moving past it
+ */
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "types.h"
+
+#define PIPE_MAX                16
+#define PIPE_SIZE               4096    // bytes buffered, a power of two
+
+struct THREAD;
+
+typedef struct PIPE {
+    BOOL used;
+    uint8 *buffer;                      // PIPE_SIZE bytes
+    volatile uint32 head;               // read position, only moved by the reader
+    volatile uint32 tail;               // write position, only moved by the writer
+    struct THREAD *volatile reader;     // blocked on an empty pipe
+    struct THREAD *volatile writer;     // blocked on a full pipe
+    volatile BOOL read_closed;
+    volatile BOOL write_closed;
+    volatile uint32 ends;               // open ends, the pipe is freed with the last
+} PIPE;
+
+/**
+ * open a pipe with both ends, NULL when out of pipes or memory
+ */
+PIPE *pipe_create();
+
+/**
+ * write len bytes, blocking while the pipe is full, returns the bytes
+ * written or -1 when the read end is closed
+ */
+int pipe_write(PIPE *pipe, const void *buf, uint32 len);
+
+/**
+ * read up to len bytes, blocking while the pipe is empty,
+ * returns 0 at the end of the data once the write end is closed
+ */
+int pipe_read(PIPE *pipe, void *buf, uint32 len);
+
+/**
+ * close the write end, the reader sees the end of the data after what is buffered
+ */
+void pipe_close_write(PIPE *pipe);
+
+/**
+ * close the read end, later writes fail and buffered data is dropped
+ */
+void pipe_close_read(PIPE *pipe);
+
+/**
+ * descriptor naming pipe as a thread's standard input or output, see stdio.h
+ */
+int pipe_fd(PIPE *pipe);
+
+/**
+ * pipe a descriptor from pipe_fd() names, NULL for any other descriptor
+ */
+PIPE *pipe_from_fd(int fd);
+
+#endif
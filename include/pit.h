@@ -0,0 +1,41 @@
+/**
+ * 8253/8254 Programmable Interval Timer(PIT), channel 0 drives IRQ0
+ */
+
+#ifndef PIT_H
+#define PIT_H
+
+#include "types.h"
+
+#define PIT_CHANNEL0        0x40
+#define PIT_COMMAND         0x43
+#define PIT_FREQUENCY       1193182   // input clock in Hz
+
+#define PIT_MODE_SQUARE     0x36      // channel 0, lobyte/hibyte, mode 3, binary
+#define PIT_MODE_ONESHOT    0x30      // channel 0, lobyte/hibyte, mode 0(interrupt on terminal count), binary
+#define PIT_MAX_COUNT       0xFFFF
+
+// scheduler tick rate
+#define PIT_HZ              100
+
+/**
+ * program channel 0 to interrupt hz times a second and hook IRQ0
+ */
+void pit_init(uint32 hz);
+
+/**
+ * interrupt once after count input clocks, for one-shot use after pit_init()
+ */
+void pit_oneshot(uint32 count);
+
+/**
+ * timer interrupts since pit_init()
+ */
+uint32 pit_ticks();
+
+/**
+ * convert milliseconds to ticks, rounded up
+ */
+uint32 pit_ms_to_ticks(uint32 ms);
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * Physical Memory Manager(PMM), 4KB page frame allocator
+ */
+
+#ifndef PMM_H
+#define PMM_H
+
+#include "types.h"
+
+#define PAGE_SIZE           4096
+#define PAGE_SHIFT          12
+#define PAGE_MASK           (~(PAGE_SIZE - 1))
+
+// physical memory tracked by the allocator, all of it is identity mapped by paging_init()
+#define PMM_MAX_MEMORY      0x40000000
+#define PMM_MAX_FRAMES      (PMM_MAX_MEMORY / PAGE_SIZE)
+
+/**
+ * initialize frame bitmap from the amount of memory above 1MB(multiboot mem_upper),
+ * everything below the end of the kernel image stays reserved
+ */
+void pmm_init(uint32 mem_upper_kb);
+
+/**
+ * mark given physical range as used so it is never handed out
+ */
+void pmm_reserve_region(uint32 base, uint32 length);
+
+/**
+ * allocate one 4KB page frame, returns NULL when out of memory
+ * returned address is both physical and virtual(identity mapped)
+ */
+void *pmm_alloc_page();
+
+/**
+ * return a page frame allocated by pmm_alloc_page()
+ */
+void pmm_free_page(void *page);
+
+// number of free/total page frames
+uint32 pmm_free_pages();
+uint32 pmm_total_pages();
+
+#endif
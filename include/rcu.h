@@ -0,0 +1,51 @@
+/**
+ * Read-copy-update(RCU) for read-mostly data
+ * readers take no locks or atomics, writers publish a new version with
+ * rcu_assign_pointer() and free the old one after synchronize_rcu(),
+ * by then every CPU passed a quiescent state and no reader can still see it
+ *
+ * quiescent states are counted in thread_switch(): every return from an interrupt,
+ * including the yield of a thread or of the idle loop, that did not interrupt a
+ * read-side section, interrupt handlers are readers without marking their section
+ */
+
+#ifndef RCU_H
+#define RCU_H
+
+#include "types.h"
+#include "smp.h"
+
+/**
+ * start a read-side section in thread context, the thread is not preempted
+ * until the section ends and must not block inside it, sections nest
+ */
+static inline void rcu_read_lock() {
+    asm volatile("incl %%gs:%c0" :: "i"(CPU_RCU_NESTING_OFFSET) : "memory");
+}
+
+/**
+ * end a read-side section, pointers read inside it must not be used any more
+ */
+static inline void rcu_read_unlock() {
+    asm volatile("decl %%gs:%c0" :: "i"(CPU_RCU_NESTING_OFFSET) : "memory");
+}
+
+// load a pointer published with rcu_assign_pointer(), x86 keeps dependent loads in order
+#define rcu_dereference(p)          __atomic_load_n(&(p), __ATOMIC_RELAXED)
+
+// publish a pointer after the data it points to is initialized
+#define rcu_assign_pointer(p, v)    __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/**
+ * wait until every read-side section that may have started before the call
+ * has ended, idle or busy CPUs are kicked with an IPI so it takes microseconds,
+ * must not be called from interrupt handlers or inside a read-side section
+ */
+void synchronize_rcu();
+
+/**
+ * print grace period statistics
+ */
+void rcu_stats();
+
+#endif
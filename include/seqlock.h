@@ -0,0 +1,61 @@
+/**
+ * Sequence locks for read-mostly data such as clock parameters
+ * readers take no lock, they retry when a writer ran meanwhile,
+ * writers serialize on a spinlock and make the sequence odd while they write
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include "types.h"
+#include "spinlock.h"
+
+typedef struct {
+    volatile uint32 sequence;     // odd while a write is in progress
+    SPINLOCK lock;
+    uint32 retries;               // reads that had to start over, not exact
+} SEQLOCK;
+
+#define SEQLOCK_INIT    {0, SPINLOCK_INIT, 0}
+
+/**
+ * start a read section, returns the sequence to pass to read_seqretry()
+ */
+static inline uint32 read_seqbegin(SEQLOCK *seq) {
+    uint32 start;
+
+    while ((start = seq->sequence) & 1)
+        asm volatile("pause" ::: "memory");
+    // x86 does not reorder loads with loads, the data reads only must not move up
+    asm volatile("" ::: "memory");
+    return start;
+}
+
+/**
+ * end a read section, returns TRUE when the data read may be torn and has to be read again
+ */
+static inline BOOL read_seqretry(SEQLOCK *seq, uint32 start) {
+    asm volatile("" ::: "memory");
+    if (seq->sequence == start)
+        return FALSE;
+    seq->retries++;
+    return TRUE;
+}
+
+/**
+ * start a write section, interrupts must be disabled when readers or
+ * writers run in interrupt handlers on the same CPU
+ */
+static inline void write_seqlock(SEQLOCK *seq) {
+    spin_lock(&seq->lock);
+    seq->sequence++;
+    asm volatile("" ::: "memory");
+}
+
+static inline void write_sequnlock(SEQLOCK *seq) {
+    asm volatile("" ::: "memory");
+    seq->sequence++;
+    spin_unlock(&seq->lock);
+}
+
+#endif
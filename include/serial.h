@@ -0,0 +1,57 @@
+/**
+ * 16550 UART serial port, COM1 for exporting kernel statistics,
+ * received characters are typed into the console like keyboard input
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "types.h"
+
+/* for more, see https://wiki.osdev.org/Serial_Ports */
+#define SERIAL_COM1             0x3F8
+#define SERIAL_DATA(port)       (port)
+#define SERIAL_IER(port)        ((port) + 1)    /* interrupt enable */
+#define SERIAL_DIVISOR_LOW(port)  (port)        /* with DLAB set */
+#define SERIAL_DIVISOR_HIGH(port) ((port) + 1)
+#define SERIAL_FCR(port)        ((port) + 2)    /* FIFO control */
+#define SERIAL_LCR(port)        ((port) + 3)    /* line control */
+#define SERIAL_MCR(port)        ((port) + 4)    /* modem control */
+#define SERIAL_LSR(port)        ((port) + 5)    /* line status */
+
+#define SERIAL_LCR_8N1          0x03
+#define SERIAL_LCR_DLAB         0x80
+#define SERIAL_FCR_ENABLE       0xC7    /* enable and clear FIFOs, 14 byte threshold */
+#define SERIAL_MCR_NORMAL       0x0F    /* DTR, RTS, OUT1, OUT2 */
+#define SERIAL_MCR_LOOPBACK     0x1E
+#define SERIAL_LSR_DATA_READY   0x01
+#define SERIAL_LSR_THR_EMPTY    0x20
+#define SERIAL_IER_RX           0x01
+
+#define SERIAL_QUEUE_SIZE       64      /* received bytes waiting for the bottom half */
+
+#define SERIAL_BAUD             115200
+#define SERIAL_CLOCK            115200  /* divisor 1 */
+
+/**
+ * set up COM1 at SERIAL_BAUD 8N1 with receive interrupts,
+ * returns FALSE when no UART answers
+ */
+BOOL serial_init();
+
+/**
+ * TRUE when serial_init() found a UART
+ */
+BOOL serial_present();
+
+/**
+ * write a character, waiting for room in the transmitter, "\n" is sent as "\r\n"
+ */
+void serial_putchar(char ch);
+
+/**
+ * write a string
+ */
+void serial_putstr(const char *str);
+
+#endif
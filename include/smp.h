@@ -0,0 +1,116 @@
+/**
+ * Symmetric multiprocessing, starts the application processors(APs)
+ * listed in the ACPI MADT and keeps per-CPU data
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include "types.h"
+#include "spinlock.h"
+
+#define SMP_MAX_CPUS            16
+#define SMP_BOOT_CPU            0
+
+// real mode entry point of the APs, trampoline.asm is copied here
+#define SMP_TRAMPOLINE_ADDRESS  0x8000
+
+#define SMP_INIT_DELAY_MS       10
+#define SMP_STARTUP_TIMEOUT_MS  100
+
+struct THREAD;
+struct SOFTIRQ_WORK;
+
+// per-CPU data, gs is based at it, see gdt_init_cpu()
+typedef struct CPU {
+    struct CPU *self;               // %gs:0, see cpu_self()
+    struct THREAD *current;         // %gs:4, thread running on this CPU
+    uint64 irq_entry;               // %gs:8, TSC when the last interrupt entered irq.asm
+    volatile uint32 rcu_nesting;    // %gs:16, depth of RCU read-side sections, see rcu.h
+    struct THREAD *idle;
+    struct THREAD *prev;            // thread switched away from, its stack is in use until thread_finish_switch()
+    uint32 index;
+    uint8 apic_id;
+    volatile BOOL online;
+    SPINLOCK lock;                  // protects the run queue
+    struct THREAD *ready_head;
+    struct THREAD *ready_tail;
+    volatile uint32 nr_ready;
+    volatile BOOL need_resched;
+    volatile BOOL kicked;           // a reschedule IPI is on its way
+    uint32 slice;
+    uint32 steals;                  // threads taken from other CPUs' run queues
+    uint32 event_tick;              // tick the one-shot timer is armed for, CLOCK_NEVER if none
+    BOOL event_ready;               // local APIC timer set up on this CPU
+    uint32 timer_events;
+    uint64 idle_since;              // TSC when the idle thread last started running
+    uint64 idle_cycles;
+    struct SOFTIRQ_WORK *volatile softirq_head;   // deferred work, see softirq.c
+    volatile BOOL in_softirq;       // running deferred work, threads are not switched
+    struct THREAD *softirqd;
+    uint32 softirq_done;            // work items run
+    volatile uint32 rcu_qs;         // quiescent states passed, see rcu.c
+    struct THREAD *fpu_owner;       // thread whose FPU state the registers hold, see fpu.c
+    volatile uint32 fpu_nesting;    // depth of kernel_fpu_begin() sections, threads are not switched
+    uint32 fpu_traps;               // Device Not Available exceptions
+    uint32 fpu_saves;               // FPU states saved on a switch or kernel_fpu_begin()
+} CPU;
+
+#define CPU_CURRENT_OFFSET      4
+#define CPU_IRQ_ENTRY_OFFSET    8
+#define CPU_RCU_NESTING_OFFSET  16
+
+/**
+ * per-CPU data of the calling CPU
+ */
+static inline CPU *cpu_self() {
+    CPU *cpu;
+    asm volatile("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/**
+ * prepare per-CPU data of CPU index before it loads its GDT
+ */
+CPU *smp_cpu_init(uint32 index);
+
+/**
+ * per-CPU data of CPU index
+ */
+CPU *smp_cpu(uint32 index);
+
+/**
+ * number of CPUs that are online, they have index 0 to smp_cpu_count() - 1
+ */
+uint32 smp_cpu_count();
+
+/**
+ * parse the MADT and start all application processors, called by the
+ * boot CPU after thread_init() and pit_init()
+ */
+void smp_init();
+
+/**
+ * make an other CPU run its scheduler soon
+ */
+void smp_resched(CPU *cpu);
+
+/**
+ * send an INIT to every other CPU, they wait for a startup IPI like at power on,
+ * for kexec, whatever locks they held stay taken
+ */
+void smp_stop_others();
+
+/**
+ * print all CPUs
+ */
+void smp_list();
+
+// defined in trampoline.asm
+extern uint8 trampoline_start[];
+extern uint8 trampoline_end[];
+extern uint8 trampoline_cr3[];
+extern uint8 trampoline_stack[];
+extern uint8 trampoline_entry[];
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * Deferred interrupt work(bottom halves)
+ * a top half acknowledges its device and raises a work item on the per-CPU
+ * lock-free queue, the queue drains with interrupts enabled on interrupt exit
+ * and whatever exceeds SOFTIRQ_BUDGET is left to the CPU's softirqd thread
+ */
+
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include "types.h"
+#include "smp.h"
+
+#define SOFTIRQ_BUDGET          16      // work items run on one interrupt exit
+
+typedef void (*SOFTIRQ_FUNC)(void *arg);
+
+typedef struct SOFTIRQ_WORK {
+    struct SOFTIRQ_WORK *next;        // queue link while pending
+    SOFTIRQ_FUNC func;                // runs with interrupts enabled, must not block
+    void *arg;
+    volatile uint32 pending;          // queued and not started yet
+} SOFTIRQ_WORK;
+
+/**
+ * prepare a work item calling func(arg)
+ */
+void softirq_work_init(SOFTIRQ_WORK *work, SOFTIRQ_FUNC func, void *arg);
+
+/**
+ * queue a work item on the calling CPU from an interrupt handler, returns FALSE
+ * when it is already pending, its function then runs once for both raises
+ */
+BOOL softirq_raise(SOFTIRQ_WORK *work);
+
+/**
+ * run queued work with interrupts enabled, batch by batch until SOFTIRQ_BUDGET
+ * items ran, being called with interrupts disabled on interrupt exit and by softirqd
+ */
+void softirq_run();
+
+/**
+ * start a softirqd thread on every CPU, called by the boot CPU after smp_init()
+ */
+void softirq_init();
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * Spinlocks for data shared between CPUs
+ * ticket locks hand the lock over in arrival order, each lock counts how often
+ * it was taken, how often it had to wait and how long it was held
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "types.h"
+#include "isr.h"
+#include "tsc.h"
+
+typedef struct {
+    union {
+        volatile uint32 ticket;       // both halves, for spin_trylock()
+        struct {
+            volatile uint16 owner;    // ticket being served
+            volatile uint16 next;     // ticket handed to the next arrival
+        };
+    };
+    uint32 acquired;
+    uint32 contended;                 // acquisitions that had to wait
+    uint32 max_hold;                  // cycles
+    uint64 hold_cycles;
+    uint64 locked_at;
+} SPINLOCK;
+
+#define SPINLOCK_INIT   {{0}, 0, 0, 0, 0, 0}
+
+// caller holds the lock
+static inline void spin_acquired(SPINLOCK *lock, BOOL waited) {
+    lock->acquired++;
+    if (waited)
+        lock->contended++;
+    lock->locked_at = rdtsc();
+}
+
+/**
+ * busy wait until the lock is ours, interrupts must be disabled
+ * when the lock is also taken from interrupt handlers
+ */
+static inline void spin_lock(SPINLOCK *lock) {
+    uint16 ticket = __sync_fetch_and_add(&lock->next, 1);
+    BOOL waited = FALSE;
+
+    while (lock->owner != ticket) {
+        waited = TRUE;
+        asm volatile("pause" ::: "memory");
+    }
+    spin_acquired(lock, waited);
+}
+
+/**
+ * take the lock if it is free, returns FALSE without waiting otherwise
+ */
+static inline BOOL spin_trylock(SPINLOCK *lock) {
+    uint32 ticket = lock->ticket;
+
+    // free when the next ticket is the one being served
+    if ((ticket & 0xFFFF) != (ticket >> 16))
+        return FALSE;
+    if (!__sync_bool_compare_and_swap(&lock->ticket, ticket, ticket + 0x10000))
+        return FALSE;
+    spin_acquired(lock, FALSE);
+    return TRUE;
+}
+
+static inline void spin_unlock(SPINLOCK *lock) {
+    uint32 held = (uint32)(rdtsc() - lock->locked_at);
+
+    lock->hold_cycles += held;
+    if (held > lock->max_hold)
+        lock->max_hold = held;
+    // only the holder writes owner, x86 keeps the stores above ahead of it
+    __atomic_store_n(&lock->owner, (uint16)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * disable interrupts and take the lock, returns the eflags for spin_unlock_irqrestore()
+ */
+static inline uint32 spin_lock_irqsave(SPINLOCK *lock) {
+    uint32 flags = irq_save();
+
+    spin_lock(lock);
+    return flags;
+}
+
+/**
+ * release the lock and enable interrupts again if they were enabled at spin_lock_irqsave()
+ */
+static inline void spin_unlock_irqrestore(SPINLOCK *lock, uint32 flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+/**
+ * TRUE while some CPU holds the lock
+ */
+static inline BOOL spin_is_locked(SPINLOCK *lock) {
+    uint32 ticket = lock->ticket;
+    return (ticket & 0xFFFF) != (ticket >> 16);
+}
+
+#endif
@@ -1,6 +1,36 @@
 #ifndef STDIO_H
 #define STDIO_H
 
+#include "types.h"
+
+// descriptor of the keyboard for input and the screen for output, every
+// thread starts with it, a shell pipeline gives its commands pipes instead
+#define STDIO_CONSOLE           0
+
 int sscanf(const char *str, const char *format, int *num1, char *op, int *num2);
 
+// read string from console, but no backing
+void getstr(char *buffer);
+
+// read string from console, and erase or go back util bound occurs
+void getstr_bound(char *buffer, uint8 bound);
+
+/**
+ * write len bytes to descriptor fd, returns the bytes written or -1
+ * when nobody reads the pipe anymore
+ */
+int stdio_write(int fd, const void *buf, uint32 len);
+
+/**
+ * read up to len bytes from descriptor fd, the keyboard gives one character
+ * at a time, returns 0 at the end of a pipe and -1 for a bad descriptor
+ */
+int stdio_read(int fd, void *buf, uint32 len);
+
+/**
+ * send printf() to the standard output of the calling thread, console_printf()
+ * stays on the screen for output from interrupt handlers
+ */
+void stdio_init();
+
 #endif // STDIO_H
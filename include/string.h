@@ -3,10 +3,16 @@
 
 #include "types.h"
 
+// bind memset and memcpy to the fastest string instructions, see cpu_features.h
+void string_init();
+
 void *memset(void *dst, char c, uint32 n);
 
 void *memcpy(void *dst, const void *src, uint32 n);
 
+// like memcpy for regions that overlap
+void *memmove(void *dst, const void *src, uint32 n);
+
 int memcmp(uint8 *s1, uint8 *s2, uint32 n);
 
 int strlen(const char *s);
@@ -0,0 +1,58 @@
+/**
+ * System calls from ring 3 through int 0x80 or SYSENTER
+ * the number goes in eax, up to three arguments in ebx, esi and edi and the
+ * result comes back in eax, ecx and edx are not preserved, SYSENTER also takes
+ * the return address in edx and the user stack pointer in ecx
+ */
+
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "types.h"
+
+#define SYSCALL_VECTOR          0x80
+#define SYSCALL_ERROR           0xFFFFFFFF
+
+// system call numbers, also used by the user programs in syscall.asm
+#define SYS_NULL                0       // does nothing, for measuring the entry and exit
+#define SYS_EXIT                1       // (code) end the calling thread
+#define SYS_WRITE               2       // (buf, len) print len bytes, returns len
+#define SYS_SLEEP               3       // (ms) block for at least ms milliseconds
+#define SYS_YIELD               4       // give the CPU to the next ready thread
+#define SYS_IPC_CREATE          5       // open a message channel, returns its id
+#define SYS_IPC_CLOSE           6       // (channel)
+#define SYS_IPC_SEND            7       // (channel, IPC_MESSAGE *) see ipc.h
+#define SYS_IPC_RECV            8       // (channel, IPC_MESSAGE *)
+#define SYSCALL_COUNT           9
+
+#define MSR_SYSENTER_CS         0x174
+#define MSR_SYSENTER_ESP        0x175
+#define MSR_SYSENTER_EIP        0x176
+
+typedef uint32 (*SYSCALL)(uint32 arg1, uint32 arg2, uint32 arg3);
+
+/**
+ * detect SYSENTER and set it up on the boot CPU, called after gdt_init()
+ */
+void syscall_init();
+
+/**
+ * point the SYSENTER MSRs of the calling CPU at the kernel entry
+ */
+void syscall_init_cpu();
+
+/**
+ * TRUE if user programs may enter through SYSENTER
+ */
+BOOL syscall_has_sysenter();
+
+/**
+ * run system call num, being called from syscall.asm with interrupts enabled
+ */
+uint32 syscall_dispatch(uint32 num, uint32 arg1, uint32 arg2, uint32 arg3);
+
+// defined in syscall.asm
+extern void syscall_int();
+extern void syscall_sysenter();
+
+#endif
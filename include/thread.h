@@ -0,0 +1,152 @@
+/**
+ * Kernel threads with a timer driven round-robin scheduler,
+ * every CPU has its own run queue and idle CPUs steal from busy ones
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "types.h"
+#include "isr.h"
+#include "smp.h"
+#include "fpu.h"
+
+#define THREAD_MAX              64
+#define THREAD_NAME_LENGTH      16
+#define THREAD_TIME_SLICE       2         // timer ticks before a thread is preempted
+
+// every thread gets a slot of virtual memory above the mmap window for its stack,
+// the unmapped lower part of the slot is a guard against stack overflows
+#define THREAD_STACK_BASE       0xE0000000
+#define THREAD_STACK_SLOT       0x8000
+#define THREAD_STACK_SIZE       0x4000
+
+// cpu argument of thread_spawn_on() for threads that may run and migrate anywhere
+#define THREAD_ANY_CPU          (-1)
+
+struct PIPE;
+
+// software interrupt entering the scheduler, see irq_yield in irq.asm
+#define THREAD_YIELD_VECTOR     0x81
+
+typedef void (*THREAD_FUNC)(void *arg);
+
+typedef enum {
+    THREAD_UNUSED,
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_SLEEPING,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+} THREAD_STATE;
+
+typedef struct THREAD {
+    uint32 id;
+    char name[THREAD_NAME_LENGTH];
+    THREAD_STATE state;
+    REGISTERS *frame;         // saved interrupt frame on the thread's stack while not running
+    uint32 stack_top;         // 0 for the boot thread, which keeps the stack from entry.asm
+    uint32 wake_tick;         // clock_ticks() value to wake up at while sleeping
+    THREAD_FUNC func;
+    void *arg;
+    struct THREAD *next;      // run queue link
+    uint32 cpu;               // CPU it runs on or last ran on, sleepers are woken there
+    sint32 pinned;            // CPU it may only run on, THREAD_ANY_CPU if it may migrate
+    volatile BOOL on_cpu;     // its stack is in use by a CPU, it must not be stolen
+    volatile BOOL wake_pending; // thread_wake() came before thread_block()
+    int in_fd;                // standard input and output, STDIO_CONSOLE or a pipe in a shell pipeline
+    int out_fd;
+    BOOL fpu_used;            // touched the FPU, its saved state is in fpu
+    uint32 fpu_cpu;           // CPU it last used the FPU on, FPU_NO_CPU for a new thread
+    FPU_STATE fpu;
+} THREAD;
+
+/**
+ * turn the boot flow into the idle thread of the boot CPU, must be called before pit_init()
+ */
+void thread_init();
+
+/**
+ * create the idle thread of an application processor, its stack is the
+ * one the AP starts on, returns NULL when no thread slot or stack memory is left
+ */
+THREAD *thread_init_cpu(CPU *cpu);
+
+/**
+ * create a thread running func(arg) queued on the calling CPU, idle CPUs
+ * may steal it, returns NULL when no thread slot or stack memory is left
+ */
+THREAD *thread_spawn(const char *name, THREAD_FUNC func, void *arg);
+
+/**
+ * create a thread running func(arg) that only runs on given CPU,
+ * or like thread_spawn() for THREAD_ANY_CPU
+ */
+THREAD *thread_spawn_on(const char *name, THREAD_FUNC func, void *arg, sint32 cpu);
+
+/**
+ * give the CPU to the next ready thread
+ */
+void thread_yield();
+
+/**
+ * block the current thread for at least ms milliseconds
+ */
+void thread_sleep(uint32 ms);
+
+/**
+ * block the current thread until thread_wake(), returns at once when it was woken
+ * since it last blocked, caller has interrupts disabled and checks its condition again
+ */
+void thread_block();
+
+/**
+ * make a thread blocked in thread_block() ready again, or let its next
+ * thread_block() return at once, may be called from interrupt handlers
+ */
+void thread_wake(THREAD *thread);
+
+/**
+ * end the current thread, also called when a thread function returns
+ */
+void thread_exit();
+
+/**
+ * wait until the thread with given id has exited
+ */
+void thread_join(uint32 id);
+
+/**
+ * thread that is running now
+ */
+THREAD *thread_current();
+
+/**
+ * idle loop of a CPU's idle thread, runs whenever no other thread is ready
+ */
+void thread_idle();
+
+/**
+ * account one timer event, wakes sleepers and preempts at the end of a time slice,
+ * being called from the timer interrupt
+ */
+void thread_tick();
+
+/**
+ * pick the frame to return to from an interrupt, the current one unless a
+ * reschedule is pending, being called from isr_irq_handler()
+ */
+REGISTERS *thread_switch(REGISTERS *reg);
+
+/**
+ * release the thread switched away from once its stack is no longer in use,
+ * being called from irq.asm on the new thread's stack
+ */
+void thread_finish_switch();
+
+/**
+ * print all threads
+ */
+void thread_list();
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * Kernel timers on a hierarchical timing wheel
+ * arming and cancelling are O(1), far timers sit in coarse slots and cascade
+ * towards the first level in batches as their expiry comes closer
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+#include "smp.h"
+
+// first level has one slot per tick, each further level one slot per whole previous level
+#define TIMER_ROOT_BITS         8
+#define TIMER_LEVEL_BITS        6
+#define TIMER_ROOT_SIZE         (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_SIZE        (1 << TIMER_LEVEL_BITS)
+#define TIMER_ROOT_MASK         (TIMER_ROOT_SIZE - 1)
+#define TIMER_LEVEL_MASK        (TIMER_LEVEL_SIZE - 1)
+#define TIMER_LEVELS            4         // levels after the first, 8 + 4 * 6 bits cover all ticks
+
+// the wheel is run by the timer events of this CPU
+#define TIMER_CPU               SMP_BOOT_CPU
+
+typedef void (*TIMER_FUNC)(void *arg);
+
+typedef struct TIMER {
+    struct TIMER *next;       // slot link
+    struct TIMER **pprev;     // link pointing at this timer, NULL when not pending
+    uint32 expires;           // clock_ticks() value to fire at
+    TIMER_FUNC func;          // called with interrupts disabled on TIMER_CPU
+    void *arg;
+} TIMER;
+
+/**
+ * prepare a timer calling func(arg) when it expires
+ */
+void timer_setup(TIMER *timer, TIMER_FUNC func, void *arg);
+
+/**
+ * arm a timer that is not pending to fire at tick expires,
+ * a tick that has passed fires on the next timer event
+ */
+void timer_add(TIMER *timer, uint32 expires);
+
+/**
+ * move a timer to tick expires whether it is pending or not,
+ * returns TRUE when it was pending
+ */
+BOOL timer_mod(TIMER *timer, uint32 expires);
+
+/**
+ * cancel a timer, returns TRUE when it was pending, the function of a timer
+ * that already fired may still be running on TIMER_CPU
+ */
+BOOL timer_del(TIMER *timer);
+
+/**
+ * cancel a timer and wait until its function is not running anymore, a
+ * function that arms its timer again is cancelled after it returns, must not
+ * be called from the function of the timer, returns TRUE when it was pending
+ */
+BOOL timer_del_sync(TIMER *timer);
+
+/**
+ * TRUE while a timer is armed
+ */
+static inline BOOL timer_pending(const TIMER *timer) {
+    return timer->pprev != NULL;
+}
+
+/**
+ * tick the wheel has to be run at next, CLOCK_NEVER when no timer is pending
+ */
+uint32 timer_next();
+
+/**
+ * fire all timers up to the current tick, being called from the timer
+ * interrupt of TIMER_CPU
+ */
+void timer_run();
+
+/**
+ * print the state of the wheel
+ */
+void timer_stats();
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include "types.h"
+
+/**
+ * read the time stamp counter
+ */
+static inline uint64 rdtsc() {
+    uint32 lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64)hi << 32) | lo;
+}
+
+/**
+ * 64 by 32 bit division without libgcc, the quotient must fit in 32 bits
+ */
+static inline uint32 udiv64_32(uint64 n, uint32 d) {
+    uint32 q, r;
+    asm("divl %4" : "=a"(q), "=d"(r) : "0"((uint32)n), "1"((uint32)(n >> 32)), "rm"(d));
+    return q;
+}
+
+#endif
@@ -6,13 +6,16 @@
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
 typedef signed char sint8;
 typedef signed short sint16;
 typedef signed int sint32;
+typedef signed long long sint64;
 typedef uint8 byte;
 typedef uint16 word;
 typedef uint32 dword;
-typedef unsigned int size_t;
+typedef __SIZE_TYPE__ size_t;
+typedef __UINTPTR_TYPE__ uintptr;     // pointer sized, 32 bits on i386 and 64 on x86_64
 typedef enum {
     FALSE,
     TRUE
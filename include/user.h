@@ -0,0 +1,68 @@
+/**
+ * Ring 3 user mode
+ * user programs live in a window of the shared address space between the
+ * identity mapped memory and the mmap window, only pages mapped with
+ * user_map() are reachable from ring 3
+ */
+
+#ifndef USER_H
+#define USER_H
+
+#include "types.h"
+
+#define USER_BASE               0x40000000
+#define USER_LIMIT              0xC0000000
+
+// stack of a loaded program at the top of the window, the page below it is a guard
+#define USER_STACK_SIZE         0x10000
+#define USER_STACK_TOP          USER_LIMIT
+
+// read-only clock page below the guard page of the stack, see vdso.h,
+// loaded programs have to end below it
+#define USER_TIME_PAGE          (USER_STACK_TOP - USER_STACK_SIZE - 0x2000)
+
+// fills a page of the window on first touch, FALSE if addr may not be accessed
+typedef BOOL (*USER_PAGER)(uint32 addr, BOOL write);
+
+/**
+ * map zeroed pages for size bytes at virt in the user window,
+ * returns FALSE and maps nothing when out of memory or outside the window
+ */
+BOOL user_map(uint32 virt, uint32 size);
+
+/**
+ * unmap and free the pages mapped by user_map()
+ */
+void user_unmap(uint32 virt, uint32 size);
+
+/**
+ * TRUE if the len bytes at ptr are readable user pages, pages the pager
+ * has not filled yet are filled, system calls check every pointer
+ * they get from ring 3 with it
+ */
+BOOL user_range_ok(const void *ptr, uint32 len);
+
+/**
+ * like user_range_ok() for buffers the kernel writes to, a read-only page
+ * is refused here instead of faulting in the middle of the copy
+ */
+BOOL user_range_writable(void *ptr, uint32 len);
+
+/**
+ * install the pager of the program loaded into the window, NULL removes it
+ */
+void user_set_pager(USER_PAGER pager);
+
+/**
+ * resolve a page fault at addr in the user window through the pager,
+ * FALSE if the access is not allowed, called from the page fault handler
+ */
+BOOL user_page_fault(uint32 addr, BOOL write);
+
+/**
+ * leave the kernel for ring 3 at eip with stack esp, the calling thread's
+ * kernel stack is reused for its interrupts and system calls, never returns
+ */
+void user_enter(uint32 eip, uint32 esp);
+
+#endif
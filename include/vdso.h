@@ -0,0 +1,59 @@
+/**
+ * Shared time page
+ * the kernel publishes its TSC to nanosecond conversion in a page that ring 3
+ * can read at USER_TIME_PAGE, so programs read the clock with rdtsc and a few
+ * multiplications instead of a system call, the sequence works like a seqlock
+ */
+
+#ifndef VDSO_H
+#define VDSO_H
+
+#include "types.h"
+#include "tsc.h"
+
+// ns = (((tsc - tsc_base) * mult) >> 32 << shift) + ns_base, the offsets are used by syscall.asm
+typedef struct {
+    volatile uint32 sequence;   // 0, odd while the kernel rewrites the page
+    uint32 shift;               // 4, only above 0 for a TSC slower than 1GHz
+    uint32 mult;                // 8, 0 until the TSC is calibrated
+    uint32 tsc_khz;             // 12
+    uint64 tsc_base;            // 16
+    uint64 ns_base;             // 24
+} VDSO_TIME;
+
+/**
+ * nanoseconds since boot from the time page, callable from ring 3
+ */
+static inline uint64 vdso_time_ns(const VDSO_TIME *time) {
+    uint32 seq;
+    uint64 delta, ns;
+
+    do {
+        while ((seq = time->sequence) & 1)
+            asm volatile("pause" ::: "memory");
+        asm volatile("" ::: "memory");
+        delta = rdtsc() - time->tsc_base;
+        ns = (((delta & 0xFFFFFFFF) * time->mult) >> 32) + (delta >> 32) * time->mult;
+        ns = (ns << time->shift) + time->ns_base;
+        asm volatile("" ::: "memory");
+    } while (time->sequence != seq);
+    return ns;
+}
+
+/**
+ * map the time page read-only into the user window, called after paging_init()
+ */
+void vdso_init();
+
+/**
+ * publish that tsc_base is nanosecond 0 and a tick takes tsc_per_tick
+ * cycles, called by clock_init() inside the write section of its seqlock
+ */
+void vdso_update(uint64 tsc_base, uint32 tsc_per_tick);
+
+/**
+ * the kernel's view of the time page
+ */
+const VDSO_TIME *vdso_time();
+
+#endif
@@ -50,3 +50,38 @@ void pic8259_eoi(uint8 irq) {
     outportb(PIC1, PIC_EOI);
 }
 
+/**
+ * enable given IRQ line(0-15) in the mask registers
+ */
+void pic8259_unmask(uint8 irq) {
+    if (irq >= 8) {
+        outportb(PIC2_DATA, inportb(PIC2_DATA) & ~(1 << (irq - 8)));
+        irq = IRQ2_CASCADE;
+    }
+    outportb(PIC1_DATA, inportb(PIC1_DATA) & ~(1 << irq));
+}
+
+/**
+ * disable given IRQ line(0-15) in the mask registers
+ */
+void pic8259_mask(uint8 irq) {
+    if (irq >= 8)
+        outportb(PIC2_DATA, inportb(PIC2_DATA) | (1 << (irq - 8)));
+    else
+        outportb(PIC1_DATA, inportb(PIC1_DATA) | (1 << irq));
+}
+
+/**
+ * mask registers of both PICs, bit n set means IRQ n is disabled
+ */
+uint16 pic8259_get_mask() {
+    return inportb(PIC1_DATA) | (inportb(PIC2_DATA) << 8);
+}
+
+/**
+ * mask every IRQ line, done once the I/O APIC has taken over
+ */
+void pic8259_disable() {
+    outportb(PIC1_DATA, 0xFF);
+    outportb(PIC2_DATA, 0xFF);
+}
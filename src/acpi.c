@@ -0,0 +1,137 @@
+/**
+ * ACPI table lookup, only the MADT(APIC table) is parsed for now
+ * for more, see https://wiki.osdev.org/MADT
+ */
+
+#include "acpi.h"
+#include "paging.h"
+#include "string.h"
+
+static ACPI_MADT_INFO g_madt;
+
+static BOOL checksum_ok(const void *table, uint32 length) {
+    const uint8 *p = table;
+    uint8 sum = 0;
+
+    for (uint32 i = 0; i < length; i++)
+        sum += p[i];
+    return sum == 0;
+}
+
+static BOOL signature_is(const char *signature, const char *expected, uint32 length) {
+    for (uint32 i = 0; i < length; i++) {
+        if (signature[i] != expected[i])
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// the RSDP sits on a 16 byte boundary in the first 1KB of the EBDA or in the BIOS area
+static ACPI_RSDP *rsdp_scan(uint32 start, uint32 end) {
+    for (uint32 addr = start; addr + sizeof(ACPI_RSDP) <= end; addr += 16) {
+        ACPI_RSDP *rsdp = (ACPI_RSDP *)addr;
+        if (signature_is(rsdp->signature, "RSD PTR ", 8) && checksum_ok(rsdp, sizeof(ACPI_RSDP)))
+            return rsdp;
+    }
+    return NULL;
+}
+
+static ACPI_RSDP *rsdp_find() {
+    uint32 ebda = (uint32)(*(uint16 *)ACPI_EBDA_POINTER) << 4;
+    ACPI_RSDP *rsdp = NULL;
+
+    if (ebda >= 0x80000 && ebda < 0xA0000)
+        rsdp = rsdp_scan(ebda, ebda + 1024);
+    if (rsdp == NULL)
+        rsdp = rsdp_scan(ACPI_BIOS_AREA_START, ACPI_BIOS_AREA_END);
+    return rsdp;
+}
+
+// tables usually sit in reserved memory above what paging_init() mapped
+static ACPI_SDT_HEADER *table_map(uint32 address) {
+    ACPI_SDT_HEADER *header = (ACPI_SDT_HEADER *)address;
+
+    if (paging_identity_map(address, sizeof(ACPI_SDT_HEADER), PAGE_WRITE) < 0)
+        return NULL;
+    if (paging_identity_map(address, header->length, PAGE_WRITE) < 0)
+        return NULL;
+    if (!checksum_ok(header, header->length))
+        return NULL;
+    return header;
+}
+
+static void madt_parse(ACPI_MADT *madt) {
+    uint8 *p = (uint8 *)madt + sizeof(ACPI_MADT);
+    uint8 *end = (uint8 *)madt + madt->header.length;
+
+    g_madt.lapic_address = madt->lapic_address;
+    g_madt.legacy_pic = (madt->flags & ACPI_MADT_PCAT_COMPAT) ? TRUE : FALSE;
+    for (uint32 i = 0; i < ACPI_ISA_IRQS; i++)
+        g_madt.isa_gsi[i] = i;
+
+    while (p + sizeof(ACPI_MADT_ENTRY) <= end) {
+        ACPI_MADT_ENTRY *entry = (ACPI_MADT_ENTRY *)p;
+        if (entry->length < sizeof(ACPI_MADT_ENTRY) || p + entry->length > end)
+            break;
+
+        if (entry->type == ACPI_MADT_LAPIC) {
+            ACPI_MADT_LAPIC_ENTRY *lapic = (ACPI_MADT_LAPIC_ENTRY *)entry;
+            if ((lapic->flags & (ACPI_MADT_LAPIC_ENABLED | ACPI_MADT_LAPIC_ONLINE_CAP)) &&
+                g_madt.cpu_count < ACPI_MAX_CPUS)
+                g_madt.cpu_apic_ids[g_madt.cpu_count++] = lapic->apic_id;
+        } else if (entry->type == ACPI_MADT_IOAPIC) {
+            ACPI_MADT_IOAPIC_ENTRY *ioapic = (ACPI_MADT_IOAPIC_ENTRY *)entry;
+            if (g_madt.ioapic_count < ACPI_MAX_IOAPICS) {
+                ACPI_IOAPIC *this = &g_madt.ioapics[g_madt.ioapic_count++];
+                this->id = ioapic->ioapic_id;
+                this->address = ioapic->address;
+                this->gsi_base = ioapic->gsi_base;
+            }
+        } else if (entry->type == ACPI_MADT_OVERRIDE) {
+            ACPI_MADT_OVERRIDE_ENTRY *override = (ACPI_MADT_OVERRIDE_ENTRY *)entry;
+            if (override->bus == 0 && override->source < ACPI_ISA_IRQS) {
+                g_madt.isa_gsi[override->source] = override->gsi;
+                g_madt.isa_flags[override->source] = override->flags;
+            }
+        } else if (entry->type == ACPI_MADT_LAPIC_ADDRESS) {
+            ACPI_MADT_LAPIC_ADDRESS_ENTRY *address = (ACPI_MADT_LAPIC_ADDRESS_ENTRY *)entry;
+            if ((address->address >> 32) == 0)
+                g_madt.lapic_address = (uint32)address->address;
+        }
+        p += entry->length;
+    }
+}
+
+/**
+ * find the RSDP and parse the MADT, returns FALSE when there is none
+ */
+BOOL acpi_init() {
+    ACPI_RSDP *rsdp = rsdp_find();
+    ACPI_SDT_HEADER *rsdt;
+    uint32 *entries, count;
+
+    memset(&g_madt, 0, sizeof(g_madt));
+    if (rsdp == NULL)
+        return FALSE;
+    rsdt = table_map(rsdp->rsdt_address);
+    if (rsdt == NULL || !signature_is(rsdt->signature, "RSDT", 4))
+        return FALSE;
+
+    entries = (uint32 *)((uint8 *)rsdt + sizeof(ACPI_SDT_HEADER));
+    count = (rsdt->length - sizeof(ACPI_SDT_HEADER)) / sizeof(uint32);
+    for (uint32 i = 0; i < count; i++) {
+        ACPI_SDT_HEADER *table = table_map(entries[i]);
+        if (table != NULL && signature_is(table->signature, "APIC", 4)) {
+            madt_parse((ACPI_MADT *)table);
+            return g_madt.cpu_count > 0;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * MADT contents, valid after acpi_init() returned TRUE
+ */
+const ACPI_MADT_INFO *acpi_madt() {
+    return &g_madt;
+}
@@ -22,6 +22,14 @@ section .text
 _start:
     cli                  
     mov esp, stack_top        
+    push ebx                    ; multiboot info structure, kmain 2nd argument
+    push eax                    ; multiboot magic, kmain 1st argument
+
+    ; first boot phase stamp, see boottime.h
+    extern g_boottime_start
+    rdtsc
+    mov [g_boottime_start], eax
+    mov [g_boottime_start + 4], edx
 
     ; Load GDT (Global Descriptor Table)
     lgdt [gdt_descriptor]
@@ -32,225 +32,196 @@ section .text
     global exception_29
     global exception_30
     global exception_31
-    global exception_128
 
 
+REG_CS  equ 48            ; offset of cs in REGISTERS, see isr.h
+
+; interrupt gates already cleared IF and iret restores it,
+; segments only need switching when the exception came from ring 3
 exception_handler:
+    cld                   ; the interrupted code may have set DF, ring 3 or memmove(), iret restores it
     pusha                 ; push all registers
-    mov ax, ds
-    push eax              ; save ds
-    
+    push ds               ; save ds
+
+    test byte [esp + REG_CS], 3
+    jz .kernel_entry
     mov ax, 0x10          ; load kernel data segment
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, 0x30          ; per-CPU segment, iret to ring 3 left gs null
     mov gs, ax
+.kernel_entry:
 
+    push esp              ; REGISTERS pointer argument
     call isr_exception_handler
+    add esp, 4
 
-    pop ebx             ; restore kernel data segment
-    mov ds, bx
-    mov es, bx
-    mov fs, bx
-    mov gs, bx
+    test byte [esp + REG_CS], 3
+    jz .kernel_exit
+    mov ds, [esp]         ; restore the interrupted data segments
+    mov es, [esp]
+    mov fs, [esp]
+.kernel_exit:
+    add esp, 4            ; skip ds
 
     popa                ; restore all registers
     add esp, 0x8        ; restore stack for erro no been pushed
-
-    sti                 ; re-enable interrupts
     iret
 
 
 exception_0:
-    cli
     push byte 0     ; store default err code(0)
     push 0          ; push exception number index in IDT
     jmp exception_handler
 
 exception_1:
-    cli
     push byte 0     ; store default err code(0)
     push 1          ; push exception number index in IDT
     jmp exception_handler
 
 exception_2:
-    cli
     push byte 0     ; store default err code(0)
     push 2          ; push exception number index in IDT
     jmp exception_handler
 
 exception_3:
-    cli
     push byte 0     ; store default err code(0)
     push 3          ; push exception number index in IDT
     jmp exception_handler
 
 exception_4:
-    cli
     push byte 0     ; store default err code(0)
     push 4          ; push exception number index in IDT
     jmp exception_handler
 
 exception_5:
-    cli
     push byte 0     ; store default err code(0)
     push 5          ; push exception number index in IDT
     jmp exception_handler
 
 exception_6:
-    cli
     push byte 0     ; store default err code(0)
     push 6          ; push exception number index in IDT
     jmp exception_handler
 
 exception_7:
-    cli
     push byte 0     ; store default err code(0)
     push 7          ; push exception number index in IDT
     jmp exception_handler
 
 exception_8:
-    cli
     push 8          ; push exception number index in IDT
     jmp exception_handler
 
 exception_9:
-    cli
     push byte 0     ; store default err code(0)
     push 9          ; push exception number index in IDT
     jmp exception_handler
 
 exception_10:
-    cli
     push 10          ; push exception number index in IDT
     jmp exception_handler
 
 exception_11:
-    cli
     push 11          ; push exception number index in IDT
     jmp exception_handler
 
 exception_12:
-    cli
     push 12          ; push exception number index in IDT
     jmp exception_handler
 
 exception_13:
-    cli
     push 13          ; push exception number index in IDT
     jmp exception_handler
 
 exception_14:
-    cli
     push 14          ; push exception number index in IDT
     jmp exception_handler
 
 exception_15:
-    cli
     push byte 0     ; store default err code(0)
     push 15          ; push exception number index in IDT
     jmp exception_handler
 
 exception_16:
-    cli
     push byte 0     ; store default err code(0)
     push 16          ; push exception number index in IDT
     jmp exception_handler
 
 exception_17:
-    cli
     push byte 0     ; store default err code(0)
     push 17          ; push exception number index in IDT
     jmp exception_handler
 
 exception_18:
-    cli
     push byte 0     ; store default err code(0)
     push 18          ; push exception number index in IDT
     jmp exception_handler
 
 exception_19:
-    cli
     push byte 0     ; store default err code(0)
     push 19          ; push exception number index in IDT
     jmp exception_handler
 
 exception_20:
-    cli
     push byte 0     ; store default err code(0)
     push 20          ; push exception number index in IDT
     jmp exception_handler
 
 exception_21:
-    cli
     push byte 0     ; store default err code(0)
     push 21          ; push exception number index in IDT
     jmp exception_handler
 
 exception_22:
-    cli
     push byte 0     ; store default err code(0)
     push 22          ; push exception number index in IDT
     jmp exception_handler
 
 exception_23:
-    cli
     push byte 0     ; store default err code(0)
     push 23          ; push exception number index in IDT
     jmp exception_handler
 
 exception_24:
-    cli
     push byte 0     ; store default err code(0)
     push 24          ; push exception number index in IDT
     jmp exception_handler
 
 exception_25:
-    cli
     push byte 0     ; store default err code(0)
     push 25          ; push exception number index in IDT
     jmp exception_handler
 
 exception_26:
-    cli
     push byte 0     ; store default err code(0)
     push 26          ; push exception number index in IDT
     jmp exception_handler
 
 exception_27:
-    cli
     push byte 0     ; store default err code(0)
     push 27          ; push exception number index in IDT
     jmp exception_handler
 
 exception_28:
-    cli
     push byte 0     ; store default err code(0)
     push 28          ; push exception number index in IDT
     jmp exception_handler
 
 exception_29:
-    cli
     push byte 0     ; store default err code(0)
     push 29          ; push exception number index in IDT
     jmp exception_handler
 
 exception_30:
-    cli
     push byte 0     ; store default err code(0)
     push 30          ; push exception number index in IDT
     jmp exception_handler
 
 exception_31:
-    cli
     push byte 0     ; store default err code(0)
     push 31          ; push exception number index in IDT
     jmp exception_handler
 
-exception_128:
-    cli
-    push byte 0     ; store default err code(0)
-    push 128          ; push exception number index in IDT
-    jmp exception_handler
-
 
@@ -1,40 +1,54 @@
 section .text
     extern isr_irq_handler
+    extern thread_finish_switch
 
+REG_CS  equ 48            ; offset of cs in REGISTERS, see isr.h
+CPU_IRQ_ENTRY equ 8       ; offset of irq_entry in CPU, see smp.h
+
+; interrupt gates already cleared IF and iret restores it,
+; segments only need switching when the interrupt came from ring 3
 irq_handler:
+    cld                   ; the interrupted code may have set DF, ring 3 or memmove(), iret restores it
     pusha                 ; push all registers
-    mov ax, ds
-    push eax              ; save ds
+    push ds               ; save ds
 
+    test byte [esp + REG_CS], 3
+    jz .kernel_entry
     mov ax, 0x10          ; load kernel data segment
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, 0x30          ; per-CPU segment, iret to ring 3 left gs null
     mov gs, ax
+.kernel_entry:
+
+    rdtsc                 ; entry stamp for the statistics in isr.c
+    mov [gs:CPU_IRQ_ENTRY], eax
+    mov [gs:CPU_IRQ_ENTRY + 4], edx
 
     push esp
     call isr_irq_handler
-    pop esp
+    mov esp, eax          ; frame to resume, another thread's after a switch
+    call thread_finish_switch
 
-    pop ebx                ; restore kernel data segment
-    mov ds, bx
-    mov es, bx
-    mov fs, bx
-    mov gs, bx
+    test byte [esp + REG_CS], 3
+    jz .kernel_exit
+    mov ds, [esp]         ; restore the interrupted data segments
+    mov es, [esp]
+    mov fs, [esp]
+.kernel_exit:
+    add esp, 4            ; skip ds
 
     popa                ; restore all registers
     add esp, 0x8        ; restore stack for erro no been pushed
-
-    sti                 ; re-enable interrupts
     iret
 
 
 %macro IRQ 2
   global irq_%1
   irq_%1:
-    cli
     push byte 0
-    push byte %2
+    push dword %2
     jmp irq_handler
 %endmacro
 
@@ -56,4 +70,23 @@ IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
 
+; software interrupt entering the scheduler, see thread_yield()
+IRQ yield, 0x81
+
+; software interrupt round trip measured by irqbench
+IRQ bench, 0x82
+
+; one-shot local APIC timer, see clock.c
+IRQ lapic_timer, 0xF0
 
+; reschedule request from another CPU, see smp_resched()
+IRQ resched, 0xF1
+
+; self IPI round trip measured by irqbench
+IRQ lapic_bench, 0xF2
+
+
+; spurious local APIC interrupt, must not be acknowledged
+global irq_spurious
+irq_spurious:
+    iret
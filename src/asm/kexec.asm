@@ -0,0 +1,90 @@
+; kexec relocation code, copied to KEXEC_TRAMPOLINE_ADDRESS by kexec()
+; runs from identity mapped low memory, turns paging off, copies the staged
+; chunks over the old kernel and enters the new one like a multiboot loader
+KEXEC_TRAMPOLINE_ADDRESS equ 0x9000     ; KEXEC_TRAMPOLINE_ADDRESS in kexec.h
+%define REL(label) (KEXEC_TRAMPOLINE_ADDRESS + ((label) - kexec_start))
+
+CHUNK_SIZE equ 12                       ; KEXEC_CHUNK, dst, src(0 zero fills) and len
+MULTIBOOT_BOOTLOADER_MAGIC equ 0x2BADB002
+
+section .text
+    global kexec_start
+    global kexec_end
+    global kexec_chunks
+    global kexec_count
+    global kexec_entry
+    global kexec_mbi
+
+bits 32
+kexec_start:
+    cli
+    cld
+    mov eax, cr0
+    and eax, 0x7FFFFFFF               ; paging off, this page is identity mapped
+    mov cr0, eax
+    xor eax, eax
+    mov cr3, eax
+    mov cr4, eax                      ; the new kernel sets up PSE, SSE and the rest itself
+
+    ; the old GDT and stack are about to be overwritten
+    lgdt [REL(kexec_gdt_ptr)]
+    jmp dword 0x08:REL(kexec_flat)
+
+kexec_flat:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov esp, KEXEC_TRAMPOLINE_ADDRESS + 4096
+
+    mov ebx, [REL(kexec_chunks)]
+    mov edx, [REL(kexec_count)]
+.next:
+    test edx, edx
+    jz .done
+    mov edi, [ebx]
+    mov esi, [ebx + 4]
+    mov ecx, [ebx + 8]
+    test esi, esi
+    jz .zero
+    mov eax, ecx
+    shr ecx, 2
+    rep movsd
+    mov ecx, eax
+    and ecx, 3
+    rep movsb
+    jmp .step
+.zero:
+    xor eax, eax
+    rep stosb
+.step:
+    add ebx, CHUNK_SIZE
+    dec edx
+    jmp .next
+
+.done:
+    mov eax, MULTIBOOT_BOOTLOADER_MAGIC
+    mov ebx, [REL(kexec_mbi)]
+    jmp [REL(kexec_entry)]
+
+align 8
+kexec_gdt:
+    dq 0                              ; NULL segment
+    dq 0x00CF9A000000FFFF             ; code segment
+    dq 0x00CF92000000FFFF             ; data segment
+kexec_gdt_ptr:
+    dw kexec_gdt_ptr - kexec_gdt - 1
+    dd REL(kexec_gdt)
+
+align 4
+kexec_chunks:
+    dd 0
+kexec_count:
+    dd 0
+kexec_entry:
+    dd 0
+kexec_mbi:
+    dd 0
+kexec_end:
@@ -0,0 +1,228 @@
+section .text
+    extern syscall_dispatch
+    global syscall_int
+    global syscall_sysenter
+    global user_enter
+    global user_sysbench
+    global user_sysbench_end
+    global user_timetest
+    global user_timetest_end
+
+USER_CODE   equ 0x1B      ; ring 3 selectors, see gdt.h
+USER_DATA   equ 0x23
+PERCPU      equ 0x30      ; per-CPU data segment, returning to ring 3 leaves gs null
+EFLAGS_IF   equ 0x200
+
+SYS_NULL    equ 0         ; see syscall.h
+SYS_EXIT    equ 1
+
+TIME_SEQUENCE   equ 0     ; VDSO_TIME, see vdso.h
+TIME_SHIFT      equ 4
+TIME_MULT       equ 8
+TIME_TSC_BASE   equ 16
+TIME_NS_BASE    equ 24
+
+; system call number in eax, arguments in ebx, esi and edi, result in eax,
+; ecx and edx are scratch in both paths, ebx, esi, edi and ebp survive
+; the C dispatcher as callee saved registers
+
+; int 0x80, the interrupt gate left IF cleared and pushed the user stack
+syscall_int:
+    cld                   ; ring 3 owns DF, the kernel's string instructions count up
+    mov cx, PERCPU
+    mov gs, cx
+    sti                   ; system calls may block and be preempted
+
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+
+    cli                   ; a thread switch could leave kernel data segments behind
+    mov cx, USER_DATA
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    iret                  ; restores IF and nulls gs
+
+
+; SYSENTER, the caller passes its return address in edx and its stack in ecx,
+; SYSENTER_ESP points at esp0 in the TSS so the first load switches to the
+; kernel stack of the current thread, ds, es and fs keep the flat user segments,
+; SYSEXIT does not restore EFLAGS so the caller gets DF back cleared
+syscall_sysenter:
+    cld                   ; ring 3 owns DF, the kernel's string instructions count up
+    mov esp, [esp]
+    push ecx              ; user stack
+    push edx              ; user return address
+    mov cx, PERCPU
+    mov gs, cx
+    sti
+
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+
+    cli
+    mov cx, USER_DATA
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    xor cx, cx
+    mov gs, cx            ; SYSEXIT leaves segment registers alone
+    pop edx
+    pop ecx
+    sti                   ; takes effect after SYSEXIT, no interrupt in between
+    sysexit
+
+
+; void user_enter(uint32 eip, uint32 esp)
+user_enter:
+    mov eax, [esp + 4]
+    mov ecx, [esp + 8]
+    cli
+    mov dx, USER_DATA
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    push dword USER_DATA  ; ss
+    push ecx              ; esp
+    pushfd
+    or dword [esp], EFLAGS_IF
+    push dword USER_CODE  ; cs
+    push eax              ; eip
+    xor eax, eax          ; leave no kernel values in registers
+    xor ebx, ebx
+    xor ecx, ecx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    iret
+
+
+; position independent user program run by sysbench, copied to the user window,
+; esp points at its SYSBENCH_FRAME: iterations, sysenter flag, then the cycles
+; of the int 0x80 and SYSENTER loops as 64 bit values
+user_sysbench:
+    mov ebx, esp          ; frame, kept in a register the system calls preserve
+    mov ebp, [ebx]
+
+    rdtsc
+    mov [ebx + 8], eax
+    mov [ebx + 12], edx
+    mov esi, ebp
+.int_loop:
+    mov eax, SYS_NULL
+    int 0x80
+    dec esi
+    jnz .int_loop
+    rdtsc
+    sub eax, [ebx + 8]
+    sbb edx, [ebx + 12]
+    mov [ebx + 8], eax
+    mov [ebx + 12], edx
+
+    cmp dword [ebx + 4], 0
+    je .exit
+    call .base            ; eip for the return address SYSEXIT jumps to
+.base:
+    pop edi
+    add edi, .sysenter_return - .base
+    rdtsc
+    mov [ebx + 16], eax
+    mov [ebx + 20], edx
+    mov esi, ebp
+.sysenter_loop:
+    mov eax, SYS_NULL
+    mov ecx, esp
+    mov edx, edi
+    sysenter
+.sysenter_return:
+    dec esi
+    jnz .sysenter_loop
+    rdtsc
+    sub eax, [ebx + 16]
+    sbb edx, [ebx + 20]
+    mov [ebx + 16], eax
+    mov [ebx + 20], edx
+
+.exit:
+    mov eax, SYS_EXIT
+    xor ebx, ebx
+    int 0x80
+user_sysbench_end:
+
+
+; position independent user program run by timetest, esp points at its
+; TIMETEST_FRAME: reads, time page, reads that went backwards, then the first
+; and last time read and the cycles of all reads as 64 bit values
+user_timetest:
+    mov ebx, esp
+    mov edi, [ebx + 4]
+    mov eax, [ebx]
+    mov [ebx + 40], eax   ; reads left
+    rdtsc
+    mov [ebx + 32], eax
+    mov [ebx + 36], edx
+    call .read
+    mov [ebx + 16], eax
+    mov [ebx + 20], edx
+    mov [ebx + 24], eax
+    mov [ebx + 28], edx
+.loop:
+    call .read
+    cmp edx, [ebx + 28]
+    ja .forward
+    jb .backward
+    cmp eax, [ebx + 24]
+    jae .forward
+.backward:
+    inc dword [ebx + 8]
+.forward:
+    mov [ebx + 24], eax
+    mov [ebx + 28], edx
+    dec dword [ebx + 40]
+    jnz .loop
+    rdtsc
+    sub eax, [ebx + 32]
+    sbb edx, [ebx + 36]
+    mov [ebx + 32], eax
+    mov [ebx + 36], edx
+
+    mov eax, SYS_EXIT
+    xor ebx, ebx
+    int 0x80
+
+; nanoseconds from the time page at edi in edx:eax, like vdso_time_ns()
+.read:
+    mov ebp, [edi + TIME_SEQUENCE]
+    test ebp, 1
+    jz .stable
+    pause
+    jmp .read
+.stable:
+    rdtsc
+    sub eax, [edi + TIME_TSC_BASE]
+    sbb edx, [edi + TIME_TSC_BASE + 4]
+    mov esi, edx
+    mul dword [edi + TIME_MULT]
+    mov ecx, edx          ; (low half * mult) >> 32
+    mov eax, esi
+    mul dword [edi + TIME_MULT]
+    add eax, ecx
+    adc edx, 0
+    mov ecx, [edi + TIME_SHIFT]
+    shld edx, eax, cl
+    shl eax, cl
+    add eax, [edi + TIME_NS_BASE]
+    adc edx, [edi + TIME_NS_BASE + 4]
+    cmp ebp, [edi + TIME_SEQUENCE]
+    jne .read
+    ret
+user_timetest_end:
@@ -0,0 +1,75 @@
+; application processor entry, copied to TRAMPOLINE_BASE by smp_init()
+; a startup IPI starts the AP here in real mode, it switches to protected mode,
+; turns on paging with the boot CPU's page directory and calls the C entry
+; with the stack smp_init() patched in
+TRAMPOLINE_BASE equ 0x8000            ; SMP_TRAMPOLINE_ADDRESS in smp.h
+%define REL(label) (TRAMPOLINE_BASE + ((label) - trampoline_start))
+
+CR4_PSE equ 0x10
+CR0_PG equ 0x80000000
+CR0_WP equ 0x10000
+
+section .text
+    global trampoline_start
+    global trampoline_end
+    global trampoline_cr3
+    global trampoline_stack
+    global trampoline_entry
+
+bits 16
+trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [REL(trampoline_gdt_ptr)]
+
+    mov eax, cr0
+    or eax, 1                         ; protected mode
+    mov cr0, eax
+    jmp dword 0x08:REL(trampoline_32)
+
+bits 32
+trampoline_32:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, cr4
+    or eax, CR4_PSE                   ; 4MB pages, see paging_init()
+    mov cr4, eax
+    mov eax, [REL(trampoline_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, CR0_PG | CR0_WP           ; paging, write protection in ring 0 as in paging_init()
+    mov cr0, eax
+
+    mov esp, [REL(trampoline_stack)]
+    mov eax, [REL(trampoline_entry)]
+    call eax                          ; never returns
+.halt:
+    hlt
+    jmp .halt
+
+align 8
+trampoline_gdt:
+    dq 0                              ; NULL segment
+    dq 0x00CF9A000000FFFF             ; code segment
+    dq 0x00CF92000000FFFF             ; data segment
+trampoline_gdt_ptr:
+    dw trampoline_gdt_ptr - trampoline_gdt - 1
+    dd REL(trampoline_gdt)
+
+align 4
+trampoline_cr3:
+    dd 0
+trampoline_stack:
+    dd 0
+trampoline_entry:
+    dd 0
+trampoline_end:
+
+bits 32
@@ -0,0 +1,98 @@
+/**
+ * Boot phase tracer
+ * a phase lasts from the previous stamp to its own, so the time of messages
+ * printed between two steps goes to the step after them
+ */
+
+#include "boottime.h"
+#include "clock.h"
+#include "console.h"
+#include "serial.h"
+#include "string.h"
+#include "tsc.h"
+
+#define BOOTTIME_NAME_WIDTH     28
+
+typedef struct {
+    const char *phase;
+    uint64 tsc;
+} BOOTTIME_STAMP;
+
+uint64 g_boottime_start;
+
+static BOOTTIME_STAMP g_stamps[BOOTTIME_MAX_PHASES];
+static uint32 g_count;
+static uint32 g_dropped;
+
+/**
+ * record the TSC as the end of phase, phase must be a string that is never freed,
+ * only the boot CPU records phases, one after another
+ */
+void boottime_mark(const char *phase) {
+    uint64 tsc = rdtsc();
+
+    if (g_count == BOOTTIME_MAX_PHASES) {
+        g_dropped++;
+        return;
+    }
+    g_stamps[g_count].phase = phase;
+    g_stamps[g_count].tsc = tsc;
+    g_count++;
+}
+
+// TSC where phase i began
+static uint64 phase_start(uint32 i) {
+    return i == 0 ? g_boottime_start : g_stamps[i - 1].tsc;
+}
+
+/**
+ * print every phase with its end and length in microseconds since _start
+ */
+void boottime_print() {
+    uint32 before = clock_cycles_to_us(g_boottime_start);
+
+    // the TSC counts from reset on bare metal, hypervisors may start it anywhere
+    if (before != 0xFFFFFFFF)
+        printf("Firmware and boot loader: %d ms of TSC before _start\n", before / 1000);
+    printf("PHASE                          END us    TOOK us\n");
+    for (uint32 i = 0; i < g_count; i++) {
+        uint32 len = strlen(g_stamps[i].phase);
+
+        printf("%s", g_stamps[i].phase);
+        for (; len < BOOTTIME_NAME_WIDTH; len++)
+            printf(" ");
+        printf(" %9d  %9d\n", clock_cycles_to_us(g_stamps[i].tsc - g_boottime_start),
+               clock_cycles_to_us(g_stamps[i].tsc - phase_start(i)));
+    }
+    if (g_dropped > 0)
+        printf("%d phases past the first %d were dropped\n", g_dropped, BOOTTIME_MAX_PHASES);
+}
+
+static void csv_append(char *line, uint32 value, const char *separator) {
+    char buf[16];
+
+    itoa(buf, 'u', value);
+    strcat(line, buf);
+    strcat(line, separator);
+}
+
+/**
+ * write the phases as CSV to COM1, returns FALSE when there is no serial port
+ */
+BOOL boottime_serial() {
+    if (!serial_present())
+        return FALSE;
+    serial_putstr("phase,end_us,took_us\n");
+    for (uint32 i = 0; i < g_count; i++) {
+        char line[80] = "";
+
+        csv_append(line, clock_cycles_to_us(g_stamps[i].tsc - g_boottime_start), ",");
+        csv_append(line, clock_cycles_to_us(g_stamps[i].tsc - phase_start(i)), "\n");
+        // quoted, the phase is the text of a call with commas in it
+        serial_putstr("\"");
+        serial_putstr(g_stamps[i].phase);
+        serial_putstr("\",");
+        serial_putstr(line);
+    }
+    return TRUE;
+}
@@ -0,0 +1,234 @@
+/**
+ * Kernel time and per-CPU one-shot timer events for tickless idle
+ * time comes from the TSC calibrated against the PIT, events from the
+ * local APIC timer(TSC-deadline mode when available) or the PIT
+ * a CPU running a thread arms its event one tick ahead for preemption,
+ * an idle CPU arms it for its first sleeper or not at all
+ */
+
+#include "clock.h"
+#include "lapic.h"
+#include "isr.h"
+#include "smp.h"
+#include "thread.h"
+#include "tsc.h"
+#include "timer.h"
+#include "seqlock.h"
+#include "vdso.h"
+#include "cpu_features.h"
+#include "console.h"
+
+static SEQLOCK g_clock_seq = SEQLOCK_INIT;     // g_source and g_tsc_base for clock_ticks()
+static CLOCK_EVENT_SOURCE g_source = CLOCK_EVENT_PIT_PERIODIC;
+static uint64 g_tsc_base;           // TSC at tick 0
+static uint32 g_tsc_per_tick;
+static uint32 g_lapic_per_tick;     // local APIC timer counts per tick
+static BOOL g_mwait;
+
+static const char *g_source_names[] = {"PIT periodic", "PIT one-shot", "local APIC one-shot", "TSC-deadline"};
+
+static void clock_event(REGISTERS *reg) {
+    CPU *cpu = cpu_self();
+
+    (void)reg;
+    cpu->event_tick = CLOCK_NEVER;
+    cpu->timer_events++;
+    if (cpu->index == TIMER_CPU)
+        timer_run();
+    thread_tick();
+}
+
+// wait for count PIT ticks, halting in between
+static void pit_wait(uint32 count) {
+    uint32 start = pit_ticks();
+
+    while (pit_ticks() - start < count)
+        asm volatile("sti; hlt");
+}
+
+/**
+ * calibrate the TSC and local APIC timer against the running PIT, then stop
+ * the periodic tick and switch every CPU to one-shot events, called by the
+ * boot CPU with interrupts enabled after pit_init() and smp_init()
+ */
+void clock_init() {
+    uint32 flags;
+    uint64 tsc;
+
+    g_mwait = cpu_has(CPU_FEATURE_MWAIT);
+
+    // start right after a tick so both ends of the measurement are tick edges
+    pit_wait(1);
+    tsc = rdtsc();
+    if (lapic_present()) {
+        lapic_timer_setup(LAPIC_TIMER_VECTOR, FALSE);
+        lapic_timer_oneshot(0xFFFFFFFF);
+    }
+    pit_wait(CLOCK_CALIBRATE_TICKS);
+    g_tsc_per_tick = udiv64_32(rdtsc() - tsc, CLOCK_CALIBRATE_TICKS);
+    if (lapic_present()) {
+        g_lapic_per_tick = (0xFFFFFFFF - lapic_timer_current()) / CLOCK_CALIBRATE_TICKS;
+        lapic_timer_oneshot(0);
+    }
+
+    flags = irq_save();
+    write_seqlock(&g_clock_seq);
+    // continue counting from the PIT so pending sleeps keep their deadlines
+    g_tsc_base = rdtsc() - (uint64)pit_ticks() * g_tsc_per_tick;
+    vdso_update(g_tsc_base, g_tsc_per_tick);
+    if (lapic_present()) {
+        isr_mask_irq(IRQ0_TIMER);
+        isr_register_interrupt_handler(LAPIC_TIMER_VECTOR, clock_event);
+        g_source = lapic_tsc_deadline() ? CLOCK_EVENT_TSC_DEADLINE : CLOCK_EVENT_LAPIC;
+    } else {
+        isr_register_interrupt_handler(IRQ_BASE + IRQ0_TIMER, clock_event);
+        g_source = CLOCK_EVENT_PIT_ONESHOT;
+    }
+    write_sequnlock(&g_clock_seq);
+    // the other CPUs arm their own events when they next pass through the scheduler
+    for (uint32 i = 0; i < smp_cpu_count(); i++) {
+        if (smp_cpu(i) != cpu_self())
+            smp_resched(smp_cpu(i));
+    }
+    irq_restore(flags);
+}
+
+/**
+ * ticks since pit_init()
+ */
+uint32 clock_ticks() {
+    CLOCK_EVENT_SOURCE source;
+    uint64 base;
+    uint32 seq;
+
+    // other CPUs read the 64-bit base while clock_init() switches over
+    do {
+        seq = read_seqbegin(&g_clock_seq);
+        source = g_source;
+        base = g_tsc_base;
+    } while (read_seqretry(&g_clock_seq, seq));
+    if (source == CLOCK_EVENT_PIT_PERIODIC)
+        return pit_ticks();
+    return udiv64_32(rdtsc() - base, g_tsc_per_tick);
+}
+
+/**
+ * nanoseconds since pit_init(), to the TSC cycle once clock_init() ran
+ */
+uint64 clock_ns() {
+    CLOCK_EVENT_SOURCE source;
+    uint64 base, delta;
+    uint32 seq, ticks;
+
+    do {
+        seq = read_seqbegin(&g_clock_seq);
+        source = g_source;
+        base = g_tsc_base;
+    } while (read_seqretry(&g_clock_seq, seq));
+    if (source == CLOCK_EVENT_PIT_PERIODIC)
+        return (uint64)pit_ticks() * CLOCK_NS_PER_TICK;
+    delta = rdtsc() - base;
+    ticks = udiv64_32(delta, g_tsc_per_tick);
+    delta -= (uint64)ticks * g_tsc_per_tick;
+    return (uint64)ticks * CLOCK_NS_PER_TICK + udiv64_32(delta * CLOCK_NS_PER_TICK, g_tsc_per_tick);
+}
+
+/**
+ * convert milliseconds to ticks, rounded up
+ */
+uint32 clock_ms_to_ticks(uint32 ms) {
+    return (ms * CLOCK_HZ + 999) / 1000;
+}
+
+/**
+ * convert TSC cycles to milliseconds
+ */
+uint32 clock_cycles_to_ms(uint64 cycles) {
+    if (g_tsc_per_tick == 0)
+        return 0;
+    return udiv64_32(cycles * (1000 / CLOCK_HZ), g_tsc_per_tick);
+}
+
+/**
+ * convert TSC cycles to microseconds, longer than about 71 minutes gives 0xFFFFFFFF
+ */
+uint32 clock_cycles_to_us(uint64 cycles) {
+    uint64 scaled = cycles * (1000000 / CLOCK_HZ);
+
+    if (g_tsc_per_tick == 0)
+        return 0;
+    // the quotient has to fit in 32 bits or divl faults
+    if ((scaled >> 32) >= g_tsc_per_tick)
+        return 0xFFFFFFFF;
+    return udiv64_32(scaled, g_tsc_per_tick);
+}
+
+/**
+ * arm the one-shot timer event of the calling CPU for tick, CLOCK_NEVER stops it,
+ * nothing is reprogrammed when it is already armed for that tick
+ */
+void clock_arm(uint32 tick) {
+    CPU *cpu = cpu_self();
+    uint64 now, deadline, delta;
+
+    if (g_source == CLOCK_EVENT_PIT_PERIODIC || tick == cpu->event_tick)
+        return;
+    cpu->event_tick = tick;
+
+    if (g_source != CLOCK_EVENT_PIT_ONESHOT && !cpu->event_ready) {
+        lapic_timer_setup(LAPIC_TIMER_VECTOR, g_source == CLOCK_EVENT_TSC_DEADLINE);
+        cpu->event_ready = TRUE;
+    }
+    if (tick == CLOCK_NEVER) {
+        // a pending PIT one-shot just fires once more
+        if (g_source == CLOCK_EVENT_TSC_DEADLINE)
+            lapic_timer_deadline(0);
+        else if (g_source == CLOCK_EVENT_LAPIC)
+            lapic_timer_oneshot(0);
+        return;
+    }
+
+    deadline = g_tsc_base + (uint64)tick * g_tsc_per_tick;
+    if (g_source == CLOCK_EVENT_TSC_DEADLINE) {
+        lapic_timer_deadline(deadline);
+        return;
+    }
+    // count based timers fire early for far deadlines and get armed again
+    now = rdtsc();
+    delta = deadline > now ? deadline - now : 0;
+    if (delta > (uint64)CLOCK_MAX_EVENT_TICKS * g_tsc_per_tick)
+        delta = (uint64)CLOCK_MAX_EVENT_TICKS * g_tsc_per_tick;
+    if (g_source == CLOCK_EVENT_LAPIC)
+        lapic_timer_oneshot(udiv64_32(delta * g_lapic_per_tick, g_tsc_per_tick) + 1);
+    else
+        pit_oneshot(udiv64_32(delta * (PIT_FREQUENCY / CLOCK_HZ), g_tsc_per_tick));
+}
+
+/**
+ * halt the calling CPU until the next interrupt, with mwait when the CPU has it
+ */
+void clock_idle() {
+    CPU *cpu = cpu_self();
+
+    if (g_mwait) {
+        // a store to need_resched wakes the CPU as well as an interrupt
+        asm volatile("monitor" :: "a"(&cpu->need_resched), "c"(0), "d"(0));
+        if (!cpu->need_resched)
+            asm volatile("sti; mwait" :: "a"(0), "c"(0));
+        else
+            asm volatile("sti");
+        return;
+    }
+    asm volatile("sti; hlt");
+}
+
+/**
+ * print the clock setup
+ */
+void clock_stats() {
+    printf("timer events: %s, idle with %s\n", g_source_names[g_source], g_mwait ? "mwait" : "hlt");
+    printf("TSC: %d kHz\n", g_tsc_per_tick / (1000 / CLOCK_HZ));
+    if (g_lapic_per_tick)
+        printf("local APIC timer: %d kHz\n", g_lapic_per_tick / (1000 / CLOCK_HZ));
+    printf("uptime: %d ms\n", clock_ticks() * (1000 / CLOCK_HZ));
+}
@@ -1,9 +1,12 @@
+#include <stdarg.h>
 #include "console.h"
 #include "string.h"
 #include "types.h"
 #include "vga.h"
-#include "keyboard.h"
+#include "spinlock.h"
 
+// cursor and buffer state, printf() may run on any CPU and in interrupt handlers
+static SPINLOCK g_console_lock = SPINLOCK_INIT;
 static uint16 *g_vga_buffer;
 // Index for video buffer array
 static uint32 g_vga_index;
@@ -13,6 +16,8 @@ static uint8 cursor_pos_x = 0, cursor_pos_y = 0;
 uint8 g_fore_color = COLOR_WHITE, g_back_color = COLOR_BLACK;
 static uint16 g_temp_pages[MAXIMUM_PAGES][VGA_TOTAL_ITEMS];
 uint32 g_current_temp_page = 0;
+// where printf() puts its characters, see console_set_output()
+static CONSOLE_OUTPUT g_output = console_putchar;
 
 // Clear video buffer array
 void console_clear(VGA_COLOR_TYPE fore_color, VGA_COLOR_TYPE back_color) {
@@ -38,31 +43,24 @@ void console_init(VGA_COLOR_TYPE fore_color, VGA_COLOR_TYPE back_color) {
 }
 
 void console_scroll(int type) {
-    uint32 i;
     if (type == SCROLL_UP) {
         // Scroll up
         if (g_current_temp_page > 0)
             g_current_temp_page--;
         g_current_temp_page %= MAXIMUM_PAGES;
-        for (i = 0; i < VGA_TOTAL_ITEMS; i++) {
-            g_vga_buffer[i] = g_temp_pages[g_current_temp_page][i];
-        }
+        memcpy(g_vga_buffer, g_temp_pages[g_current_temp_page], sizeof(g_temp_pages[0]));
     } else {
         // Scroll down
         g_current_temp_page++;
         g_current_temp_page %= MAXIMUM_PAGES;
-        for (i = 0; i < VGA_TOTAL_ITEMS; i++) {
-            g_vga_buffer[i] = g_temp_pages[g_current_temp_page][i];
-        }
+        memcpy(g_vga_buffer, g_temp_pages[g_current_temp_page], sizeof(g_temp_pages[0]));
     }
 }
 
 static void console_newline() {
     if (cursor_pos_y >= VGA_HEIGHT - 1) {
-        // scroll screen
-        for (int i = 0; i < (VGA_HEIGHT - 1) * VGA_WIDTH; i++) {
-            g_vga_buffer[i] = g_vga_buffer[i + VGA_WIDTH];
-        }
+        // scroll screen, the rows overlap
+        memmove(g_vga_buffer, g_vga_buffer + VGA_WIDTH, (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16));
         for (int i = (VGA_HEIGHT - 1) * VGA_WIDTH; i < VGA_HEIGHT * VGA_WIDTH; i++) {
             g_vga_buffer[i] = vga_item_entry(' ', g_fore_color, g_back_color);
         }
@@ -75,8 +73,7 @@ static void console_newline() {
     vga_set_cursor_pos(cursor_pos_x, cursor_pos_y);
 }
 
-// Assign ASCII character to video buffer
-void console_putchar(char ch) {
+static void console_putchar_locked(char ch) {
     if (ch == '\t') {
         for(int i = 0; i < 4; i++) {
             g_vga_buffer[g_vga_index++] = vga_item_entry(' ', g_fore_color, g_back_color);
@@ -104,8 +101,18 @@ void console_putchar(char ch) {
     vga_set_cursor_pos(cursor_pos_x, cursor_pos_y);
 }
 
+// Assign ASCII character to video buffer
+void console_putchar(char ch) {
+    uint32 flags = spin_lock_irqsave(&g_console_lock);
+
+    console_putchar_locked(ch);
+    spin_unlock_irqrestore(&g_console_lock, flags);
+}
+
 // Revert back the printed character and add 0 to it
 void console_ungetchar() {
+    uint32 flags = spin_lock_irqsave(&g_console_lock);
+
     if(g_vga_index > 0) {
         g_vga_index--;  // Move back the index first
         if(cursor_pos_x > 0) {
@@ -117,6 +124,7 @@ void console_ungetchar() {
         g_vga_buffer[g_vga_index] = vga_item_entry(0, g_fore_color, g_back_color);
         vga_set_cursor_pos(cursor_pos_x, cursor_pos_y);
     }
+    spin_unlock_irqrestore(&g_console_lock, flags);
 }
 
 // Revert back the printed character until n characters
@@ -127,94 +135,38 @@ void console_ungetchar_bound(uint8 n) {
 }
 
 void console_gotoxy(uint16 x, uint16 y) {
+    uint32 flags = spin_lock_irqsave(&g_console_lock);
+
     g_vga_index = (80 * y) + x;
     cursor_pos_x = x;
     cursor_pos_y = y;
     vga_set_cursor_pos(cursor_pos_x, cursor_pos_y);
+    spin_unlock_irqrestore(&g_console_lock, flags);
 }
 
 // Print string by calling print_char
 void console_putstr(const char *str) {
     uint32 index = 0;
     while (str[index]) {
-        if (str[index] == '\n')
-            console_newline();
-        else
-            console_putchar(str[index]);
+        console_putchar(str[index]);
         index++;
     }
 }
 
-void printf(const char *format, ...) {
-    g_fore_color = COLOR_WHITE;
-    char **arg = (char **)&format;
-    int c;
-    char buf[32];
-
-    arg++;
-
-    memset(buf, 0, sizeof(buf));
-    while ((c = *format++) != 0) {
-        if (c != '%')
-            console_putchar(c);
-        else {
-            char *p, *p2;
-            int pad0 = 0, pad = 0;
-
-            c = *format++;
-            if (c == '0') {
-                pad0 = 1;
-                c = *format++;
-            }
-
-            if (c >= '0' && c <= '9') {
-                pad = c - '0';
-                c = *format++;
-            }
-
-            switch (c) {
-                case 'd':
-                case 'u':
-                case 'x':
-                    itoa(buf, c, *((int *)arg++));
-                    p = buf;
-                    goto string;
-                    break;
-
-                case 's':
-                    p = *arg++;
-                    if (!p)
-                        p = "(null)";
-
-                string:
-                    for (p2 = p; *p2; p2++)
-                        ;
-                    for (; p2 < p + pad; p2++)
-                        console_putchar(pad0 ? '0' : ' ');
-                    while (*p)
-                        console_putchar(*p++);
-                    break;
-
-                default:
-                    console_putchar(*((int *)arg++));
-                    break;
-            }
-        }
-    }
+// send printf() and printf_color() output to output instead of the screen
+void console_set_output(CONSOLE_OUTPUT output) {
+    g_output = output;
 }
 
-void printf_color(char vga_color, const char *format, ...) {
-    g_fore_color = vga_color;
-    char **arg = (char **)&format;
+// the formatting of printf(), printf_color() and console_printf()
+static void console_vprintf(CONSOLE_OUTPUT put, const char *format, va_list args) {
     int c;
     char buf[32];
 
-    arg++;
-
     memset(buf, 0, sizeof(buf));
     while ((c = *format++) != 0) {
         if (c != '%') {
-            console_putchar(c);
+            put(c);
         } else {
             char *p, *p2;
             int pad0 = 0, pad = 0;
@@ -234,13 +186,13 @@ void printf_color(char vga_color, const char *format, ...) {
                 case 'd':
                 case 'u':
                 case 'x':
-                    itoa(buf, c, *((int *)arg++));
+                    itoa(buf, c, va_arg(args, int));
                     p = buf;
                     goto string;
                     break;
 
                 case 's':
-                    p = *arg++;
+                    p = va_arg(args, char *);
                     if (!p)
                         p = "(null)";
 
@@ -248,55 +200,45 @@ void printf_color(char vga_color, const char *format, ...) {
                     for (p2 = p; *p2; p2++)
                         ;
                     for (; p2 < p + pad; p2++)
-                        console_putchar(pad0 ? '0' : ' ');
+                        put(pad0 ? '0' : ' ');
                     while (*p)
-                        console_putchar(*p++);
+                        put(*p++);
                     break;
 
                 default:
-                    console_putchar(*((int *)arg++));
+                    put(va_arg(args, int));
                     break;
             }
         }
     }
 }
 
-// Read string from console, but no backing
-void getstr(char *buffer) {
-    if (!buffer) return;
-    while(1) {
-        char ch = kb_getchar();
-        if (ch == '\n') {
-            printf("\n");
-            return ;
-        } else {
-            *buffer++ = ch;
-            printf("%c", ch);
-        }
-    }
+void printf(const char *format, ...) {
+    va_list args;
+
+    g_fore_color = COLOR_WHITE;
+    va_start(args, format);
+    console_vprintf(g_output, format, args);
+    va_end(args);
 }
 
-// Read string from console, and erase or go back until bound occurs
-void getstr_bound(char *buffer, uint8 bound) {
-    if (!buffer) return;
-    while(1) {
-        char ch = kb_getchar();
-        if (ch == '\n') {
-            printf("\n");
-            return ;
-        } else if(ch == '\b') {
-            if (buffer > 0) {
-                console_ungetchar_bound(1);
-                buffer--;
-                *buffer = '\0';
-            }
-        } else {
-            if (buffer - buffer < bound) {
-                *buffer++ = ch;
-                printf("%c", ch);
-            }
-        }
-    }
+void printf_color(char vga_color, const char *format, ...) {
+    va_list args;
+
+    g_fore_color = vga_color;
+    va_start(args, format);
+    console_vprintf(g_output, format, args);
+    va_end(args);
+}
+
+// printf() straight to the screen, for interrupt handlers and fatal errors
+void console_printf(const char *format, ...) {
+    va_list args;
+
+    g_fore_color = COLOR_WHITE;
+    va_start(args, format);
+    console_vprintf(console_putchar, format, args);
+    va_end(args);
 }
 
 uint8 get_cursor_x() {
@@ -0,0 +1,145 @@
+/**
+ * CPU feature detection and boot-time dispatch
+ * the APs are assumed to have the features of the boot CPU
+ */
+
+#include "cpu_features.h"
+#include "console.h"
+#include "string.h"
+
+#define JMP_REL32               0xE9
+
+typedef struct {
+    uint32 feature;
+    const char *name;
+} CPU_FEATURE_NAME;
+
+typedef struct {
+    const char *name;
+    const char *impl;
+} CPU_DISPATCH_SLOT;
+
+CPU_FEATURES g_cpu_features;
+
+static CPU_DISPATCH_SLOT g_dispatch[CPU_DISPATCH_MAX];
+static uint32 g_dispatch_count;
+
+static const CPU_FEATURE_NAME g_feature_names[] = {
+    {CPU_FEATURE_FPU, "fpu"}, {CPU_FEATURE_TSC, "tsc"}, {CPU_FEATURE_MSR, "msr"},
+    {CPU_FEATURE_PAE, "pae"}, {CPU_FEATURE_APIC, "apic"}, {CPU_FEATURE_SEP, "sep"},
+    {CPU_FEATURE_PGE, "pge"}, {CPU_FEATURE_CMOV, "cmov"}, {CPU_FEATURE_CLFLUSH, "clflush"},
+    {CPU_FEATURE_MMX, "mmx"}, {CPU_FEATURE_FXSR, "fxsr"}, {CPU_FEATURE_SSE, "sse"},
+    {CPU_FEATURE_SSE2, "sse2"}, {CPU_FEATURE_HTT, "htt"}, {CPU_FEATURE_SSE3, "sse3"},
+    {CPU_FEATURE_PCLMULQDQ, "pclmulqdq"}, {CPU_FEATURE_MWAIT, "mwait"}, {CPU_FEATURE_SSSE3, "ssse3"},
+    {CPU_FEATURE_FMA, "fma"}, {CPU_FEATURE_CX16, "cx16"}, {CPU_FEATURE_PCID, "pcid"},
+    {CPU_FEATURE_SSE41, "sse4.1"}, {CPU_FEATURE_SSE42, "sse4.2"}, {CPU_FEATURE_X2APIC, "x2apic"},
+    {CPU_FEATURE_MOVBE, "movbe"}, {CPU_FEATURE_POPCNT, "popcnt"}, {CPU_FEATURE_TSC_DEADLINE, "tsc-deadline"},
+    {CPU_FEATURE_AES, "aes"}, {CPU_FEATURE_XSAVE, "xsave"}, {CPU_FEATURE_AVX, "avx"},
+    {CPU_FEATURE_F16C, "f16c"}, {CPU_FEATURE_RDRAND, "rdrand"}, {CPU_FEATURE_HYPERVISOR, "hypervisor"},
+    {CPU_FEATURE_ARAT, "arat"}, {CPU_FEATURE_FSGSBASE, "fsgsbase"}, {CPU_FEATURE_BMI1, "bmi1"},
+    {CPU_FEATURE_AVX2, "avx2"}, {CPU_FEATURE_SMEP, "smep"}, {CPU_FEATURE_BMI2, "bmi2"},
+    {CPU_FEATURE_ERMS, "erms"}, {CPU_FEATURE_INVPCID, "invpcid"}, {CPU_FEATURE_AVX512F, "avx512f"},
+    {CPU_FEATURE_RDSEED, "rdseed"}, {CPU_FEATURE_SMAP, "smap"}, {CPU_FEATURE_CLFLUSHOPT, "clflushopt"},
+    {CPU_FEATURE_SHA, "sha"}, {CPU_FEATURE_UMIP, "umip"}, {CPU_FEATURE_VAES, "vaes"},
+    {CPU_FEATURE_FSRM, "fsrm"}, {CPU_FEATURE_SYSCALL, "syscall"}, {CPU_FEATURE_NX, "nx"},
+    {CPU_FEATURE_PDPE1GB, "pdpe1gb"}, {CPU_FEATURE_RDTSCP, "rdtscp"}, {CPU_FEATURE_LM, "lm"},
+    {CPU_FEATURE_LAHF_LM, "lahf_lm"}, {CPU_FEATURE_LZCNT, "lzcnt"}, {CPU_FEATURE_INVARIANT_TSC, "invariant-tsc"},
+};
+
+/**
+ * read the CPUID leaves into g_cpu_features, the first thing boot() does
+ */
+void cpu_features_init() {
+    CPU_FEATURES *f = &g_cpu_features;
+    uint32 eax, ebx, ecx, edx;
+
+    memset(f, 0, sizeof(CPU_FEATURES));
+    cpuid(0, 0, &f->max_leaf, (uint32 *)f->vendor, (uint32 *)(f->vendor + 8), (uint32 *)(f->vendor + 4));
+    if (f->max_leaf >= 1) {
+        cpuid(1, 0, &eax, &ebx, &f->words[CPU_WORD_1_ECX], &f->words[CPU_WORD_1_EDX]);
+        f->signature = eax;
+        f->stepping = eax & 0xF;
+        f->model = (eax >> 4) & 0xF;
+        f->family = (eax >> 8) & 0xF;
+        if (f->family == 6 || f->family == 0xF)
+            f->model += ((eax >> 16) & 0xF) << 4;
+        if (f->family == 0xF)
+            f->family += (eax >> 20) & 0xFF;
+    }
+    if (f->max_leaf >= 6)
+        cpuid(6, 0, &f->words[CPU_WORD_6_EAX], &ebx, &ecx, &edx);
+    if (f->max_leaf >= 7)
+        cpuid(7, 0, &eax, &f->words[CPU_WORD_7_EBX], &f->words[CPU_WORD_7_ECX], &f->words[CPU_WORD_7_EDX]);
+
+    cpuid(0x80000000, 0, &f->max_ext_leaf, &ebx, &ecx, &edx);
+    // CPUs without extended leaves repeat the highest standard leaf
+    if (f->max_ext_leaf < 0x80000000 || f->max_ext_leaf > 0x8000FFFF)
+        f->max_ext_leaf = 0;
+    if (f->max_ext_leaf >= 0x80000001)
+        cpuid(0x80000001, 0, &eax, &ebx, &f->words[CPU_WORD_81_ECX], &f->words[CPU_WORD_81_EDX]);
+    if (f->max_ext_leaf >= 0x80000004) {
+        uint32 *brand = (uint32 *)f->brand;
+        for (uint32 i = 0; i < 3; i++)
+            cpuid(0x80000002 + i, 0, &brand[i * 4], &brand[i * 4 + 1], &brand[i * 4 + 2], &brand[i * 4 + 3]);
+    }
+    if (f->max_ext_leaf >= 0x80000007)
+        cpuid(0x80000007, 0, &eax, &ebx, &ecx, &f->words[CPU_WORD_87_EDX]);
+}
+
+/**
+ * point the CPU_DISPATCH() routine at site to target and record impl as its
+ * name for cpuinfo, only while no other CPU runs, before smp_init()
+ */
+void cpu_dispatch_bind(void *site, void *target, const char *name, const char *impl) {
+    uint8 *jmp = site;
+    uint32 eax, ebx, ecx, edx;
+    uint32 i;
+
+    if (jmp[0] != JMP_REL32) {
+        printf("[CPU] %s is not a dispatched routine\n", name);
+        return;
+    }
+    *(volatile uint32 *)(jmp + 1) = (uint32)((uintptr)target - (uintptr)(jmp + 5));
+    // serialize so the CPU does not run a prefetched copy of the old jump
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+
+    for (i = 0; i < g_dispatch_count; i++) {
+        if (strcmp(g_dispatch[i].name, (char *)name) == 0)
+            break;
+    }
+    if (i == g_dispatch_count) {
+        if (g_dispatch_count == CPU_DISPATCH_MAX)
+            return;
+        g_dispatch_count++;
+    }
+    g_dispatch[i].name = name;
+    g_dispatch[i].impl = impl;
+}
+
+/**
+ * print vendor, model, features and the implementation every dispatched routine got
+ */
+void cpu_features_print() {
+    CPU_FEATURES *f = &g_cpu_features;
+    char line[80] = "";
+
+    printf("Vendor: %s\n", f->vendor);
+    printf("Brand: %s\n", f->brand[0] ? f->brand : "-");
+    printf("Family %d, model %d, stepping %d, leaves 0x%x and 0x%x\n", f->family, f->model, f->stepping,
+           f->max_leaf, f->max_ext_leaf);
+    printf("Features:\n");
+    for (uint32 i = 0; i < sizeof(g_feature_names) / sizeof(g_feature_names[0]); i++) {
+        if (!cpu_has(g_feature_names[i].feature))
+            continue;
+        if (strlen(line) + strlen(g_feature_names[i].name) + 1 >= 72) {
+            printf("%s\n", line);
+            line[0] = '\0';
+        }
+        strcat(line, " ");
+        strcat(line, g_feature_names[i].name);
+    }
+    printf("%s\n", line);
+    printf("Dispatch:\n");
+    for (uint32 i = 0; i < g_dispatch_count; i++)
+        printf(" %s: %s\n", g_dispatch[i].name, g_dispatch[i].impl);
+}
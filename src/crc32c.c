@@ -0,0 +1,75 @@
+/**
+ * CRC32C(Castagnoli) checksums
+ * slicing-by-8 processes 8 bytes per step with 8 tables,
+ * the SSE4.2 kernel feeds 4 bytes per crc32 instruction
+ */
+
+#include "crc32c.h"
+#include "cpu_features.h"
+
+typedef uint32 __attribute__((__may_alias__, aligned(1))) unaligned_uint32;
+
+static uint32 crc_table[8][256];
+
+// crc32c() jumps straight to the kernel crc32c_init() picked
+CPU_DISPATCH(crc32c, crc32c_sw);
+
+void crc32c_init() {
+    for (uint32 i = 0; i < 256; i++) {
+        uint32 crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc_table[0][i] = crc;
+    }
+    for (uint32 i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++)
+            crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^ crc_table[0][crc_table[k - 1][i] & 0xFF];
+    }
+
+    if (crc32c_has_hw())
+        cpu_dispatch_bind(crc32c, crc32c_hw, "crc32c", "sse4.2 crc32");
+    else
+        cpu_dispatch_bind(crc32c, crc32c_sw, "crc32c", "slicing-by-8");
+}
+
+BOOL crc32c_has_hw() {
+    return cpu_has(CPU_FEATURE_SSE42);
+}
+
+uint32 crc32c_sw(uint32 crc, const void *buf, uint32 len) {
+    const uint8 *p = buf;
+
+    crc = ~crc;
+    for (; len > 0 && ((uintptr)p & 3); len--)
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32 one = *(const unaligned_uint32 *)p ^ crc;
+        uint32 two = *(const unaligned_uint32 *)(p + 4);
+        crc = crc_table[7][one & 0xFF] ^ crc_table[6][(one >> 8) & 0xFF] ^
+              crc_table[5][(one >> 16) & 0xFF] ^ crc_table[4][one >> 24] ^
+              crc_table[3][two & 0xFF] ^ crc_table[2][(two >> 8) & 0xFF] ^
+              crc_table[1][(two >> 16) & 0xFF] ^ crc_table[0][two >> 24];
+    }
+
+    for (; len > 0; len--)
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32 crc32c_hw(uint32 crc, const void *buf, uint32 len) {
+    const uint8 *p = buf;
+
+    crc = ~crc;
+    for (; len > 0 && ((uintptr)p & 3); len--)
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p++));
+
+    for (; len >= 8; len -= 8, p += 8) {
+        asm("crc32l %1, %0" : "+r"(crc) : "rm"(*(const unaligned_uint32 *)p));
+        asm("crc32l %1, %0" : "+r"(crc) : "rm"(*(const unaligned_uint32 *)(p + 4)));
+    }
+
+    for (; len > 0; len--)
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p++));
+    return ~crc;
+}
@@ -0,0 +1,345 @@
+/**
+ * ELF32 program loader
+ * the user window holds one program at a time, its PT_LOAD segments and stack
+ * are only described at exec and filled page by page from the fault handler,
+ * read-only pages wholly inside the file map the page cache frame itself
+ */
+
+#include "elf.h"
+#include "user.h"
+#include "thread.h"
+#include "paging.h"
+#include "pmm.h"
+#include "console.h"
+#include "string.h"
+#include "ipc.h"
+#include "fs/vfs.h"
+#include "fs/page_cache.h"
+
+typedef struct {
+    uint32 start, end;          // page aligned range of the segment
+    uint32 vaddr;               // first byte backed by the file
+    uint32 filesz;
+    uint32 offset;              // file offset of vaddr
+    BOOL write;
+} ELF_SEGMENT;
+
+// pages a program received at addr from a channel, outside its segments
+typedef struct {
+    uint32 start, end;
+} ELF_RANGE;
+
+typedef struct {
+    BOOL used;
+    THREAD *thread;             // the thread running the program in ring 3
+    VfsFile *file;
+    uint32 entry;
+    uint32 count;
+    ELF_SEGMENT segments[ELF_MAX_SEGMENTS + 1];     // the last one is the stack
+    uint32 shared_pages;        // page cache frames mapped read-only
+    uint32 file_pages;          // private copies of file data
+    uint32 zero_pages;
+    uint32 channels;            // bit per channel the program has open
+    ELF_RANGE received[ELF_MAX_RECEIVED];
+    uint32 received_count;
+} ELF_IMAGE;
+
+static ELF_IMAGE g_image;
+
+static ELF_SEGMENT *segment_find(uint32 addr) {
+    for (uint32 i = 0; i < g_image.count; i++) {
+        if (addr >= g_image.segments[i].start && addr < g_image.segments[i].end)
+            return &g_image.segments[i];
+    }
+    return NULL;
+}
+
+// copy the file backed part of seg that falls into page to frame,
+// returns the bytes copied or -1 on a read error
+static int segment_copy(ELF_SEGMENT *seg, uint32 page, uint8 *frame) {
+    uint32 lo = page > seg->vaddr ? page : seg->vaddr;
+    uint32 hi = seg->vaddr + seg->filesz;
+
+    if (hi > page + PAGE_SIZE)
+        hi = page + PAGE_SIZE;
+    if (lo >= hi)
+        return 0;
+    if (vfs_read(g_image.file, seg->offset + lo - seg->vaddr, frame + lo - page, hi - lo) != (int)(hi - lo))
+        return -1;
+    return hi - lo;
+}
+
+// fill the page at addr on first touch, being called with interrupts disabled
+static BOOL elf_pager(uint32 addr, BOOL write) {
+    uint32 page = addr & PAGE_MASK, covering = 0, copied = 0;
+    uint32 *pte = paging_get_pte(page, FALSE);
+    ELF_SEGMENT *seg = NULL;
+    BOOL writable = FALSE;
+    uint8 *frame;
+
+    if (pte != NULL && (*pte & PAGE_PRESENT))
+        return FALSE;
+    // the linker may let the end of one segment share a page with the start of the next
+    for (uint32 i = 0; i < g_image.count; i++) {
+        if (page < g_image.segments[i].end && g_image.segments[i].start <= page) {
+            seg = &g_image.segments[i];
+            writable |= seg->write;
+            covering++;
+        }
+    }
+    if (seg == NULL || (write && !writable))
+        return FALSE;
+
+    // vaddr and offset share the page offset, so such a page is one page of the file
+    if (covering == 1 && !writable && seg->vaddr <= page && page + PAGE_SIZE <= seg->vaddr + seg->filesz) {
+        CachedPage *cached = page_cache_get(g_image.file->id, (seg->offset + page - seg->vaddr) / PAGE_SIZE);
+        if (cached == NULL || paging_map_page(page, (uint32)cached->data, PAGE_USER) < 0)
+            return FALSE;
+        page_cache_map(cached);
+        g_image.shared_pages++;
+        return TRUE;
+    }
+
+    frame = pmm_alloc_page();
+    if (frame == NULL)
+        return FALSE;
+    memset(frame, 0, PAGE_SIZE);
+    for (uint32 i = 0; i < g_image.count; i++) {
+        if (page < g_image.segments[i].end && g_image.segments[i].start <= page) {
+            int n = segment_copy(&g_image.segments[i], page, frame);
+            if (n < 0) {
+                pmm_free_page(frame);
+                return FALSE;
+            }
+            copied += n;
+        }
+    }
+    if (copied > 0)
+        g_image.file_pages++;
+    else
+        g_image.zero_pages++;
+    if (paging_map_page(page, (uint32)frame, PAGE_USER | (writable ? PAGE_WRITE : 0)) < 0) {
+        pmm_free_page(frame);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// TRUE if the calling thread is the running program
+static BOOL elf_caller() {
+    return g_image.used && g_image.thread != NULL && g_image.thread == thread_current();
+}
+
+/**
+ * note that the running program opened or closed a channel, calls from
+ * other threads are ignored
+ */
+void elf_note_channel(int id, BOOL open) {
+    if (!elf_caller() || id < 0 || id >= IPC_MAX_CHANNELS)
+        return;
+    if (open)
+        g_image.channels |= 1U << id;
+    else
+        g_image.channels &= ~(1U << id);
+}
+
+/**
+ * TRUE if the caller is the running program and has channel id open
+ */
+BOOL elf_has_channel(int id) {
+    return elf_caller() && id >= 0 && id < IPC_MAX_CHANNELS && (g_image.channels & (1U << id));
+}
+
+/**
+ * note count pages the running program received at addr, calls from other
+ * threads are ignored
+ */
+void elf_note_pages(uint32 addr, uint32 count) {
+    uint32 end = addr + count * PAGE_SIZE;
+    ELF_RANGE *range;
+
+    if (!elf_caller() || count == 0)
+        return;
+    for (uint32 i = 0; i < g_image.received_count; i++) {
+        range = &g_image.received[i];
+        if (addr <= range->end && range->start <= end) {
+            range->start = addr < range->start ? addr : range->start;
+            range->end = end > range->end ? end : range->end;
+            return;
+        }
+    }
+    if (g_image.received_count < ELF_MAX_RECEIVED) {
+        range = &g_image.received[g_image.received_count++];
+        range->start = addr;
+        range->end = end;
+        return;
+    }
+    // out of ranges, the last one grows to cover both, elf_release() only frees what is mapped
+    range = &g_image.received[ELF_MAX_RECEIVED - 1];
+    range->start = addr < range->start ? addr : range->start;
+    range->end = end > range->end ? end : range->end;
+}
+
+// unmap the page at addr and give its frame back, page cache frames are only unmapped
+static void elf_release_page(uint32 page) {
+    uint32 *pte = paging_get_pte(page, FALSE);
+    uint8 *frame;
+    CachedPage *cached;
+
+    if (pte == NULL || !(*pte & PAGE_PRESENT))
+        return;
+    frame = (uint8 *)(*pte & PAGE_MASK);
+    cached = page_cache_find_frame(frame);
+    paging_unmap_page(page);
+    if (cached != NULL)
+        page_cache_unmap(cached);
+    else
+        pmm_free_page(frame);
+}
+
+// unmap every page the program touched or received, close the channels it
+// left open and close its file
+static void elf_release() {
+    user_set_pager(NULL);
+    for (uint32 i = 0; i < g_image.count; i++) {
+        for (uint32 page = g_image.segments[i].start; page < g_image.segments[i].end; page += PAGE_SIZE)
+            elf_release_page(page);
+    }
+    // received pages inside a segment went with it, the time page is shared
+    for (uint32 i = 0; i < g_image.received_count; i++) {
+        for (uint32 page = g_image.received[i].start; page < g_image.received[i].end; page += PAGE_SIZE) {
+            if (page != USER_TIME_PAGE)
+                elf_release_page(page);
+        }
+    }
+    // with the program gone nobody can be blocked on them
+    for (int id = 0; id < IPC_MAX_CHANNELS; id++) {
+        if (g_image.channels & (1U << id))
+            ipc_channel_destroy(id);
+    }
+    vfs_close(g_image.file);
+    g_image.used = FALSE;
+}
+
+// read and check the headers, describe the PT_LOAD segments
+static const char *elf_load(VfsFile *file) {
+    ELF_HEADER header;
+    ELF_PROGRAM_HEADER ph;
+
+    if (vfs_read(file, 0, &header, sizeof(header)) != sizeof(header) || header.magic != ELF_MAGIC)
+        return "not an ELF file";
+    if (header.class != ELF_CLASS_32 || header.data != ELF_DATA_LSB ||
+        header.type != ELF_TYPE_EXEC || header.machine != ELF_MACHINE_386)
+        return "not an ELF32 i386 executable";
+    if (header.phentsize < sizeof(ph) || header.phnum > ELF_MAX_SEGMENTS)
+        return "bad program headers";
+
+    g_image.count = 0;
+    for (uint32 i = 0; i < header.phnum; i++) {
+        ELF_SEGMENT *seg = &g_image.segments[g_image.count];
+
+        if (vfs_read(file, header.phoff + i * header.phentsize, &ph, sizeof(ph)) != sizeof(ph))
+            return "truncated program headers";
+        if (ph.type != ELF_PT_LOAD || ph.memsz == 0)
+            continue;
+        if (ph.filesz > ph.memsz || (ph.vaddr ^ ph.offset) % PAGE_SIZE != 0 ||
+            ph.vaddr < USER_BASE || ph.vaddr >= USER_TIME_PAGE || ph.memsz > USER_TIME_PAGE - ph.vaddr)
+            return "segment outside the user window";
+        seg->start = ph.vaddr & PAGE_MASK;
+        seg->end = (ph.vaddr + ph.memsz + PAGE_SIZE - 1) & PAGE_MASK;
+        seg->vaddr = ph.vaddr;
+        seg->filesz = ph.filesz;
+        seg->offset = ph.offset;
+        seg->write = (ph.flags & ELF_PF_W) ? TRUE : FALSE;
+        g_image.count++;
+    }
+    if (segment_find(header.entry) == NULL)
+        return "entry point outside the program";
+
+    // the stack is a zero filled segment, the page below it stays unmapped
+    g_image.segments[g_image.count].start = USER_STACK_TOP - USER_STACK_SIZE;
+    g_image.segments[g_image.count].end = USER_STACK_TOP;
+    g_image.segments[g_image.count].vaddr = USER_STACK_TOP;
+    g_image.segments[g_image.count].filesz = 0;
+    g_image.segments[g_image.count].offset = 0;
+    g_image.segments[g_image.count].write = TRUE;
+    g_image.count++;
+    g_image.entry = header.entry;
+    return NULL;
+}
+
+// copy the argument strings to the top of the stack below argc, argv and an
+// empty environment like the i386 System V ABI, returns the initial stack pointer
+static uint32 elf_push_args(int argc, char **argv) {
+    uint32 sp = USER_STACK_TOP, pointers[ELF_MAX_ARGS];
+    uint32 *stack;
+
+    for (int i = argc - 1; i >= 0; i--) {
+        uint32 len = strlen(argv[i]) + 1;
+        sp -= len;
+        memcpy((void *)sp, argv[i], len);
+        pointers[i] = sp;
+    }
+    // argc, argv[], NULL, envp NULL, auxv AT_NULL pair, 16 byte aligned at argc
+    sp = (sp - (argc + 5) * sizeof(uint32)) & ~0xF;
+    stack = (uint32 *)sp;
+    *stack++ = argc;
+    for (int i = 0; i < argc; i++)
+        *stack++ = pointers[i];
+    *stack++ = 0;
+    *stack++ = 0;
+    *stack++ = 0;
+    *stack = 0;
+    return sp;
+}
+
+static void elf_thread(void *arg) {
+    g_image.thread = thread_current();
+    user_enter(g_image.entry, (uint32)arg);
+}
+
+/**
+ * run the program at path in ring 3 with argv and wait until it ends,
+ * argv[0] is the path, returns FALSE with a message when it cannot be loaded
+ */
+BOOL elf_exec(const char *path, int argc, char **argv) {
+    const char *error;
+    THREAD *thread;
+    uint32 sp;
+
+    if (g_image.used) {
+        printf("exec: another program is running\n");
+        return FALSE;
+    }
+    if (argc > ELF_MAX_ARGS) {
+        printf("exec: more than %d arguments\n", ELF_MAX_ARGS);
+        return FALSE;
+    }
+    memset(&g_image, 0, sizeof(g_image));
+    g_image.file = vfs_open(path);
+    if (g_image.file == NULL) {
+        printf("exec: '%s' not found\n", path);
+        return FALSE;
+    }
+    g_image.used = TRUE;
+    error = elf_load(g_image.file);
+    if (error != NULL) {
+        printf("exec: %s: %s\n", path, error);
+        elf_release();
+        return FALSE;
+    }
+    user_set_pager(elf_pager);
+    sp = elf_push_args(argc, argv);
+    // the page cache is not SMP safe, faults have to come in on the boot CPU
+    thread = thread_spawn_on(argv[0], elf_thread, (void *)sp, SMP_BOOT_CPU);
+    if (thread == NULL) {
+        printf("exec: out of threads or memory\n");
+        elf_release();
+        return FALSE;
+    }
+    thread_join(thread->id);
+    printf("[%s: %d pages shared with the page cache, %d copied from the file, %d zero filled]\n",
+           path, g_image.shared_pages, g_image.file_pages, g_image.zero_pages);
+    elf_release();
+    return TRUE;
+}
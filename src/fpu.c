@@ -0,0 +1,235 @@
+/**
+ * x87 FPU and SSE state with lazy switching
+ * CR0.TS clear means the registers belong to the running thread and may hold
+ * changes not saved yet, so thread_switch() saves them, with TS set every saved
+ * state is current and a CPU's fpu_owner tells whose registers it still holds,
+ * the Device Not Available handler skips the restore when that is the thread
+ * trapping and it did not run on another CPU meanwhile
+ */
+
+#include "fpu.h"
+#include "thread.h"
+#include "smp.h"
+#include "isr.h"
+#include "cpu_features.h"
+#include "console.h"
+
+#define FPU_VECTOR              7           // Device Not Available
+
+static BOOL g_enabled;
+static BOOL g_sse;
+static BOOL g_xsave;
+static uint32 g_xcr0;
+static uint32 g_state_size;
+static FPU_STATE g_init_state;              // state after fninit, loaded on a thread's first use
+
+static inline uint32 read_cr0() {
+    uint32 val;
+    asm volatile("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr0(uint32 val) {
+    asm volatile("mov %0, %%cr0" :: "r"(val) : "memory");
+}
+
+static inline uint32 read_cr4() {
+    uint32 val;
+    asm volatile("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr4(uint32 val) {
+    asm volatile("mov %0, %%cr4" :: "r"(val));
+}
+
+static inline void xsetbv(uint32 xcr, uint64 value) {
+    asm volatile("xsetbv" :: "c"(xcr), "a"((uint32)value), "d"((uint32)(value >> 32)));
+}
+
+static inline void clts() {
+    asm volatile("clts" ::: "memory");
+}
+
+static void fpu_save(FPU_STATE *state) {
+    if (g_xsave)
+        asm volatile("xsave %0" : "=m"(*state) : "a"(g_xcr0), "d"(0) : "memory");
+    else
+        asm volatile("fxsave %0" : "=m"(*state) :: "memory");
+}
+
+static void fpu_restore(const FPU_STATE *state) {
+    if (g_xsave)
+        asm volatile("xrstor %0" :: "m"(*state), "a"(g_xcr0), "d"(0) : "memory");
+    else
+        asm volatile("fxrstor %0" :: "m"(*state) : "memory");
+}
+
+// fresh x87 and SSE control words
+static void fpu_reset() {
+    uint32 mxcsr = FPU_MXCSR_DEFAULT;
+
+    asm volatile("fninit");
+    if (g_sse)
+        asm volatile("ldmxcsr %0" :: "m"(mxcsr));
+}
+
+// enable the FPU, FXSAVE and the XSAVE features in g_xcr0 on the calling CPU, TS stays set
+static void fpu_setup_cpu() {
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT | (g_xsave ? CR4_OSXSAVE : 0));
+    if (g_xsave)
+        xsetbv(0, g_xcr0);
+}
+
+// first FPU instruction since CR0.TS was set, being called with interrupts disabled
+static void fpu_trap(REGISTERS *reg) {
+    CPU *cpu = cpu_self();
+    THREAD *thread = cpu->current;
+
+    (void)reg;
+    clts();
+    cpu->fpu_traps++;
+    // before thread_init() or still holding the thread's registers
+    if (thread == NULL || (cpu->fpu_owner == thread && thread->fpu_cpu == cpu->index))
+        return;
+    fpu_restore(thread->fpu_used ? &thread->fpu : &g_init_state);
+    thread->fpu_used = TRUE;
+    thread->fpu_cpu = cpu->index;
+    cpu->fpu_owner = thread;
+}
+
+/**
+ * detect the FPU, enable SSE and lazy switching on the boot CPU, called after idt_init()
+ */
+void fpu_init() {
+    uint32 eax, ebx, ecx, edx;
+
+    if (!cpu_has(CPU_FEATURE_FPU) || !cpu_has(CPU_FEATURE_FXSR)) {
+        printf("[FPU] no FXSAVE, FPU and SSE stay off\n");
+        return;
+    }
+    g_sse = cpu_has(CPU_FEATURE_SSE);
+    g_xsave = cpu_has(CPU_FEATURE_XSAVE);
+    g_xcr0 = XCR0_X87 | XCR0_SSE | (cpu_has(CPU_FEATURE_AVX) ? XCR0_AVX : 0);
+    g_state_size = 512;
+
+    fpu_setup_cpu();
+    if (g_xsave) {
+        // leaf 0xD reports the image size for the features enabled in XCR0 right now
+        cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+        if (ebx > FPU_STATE_SIZE && (g_xcr0 & XCR0_AVX)) {
+            g_xcr0 &= ~XCR0_AVX;
+            xsetbv(0, g_xcr0);
+            cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+        }
+        if (ebx > FPU_STATE_SIZE) {
+            g_xsave = FALSE;
+            write_cr4(read_cr4() & ~CR4_OSXSAVE);
+        } else {
+            g_state_size = ebx;
+        }
+    }
+
+    clts();
+    fpu_reset();
+    fpu_save(&g_init_state);
+    write_cr0(read_cr0() | CR0_TS);
+
+    isr_register_interrupt_handler(FPU_VECTOR, fpu_trap);
+    g_enabled = TRUE;
+    printf("[FPU] %s%s, %d byte state, lazy switching\n", g_xsave ? "XSAVE" : "FXSAVE",
+           (g_xcr0 & XCR0_AVX) && g_xsave ? " with AVX" : g_sse ? " with SSE" : "", g_state_size);
+}
+
+/**
+ * set up the control registers of the calling CPU like fpu_init() did on the boot CPU
+ */
+void fpu_init_cpu() {
+    if (!g_enabled)
+        return;
+    fpu_setup_cpu();
+}
+
+/**
+ * TRUE once FXSAVE based switching is on, SSE instructions may be used when fpu_has_sse()
+ */
+BOOL fpu_enabled() {
+    return g_enabled;
+}
+
+BOOL fpu_has_sse() {
+    return g_enabled && g_sse;
+}
+
+/**
+ * save the registers of prev if it used the FPU since it was switched in
+ * and set CR0.TS, being called from thread_switch() with interrupts disabled
+ */
+void fpu_switch(CPU *cpu, THREAD *prev) {
+    uint32 cr0;
+
+    if (!g_enabled)
+        return;
+    cr0 = read_cr0();
+    if (cr0 & CR0_TS)
+        return;
+    // the registers stay loaded, prev gets them back without a restore if nobody else uses them
+    if (prev->state != THREAD_DEAD) {
+        fpu_save(&prev->fpu);
+        cpu->fpu_saves++;
+    } else {
+        cpu->fpu_owner = NULL;
+    }
+    write_cr0(cr0 | CR0_TS);
+}
+
+/**
+ * let the kernel use FPU and SSE registers until kernel_fpu_end(), the state of
+ * the current thread is saved first, the thread is not switched out in between
+ * and must not block, not for interrupt handlers
+ */
+void kernel_fpu_begin() {
+    uint32 flags = irq_save();
+    CPU *cpu = cpu_self();
+
+    if (cpu->fpu_nesting++ == 0 && g_enabled) {
+        if (!(read_cr0() & CR0_TS) && cpu->current != NULL) {
+            fpu_save(&cpu->current->fpu);
+            cpu->fpu_saves++;
+        }
+        clts();
+        cpu->fpu_owner = NULL;
+        fpu_reset();
+    }
+    irq_restore(flags);
+}
+
+/**
+ * end a kernel_fpu_begin() section, the thread gets its registers back on its next FPU instruction
+ */
+void kernel_fpu_end() {
+    uint32 flags = irq_save();
+    CPU *cpu = cpu_self();
+
+    if (--cpu->fpu_nesting == 0 && g_enabled)
+        write_cr0(read_cr0() | CR0_TS);
+    irq_restore(flags);
+}
+
+/**
+ * print the save mode and the per-CPU trap and save counts
+ */
+void fpu_print() {
+    if (!g_enabled) {
+        printf("FPU: off, no FXSAVE\n");
+        return;
+    }
+    printf("FPU: %s, %d byte state, SSE %s\n", g_xsave ? "XSAVE" : "FXSAVE", g_state_size, g_sse ? "on" : "off");
+    printf(" CPU     TRAPS     SAVES  OWNER\n");
+    for (uint32 i = 0; i < smp_cpu_count(); i++) {
+        CPU *cpu = smp_cpu(i);
+        THREAD *owner = cpu->fpu_owner;
+        printf("%4d  %8d  %8d  %s\n", cpu->index, cpu->fpu_traps, cpu->fpu_saves, owner ? owner->name : "-");
+    }
+}
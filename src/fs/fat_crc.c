@@ -0,0 +1,117 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "console.h"
+#include "crc32c.h"
+#include "fs.h"
+#include "fat_crc.h"
+
+// Per sector state since mount
+#define CRC_UNCHECKED 0
+#define CRC_VERIFIED 1
+#define CRC_DIRTY 2 // Modified in memory, checksum is recomputed by fat_crc_seal()
+
+static uint8_t sector_state[DATA_START];
+static uint32_t stat_verified;
+static uint32_t stat_errors;
+static uint32_t stat_repaired;
+
+static FatCrcSidecar *crc_sidecar() {
+    return (FatCrcSidecar *)(fat_sector_home(0) + FAT_CRC_SIDECAR_OFFSET);
+}
+
+// Sidecar slot of a sector, -1 for sectors without a checksum
+static int crc_index(uint32_t sector) {
+    if (sector >= FAT_TABLE_START && sector < FAT_TABLE_START + FAT_SIZE) {
+        return sector - FAT_TABLE_START;
+    }
+    if (sector >= ROOT_DIR_START && sector < DATA_START) {
+        return FAT_SIZE + sector - ROOT_DIR_START;
+    }
+    return -1;
+}
+
+static uint32_t sector_crc(uint32_t sector) {
+    return crc32c(0, fat_sector_home(sector), SECTOR_SIZE);
+}
+
+// Checksum every covered sector of a volume that has none yet
+void fat_crc_format() {
+    for (uint32_t sector = 0; sector < DATA_START; sector++) {
+        sector_state[sector] = crc_index(sector) < 0 ? CRC_VERIFIED : CRC_DIRTY;
+    }
+    crc_sidecar()->magic = FAT_CRC_MAGIC;
+    fat_crc_seal();
+}
+
+void fat_crc_mount() {
+    memset(sector_state, CRC_UNCHECKED, sizeof(sector_state));
+    if (crc_sidecar()->magic != FAT_CRC_MAGIC) {
+        printf("FAT: volume has no checksums, creating them\n");
+        fat_crc_format();
+    }
+}
+
+// Verify a sector on its first load after mount
+void fat_crc_check(uint32_t sector) {
+    int index = crc_index(sector);
+    uint32_t expected;
+
+    if (index < 0 || sector_state[sector] != CRC_UNCHECKED) {
+        return;
+    }
+    sector_state[sector] = CRC_VERIFIED;
+    stat_verified++;
+    expected = crc_sidecar()->crc[index];
+    if (sector_crc(sector) == expected) {
+        return;
+    }
+    if (index < FAT_SIZE && sector_crc(sector + FAT_SIZE) == expected) {
+        memcpy(fat_sector_home(sector), fat_sector_home(sector + FAT_SIZE), SECTOR_SIZE);
+        printf("FAT: sector %d failed its checksum, restored from the second FAT\n", sector);
+        stat_repaired++;
+        return;
+    }
+    printf("FAT: sector %d failed its checksum\n", sector);
+    stat_errors++;
+}
+
+void fat_crc_dirty(uint32_t sector) {
+    if (crc_index(sector) >= 0) {
+        sector_state[sector] = CRC_DIRTY;
+    }
+}
+
+void fat_crc_seal() {
+    FatCrcSidecar *sidecar = crc_sidecar();
+
+    for (uint32_t sector = 0; sector < DATA_START; sector++) {
+        if (sector_state[sector] != CRC_DIRTY) {
+            continue;
+        }
+        int index = crc_index(sector);
+        sidecar->crc[index] = sector_crc(sector);
+        if (index < FAT_SIZE) {
+            memcpy(fat_sector_home(sector + FAT_SIZE), fat_sector_home(sector), SECTOR_SIZE);
+        }
+        sector_state[sector] = CRC_VERIFIED;
+    }
+}
+
+// Re-verify every covered sector, returns the number of sectors that could not be repaired
+int fat_crc_verify_all() {
+    uint32_t errors = stat_errors;
+
+    for (uint32_t sector = 0; sector < DATA_START; sector++) {
+        if (sector_state[sector] == CRC_VERIFIED) {
+            sector_state[sector] = CRC_UNCHECKED;
+        }
+        fat_crc_check(sector);
+    }
+    return stat_errors - errors;
+}
+
+void fat_crc_stats() {
+    printf("%d sector loads verified, %d checksum errors, %d repaired from the second FAT\n",
+           stat_verified, stat_errors, stat_repaired);
+}
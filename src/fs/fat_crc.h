@@ -0,0 +1,29 @@
+#ifndef FAT_CRC_H
+#define FAT_CRC_H
+
+#include <stdint.h>
+#include "fs.h"
+
+// CRC32C of every FAT and root directory sector, kept in a sidecar in the boot sector.
+// A sector is verified the first time it is loaded after mount and resealed after the
+// operation that modified it. FAT sectors are mirrored to the second FAT on seal so a
+// sector that fails its checksum can be restored from there.
+#define FAT_CRC_MAGIC 0x43524346 // "FCRC"
+#define FAT_CRC_SIDECAR_OFFSET 0x50 // Sidecar location in the boot sector, after FatLogSuper
+#define FAT_CRC_SECTORS (FAT_SIZE + ROOT_DIR_SIZE)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t crc[FAT_CRC_SECTORS]; // First FAT, then the root directory
+} FatCrcSidecar;
+
+//FUNCS
+void fat_crc_format();
+void fat_crc_mount();
+void fat_crc_check(uint32_t sector);
+void fat_crc_dirty(uint32_t sector);
+void fat_crc_seal();
+int fat_crc_verify_all();
+void fat_crc_stats();
+
+#endif
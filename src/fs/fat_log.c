@@ -0,0 +1,282 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "console.h"
+#include "fs.h"
+#include "fat_log.h"
+#include "fat_crc.h"
+#include "crc32c.h"
+#include "isr.h"
+
+#define NO_TRANSACTION 0xFFFFFFFF
+#define LOG_FIRST_CLUSTER (FAT_SECTOR_COUNT - FAT_LOG_SECTORS - DATA_START + 2)
+
+static int log_active;
+static uint32_t log_start;
+static uint32_t log_length;
+static uint32_t log_head; // Next free slot
+static uint32_t log_sequence; // Sequence number of the next transaction
+static uint32_t txn_desc = NO_TRANSACTION; // Descriptor slot of the open transaction
+static uint32_t txn_depth;
+static uint16_t log_map[FAT_SECTOR_COUNT]; // Slot + 1 of the newest copy of a sector, 0 when home is current
+
+static uint32_t stat_transactions;
+static uint32_t stat_sectors;
+static uint32_t stat_checkpoints;
+static uint32_t stat_replayed;
+
+static FatLogSuper *log_super() {
+    return (FatLogSuper *)(fat_sector_home(0) + FAT_LOG_SUPER_OFFSET);
+}
+
+static uint8_t *log_slot(uint32_t slot) {
+    return fat_sector_home(log_start + slot);
+}
+
+static FatLogRecord *log_record(uint32_t slot) {
+    return (FatLogRecord *)log_slot(slot);
+}
+
+// CRC32C over count slots
+static uint32_t log_checksum(uint32_t first, uint32_t count) {
+    uint32_t crc = 0;
+
+    for (uint32_t slot = first; slot < first + count; slot++) {
+        crc = crc32c(crc, log_slot(slot), SECTOR_SIZE);
+    }
+    return crc;
+}
+
+static void log_open_transaction() {
+    FatLogRecord *desc = log_record(log_head);
+
+    memset(desc, 0, SECTOR_SIZE);
+    desc->magic = FAT_LOG_DESC_MAGIC;
+    desc->sequence = log_sequence;
+    txn_desc = log_head++;
+}
+
+static void log_commit_transaction() {
+    FatLogRecord *desc, *commit;
+
+    if (txn_desc == NO_TRANSACTION) {
+        return;
+    }
+    desc = log_record(txn_desc);
+    commit = log_record(log_head);
+    memset(commit, 0, SECTOR_SIZE);
+    commit->magic = FAT_LOG_COMMIT_MAGIC;
+    commit->sequence = desc->sequence;
+    commit->count = desc->count;
+    commit->data[0] = log_checksum(txn_desc, desc->count + 1);
+    log_head++;
+    log_sequence++;
+    txn_desc = NO_TRANSACTION;
+    stat_transactions++;
+}
+
+// Copy the newest copy of every logged sector home, in sector order, then start a new log
+static void log_apply() {
+    for (uint32_t sector = 0; sector < FAT_SECTOR_COUNT; sector++) {
+        if (log_map[sector]) {
+            memcpy(fat_sector_home(sector), log_slot(log_map[sector] - 1), SECTOR_SIZE);
+            fat_crc_dirty(sector);
+            log_map[sector] = 0;
+        }
+    }
+    fat_crc_seal();
+    log_super()->sequence = log_sequence;
+    log_head = 0;
+    stat_checkpoints++;
+}
+
+void fat_log_reset() {
+    log_active = 0;
+    log_head = 0;
+    txn_desc = NO_TRANSACTION;
+    txn_depth = 0;
+    memset(log_map, 0, sizeof(log_map));
+}
+
+// Replay the committed transactions written since the last checkpoint
+void fat_log_mount() {
+    FatLogSuper *super = log_super();
+    uint32_t slot = 0, replayed = 0;
+
+    fat_log_reset();
+    if (super->magic != FAT_LOG_MAGIC || super->length < 3 || super->length > FAT_LOG_SECTORS ||
+        super->start < DATA_START || super->start + super->length > FAT_SECTOR_COUNT) {
+        return;
+    }
+    log_start = super->start;
+    log_length = super->length;
+    log_sequence = super->sequence;
+
+    while (slot + 2 <= log_length) {
+        FatLogRecord *desc = log_record(slot), *commit;
+        if (desc->magic != FAT_LOG_DESC_MAGIC || desc->sequence != log_sequence ||
+            desc->count > FAT_LOG_DESC_MAX || slot + desc->count + 2 > log_length) {
+            break;
+        }
+        commit = log_record(slot + desc->count + 1);
+        if (commit->magic != FAT_LOG_COMMIT_MAGIC || commit->sequence != log_sequence ||
+            commit->count != desc->count || commit->data[0] != log_checksum(slot, desc->count + 1)) {
+            break; // Torn transaction, everything after it is discarded
+        }
+        for (uint32_t i = 0; i < desc->count; i++) {
+            uint32_t home = desc->data[i];
+            if (home > 0 && home < log_start) {
+                memcpy(fat_sector_home(home), log_slot(slot + 1 + i), SECTOR_SIZE);
+                fat_crc_dirty(home);
+            }
+        }
+        slot += desc->count + 2;
+        log_sequence++;
+        replayed++;
+    }
+
+    fat_crc_seal();
+    super->sequence = log_sequence;
+    log_active = 1;
+    stat_replayed += replayed;
+    if (replayed > 0) {
+        printf("FAT log: replayed %d transactions\n", replayed);
+    }
+}
+
+int fat_log_enable() {
+    FatLogSuper *super = log_super();
+
+    if (log_active) {
+        return 0;
+    }
+    for (uint16_t cluster = LOG_FIRST_CLUSTER; cluster < DATA_CLUSTER_COUNT + 2; cluster++) {
+        if (get_fat_entry(cluster) != 0x000) {
+            return -1;
+        }
+    }
+    for (uint16_t cluster = LOG_FIRST_CLUSTER; cluster < DATA_CLUSTER_COUNT + 2; cluster++) {
+        set_fat(cluster, 0xFF7); // Bad cluster, keeps the segment out of allocation
+    }
+
+    log_start = FAT_SECTOR_COUNT - FAT_LOG_SECTORS;
+    log_length = FAT_LOG_SECTORS;
+    log_sequence = 1;
+    memset(log_slot(0), 0, SECTOR_SIZE); // Records of an earlier log must not replay
+    super->magic = FAT_LOG_MAGIC;
+    super->start = log_start;
+    super->length = log_length;
+    super->sequence = log_sequence;
+    log_active = 1;
+    fat_crc_seal();
+    return 0;
+}
+
+int fat_log_disable() {
+    if (!log_active) {
+        return 0;
+    }
+    if (fat_log_checkpoint() < 0) {
+        return -1;
+    }
+    log_active = 0;
+    log_super()->magic = 0;
+    for (uint16_t cluster = LOG_FIRST_CLUSTER; cluster < DATA_CLUSTER_COUNT + 2; cluster++) {
+        set_fat(cluster, 0x000);
+    }
+    fat_crc_seal();
+    return 0;
+}
+
+int fat_log_active() {
+    return log_active;
+}
+
+void fat_log_begin() {
+    txn_depth++;
+}
+
+void fat_log_commit() {
+    if (txn_depth == 0 || --txn_depth > 0) {
+        return;
+    }
+    if (log_active) {
+        log_commit_transaction();
+        if (log_head >= FAT_LOG_CHECKPOINT_MARK) {
+            log_apply();
+        }
+    }
+    fat_crc_seal();
+}
+
+int fat_log_checkpoint() {
+    if (!log_active) {
+        return 0;
+    }
+    if (txn_depth > 0) {
+        return -1;
+    }
+    if (log_head == 0) {
+        return 0;
+    }
+    log_commit_transaction();
+    log_apply();
+    return 0;
+}
+
+// Checkpoint from a background thread, skipped while a foreground operation is open
+int fat_log_background_checkpoint() {
+    uint32 flags = irq_save();
+    int result = fat_log_checkpoint();
+    irq_restore(flags);
+    return result;
+}
+
+uint8_t *fat_log_lookup(uint32_t sector) {
+    if (!log_active || log_map[sector] == 0) {
+        return NULL;
+    }
+    return log_slot(log_map[sector] - 1);
+}
+
+uint8_t *fat_log_update(uint32_t sector) {
+    FatLogRecord *desc;
+    uint32_t slot;
+
+    if (!log_active || sector == 0) {
+        return NULL;
+    }
+    if (txn_desc != NO_TRANSACTION && log_map[sector] > txn_desc + 1) {
+        return log_slot(log_map[sector] - 1); // Already copied in this transaction
+    }
+
+    // Keep room for the commit record, split operations that do not fit
+    if (txn_desc != NO_TRANSACTION &&
+        (log_record(txn_desc)->count == FAT_LOG_DESC_MAX || log_head + 2 > log_length)) {
+        log_commit_transaction();
+    }
+    if (txn_desc == NO_TRANSACTION) {
+        if (log_head + 3 > log_length) {
+            log_apply();
+        }
+        log_open_transaction();
+    }
+
+    desc = log_record(txn_desc);
+    slot = log_head++;
+    memcpy(log_slot(slot), fat_sector_read(sector), SECTOR_SIZE);
+    desc->data[desc->count++] = sector;
+    log_map[sector] = slot + 1;
+    stat_sectors++;
+    return log_slot(slot);
+}
+
+void fat_log_stats() {
+    if (!log_active) {
+        printf("FAT log: off\n");
+    } else {
+        printf("FAT log: on, %d of %d sectors used\n", log_head, log_length);
+    }
+    printf("%d transactions, %d sectors logged, %d checkpoints, %d replayed\n",
+           stat_transactions, stat_sectors, stat_checkpoints, stat_replayed);
+}
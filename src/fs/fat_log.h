@@ -0,0 +1,49 @@
+#ifndef FAT_LOG_H
+#define FAT_LOG_H
+
+#include <stdint.h>
+#include "fs.h"
+
+// Log mode turns every volume update into an append to a log segment at the end of the
+// data area. Each transaction is a descriptor sector listing the home sectors, copies of
+// those sectors, then a commit sector. Checkpoints copy the newest copies home in sector
+// order, mount replays committed transactions that were not checkpointed yet.
+#define FAT_LOG_MAGIC 0x474F4C46 // "FLOG", FatLogSuper
+#define FAT_LOG_DESC_MAGIC 0x43534544 // "DESC"
+#define FAT_LOG_COMMIT_MAGIC 0x54494D43 // "CMIT"
+#define FAT_LOG_SECTORS 256 // Log segment size, taken from the last data clusters
+#define FAT_LOG_SUPER_OFFSET 0x40 // FatLogSuper location in the boot sector
+#define FAT_LOG_DESC_MAX ((SECTOR_SIZE - 12) / sizeof(uint32_t)) // Sectors per transaction
+#define FAT_LOG_CHECKPOINT_MARK (FAT_LOG_SECTORS * 3 / 4) // Checkpoint once the log is this full
+
+typedef struct {
+    uint32_t magic;
+    uint32_t start; // First sector of the log segment
+    uint32_t length; // Sectors in the log segment
+    uint32_t sequence; // Sequence number of the first transaction after the last checkpoint
+} FatLogSuper;
+
+typedef struct {
+    uint32_t magic; // FAT_LOG_DESC_MAGIC or FAT_LOG_COMMIT_MAGIC
+    uint32_t sequence;
+    uint32_t count; // Sectors in the transaction
+    uint32_t data[FAT_LOG_DESC_MAX]; // Home sectors (descriptor), data[0] is the checksum (commit)
+} FatLogRecord;
+
+//FUNCS
+void fat_log_mount();
+void fat_log_reset();
+int fat_log_enable();
+int fat_log_disable();
+int fat_log_active();
+// Brackets one file system operation, brackets nest and only the outermost commits.
+// Operations larger than the free log space are split into several transactions.
+void fat_log_begin();
+void fat_log_commit();
+int fat_log_checkpoint();
+int fat_log_background_checkpoint();
+uint8_t *fat_log_lookup(uint32_t sector);
+uint8_t *fat_log_update(uint32_t sector);
+void fat_log_stats();
+
+#endif
@@ -0,0 +1,443 @@
+#include <string.h>
+#include <stdint.h>
+#include "pmm.h"
+#include "lz4.h"
+#include "fs.h"
+#include "vfs.h"
+#include "page_cache.h"
+#include "fat_lz4.h"
+#include "fat_log.h"
+
+#define CHUNK_STORED_MASK 0x1FFF // FatLz4Chunk.stored without flags
+
+// Scratch pages for one compressed file operation
+typedef struct {
+    uint8_t *logical; // One uncompressed chunk
+    uint8_t *stored; // One stored chunk
+    void *workmem; // lz4_compress match table
+} Lz4Scratch;
+
+static int scratch_alloc(Lz4Scratch *scratch) {
+    scratch->logical = pmm_alloc_page();
+    scratch->stored = pmm_alloc_page();
+    scratch->workmem = pmm_alloc_page();
+    if (scratch->logical && scratch->stored && scratch->workmem) {
+        return 0;
+    }
+    return -1;
+}
+
+static void scratch_free(Lz4Scratch *scratch) {
+    pmm_free_page(scratch->logical);
+    pmm_free_page(scratch->stored);
+    pmm_free_page(scratch->workmem);
+}
+
+static uint32_t header_size(uint32_t chunk_count) {
+    return sizeof(FatLz4Header) + chunk_count * sizeof(FatLz4Chunk);
+}
+
+static uint32_t chunk_count(uint32_t size) {
+    return (size + FAT_LZ4_CHUNK_SIZE - 1) / FAT_LZ4_CHUNK_SIZE;
+}
+
+static uint32_t chunk_length(uint32_t size, uint32_t k) {
+    if (k * FAT_LZ4_CHUNK_SIZE >= size) {
+        return 0;
+    }
+    uint32_t left = size - k * FAT_LZ4_CHUNK_SIZE;
+    return left > FAT_LZ4_CHUNK_SIZE ? FAT_LZ4_CHUNK_SIZE : left;
+}
+
+static int read_header(uint16_t start, FatLz4Header *header) {
+    fat_chain_read(start, 0, header, sizeof(FatLz4Header));
+    if (header->magic != FAT_LZ4_MAGIC || header->chunk_count > FAT_LZ4_MAX_CHUNKS) {
+        return -1;
+    }
+    return 0;
+}
+
+// Index entry of chunk k, chunks past the index are holes
+static void read_index(uint16_t start, const FatLz4Header *header, uint32_t k, FatLz4Chunk *chunk) {
+    memset(chunk, 0, sizeof(FatLz4Chunk));
+    if (k < header->chunk_count) {
+        fat_chain_read(start, header_size(k), chunk, sizeof(FatLz4Chunk));
+    }
+}
+
+static int write_index(uint16_t *start, uint32_t k, const FatLz4Chunk *chunk) {
+    if (fat_chain_write(start, header_size(k), chunk, sizeof(FatLz4Chunk)) != sizeof(FatLz4Chunk)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Decompress a chunk into out, anything past the stored data reads as zeros
+static int load_chunk(const FatLz4Chunk *chunk, uint8_t *out, uint8_t *stored) {
+    uint32_t n = chunk->stored & CHUNK_STORED_MASK;
+
+    memset(out, 0, FAT_LZ4_CHUNK_SIZE);
+    if (chunk->start == 0) {
+        return 0;
+    }
+    if (n > FAT_LZ4_CHUNK_SIZE) {
+        return -1;
+    }
+    if (chunk->stored & FAT_LZ4_CHUNK_RAW) {
+        fat_chain_read(chunk->start, 0, out, n);
+        return 0;
+    }
+    fat_chain_read(chunk->start, 0, stored, n);
+    if (lz4_decompress(stored, n, out, FAT_LZ4_CHUNK_SIZE) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Compress len bytes of logical into the chunk's own chain, the clusters it has are rewritten
+// in place and those it no longer needs are freed. Fails before writing when the volume is too
+// full for the chunk to grow.
+static int store_chunk(FatLz4Chunk *chunk, const uint8_t *logical, uint32_t len, Lz4Scratch *scratch) {
+    const uint8_t *data = scratch->stored;
+    uint16_t start = chunk->start;
+    uint16_t raw = 0;
+    uint32_t n, needed, have;
+
+    // Keep the chunk raw unless compression actually saves space
+    n = len > 0 ? lz4_compress(logical, len, scratch->stored, len - 1, scratch->workmem) : 0;
+    if (n == 0) {
+        data = logical;
+        n = len;
+        raw = FAT_LZ4_CHUNK_RAW;
+    }
+
+    needed = (n + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    have = fat_chain_clusters(start);
+    if (needed > have && fat_free_clusters() < needed - have) {
+        return -1;
+    }
+    if (n > 0 && fat_chain_write(&start, 0, data, n) != (int)n) {
+        return -1;
+    }
+    fat_chain_truncate(&start, n);
+    chunk->start = start;
+    chunk->stored = n | raw;
+    return 0;
+}
+
+static void free_chunks(uint16_t start, const FatLz4Header *header) {
+    FatLz4Chunk chunk;
+
+    for (uint32_t k = 0; k < header->chunk_count; k++) {
+        read_index(start, header, k, &chunk);
+        fat_chain_free(chunk.start);
+    }
+}
+
+int fat_lz4_read(int index, uint32_t offset, void *buf, uint32_t len) {
+    DirectoryEntry *entry = fat_entry(index);
+    uint16_t start = entry->start_cluster;
+    FatLz4Header header;
+    FatLz4Chunk chunk;
+    uint8_t *dst = buf;
+    uint8_t *logical, *stored;
+    uint32_t done = 0;
+
+    if (read_header(start, &header) < 0) {
+        return -1;
+    }
+    logical = pmm_alloc_page();
+    stored = pmm_alloc_page();
+    if (logical == NULL || stored == NULL) {
+        pmm_free_page(logical);
+        pmm_free_page(stored);
+        return -1;
+    }
+
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t chunk_len = FAT_LZ4_CHUNK_SIZE - pos % FAT_LZ4_CHUNK_SIZE;
+        if (chunk_len > len - done) {
+            chunk_len = len - done;
+        }
+        read_index(start, &header, pos / FAT_LZ4_CHUNK_SIZE, &chunk);
+
+        // Whole aligned chunks (page cache fills) decompress straight into the caller's buffer
+        if (chunk_len == FAT_LZ4_CHUNK_SIZE) {
+            if (load_chunk(&chunk, dst + done, stored) < 0) {
+                break;
+            }
+        } else {
+            if (load_chunk(&chunk, logical, stored) < 0) {
+                break;
+            }
+            memcpy(dst + done, logical + pos % FAT_LZ4_CHUNK_SIZE, chunk_len);
+        }
+        done += chunk_len;
+    }
+
+    pmm_free_page(logical);
+    pmm_free_page(stored);
+    return done > 0 ? (int)done : -1;
+}
+
+int fat_lz4_write(int index, uint32_t offset, const void *buf, uint32_t len) {
+    DirectoryEntry *entry = fat_entry(index);
+    uint16_t start = entry->start_cluster;
+    uint32_t old_size = entry->size;
+    uint32_t new_size = old_size;
+    const uint8_t *src = buf;
+    FatLz4Header header;
+    FatLz4Chunk chunk;
+    Lz4Scratch scratch;
+    uint32_t done = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (offset + len < offset || read_header(start, &header) < 0) {
+        return -1;
+    }
+    if (offset + len > new_size) {
+        new_size = offset + len;
+    }
+    if (chunk_count(new_size) > FAT_LZ4_MAX_CHUNKS) {
+        return -1;
+    }
+    if (scratch_alloc(&scratch) < 0) {
+        scratch_free(&scratch);
+        return -1;
+    }
+
+    // Chunks the file grows by start out as holes
+    if (chunk_count(new_size) > header.chunk_count) {
+        uint32_t grow = chunk_count(new_size) - header.chunk_count;
+        memset(scratch.stored, 0, grow * sizeof(FatLz4Chunk));
+        if (fat_chain_write(&start, header_size(header.chunk_count), scratch.stored,
+                            grow * sizeof(FatLz4Chunk)) != (int)(grow * sizeof(FatLz4Chunk))) {
+            scratch_free(&scratch);
+            return -1;
+        }
+        header.chunk_count += grow;
+        header.stored_size += grow * sizeof(FatLz4Chunk);
+    }
+
+    // Data left past a truncation must not come back when the file grows again, chunks between
+    // the old end and the chunk the write starts in are cut at the old end or become holes
+    for (uint32_t k = old_size / FAT_LZ4_CHUNK_SIZE; (k + 1) * FAT_LZ4_CHUNK_SIZE <= offset && k < header.chunk_count; k++) {
+        uint32_t chunk_start = k * FAT_LZ4_CHUNK_SIZE;
+        uint32_t old_stored;
+
+        read_index(start, &header, k, &chunk);
+        if (chunk.start == 0) {
+            continue;
+        }
+        old_stored = chunk.stored & CHUNK_STORED_MASK;
+        if (chunk_start < old_size) {
+            if (load_chunk(&chunk, scratch.logical, scratch.stored) < 0) {
+                break;
+            }
+            memset(scratch.logical + (old_size - chunk_start), 0, FAT_LZ4_CHUNK_SIZE - (old_size - chunk_start));
+            if (store_chunk(&chunk, scratch.logical, FAT_LZ4_CHUNK_SIZE, &scratch) < 0) {
+                break;
+            }
+        } else {
+            fat_chain_free(chunk.start);
+            memset(&chunk, 0, sizeof(chunk));
+        }
+        write_index(&start, k, &chunk);
+        header.stored_size += (chunk.stored & CHUNK_STORED_MASK) - old_stored;
+    }
+
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t k = pos / FAT_LZ4_CHUNK_SIZE;
+        uint32_t chunk_start = k * FAT_LZ4_CHUNK_SIZE;
+        uint32_t from = pos - chunk_start;
+        uint32_t clen = chunk_length(new_size, k);
+        uint32_t n = clen - from;
+        uint32_t old_stored;
+
+        if (n > len - done) {
+            n = len - done;
+        }
+        read_index(start, &header, k, &chunk);
+        old_stored = chunk.stored & CHUNK_STORED_MASK;
+
+        // A chunk written whole needs none of its old data
+        if (from != 0 || n != clen) {
+            if (load_chunk(&chunk, scratch.logical, scratch.stored) < 0) {
+                break;
+            }
+            if (old_size < chunk_start + FAT_LZ4_CHUNK_SIZE) {
+                uint32_t keep = old_size > chunk_start ? old_size - chunk_start : 0;
+                memset(scratch.logical + keep, 0, FAT_LZ4_CHUNK_SIZE - keep);
+            }
+        }
+        memcpy(scratch.logical + from, src + done, n);
+        if (store_chunk(&chunk, scratch.logical, clen, &scratch) < 0 || write_index(&start, k, &chunk) < 0) {
+            break;
+        }
+        header.stored_size += (chunk.stored & CHUNK_STORED_MASK) - old_stored;
+        done += n;
+    }
+
+    if (offset + done > old_size) {
+        new_size = offset + done;
+    } else {
+        new_size = old_size;
+    }
+    header.size = new_size;
+    fat_chain_write(&start, 0, &header, sizeof(header));
+    if (new_size != old_size || start != fat_entry(index)->start_cluster) {
+        entry = fat_entry_update(index);
+        entry->start_cluster = start;
+        entry->size = new_size;
+    }
+    scratch_free(&scratch);
+    return done > 0 ? (int)done : -1;
+}
+
+void fat_lz4_free_chunks(int index) {
+    FatLz4Header header;
+    uint16_t start = fat_entry(index)->start_cluster;
+
+    if (read_header(start, &header) == 0) {
+        free_chunks(start, &header);
+    }
+}
+
+// Build the header chain and one chain per chunk from the plain file, the plain chain is only
+// released once every chunk is stored
+static int lz4_pack(int index) {
+    DirectoryEntry *entry = fat_entry(index);
+    uint16_t old_start = entry->start_cluster;
+    uint32_t size = entry->size;
+    uint32_t chunks = chunk_count(size);
+    FatLz4Header header;
+    FatLz4Chunk chunk;
+    Lz4Scratch scratch;
+    uint16_t new_start = 0;
+
+    if (chunks > FAT_LZ4_MAX_CHUNKS) {
+        return -1;
+    }
+    if (scratch_alloc(&scratch) < 0) {
+        scratch_free(&scratch);
+        return -1;
+    }
+
+    header.magic = FAT_LZ4_MAGIC;
+    header.size = size;
+    header.chunk_count = 0;
+    header.stored_size = header_size(chunks);
+    memset(scratch.stored, 0, header_size(chunks));
+    memcpy(scratch.stored, &header, sizeof(header));
+    if (fat_chain_write(&new_start, 0, scratch.stored, header_size(chunks)) != (int)header_size(chunks)) {
+        goto fail;
+    }
+
+    for (uint32_t k = 0; k < chunks; k++) {
+        uint32_t clen = chunk_length(size, k);
+
+        memset(scratch.logical, 0, FAT_LZ4_CHUNK_SIZE);
+        fat_chain_read(old_start, k * FAT_LZ4_CHUNK_SIZE, scratch.logical, clen);
+        memset(&chunk, 0, sizeof(chunk));
+        if (store_chunk(&chunk, scratch.logical, clen, &scratch) < 0) {
+            goto fail;
+        }
+        // Counted before the index write so a failure frees this chunk too
+        header.chunk_count = k + 1;
+        if (write_index(&new_start, k, &chunk) < 0) {
+            fat_chain_free(chunk.start);
+            header.chunk_count = k;
+            goto fail;
+        }
+        header.stored_size += chunk.stored & CHUNK_STORED_MASK;
+    }
+    fat_chain_write(&new_start, 0, &header, sizeof(header));
+
+    fat_chain_free(old_start);
+    entry = fat_entry_update(index);
+    entry->start_cluster = new_start;
+    entry->flags |= FAT_ENTRY_COMPRESSED;
+    scratch_free(&scratch);
+    return 0;
+
+fail:
+    free_chunks(new_start, &header);
+    fat_chain_free(new_start);
+    scratch_free(&scratch);
+    return -1;
+}
+
+int fat_lz4_compress(int index) {
+    DirectoryEntry *entry = fat_entry(index);
+    int result;
+
+    if (entry->flags & FAT_ENTRY_COMPRESSED) {
+        return 0;
+    }
+    page_cache_sync(VFS_FILE_ID(VFS_BACKEND_FAT, index));
+    fat_log_begin();
+    result = lz4_pack(index);
+    fat_log_commit();
+    return result;
+}
+
+int fat_lz4_decompress(int index) {
+    DirectoryEntry *entry = fat_entry(index);
+    FatLz4Header header;
+    FatLz4Chunk chunk;
+    uint8_t *logical, *stored;
+    uint16_t old_start = entry->start_cluster;
+    uint16_t new_start = 0;
+    uint32_t size = entry->size;
+    int result = 0;
+
+    if (!(entry->flags & FAT_ENTRY_COMPRESSED)) {
+        return 0;
+    }
+    page_cache_sync(VFS_FILE_ID(VFS_BACKEND_FAT, index));
+    if (read_header(old_start, &header) < 0) {
+        return -1;
+    }
+    fat_log_begin();
+    logical = pmm_alloc_page();
+    stored = pmm_alloc_page();
+    if (logical == NULL || stored == NULL) {
+        result = -1;
+    }
+
+    for (uint32_t k = 0; result == 0 && k < chunk_count(size); k++) {
+        uint32_t clen = chunk_length(size, k);
+        read_index(old_start, &header, k, &chunk);
+        if (load_chunk(&chunk, logical, stored) < 0 ||
+            fat_chain_write(&new_start, k * FAT_LZ4_CHUNK_SIZE, logical, clen) != (int)clen) {
+            result = -1;
+        }
+    }
+
+    if (result == 0) {
+        free_chunks(old_start, &header);
+        fat_chain_free(old_start);
+        entry = fat_entry_update(index);
+        entry->start_cluster = new_start;
+        entry->flags &= ~FAT_ENTRY_COMPRESSED;
+    } else {
+        fat_chain_free(new_start);
+    }
+    fat_log_commit();
+    pmm_free_page(logical);
+    pmm_free_page(stored);
+    return result;
+}
+
+uint32_t fat_lz4_stored_size(int index) {
+    FatLz4Header header;
+
+    if (read_header(fat_entry(index)->start_cluster, &header) < 0) {
+        return 0;
+    }
+    return header.stored_size;
+}
@@ -0,0 +1,36 @@
+#ifndef FAT_LZ4_H
+#define FAT_LZ4_H
+
+#include <stdint.h>
+
+// Compressed FAT files store every 4KB logical chunk as an LZ4 block in a cluster chain of its own,
+// so writing one chunk back only recompresses it and rewrites its clusters in place.
+// On disk: the file's chain holds FatLz4Header and FatLz4Chunk index[chunk_count].
+#define FAT_LZ4_MAGIC 0x43345A4C // "LZ4C"
+#define FAT_LZ4_CHUNK_SIZE 4096
+#define FAT_LZ4_CHUNK_RAW 0x8000 // FatLz4Chunk.stored flag, chunk did not compress and is stored as is
+#define FAT_LZ4_MAX_CHUNKS ((FAT_LZ4_CHUNK_SIZE - sizeof(FatLz4Header)) / sizeof(FatLz4Chunk))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size; // Logical size covered by the stored chunks
+    uint32_t chunk_count;
+    uint32_t stored_size; // Bytes stored, header, index and chunks
+} FatLz4Header;
+
+typedef struct {
+    uint16_t start; // First cluster of the chunk, 0 for a chunk never written (reads as zeros)
+    uint16_t stored; // Stored bytes, FAT_LZ4_CHUNK_RAW set when kept uncompressed
+} FatLz4Chunk;
+
+//FUNCS
+int fat_lz4_read(int index, uint32_t offset, void *buf, uint32_t len);
+// Recompresses only the chunks the range touches
+int fat_lz4_write(int index, uint32_t offset, const void *buf, uint32_t len);
+// Free the chains of the chunks, the header chain is freed with the directory entry
+void fat_lz4_free_chunks(int index);
+int fat_lz4_compress(int index);
+int fat_lz4_decompress(int index);
+uint32_t fat_lz4_stored_size(int index);
+
+#endif
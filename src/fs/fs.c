@@ -1,39 +1,86 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "console.h"
+#include "pmm.h"
+#include "rcu.h"
 #include "fs.h"
-uint16_t get_fat_entry(uint16_t cluster);
-
-#define SECTOR_SIZE 512
-#define MAX_FILENAME_LENGTH 11 // 8.3 format
-#define MAX_FILE_COUNT 224 // Maximum number of files supported in the root directory
-
-// FAT12 Disk Layout
-#define BOOT_SECTOR_SIZE 1
-#define FAT_COUNT 2
-#define FAT_SIZE 9 // Number of sectors per FAT table
-#define ROOT_DIR_SIZE 14 // Number of sectors in the root directory
-
-typedef struct {
-    char name[MAX_FILENAME_LENGTH];
-    uint8_t attr; // File attributes (read-only, hidden, system, etc.)
-    uint8_t reserved[10];
-    uint16_t time; // Last modification time
-    uint16_t date; // Last modification date
-    uint16_t start_cluster; // Starting cluster of the file
-    uint32_t size; // File size in bytes
-} DirectoryEntry;
+#include "vfs.h"
+#include "page_cache.h"
+#include "fat_lz4.h"
+#include "fat_log.h"
+#include "fat_crc.h"
 
 typedef struct {
     uint8_t boot_sector[SECTOR_SIZE];
     uint8_t fat[FAT_COUNT][FAT_SIZE * SECTOR_SIZE];
     DirectoryEntry root_directory[MAX_FILE_COUNT];
-    uint8_t data_area[2880 - (BOOT_SECTOR_SIZE + FAT_COUNT * FAT_SIZE + ROOT_DIR_SIZE)][SECTOR_SIZE];
+    uint8_t data_area[DATA_CLUSTER_COUNT][SECTOR_SIZE];
 } FAT12FileSystem;
 
 FAT12FileSystem fs;
 
+// Names of the used root directory entries, fat_lookup() reads it under RCU without going
+// through the log and CRC checks. Rebuilt and republished whenever a file is added or removed.
+typedef struct {
+    uint32_t count;
+    struct {
+        char name[MAX_FILENAME_LENGTH];
+        uint8_t index; // Root directory entry
+    } files[MAX_FILE_COUNT];
+} FatNameIndex;
+
+static FatNameIndex *fat_name_index; // NULL while there is none, lookups scan the directory
+
+static void fat_index_rebuild();
+
+uint8_t *fat_sector_home(uint32_t sector) {
+    return (uint8_t *)&fs + sector * SECTOR_SIZE;
+}
+
+uint8_t *fat_sector_read(uint32_t sector) {
+    uint8_t *logged = fat_log_lookup(sector);
+    if (logged) {
+        return logged;
+    }
+    if (sector < DATA_START) {
+        fat_crc_check(sector);
+    }
+    return fat_sector_home(sector);
+}
+
+uint8_t *fat_sector_write(uint32_t sector) {
+    uint8_t *logged = fat_log_update(sector);
+    if (logged) {
+        return logged;
+    }
+    if (sector < DATA_START) {
+        fat_crc_check(sector);
+        fat_crc_dirty(sector);
+    }
+    return fat_sector_home(sector);
+}
+
+static uint8_t *cluster_read(uint16_t cluster) {
+    return fat_sector_read(DATA_START + cluster - 2);
+}
+
+static uint8_t *cluster_write(uint16_t cluster) {
+    return fat_sector_write(DATA_START + cluster - 2);
+}
+
+static uint8_t fat_byte(uint32_t offset) {
+    return fat_sector_read(FAT_TABLE_START + offset / SECTOR_SIZE)[offset % SECTOR_SIZE];
+}
+
+static void fat_byte_set(uint32_t offset, uint8_t value) {
+    fat_sector_write(FAT_TABLE_START + offset / SECTOR_SIZE)[offset % SECTOR_SIZE] = value;
+}
+
 void initFileSystem() {
+    // A new volume starts without a log
+    fat_log_reset();
+
     // Initialize the boot sector
     memset(fs.boot_sector, 0, SECTOR_SIZE);
     fs.boot_sector[0x00] = 0xEB; // JMP instruction
@@ -49,47 +96,84 @@ void initFileSystem() {
 
     // Initialize the root directory
     memset(fs.root_directory, 0, sizeof(fs.root_directory));
+    fat_crc_format();
+
+    // Nothing cached from a previous volume is valid anymore
+    page_cache_invalidate_backend(VFS_BACKEND_FAT);
+    fat_index_rebuild();
+}
+
+// Format the volume on first use, otherwise bring it back to its last committed state
+void fat_mount() {
+    if (fs.boot_sector[0x00] != 0xEB || strncmp((char *)&fs.boot_sector[0x03], "MSDOS5.0", 8) != 0) {
+        initFileSystem();
+        return;
+    }
+    fat_crc_mount();
+    fat_log_mount();
+    fat_index_rebuild();
+}
+
+// Forget everything kept in memory about the volume and mount it again from what it holds,
+// like after a power cut: committed log transactions are replayed, an open one is lost
+void fat_remount() {
+    page_cache_invalidate_backend(VFS_BACKEND_FAT);
+    fat_mount();
 }
 
 uint16_t find_free_cluster() {
-    for (uint16_t i = 2; i < FAT_SIZE * SECTOR_SIZE * 8 / 12; i++) {
-        uint16_t value = ((fs.fat[0][i * 3 / 2 + 1] & 0x0F) << 8) | fs.fat[0][i * 3 / 2];
-        if (value == 0x000) {
+    for (uint16_t i = 2; i < DATA_CLUSTER_COUNT + 2; i++) {
+        if (get_fat_entry(i) == 0x000) {
             return i;
         }
     }
     return 0xFFFF; // No free clusters
 }
 
+uint32_t fat_free_clusters() {
+    uint32_t count = 0;
+    for (uint16_t i = 2; i < DATA_CLUSTER_COUNT + 2; i++) {
+        if (get_fat_entry(i) == 0x000) {
+            count++;
+        }
+    }
+    return count;
+}
+
 void set_fat(uint16_t cluster, uint16_t value) {
+    uint32_t offset = cluster * 3 / 2;
     if (cluster % 2 == 0) {
-        fs.fat[0][cluster * 3 / 2] = value & 0xFF;
-        fs.fat[0][cluster * 3 / 2 + 1] = (fs.fat[0][cluster * 3 / 2 + 1] & 0xF0) | ((value >> 8) & 0x0F);
+        fat_byte_set(offset, value & 0xFF);
+        fat_byte_set(offset + 1, (fat_byte(offset + 1) & 0xF0) | ((value >> 8) & 0x0F));
     } else {
-        fs.fat[0][cluster * 3 / 2] = (fs.fat[0][cluster * 3 / 2] & 0x0F) | ((value << 4) & 0xF0);
-        fs.fat[0][cluster * 3 / 2 + 1] = (value >> 4) & 0xFF;
+        fat_byte_set(offset, (fat_byte(offset) & 0x0F) | ((value << 4) & 0xF0));
+        fat_byte_set(offset + 1, (value >> 4) & 0xFF);
     }
 }
 
 void createFile(char *name, char *content) {
     for (int i = 0; i < MAX_FILE_COUNT; i++) {
-        if (fs.root_directory[i].name[0] == 0) { // Find an empty directory entry
-            strncpy(fs.root_directory[i].name, name, MAX_FILENAME_LENGTH);
-            fs.root_directory[i].attr = 0x20; // Regular file
-
+        if (fat_entry(i)->name[0] == 0) { // Find an empty directory entry
             uint16_t free_cluster = find_free_cluster();
             if (free_cluster == 0xFFFF) {
                 printf("No free clusters.\n");
                 return;
             }
-            fs.root_directory[i].start_cluster = free_cluster;
-            fs.root_directory[i].size = strlen(content);
+            fat_log_begin();
 
             // Write content to the data area
-            uint8_t *data_ptr = fs.data_area[free_cluster - 2];
+            uint8_t *data_ptr = cluster_write(free_cluster);
             strncpy((char *)data_ptr, content, SECTOR_SIZE);
             set_fat(free_cluster, 0xFFF); // Mark end of file
 
+            DirectoryEntry *entry = fat_entry_update(i);
+            strncpy(entry->name, name, MAX_FILENAME_LENGTH);
+            entry->attr = 0x20; // Regular file
+            entry->start_cluster = free_cluster;
+            entry->size = strlen(content);
+            fat_log_commit();
+            fat_index_rebuild();
+
             printf("File '%s' created successfully in FAT12 FS.\n", name);
             return;
         }
@@ -99,34 +183,36 @@ void createFile(char *name, char *content) {
 
 void listFiles() {
     for (int i = 0; i < MAX_FILE_COUNT; ++i) {
-        if (fs.root_directory[i].name[0] != 0) {
-            printf("- %s, %d bytes\n", fs.root_directory[i].name, fs.root_directory[i].size);
+        DirectoryEntry *entry = fat_entry(i);
+        if (entry->name[0] == 0) {
+            continue;
+        }
+        if (entry->flags & FAT_ENTRY_COMPRESSED) {
+            printf("- %s, %d bytes (compressed, %d stored)\n", entry->name, entry->size, fat_lz4_stored_size(i));
+        } else {
+            printf("- %s, %d bytes\n", entry->name, entry->size);
         }
     }
+    printf("%d of %d clusters free\n", fat_free_clusters(), DATA_CLUSTER_COUNT);
 }
 
-void fat_catFile(const char *filename) {
+void fat_removeFile(const char *filename) {
     for (int i = 0; i < MAX_FILE_COUNT; ++i) {
-        if (fs.root_directory[i].name[0] == 0) {
+        DirectoryEntry *entry = fat_entry(i);
+        if (entry->name[0] == 0) {
             continue;
         }
-        if (strncmp(fs.root_directory[i].name, filename, MAX_FILENAME_LENGTH) == 0) {
-            uint16_t cluster = fs.root_directory[i].start_cluster;
-            uint32_t size = fs.root_directory[i].size;
-            uint8_t *data_ptr;
-
-            while (cluster < 0xFFF8 && size > 0) {
-                data_ptr = fs.data_area[cluster - 2];
-                uint32_t bytes_to_read = (size > SECTOR_SIZE) ? SECTOR_SIZE : size;
-
-                for (uint32_t j = 0; j < bytes_to_read; j++) {
-                    console_putchar(data_ptr[j]);
-                }
-
-                size -= bytes_to_read;
-                cluster = get_fat_entry(cluster);
+        if (strncmp(entry->name, filename, MAX_FILENAME_LENGTH) == 0) {
+            fat_log_begin();
+            if (entry->flags & FAT_ENTRY_COMPRESSED) {
+                fat_lz4_free_chunks(i);
             }
-            printf("\n");
+            fat_chain_free(fat_entry(i)->start_cluster);
+            memset(fat_entry_update(i), 0, sizeof(DirectoryEntry));
+            fat_log_commit();
+            fat_index_rebuild();
+            page_cache_invalidate(VFS_FILE_ID(VFS_BACKEND_FAT, i));
+            printf("File '%s' removed successfully.\n", filename);
             return;
         }
     }
@@ -135,12 +221,255 @@ void fat_catFile(const char *filename) {
 
 uint16_t get_fat_entry(uint16_t cluster) {
     uint16_t value;
+    uint32_t offset = cluster * 3 / 2;
     if (cluster % 2 == 0) {
-        value = (fs.fat[0][cluster * 3 / 2 + 1] << 8) | fs.fat[0][cluster * 3 / 2];
+        value = (fat_byte(offset + 1) << 8) | fat_byte(offset);
         value &= 0x0FFF;
     } else {
-        value = (fs.fat[0][cluster * 3 / 2] >> 4) | (fs.fat[0][cluster * 3 / 2 + 1] << 4);
+        value = (fat_byte(offset) >> 4) | (fat_byte(offset + 1) << 4);
         value &= 0x0FFF;
     }
     return value;
 }
+
+
+// Build a name index of the current root directory and publish it, the old one is
+// freed once no lookup can still be reading it
+static void fat_index_rebuild() {
+    FatNameIndex *index = pmm_alloc_page();
+    FatNameIndex *old = fat_name_index;
+
+    if (index != NULL) {
+        index->count = 0;
+        for (int i = 0; i < MAX_FILE_COUNT; ++i) {
+            DirectoryEntry *entry = fat_entry(i);
+            if (entry->name[0] != 0) {
+                memcpy(index->files[index->count].name, entry->name, MAX_FILENAME_LENGTH);
+                index->files[index->count].index = i;
+                index->count++;
+            }
+        }
+    }
+    rcu_assign_pointer(fat_name_index, index);
+    if (old != NULL) {
+        synchronize_rcu();
+        pmm_free_page(old);
+    }
+}
+
+int fat_lookup(const char *filename) {
+    int found = -1;
+
+    rcu_read_lock();
+    FatNameIndex *index = rcu_dereference(fat_name_index);
+    if (index != NULL) {
+        for (uint32_t i = 0; i < index->count; ++i) {
+            if (strncmp(index->files[i].name, filename, MAX_FILENAME_LENGTH) == 0) {
+                found = index->files[i].index;
+                break;
+            }
+        }
+    }
+    rcu_read_unlock();
+    if (index != NULL) {
+        return found;
+    }
+
+    for (int i = 0; i < MAX_FILE_COUNT; ++i) {
+        DirectoryEntry *entry = fat_entry(i);
+        if (entry->name[0] != 0 && strncmp(entry->name, filename, MAX_FILENAME_LENGTH) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+DirectoryEntry *fat_entry(int index) {
+    return (DirectoryEntry *)fat_sector_read(ROOT_DIR_START + index / DIR_ENTRIES_PER_SECTOR) +
+           index % DIR_ENTRIES_PER_SECTOR;
+}
+
+DirectoryEntry *fat_entry_update(int index) {
+    return (DirectoryEntry *)fat_sector_write(ROOT_DIR_START + index / DIR_ENTRIES_PER_SECTOR) +
+           index % DIR_ENTRIES_PER_SECTOR;
+}
+
+uint32_t fat_size(int index) {
+    return fat_entry(index)->size;
+}
+
+int fat_set_size(int index, uint32_t size) {
+    if (fat_entry(index)->size != size) {
+        fat_log_begin();
+        fat_entry_update(index)->size = size;
+        fat_log_commit();
+    }
+    return 0;
+}
+
+// Next cluster in the chain, a new cluster is linked at the end of the chain when allocate is set
+static uint16_t fat_next_cluster(uint16_t cluster, int allocate) {
+    uint16_t next = get_fat_entry(cluster);
+    if (next >= 2 && next < 0xFF8) {
+        return next;
+    }
+    if (!allocate) {
+        return 0xFFFF;
+    }
+    next = find_free_cluster();
+    if (next == 0xFFFF) {
+        return 0xFFFF;
+    }
+    memset(cluster_write(next), 0, SECTOR_SIZE);
+    set_fat(next, 0xFFF);
+    set_fat(cluster, next);
+    return next;
+}
+
+// Walk the cluster chain to the cluster holding byte offset
+static uint16_t fat_cluster_at(uint16_t start, uint32_t offset, int allocate) {
+    uint16_t cluster = start;
+
+    if (cluster < 2 || cluster >= 0xFF8) {
+        return 0xFFFF;
+    }
+    for (uint32_t skip = offset / SECTOR_SIZE; skip > 0 && cluster != 0xFFFF; skip--) {
+        cluster = fat_next_cluster(cluster, allocate);
+    }
+    return cluster;
+}
+
+int fat_chain_read(uint16_t start, uint32_t offset, void *buf, uint32_t len) {
+    uint8_t *dst = buf;
+    uint32_t done = 0;
+    uint16_t cluster = fat_cluster_at(start, offset, 0);
+
+    while (done < len) {
+        uint32_t pos = (offset + done) % SECTOR_SIZE;
+        uint32_t chunk = SECTOR_SIZE - pos;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        if (cluster == 0xFFFF) {
+            memset(dst + done, 0, len - done); // Past the end of the chain
+            return len;
+        }
+        memcpy(dst + done, cluster_read(cluster) + pos, chunk);
+        done += chunk;
+        cluster = fat_next_cluster(cluster, 0);
+    }
+    return done;
+}
+
+int fat_chain_write(uint16_t *start, uint32_t offset, const void *buf, uint32_t len) {
+    const uint8_t *src = buf;
+    uint32_t done = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (*start < 2 || *start >= 0xFF8) {
+        uint16_t free_cluster = find_free_cluster();
+        if (free_cluster == 0xFFFF) {
+            return -1;
+        }
+        memset(cluster_write(free_cluster), 0, SECTOR_SIZE);
+        set_fat(free_cluster, 0xFFF);
+        *start = free_cluster;
+    }
+
+    uint16_t cluster = fat_cluster_at(*start, offset, 1);
+    while (done < len) {
+        uint32_t pos = (offset + done) % SECTOR_SIZE;
+        uint32_t chunk = SECTOR_SIZE - pos;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        if (cluster == 0xFFFF) {
+            break; // Volume full
+        }
+        memcpy(cluster_write(cluster) + pos, src + done, chunk);
+        done += chunk;
+        if (done < len) {
+            cluster = fat_next_cluster(cluster, 1);
+        }
+    }
+    return done > 0 ? (int)done : -1;
+}
+
+void fat_chain_free(uint16_t start) {
+    uint16_t cluster = start;
+    while (cluster >= 2 && cluster < 0xFF8) {
+        uint16_t next = get_fat_entry(cluster);
+        set_fat(cluster, 0x000);
+        cluster = next;
+    }
+}
+
+void fat_chain_truncate(uint16_t *start, uint32_t len) {
+    uint16_t cluster, next;
+
+    if (len == 0) {
+        fat_chain_free(*start);
+        *start = 0;
+        return;
+    }
+    cluster = fat_cluster_at(*start, len - 1, 0);
+    if (cluster == 0xFFFF) {
+        return;
+    }
+    next = get_fat_entry(cluster);
+    if (next >= 2 && next < 0xFF8) {
+        set_fat(cluster, 0xFFF);
+        fat_chain_free(next);
+    }
+}
+
+uint32_t fat_chain_clusters(uint16_t start) {
+    uint32_t count = 0;
+    for (uint16_t cluster = start; cluster >= 2 && cluster < 0xFF8; cluster = get_fat_entry(cluster)) {
+        count++;
+    }
+    return count;
+}
+
+int fat_read(int index, uint32_t offset, void *buf, uint32_t len) {
+    DirectoryEntry *entry = fat_entry(index);
+
+    if (offset >= entry->size) {
+        return 0;
+    }
+    if (len > entry->size - offset) {
+        len = entry->size - offset;
+    }
+    if (entry->flags & FAT_ENTRY_COMPRESSED) {
+        return fat_lz4_read(index, offset, buf, len);
+    }
+    return fat_chain_read(entry->start_cluster, offset, buf, len);
+}
+
+int fat_write(int index, uint32_t offset, const void *buf, uint32_t len) {
+    DirectoryEntry *entry = fat_entry(index);
+    uint16_t start = entry->start_cluster;
+    uint32_t size = entry->size;
+    int written;
+
+    fat_log_begin();
+    if (entry->flags & FAT_ENTRY_COMPRESSED) {
+        written = fat_lz4_write(index, offset, buf, len);
+        fat_log_commit();
+        return written;
+    }
+    written = fat_chain_write(&start, offset, buf, len);
+    if (written > 0 && offset + written > size) {
+        size = offset + written;
+    }
+    // Only touch the directory sector when the entry changes
+    if (start != fat_entry(index)->start_cluster || size != fat_entry(index)->size) {
+        entry = fat_entry_update(index);
+        entry->start_cluster = start;
+        entry->size = size;
+    }
+    fat_log_commit();
+    return written;
+}
@@ -4,19 +4,74 @@
 #include <string.h>
 #include <stdint.h>
 
+#define SECTOR_SIZE 512
+#define MAX_FILENAME_LENGTH 11 // 8.3 format
+#define MAX_FILE_COUNT 224 // Maximum number of files supported in the root directory
+
+// FAT12 Disk Layout
+#define BOOT_SECTOR_SIZE 1
+#define FAT_COUNT 2
+#define FAT_SIZE 9 // Number of sectors per FAT table
+#define ROOT_DIR_SIZE 14 // Number of sectors in the root directory
+#define FAT_SECTOR_COUNT 2880 // 1.44MB floppy
+#define FAT_TABLE_START BOOT_SECTOR_SIZE // First sector of the first FAT
+#define ROOT_DIR_START (BOOT_SECTOR_SIZE + FAT_COUNT * FAT_SIZE)
+#define DATA_START (ROOT_DIR_START + ROOT_DIR_SIZE) // Sector of cluster 2
+#define DATA_CLUSTER_COUNT (FAT_SECTOR_COUNT - DATA_START)
+
+typedef struct {
+    char name[MAX_FILENAME_LENGTH];
+    uint8_t attr; // File attributes (read-only, hidden, system, etc.)
+    uint8_t flags; // EdgeOS extension flags (FAT_ENTRY_*)
+    uint8_t reserved[9];
+    uint16_t time; // Last modification time
+    uint16_t date; // Last modification date
+    uint16_t start_cluster; // Starting cluster of the file
+    uint32_t size; // File size in bytes
+} DirectoryEntry;
+
+#define DIR_ENTRIES_PER_SECTOR (SECTOR_SIZE / sizeof(DirectoryEntry))
+
+// DirectoryEntry flags
+#define FAT_ENTRY_COMPRESSED 0x01 // Data is stored as LZ4 chunks, see fat_lz4.h
+
 //FUNCS
 void custom_strcpy(char *dest, const char *src);
 void initFileSystem();
+void fat_mount();
+void fat_remount();
 void createFile(char *name, char *content);
 void listFiles();
+void fat_removeFile(const char *filename);
+int fat_lookup(const char *filename);
+DirectoryEntry *fat_entry(int index);
+DirectoryEntry *fat_entry_update(int index);
+uint16_t get_fat_entry(uint16_t cluster);
+void set_fat(uint16_t cluster, uint16_t value);
+uint32_t fat_free_clusters();
+uint32_t fat_size(int index);
+int fat_set_size(int index, uint32_t size);
+int fat_read(int index, uint32_t offset, void *buf, uint32_t len);
+int fat_write(int index, uint32_t offset, const void *buf, uint32_t len);
+
+// Cluster chain I/O, offsets are relative to the first cluster of the chain
+int fat_chain_read(uint16_t start, uint32_t offset, void *buf, uint32_t len);
+int fat_chain_write(uint16_t *start, uint32_t offset, const void *buf, uint32_t len);
+void fat_chain_free(uint16_t start);
+// Keep the clusters holding the first len bytes and free the rest, len 0 frees the chain
+void fat_chain_truncate(uint16_t *start, uint32_t len);
+uint32_t fat_chain_clusters(uint16_t start);
+
+// Sector access, sectors are numbered from the boot sector. Reads see the newest logged
+// copy of a sector, writes go to the log segment while log mode is on (see fat_log.h).
+// Returned pointers are only valid until the next call that may write the volume.
+uint8_t *fat_sector_home(uint32_t sector);
+uint8_t *fat_sector_read(uint32_t sector);
+uint8_t *fat_sector_write(uint32_t sector);
 
 
 //CONST
 #define BRAND_QEMU  1
 #define BRAND_VBOX  2
 
-#define MAX_FILENAME_LENGTH 20
-#define MAX_FILE_COUNT 100
-#define MAX_FILE_CONTENT_LENGTH 10000
-
 #endif
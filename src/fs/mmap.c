@@ -0,0 +1,167 @@
+#include <string.h>
+#include <stdint.h>
+#include "console.h"
+#include "isr.h"
+#include "pmm.h"
+#include "paging.h"
+#include "page_cache.h"
+#include "mmap.h"
+#include "user.h"
+
+static MmapRegion mmap_regions[MMAP_MAX_REGIONS];
+
+static MmapRegion *mmap_find(uint32_t addr) {
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        MmapRegion *region = &mmap_regions[i];
+        if (region->used && addr >= region->start && addr - region->start < region->length) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+// First fit search for a free virtual range in the mmap window
+static uint32_t mmap_find_range(uint32_t length) {
+    uint32_t candidate = MMAP_BASE;
+    int moved = 1;
+
+    while (moved) {
+        moved = 0;
+        for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+            MmapRegion *region = &mmap_regions[i];
+            if (region->used && candidate < region->start + region->length &&
+                region->start < candidate + length) {
+                candidate = region->start + region->length;
+                moved = 1;
+            }
+        }
+        if (candidate >= MMAP_LIMIT || MMAP_LIMIT - candidate < length) {
+            return 0;
+        }
+    }
+    return candidate;
+}
+
+static uint32_t mmap_page_index(MmapRegion *region, uint32_t addr) {
+    return (region->offset + (addr & PAGE_MASK) - region->start) / PAGE_SIZE;
+}
+
+// Fill a faulting page of a mapping from the page cache
+static void mmap_page_fault(REGISTERS *reg) {
+    uint32_t addr = paging_fault_address();
+    MmapRegion *region = mmap_find(addr);
+    int write = reg->err_code & 0x2;
+
+    // The user window is paged by the program loaded into it
+    if (addr >= USER_BASE && addr < USER_LIMIT) {
+        if ((reg->err_code & 0x1) || !user_page_fault(addr, write != 0)) {
+            console_printf("Page fault at 0x%x\n", addr);
+            isr_exception_halt(reg);
+        }
+        return;
+    }
+
+    if (region == NULL || (write && !(region->prot & PROT_WRITE)) || (reg->err_code & 0x1)) {
+        console_printf("Page fault at 0x%x\n", addr);
+        isr_exception_halt(reg);
+    }
+
+    CachedPage *page = page_cache_get(region->file_id, mmap_page_index(region, addr));
+    if (page == NULL || paging_map_page(addr & PAGE_MASK, (uint32_t)page->data,
+                                        (region->prot & PROT_WRITE) ? PAGE_WRITE : 0) < 0) {
+        console_printf("Out of memory mapping 0x%x\n", addr);
+        isr_exception_halt(reg);
+    }
+    page_cache_map(page);
+}
+
+void mmap_init() {
+    memset(mmap_regions, 0, sizeof(mmap_regions));
+    isr_register_interrupt_handler(EXCEPTION_PAGE_FAULT, mmap_page_fault);
+}
+
+void *mmap(VfsFile *file, uint32_t offset, uint32_t length, int prot) {
+    if (file == NULL || length == 0 || (offset % PAGE_SIZE) != 0) {
+        return NULL;
+    }
+    length = (length + PAGE_SIZE - 1) & PAGE_MASK;
+
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        MmapRegion *region = &mmap_regions[i];
+        if (region->used) {
+            continue;
+        }
+        uint32_t start = mmap_find_range(length);
+        if (start == 0) {
+            return NULL;
+        }
+        region->start = start;
+        region->length = length;
+        region->file_id = file->id;
+        region->offset = offset;
+        region->prot = prot;
+        region->used = 1;
+        return (void *)start; // Nothing is mapped until first touch
+    }
+    return NULL;
+}
+
+// Move PTE dirty bits of the range into the page cache and write those pages back
+static void mmap_sync_range(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+        uint32_t *pte = paging_get_pte(addr, FALSE);
+        if (pte == NULL || !(*pte & PAGE_PRESENT) || !(*pte & PAGE_DIRTY)) {
+            continue;
+        }
+        *pte &= ~PAGE_DIRTY;
+        paging_invalidate(addr);
+
+        CachedPage *page = page_cache_find_frame((uint8_t *)(*pte & PAGE_MASK));
+        if (page != NULL) {
+            page_cache_mark_dirty(page);
+            page_cache_writeback(page);
+        }
+    }
+}
+
+int msync(void *addr, uint32_t length) {
+    uint32_t start = (uint32_t)addr & PAGE_MASK;
+    uint32_t end = (uint32_t)addr + length;
+    MmapRegion *region = mmap_find(start);
+
+    if (region == NULL) {
+        return -1;
+    }
+    if (end > region->start + region->length) {
+        end = region->start + region->length;
+    }
+    mmap_sync_range(start, end);
+    return 0;
+}
+
+// Only whole regions can be unmapped
+int munmap(void *addr, uint32_t length) {
+    MmapRegion *region = mmap_find((uint32_t)addr);
+    uint32_t end;
+
+    if (region == NULL || region->start != (uint32_t)addr) {
+        return -1;
+    }
+    (void)length;
+    end = region->start + region->length;
+    mmap_sync_range(region->start, end);
+
+    for (uint32_t va = region->start; va < end; va += PAGE_SIZE) {
+        uint32_t *pte = paging_get_pte(va, FALSE);
+        if (pte == NULL || !(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+        CachedPage *page = page_cache_find_frame((uint8_t *)(*pte & PAGE_MASK));
+        paging_unmap_page(va);
+        if (page != NULL) {
+            page_cache_unmap(page);
+        }
+    }
+    region->used = 0;
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <stdint.h>
+#include "vfs.h"
+
+// Virtual window for file mappings, outside the identity mapped RAM
+#define MMAP_BASE 0xC0000000
+#define MMAP_LIMIT 0xE0000000
+#define MMAP_MAX_REGIONS 32
+
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+
+typedef struct {
+    uint32_t start;
+    uint32_t length; // Page aligned
+    uint32_t file_id;
+    uint32_t offset; // Page aligned offset into the file
+    int prot;
+    int used;
+} MmapRegion;
+
+//FUNCS
+void mmap_init();
+// Map length bytes of file starting at offset, pages are filled from the page cache on first touch
+void *mmap(VfsFile *file, uint32_t offset, uint32_t length, int prot);
+// Write dirty mapped pages back to the file
+int msync(void *addr, uint32_t length);
+int munmap(void *addr, uint32_t length);
+
+#endif
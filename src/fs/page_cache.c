@@ -0,0 +1,293 @@
+#include <string.h>
+#include <stdint.h>
+#include "console.h"
+#include "pmm.h"
+#include "vfs.h"
+#include "page_cache.h"
+
+static CachedPage page_cache_pages[PAGE_CACHE_MAX_PAGES];
+static CachedPage *page_cache_hash[PAGE_CACHE_HASH_SIZE];
+// Recycled descriptors, chained through hash_next
+static CachedPage *page_cache_free_list;
+static uint32_t page_cache_next_unused;
+// Most recently used page is lru_head.lru_next, eviction candidates come from lru_head.lru_prev
+static CachedPage lru_head = { .lru_prev = &lru_head, .lru_next = &lru_head };
+
+static uint32_t stat_hits, stat_misses, stat_evictions, stat_writebacks, stat_pages;
+// Orphaned pages still holding a borrowed frame, page_cache_adopt() has nothing to find while zero
+static uint32_t borrowed_orphans;
+
+static uint32_t page_cache_bucket(uint32_t file_id, uint32_t index) {
+    return ((file_id * 0x9E3779B1) ^ index) % PAGE_CACHE_HASH_SIZE;
+}
+
+static void lru_remove(CachedPage *page) {
+    page->lru_prev->lru_next = page->lru_next;
+    page->lru_next->lru_prev = page->lru_prev;
+    page->lru_prev = page->lru_next = page;
+}
+
+static void lru_push_front(CachedPage *page) {
+    page->lru_next = lru_head.lru_next;
+    page->lru_prev = &lru_head;
+    lru_head.lru_next->lru_prev = page;
+    lru_head.lru_next = page;
+}
+
+static void hash_remove(CachedPage *page) {
+    CachedPage **link = &page_cache_hash[page_cache_bucket(page->file_id, page->index)];
+    while (*link != NULL) {
+        if (*link == page) {
+            *link = page->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    page->hash_next = NULL;
+}
+
+// Give descriptor and frame back, a borrowed frame stays with its backend
+static void page_cache_release(CachedPage *page) {
+    if (!(page->flags & PAGE_CACHE_BORROWED)) {
+        pmm_free_page(page->data);
+    }
+    page->data = NULL;
+    page->flags = 0;
+    page->hash_next = page_cache_free_list;
+    page_cache_free_list = page;
+    stat_pages--;
+}
+
+// Reuse descriptor and frame of the least recently used unmapped page
+static CachedPage *page_cache_evict() {
+    for (CachedPage *page = lru_head.lru_prev; page != &lru_head; page = page->lru_prev) {
+        if (page->mapcount != 0) {
+            continue;
+        }
+        if (page_cache_writeback(page) < 0) {
+            continue;
+        }
+        hash_remove(page);
+        lru_remove(page);
+        stat_evictions++;
+        stat_pages--;
+        return page;
+    }
+    return NULL;
+}
+
+// Descriptor for a new page, frame is the backend's page to borrow or NULL for a frame of our own
+static CachedPage *page_cache_alloc(uint8_t *frame) {
+    CachedPage *page = NULL;
+
+    if (page_cache_free_list != NULL) {
+        page = page_cache_free_list;
+        page_cache_free_list = page->hash_next;
+    } else if (page_cache_next_unused < PAGE_CACHE_MAX_PAGES) {
+        page = &page_cache_pages[page_cache_next_unused++];
+    }
+    if (page != NULL) {
+        page->data = frame != NULL ? frame : pmm_alloc_page();
+        if (page->data != NULL) {
+            return page;
+        }
+        page->hash_next = page_cache_free_list;
+        page_cache_free_list = page;
+    }
+
+    page = page_cache_evict();
+    if (page == NULL) {
+        return NULL;
+    }
+    if (frame != NULL) {
+        if (!(page->flags & PAGE_CACHE_BORROWED)) {
+            pmm_free_page(page->data);
+        }
+        page->data = frame;
+    } else if (page->flags & PAGE_CACHE_BORROWED) {
+        page->data = pmm_alloc_page();
+        if (page->data == NULL) {
+            page->flags = 0;
+            page->hash_next = page_cache_free_list;
+            page_cache_free_list = page;
+            return NULL;
+        }
+    }
+    return page;
+}
+
+void page_cache_init() {
+    memset(page_cache_hash, 0, sizeof(page_cache_hash));
+    page_cache_free_list = NULL;
+    page_cache_next_unused = 0;
+    borrowed_orphans = 0;
+    lru_head.lru_prev = lru_head.lru_next = &lru_head;
+}
+
+CachedPage *page_cache_lookup(uint32_t file_id, uint32_t index) {
+    CachedPage *page = page_cache_hash[page_cache_bucket(file_id, index)];
+    while (page != NULL) {
+        if (page->file_id == file_id && page->index == index) {
+            return page;
+        }
+        page = page->hash_next;
+    }
+    return NULL;
+}
+
+CachedPage *page_cache_get(uint32_t file_id, uint32_t index) {
+    CachedPage *page = page_cache_lookup(file_id, index);
+
+    if (page != NULL) {
+        stat_hits++;
+        lru_remove(page);
+        lru_push_front(page);
+        return page;
+    }
+
+    stat_misses++;
+    if (vfs_shares_pages(file_id)) {
+        uint8_t *frame = vfs_getpage(file_id, index);
+        if (frame == NULL || (page = page_cache_alloc(frame)) == NULL) {
+            return NULL;
+        }
+        page->flags = PAGE_CACHE_BORROWED;
+    } else {
+        if ((page = page_cache_alloc(NULL)) == NULL) {
+            return NULL;
+        }
+        page->flags = 0;
+    }
+    page->file_id = file_id;
+    page->index = index;
+    page->mapcount = 0;
+    stat_pages++;
+    if (!(page->flags & PAGE_CACHE_BORROWED) && vfs_readpage(file_id, index, page->data) < 0) {
+        page_cache_release(page);
+        return NULL;
+    }
+
+    uint32_t bucket = page_cache_bucket(file_id, index);
+    page->hash_next = page_cache_hash[bucket];
+    page_cache_hash[bucket] = page;
+    lru_push_front(page);
+    return page;
+}
+
+CachedPage *page_cache_find_frame(uint8_t *data) {
+    for (uint32_t i = 0; i < page_cache_next_unused; i++) {
+        if (page_cache_pages[i].data == data) {
+            return &page_cache_pages[i];
+        }
+    }
+    return NULL;
+}
+
+void page_cache_map(CachedPage *page) {
+    page->mapcount++;
+}
+
+void page_cache_unmap(CachedPage *page) {
+    if (page->mapcount > 0 && --page->mapcount == 0 && (page->flags & PAGE_CACHE_ORPHAN)) {
+        if (page->flags & PAGE_CACHE_BORROWED) {
+            borrowed_orphans--;
+        }
+        page_cache_release(page);
+    }
+}
+
+void page_cache_mark_dirty(CachedPage *page) {
+    page->flags |= PAGE_CACHE_DIRTY;
+}
+
+int page_cache_writeback(CachedPage *page) {
+    if (!(page->flags & PAGE_CACHE_DIRTY) || (page->flags & PAGE_CACHE_ORPHAN)) {
+        return 0;
+    }
+    // The backend already holds what was written to its own frame
+    if (page->flags & PAGE_CACHE_BORROWED) {
+        page->flags &= ~PAGE_CACHE_DIRTY;
+        return 0;
+    }
+    if (vfs_writepage(page->file_id, page->index, page->data) < 0) {
+        return -1;
+    }
+    page->flags &= ~PAGE_CACHE_DIRTY;
+    stat_writebacks++;
+    return 0;
+}
+
+void page_cache_sync(uint32_t file_id) {
+    for (CachedPage *page = lru_head.lru_next; page != &lru_head; page = page->lru_next) {
+        if (page->file_id == file_id) {
+            page_cache_writeback(page);
+        }
+    }
+}
+
+void page_cache_sync_all() {
+    for (CachedPage *page = lru_head.lru_next; page != &lru_head; page = page->lru_next) {
+        page_cache_writeback(page);
+    }
+}
+
+// Drop every page matching file_id under mask
+static void page_cache_drop(uint32_t file_id, uint32_t mask) {
+    CachedPage *page = lru_head.lru_next;
+    while (page != &lru_head) {
+        CachedPage *next = page->lru_next;
+        if ((page->file_id & mask) == (file_id & mask)) {
+            hash_remove(page);
+            lru_remove(page);
+            if (page->mapcount > 0) {
+                page->flags |= PAGE_CACHE_ORPHAN; // freed on last unmap
+                if (page->flags & PAGE_CACHE_BORROWED) {
+                    borrowed_orphans++;
+                }
+            } else {
+                page_cache_release(page);
+            }
+        }
+        page = next;
+    }
+}
+
+void page_cache_invalidate(uint32_t file_id) {
+    page_cache_drop(file_id, 0xFFFFFFFF);
+}
+
+void page_cache_invalidate_backend(uint32_t backend) {
+    page_cache_drop(VFS_FILE_ID(backend, 0), 0xFFFF0000);
+}
+
+int page_cache_adopt(uint8_t *data) {
+    if (borrowed_orphans == 0) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < page_cache_next_unused; i++) {
+        CachedPage *page = &page_cache_pages[i];
+        if (page->data == data && (page->flags & PAGE_CACHE_ORPHAN) && (page->flags & PAGE_CACHE_BORROWED)) {
+            page->flags &= ~PAGE_CACHE_BORROWED;
+            borrowed_orphans--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void page_cache_stats() {
+    uint32_t dirty = 0, mapped = 0, borrowed = 0;
+    for (CachedPage *page = lru_head.lru_next; page != &lru_head; page = page->lru_next) {
+        if (page->flags & PAGE_CACHE_BORROWED) {
+            borrowed++;
+        }
+        if (page->flags & PAGE_CACHE_DIRTY) {
+            dirty++;
+        }
+        if (page->mapcount) {
+            mapped++;
+        }
+    }
+    printf("Page cache: %d/%d pages, %d dirty, %d mapped, %d shared with tmpfs\n", stat_pages, PAGE_CACHE_MAX_PAGES, dirty, mapped, borrowed);
+    printf("hits=%d misses=%d evictions=%d writebacks=%d\n", stat_hits, stat_misses, stat_evictions, stat_writebacks);
+}
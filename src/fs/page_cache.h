@@ -0,0 +1,48 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdint.h>
+
+// Pages of file data kept in RAM, keyed by (file id, page index)
+#define PAGE_CACHE_MAX_PAGES 1024
+#define PAGE_CACHE_HASH_SIZE 256
+
+// CachedPage flags
+#define PAGE_CACHE_DIRTY 0x1 // Newer than the backing file
+#define PAGE_CACHE_ORPHAN 0x2 // File went away while the page was still mapped
+#define PAGE_CACHE_BORROWED 0x4 // data is the backend's own frame, never copied, written back or freed here
+
+typedef struct CachedPage {
+    uint32_t file_id;
+    uint32_t index;
+    uint8_t *data; // 4KB frame
+    uint16_t flags;
+    uint16_t mapcount; // Number of mmap PTEs pointing at data, pinned while non-zero
+    struct CachedPage *hash_next;
+    struct CachedPage *lru_prev;
+    struct CachedPage *lru_next;
+} CachedPage;
+
+//FUNCS
+void page_cache_init();
+// Find a page, filling it from the backing file on a miss
+CachedPage *page_cache_get(uint32_t file_id, uint32_t index);
+// Find a page without filling it
+CachedPage *page_cache_lookup(uint32_t file_id, uint32_t index);
+// Find the page owning a frame, also finds orphaned pages
+CachedPage *page_cache_find_frame(uint8_t *data);
+void page_cache_map(CachedPage *page);
+void page_cache_unmap(CachedPage *page);
+void page_cache_mark_dirty(CachedPage *page);
+int page_cache_writeback(CachedPage *page);
+// Write back all dirty pages of a file
+void page_cache_sync(uint32_t file_id);
+void page_cache_sync_all();
+// Drop pages of a file without writing them back
+void page_cache_invalidate(uint32_t file_id);
+void page_cache_invalidate_backend(uint32_t backend);
+// Backend is about to free a borrowed frame, returns 1 when a mapping still uses it and the cache frees it on last unmap
+int page_cache_adopt(uint8_t *data);
+void page_cache_stats();
+
+#endif
@@ -0,0 +1,302 @@
+#include <string.h>
+#include <stdint.h>
+#include "console.h"
+#include "pmm.h"
+#include "tmpfs.h"
+#include "vfs.h"
+#include "page_cache.h"
+
+// Inode table only holds names and radix roots, file data lives in pages allocated on demand
+static TmpfsInode tmpfs_inodes[TMPFS_MAX_FILES];
+
+static void *alloc_zeroed_page() {
+    void *page = pmm_alloc_page();
+    if (page != NULL) {
+        memset(page, 0, PAGE_SIZE);
+    }
+    return page;
+}
+
+// Number of pages a subtree of given height can address
+static uint32_t radix_capacity(uint32_t height) {
+    uint32_t capacity = 1;
+    if (height == 0) {
+        return 0;
+    }
+    while (--height > 0) {
+        capacity <<= TMPFS_RADIX_SHIFT;
+    }
+    return capacity;
+}
+
+// Add levels on top of the tree until page index fits
+static int radix_grow(TmpfsInode *inode, uint32_t index) {
+    while (radix_capacity(inode->height) <= index) {
+        if (inode->height >= TMPFS_MAX_HEIGHT) {
+            return -1;
+        }
+        if (inode->root != NULL && inode->height > 0) {
+            void **node = alloc_zeroed_page();
+            if (node == NULL) {
+                return -1;
+            }
+            node[0] = inode->root;
+            inode->root = node;
+        }
+        inode->height++;
+    }
+    return 0;
+}
+
+// Find data page at given page index, allocating pages and nodes on the way when create is set
+static void *radix_get_page(TmpfsInode *inode, uint32_t index, int create) {
+    void **slot;
+    uint32_t shift, level;
+
+    if (index >= radix_capacity(inode->height)) {
+        if (!create || radix_grow(inode, index) < 0) {
+            return NULL;
+        }
+    }
+
+    slot = &inode->root;
+    shift = (inode->height - 1) * TMPFS_RADIX_SHIFT;
+    for (level = inode->height; level > 1; level--) {
+        if (*slot == NULL) {
+            if (!create || (*slot = alloc_zeroed_page()) == NULL) {
+                return NULL;
+            }
+        }
+        shift -= TMPFS_RADIX_SHIFT;
+        slot = &((void **)*slot)[(index >> shift) & (TMPFS_RADIX_SLOTS - 1)];
+    }
+    if (*slot == NULL && create) {
+        *slot = alloc_zeroed_page();
+        if (*slot != NULL) {
+            inode->nr_pages++;
+        }
+    }
+    return *slot;
+}
+
+// Free every data page with index >= start below slot, empty nodes are freed too
+static void radix_free_from(TmpfsInode *inode, void **slot, uint32_t level, uint32_t base, uint32_t start) {
+    if (*slot == NULL) {
+        return;
+    }
+    if (level == 1) {
+        if (base >= start) {
+            // a page still mapped through the page cache is freed there on last unmap
+            if (!page_cache_adopt(*slot)) {
+                pmm_free_page(*slot);
+            }
+            *slot = NULL;
+            inode->nr_pages--;
+        }
+        return;
+    }
+
+    void **node = *slot;
+    uint32_t span = radix_capacity(level - 1);
+    int used = 0;
+    for (uint32_t i = 0; i < TMPFS_RADIX_SLOTS; i++) {
+        if (base + (i + 1) * span > start) {
+            radix_free_from(inode, &node[i], level - 1, base + i * span, start);
+        }
+        if (node[i] != NULL) {
+            used = 1;
+        }
+    }
+    if (!used) {
+        pmm_free_page(node);
+        *slot = NULL;
+    }
+}
+
+// Drop top levels that only have their first slot in use
+static void radix_shrink(TmpfsInode *inode) {
+    if (inode->root == NULL) {
+        inode->height = 0;
+        return;
+    }
+    while (inode->height > 1) {
+        void **node = inode->root;
+        for (uint32_t i = 1; i < TMPFS_RADIX_SLOTS; i++) {
+            if (node[i] != NULL) {
+                return;
+            }
+        }
+        inode->root = node[0];
+        pmm_free_page(node);
+        inode->height--;
+        if (inode->root == NULL) {
+            inode->height = 0;
+            return;
+        }
+    }
+}
+
+void tmpfs_init() {
+    memset(tmpfs_inodes, 0, sizeof(tmpfs_inodes));
+}
+
+const char *tmpfs_path(const char *path) {
+    if (strncmp(path, TMPFS_MOUNT_POINT, 4) != 0) {
+        return NULL;
+    }
+    if (path[4] == '\0') {
+        return path + 4;
+    }
+    if (path[4] == '/') {
+        return path + 5;
+    }
+    return NULL;
+}
+
+TmpfsInode *tmpfs_inode(int ino) {
+    if (ino < 0 || ino >= TMPFS_MAX_FILES || tmpfs_inodes[ino].name[0] == 0) {
+        return NULL;
+    }
+    return &tmpfs_inodes[ino];
+}
+
+int tmpfs_lookup(const char *name) {
+    for (int i = 0; i < TMPFS_MAX_FILES; i++) {
+        if (tmpfs_inodes[i].name[0] != 0 && strncmp(tmpfs_inodes[i].name, name, TMPFS_MAX_NAME) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int tmpfs_create(const char *name) {
+    int ino = tmpfs_lookup(name);
+    if (ino >= 0) {
+        return ino;
+    }
+    if (name[0] == 0 || strlen(name) >= TMPFS_MAX_NAME) {
+        return -1;
+    }
+    for (int i = 0; i < TMPFS_MAX_FILES; i++) {
+        if (tmpfs_inodes[i].name[0] == 0) {
+            memset(&tmpfs_inodes[i], 0, sizeof(TmpfsInode));
+            strncpy(tmpfs_inodes[i].name, name, TMPFS_MAX_NAME);
+            return i;
+        }
+    }
+    return -1;
+}
+
+int tmpfs_truncate(int ino, uint32_t size) {
+    TmpfsInode *inode = tmpfs_inode(ino);
+    if (inode == NULL) {
+        return -1;
+    }
+    if (size < inode->size) {
+        page_cache_invalidate(VFS_FILE_ID(VFS_BACKEND_TMPFS, ino));
+
+        uint32_t keep_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        radix_free_from(inode, &inode->root, inode->height, 0, keep_pages);
+        radix_shrink(inode);
+
+        // zero the tail of the last page so growing the file again reads zeros
+        if (size % PAGE_SIZE) {
+            uint8_t *page = radix_get_page(inode, size / PAGE_SIZE, 0);
+            if (page != NULL) {
+                memset(page + size % PAGE_SIZE, 0, PAGE_SIZE - size % PAGE_SIZE);
+            }
+        }
+    }
+    inode->size = size;
+    return 0;
+}
+
+int tmpfs_unlink(const char *name) {
+    int ino = tmpfs_lookup(name);
+    if (ino < 0) {
+        return -1;
+    }
+    tmpfs_truncate(ino, 0);
+    page_cache_invalidate(VFS_FILE_ID(VFS_BACKEND_TMPFS, ino));
+    memset(&tmpfs_inodes[ino], 0, sizeof(TmpfsInode));
+    return 0;
+}
+
+int tmpfs_read(int ino, uint32_t offset, void *buf, uint32_t len) {
+    TmpfsInode *inode = tmpfs_inode(ino);
+    uint8_t *dst = buf;
+    uint32_t done = 0;
+
+    if (inode == NULL) {
+        return -1;
+    }
+    if (offset >= inode->size) {
+        return 0;
+    }
+    if (len > inode->size - offset) {
+        len = inode->size - offset;
+    }
+
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t chunk = PAGE_SIZE - pos % PAGE_SIZE;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        uint8_t *page = radix_get_page(inode, pos / PAGE_SIZE, 0);
+        if (page != NULL) {
+            memcpy(dst + done, page + pos % PAGE_SIZE, chunk);
+        } else {
+            memset(dst + done, 0, chunk); // hole
+        }
+        done += chunk;
+    }
+    return done;
+}
+
+int tmpfs_write(int ino, uint32_t offset, const void *buf, uint32_t len) {
+    TmpfsInode *inode = tmpfs_inode(ino);
+    const uint8_t *src = buf;
+    uint32_t done = 0;
+
+    if (inode == NULL || offset + len < offset) {
+        return -1;
+    }
+
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t chunk = PAGE_SIZE - pos % PAGE_SIZE;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        uint8_t *page = radix_get_page(inode, pos / PAGE_SIZE, 1);
+        if (page == NULL) {
+            break; // out of memory
+        }
+        memcpy(page + pos % PAGE_SIZE, src + done, chunk);
+        done += chunk;
+    }
+    if (offset + done > inode->size) {
+        inode->size = offset + done;
+    }
+    if (done == 0 && len > 0) {
+        return -1;
+    }
+    return done;
+}
+
+void *tmpfs_getpage(int ino, uint32_t index) {
+    TmpfsInode *inode = tmpfs_inode(ino);
+    if (inode == NULL) {
+        return NULL;
+    }
+    return radix_get_page(inode, index, 1);
+}
+
+void tmpfs_listFiles() {
+    for (int i = 0; i < TMPFS_MAX_FILES; ++i) {
+        if (tmpfs_inodes[i].name[0] != 0) {
+            printf("- %s, %d bytes (%d pages)\n", tmpfs_inodes[i].name, tmpfs_inodes[i].size, tmpfs_inodes[i].nr_pages);
+        }
+    }
+}
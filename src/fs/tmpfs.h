@@ -0,0 +1,39 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <stdint.h>
+
+// RAM backed file system, mounted at /tmp
+#define TMPFS_MOUNT_POINT "/tmp"
+#define TMPFS_MAX_NAME 32
+#define TMPFS_MAX_FILES 128
+
+// file pages are kept in a radix tree of 4KB nodes (1024 slots each)
+#define TMPFS_RADIX_SHIFT 10
+#define TMPFS_RADIX_SLOTS (1 << TMPFS_RADIX_SHIFT)
+#define TMPFS_MAX_HEIGHT 3
+
+typedef struct {
+    char name[TMPFS_MAX_NAME];
+    uint32_t size; // File size in bytes
+    uint32_t height; // 0 = no pages, 1 = root is a data page, 2+ = root is a node
+    uint32_t nr_pages; // Data pages currently allocated
+    void *root;
+} TmpfsInode;
+
+//FUNCS
+void tmpfs_init();
+// strip the mount point, returns NULL when path is not inside /tmp
+const char *tmpfs_path(const char *path);
+int tmpfs_lookup(const char *name);
+int tmpfs_create(const char *name);
+int tmpfs_unlink(const char *name);
+int tmpfs_read(int ino, uint32_t offset, void *buf, uint32_t len);
+int tmpfs_write(int ino, uint32_t offset, const void *buf, uint32_t len);
+int tmpfs_truncate(int ino, uint32_t size);
+// Data page at index, allocated when missing, the page cache uses it in place
+void *tmpfs_getpage(int ino, uint32_t index);
+TmpfsInode *tmpfs_inode(int ino);
+void tmpfs_listFiles();
+
+#endif
@@ -0,0 +1,191 @@
+#include <string.h>
+#include <stdint.h>
+#include "console.h"
+#include "stdio.h"
+#include "thread.h"
+#include "pmm.h"
+#include "fs.h"
+#include "tmpfs.h"
+#include "vfs.h"
+#include "page_cache.h"
+#include "isr.h"
+
+static uint32_t tmpfs_size(int ino) {
+    TmpfsInode *inode = tmpfs_inode(ino);
+    return inode != NULL ? inode->size : 0;
+}
+
+static const VfsBackend vfs_backends[VFS_BACKEND_COUNT] = {
+    [VFS_BACKEND_FAT] = { fat_size, fat_set_size, fat_read, fat_write, NULL },
+    [VFS_BACKEND_TMPFS] = { tmpfs_size, tmpfs_truncate, tmpfs_read, tmpfs_write, tmpfs_getpage },
+};
+
+static VfsFile vfs_open_files[VFS_MAX_OPEN_FILES];
+
+static const VfsBackend *vfs_backend(uint32_t file_id) {
+    return &vfs_backends[VFS_FILE_BACKEND(file_id)];
+}
+
+static VfsFile *vfs_open_file(const char *path) {
+    const char *tmp_name = tmpfs_path(path);
+    uint32_t id;
+    int ino;
+
+    if (tmp_name != NULL) {
+        ino = tmpfs_lookup(tmp_name);
+        id = VFS_FILE_ID(VFS_BACKEND_TMPFS, ino);
+    } else {
+        ino = fat_lookup(path);
+        id = VFS_FILE_ID(VFS_BACKEND_FAT, ino);
+    }
+    if (ino < 0) {
+        return NULL;
+    }
+
+    for (int i = 0; i < VFS_MAX_OPEN_FILES; i++) {
+        if (!vfs_open_files[i].used) {
+            vfs_open_files[i].used = 1;
+            vfs_open_files[i].id = id;
+            return &vfs_open_files[i];
+        }
+    }
+    return NULL;
+}
+
+void vfs_close(VfsFile *file) {
+    if (file != NULL) {
+        file->used = 0;
+    }
+}
+
+uint32_t vfs_size(VfsFile *file) {
+    return vfs_backend(file->id)->size(VFS_FILE_INO(file->id));
+}
+
+static int vfs_read_file(VfsFile *file, uint32_t offset, void *buf, uint32_t len) {
+    uint32_t size = vfs_size(file);
+    uint8_t *dst = buf;
+    uint32_t done = 0;
+
+    if (offset >= size) {
+        return 0;
+    }
+    if (len > size - offset) {
+        len = size - offset;
+    }
+
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t chunk = PAGE_SIZE - pos % PAGE_SIZE;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        CachedPage *page = page_cache_get(file->id, pos / PAGE_SIZE);
+        if (page == NULL) {
+            break;
+        }
+        memcpy(dst + done, page->data + pos % PAGE_SIZE, chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+static int vfs_write_file(VfsFile *file, uint32_t offset, const void *buf, uint32_t len) {
+    const uint8_t *src = buf;
+    uint32_t done = 0;
+
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t chunk = PAGE_SIZE - pos % PAGE_SIZE;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        CachedPage *page = page_cache_get(file->id, pos / PAGE_SIZE);
+        if (page == NULL) {
+            break;
+        }
+        memcpy(page->data + pos % PAGE_SIZE, src + done, chunk);
+        page_cache_mark_dirty(page);
+        done += chunk;
+    }
+    if (offset + done > vfs_size(file)) {
+        vfs_backend(file->id)->set_size(VFS_FILE_INO(file->id), offset + done);
+    }
+    return done;
+}
+
+// The commands of a shell pipeline share the boot CPU, each call runs with
+// interrupts disabled so one is never preempted inside the page cache or FAT
+VfsFile *vfs_open(const char *path) {
+    uint32_t flags = irq_save();
+    VfsFile *file = vfs_open_file(path);
+    irq_restore(flags);
+    return file;
+}
+
+int vfs_read(VfsFile *file, uint32_t offset, void *buf, uint32_t len) {
+    uint32_t flags = irq_save();
+    int n = vfs_read_file(file, offset, buf, len);
+    irq_restore(flags);
+    return n;
+}
+
+int vfs_write(VfsFile *file, uint32_t offset, const void *buf, uint32_t len) {
+    uint32_t flags = irq_save();
+    int n = vfs_write_file(file, offset, buf, len);
+    irq_restore(flags);
+    return n;
+}
+
+int vfs_readpage(uint32_t file_id, uint32_t index, void *page) {
+    int n = vfs_backend(file_id)->read(VFS_FILE_INO(file_id), index * PAGE_SIZE, page, PAGE_SIZE);
+    if (n < 0) {
+        return n;
+    }
+    memset((uint8_t *)page + n, 0, PAGE_SIZE - n);
+    return n;
+}
+
+int vfs_writepage(uint32_t file_id, uint32_t index, const void *page) {
+    const VfsBackend *backend = vfs_backend(file_id);
+    uint32_t size = backend->size(VFS_FILE_INO(file_id));
+    uint32_t offset = index * PAGE_SIZE;
+    uint32_t len = PAGE_SIZE;
+
+    // Never grow the file from writeback, only what lies inside it is written
+    if (offset >= size) {
+        return 0;
+    }
+    if (len > size - offset) {
+        len = size - offset;
+    }
+    return backend->write(VFS_FILE_INO(file_id), offset, page, len);
+}
+
+int vfs_shares_pages(uint32_t file_id) {
+    return vfs_backend(file_id)->getpage != NULL;
+}
+
+void *vfs_getpage(uint32_t file_id, uint32_t index) {
+    return vfs_backend(file_id)->getpage(VFS_FILE_INO(file_id), index);
+}
+
+void vfs_catFile(const char *path) {
+    char buffer[256];
+    uint32_t offset = 0;
+    VfsFile *file = vfs_open(path);
+    int n;
+
+    if (file == NULL) {
+        printf("File '%s' not found.\n", path);
+        return;
+    }
+    // to standard output, stop once nobody reads it anymore
+    while ((n = vfs_read(file, offset, buffer, sizeof(buffer))) > 0) {
+        if (stdio_write(thread_current()->out_fd, buffer, n) < 0)
+            break;
+        offset += n;
+    }
+    printf("\n");
+    vfs_close(file);
+}
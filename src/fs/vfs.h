@@ -0,0 +1,47 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+
+// Backends a path can resolve to
+#define VFS_BACKEND_FAT 0
+#define VFS_BACKEND_TMPFS 1
+#define VFS_BACKEND_COUNT 2
+
+// Identity of a file across opens, used as page cache key
+#define VFS_FILE_ID(backend, ino) (((uint32_t)(backend) << 16) | (uint32_t)(ino))
+#define VFS_FILE_BACKEND(id) ((id) >> 16)
+#define VFS_FILE_INO(id) ((int)((id) & 0xFFFF))
+
+#define VFS_MAX_OPEN_FILES 32
+
+typedef struct {
+    uint32_t (*size)(int ino);
+    int (*set_size)(int ino, uint32_t size);
+    int (*read)(int ino, uint32_t offset, void *buf, uint32_t len);
+    int (*write)(int ino, uint32_t offset, const void *buf, uint32_t len);
+    void *(*getpage)(int ino, uint32_t index); // Backend's own page frame, NULL for backends that copy
+} VfsBackend;
+
+typedef struct {
+    uint32_t id; // VFS_FILE_ID of the open file
+    int used;
+} VfsFile;
+
+//FUNCS
+VfsFile *vfs_open(const char *path);
+void vfs_close(VfsFile *file);
+uint32_t vfs_size(VfsFile *file);
+int vfs_read(VfsFile *file, uint32_t offset, void *buf, uint32_t len);
+int vfs_write(VfsFile *file, uint32_t offset, const void *buf, uint32_t len);
+
+// Page sized transfers between a backend and the page cache
+int vfs_readpage(uint32_t file_id, uint32_t index, void *page);
+int vfs_writepage(uint32_t file_id, uint32_t index, const void *page);
+// Backends that keep file data in page frames lend them to the page cache instead of copying
+int vfs_shares_pages(uint32_t file_id);
+void *vfs_getpage(uint32_t file_id, uint32_t index);
+
+void vfs_catFile(const char *path);
+
+#endif
@@ -1,16 +1,20 @@
 /**
  * Global Descriptor Table(GDT) setup
+ * every CPU has its own GDT with its own TSS and per-CPU data segment
  */
 #include "gdt.h"
+#include "smp.h"
+#include "string.h"
 
-GDT g_gdt[NO_GDT_DESCRIPTORS];
-GDT_PTR g_gdt_ptr;
+GDT g_gdt[SMP_MAX_CPUS][NO_GDT_DESCRIPTORS];
+GDT_PTR g_gdt_ptr[SMP_MAX_CPUS];
+TSS g_tss[SMP_MAX_CPUS] __attribute__((aligned(4)));
 
 /**
- * fill entries of GDT 
+ * fill entries of the GDT of given CPU
  */
-void gdt_set_entry(int index, uint32 base, uint32 limit, uint8 access, uint8 gran) {
-    GDT *this = &g_gdt[index];
+void gdt_set_entry(uint32 cpu, int index, uint32 base, uint32 limit, uint8 access, uint8 gran) {
+    GDT *this = &g_gdt[cpu][index];
 
     this->segment_limit = limit & 0xFFFF;
     this->base_low = base & 0xFFFF;
@@ -23,21 +27,56 @@ void gdt_set_entry(int index, uint32 base, uint32 limit, uint8 access, uint8 gra
     this->base_high = (base >> 24 & 0xFF);
 }
 
-// initialize GDT
-void gdt_init() {
-    g_gdt_ptr.limit = sizeof(g_gdt) - 1;
-    g_gdt_ptr.base_address = (uint32)g_gdt;
+/**
+ * build and load the GDT of given CPU, gs is pointed at percpu
+ */
+void gdt_init_cpu(uint32 cpu, void *percpu, uint32 percpu_size) {
+    TSS *tss = &g_tss[cpu];
+
+    g_gdt_ptr[cpu].limit = sizeof(g_gdt[cpu]) - 1;
+    g_gdt_ptr[cpu].base_address = (uint32)g_gdt[cpu];
+
+    memset(tss, 0, sizeof(TSS));
+    tss->ss0 = GDT_KERNEL_DATA;
+    tss->iomap_base = sizeof(TSS);
 
     // NULL segment
-    gdt_set_entry(0, 0, 0, 0, 0);
+    gdt_set_entry(cpu, 0, 0, 0, 0, 0);
     // code segment
-    gdt_set_entry(1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
+    gdt_set_entry(cpu, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
     // data segment
-    gdt_set_entry(2, 0, 0xFFFFFFFF, 0x92, 0xCF);
+    gdt_set_entry(cpu, 2, 0, 0xFFFFFFFF, 0x92, 0xCF);
     // user code segment
-    gdt_set_entry(3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
+    gdt_set_entry(cpu, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
     // user data segment
-    gdt_set_entry(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+    gdt_set_entry(cpu, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+    // task state segment, 32 bit available TSS
+    gdt_set_entry(cpu, 5, (uint32)tss, sizeof(TSS) - 1, 0x89, 0x00);
+    // per-CPU data segment, byte granular
+    gdt_set_entry(cpu, 6, (uint32)percpu, percpu_size - 1, 0x92, 0x40);
+
+    load_gdt((uint32)&g_gdt_ptr[cpu]);
+    asm volatile("ltr %w0" :: "r"(GDT_TSS));
+    asm volatile("mov %w0, %%gs" :: "r"(GDT_PERCPU));
+}
+
+// initialize GDT of the boot CPU
+void gdt_init() {
+    gdt_init_cpu(SMP_BOOT_CPU, smp_cpu_init(SMP_BOOT_CPU), sizeof(CPU));
+}
+
+/**
+ * set the stack given CPU switches to when an interrupt
+ * or system call enters the kernel from ring 3
+ */
+void gdt_set_kernel_stack(uint32 cpu, uint32 esp0) {
+    g_tss[cpu].esp0 = esp0;
+}
 
-    load_gdt((uint32)&g_gdt_ptr);
+/**
+ * esp0 field of the TSS of given CPU, SYSENTER loads the stack pointer from it
+ */
+uint32 *gdt_kernel_stack(uint32 cpu) {
+    // the TSS is packed, esp0 is still 4 byte aligned as it follows prev_tss
+    return (uint32 *)&g_tss[cpu] + 1;
 }
@@ -5,12 +5,16 @@
 #include "idt.h"
 #include "isr.h"
 #include "8259_pic.h"
+#include "thread.h"
+#include "lapic.h"
+#include "syscall.h"
 
 IDT g_idt[NO_IDT_DESCRIPTORS];
 IDT_PTR g_idt_ptr;
 
 /**
- * fill entries of IDT 
+ * fill entries of IDT, flags carry the gate's privilege level,
+ * only gates with DPL 3 can be raised by int from ring 3
  */
 void idt_set_entry(int index, uint32 base, uint16 seg_sel, uint8 flags) {
     IDT *this = &g_idt[index];
@@ -18,7 +22,7 @@ void idt_set_entry(int index, uint32 base, uint16 seg_sel, uint8 flags) {
     this->base_low = base & 0xFFFF;
     this->segment_selector = seg_sel;
     this->zero = 0;
-    this->type = flags | 0x60;
+    this->type = flags;
     this->base_high = (base >> 16) & 0xFFFF;
 }
 
@@ -26,6 +30,7 @@ void idt_init() {
     g_idt_ptr.base_address = (uint32)g_idt;
     g_idt_ptr.limit = sizeof(g_idt) - 1;
     pic8259_init();
+    isr_init();
 
     idt_set_entry(0, (uint32)exception_0, 0x08, 0x8E);
     idt_set_entry(1, (uint32)exception_1, 0x08, 0x8E);
@@ -75,9 +80,23 @@ void idt_init() {
     idt_set_entry(45, (uint32)irq_13, 0x08, 0x8E);
     idt_set_entry(46, (uint32)irq_14, 0x08, 0x8E);
     idt_set_entry(47, (uint32)irq_15, 0x08, 0x8E);
-    idt_set_entry(128, (uint32)exception_128, 0x08, 0x8E);
+    idt_set_entry(SYSCALL_VECTOR, (uint32)syscall_int, 0x08, 0xEE);
+    idt_set_entry(THREAD_YIELD_VECTOR, (uint32)irq_yield, 0x08, 0x8E);
+    idt_set_entry(ISR_BENCH_VECTOR, (uint32)irq_bench, 0x08, 0x8E);
+    idt_set_entry(LAPIC_TIMER_VECTOR, (uint32)irq_lapic_timer, 0x08, 0x8E);
+    idt_set_entry(LAPIC_RESCHED_VECTOR, (uint32)irq_resched, 0x08, 0x8E);
+    idt_set_entry(LAPIC_BENCH_VECTOR, (uint32)irq_lapic_bench, 0x08, 0x8E);
+    idt_set_entry(LAPIC_SPURIOUS_VECTOR, (uint32)irq_spurious, 0x08, 0x8E);
 
     load_idt((uint32)&g_idt_ptr);
     asm volatile("sti");
 }
 
+/**
+ * load the IDT built by idt_init() on an application processor,
+ * all CPUs share the same vectors
+ */
+void idt_load() {
+    load_idt((uint32)&g_idt_ptr);
+}
+
@@ -0,0 +1,173 @@
+/**
+ * I/O APIC, routes the ISA IRQs to the local APICs in place of the 8259 PIC
+ * for more, see https://wiki.osdev.org/IOAPIC
+ */
+
+#include "ioapic.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "8259_pic.h"
+#include "isr.h"
+#include "smp.h"
+#include "pmm.h"
+#include "paging.h"
+#include "spinlock.h"
+#include "console.h"
+
+typedef struct {
+    volatile uint32 *base;      // NULL when the IRQ has no I/O APIC input
+    uint32 pin;                 // redirection entry
+    uint32 gsi;
+    uint32 low;                 // redirection entry low dword, without IOAPIC_MASKED
+    uint32 cpu;
+    BOOL masked;
+} IOAPIC_IRQ;
+
+static IOAPIC_IRQ g_irqs[IOAPIC_ISA_IRQS];
+static SPINLOCK g_ioapic_lock = SPINLOCK_INIT;
+static BOOL g_active;
+
+static uint32 ioapic_read(volatile uint32 *base, uint32 reg) {
+    base[IOAPIC_REGSEL / 4] = reg;
+    return base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(volatile uint32 *base, uint32 reg, uint32 value) {
+    base[IOAPIC_REGSEL / 4] = reg;
+    base[IOAPIC_WINDOW / 4] = value;
+}
+
+// rewrite the redirection entry of irq from g_irqs
+static void irq_program(uint8 irq) {
+    IOAPIC_IRQ *this = &g_irqs[irq];
+    uint32 reg = IOAPIC_REG_REDTBL + this->pin * 2;
+    uint32 flags = spin_lock_irqsave(&g_ioapic_lock);
+
+    // mask while the destination changes, then write the final low dword
+    ioapic_write(this->base, reg, this->low | IOAPIC_MASKED);
+    ioapic_write(this->base, reg + 1, (uint32)smp_cpu(this->cpu)->apic_id << 24);
+    ioapic_write(this->base, reg, this->low | (this->masked ? IOAPIC_MASKED : 0));
+    spin_unlock_irqrestore(&g_ioapic_lock, flags);
+}
+
+// find the I/O APIC input of an ISA IRQ, honouring interrupt source overrides
+static BOOL irq_setup(const ACPI_MADT_INFO *madt, uint8 irq) {
+    IOAPIC_IRQ *this = &g_irqs[irq];
+    uint32 gsi = madt->isa_gsi[irq];
+    uint16 flags = madt->isa_flags[irq];
+
+    for (uint32 i = 0; i < madt->ioapic_count; i++) {
+        const ACPI_IOAPIC *ioapic = &madt->ioapics[i];
+        volatile uint32 *base = (volatile uint32 *)ioapic->address;
+        uint32 pins;
+
+        if (paging_identity_map(ioapic->address, PAGE_SIZE, PAGE_WRITE | PAGE_CACHE_DISABLE) < 0)
+            continue;
+        pins = ((ioapic_read(base, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+        if (gsi < ioapic->gsi_base || gsi >= ioapic->gsi_base + pins)
+            continue;
+
+        this->base = base;
+        this->pin = gsi - ioapic->gsi_base;
+        this->gsi = gsi;
+        this->cpu = SMP_BOOT_CPU;
+        // ISA IRQs are edge triggered and active high unless overridden
+        this->low = IRQ_BASE + irq;
+        if ((flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW)
+            this->low |= IOAPIC_ACTIVE_LOW;
+        if ((flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL)
+            this->low |= IOAPIC_LEVEL;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * route the ISA IRQs through the I/O APIC listed in the MADT to the boot CPU,
+ * keeping the vectors and the enabled lines of the 8259 which is then masked,
+ * returns FALSE and leaves the 8259 alone when there is no I/O APIC
+ */
+BOOL ioapic_init() {
+    const ACPI_MADT_INFO *madt = acpi_madt();
+    uint16 pic_mask;
+    uint32 flags;
+
+    if (!lapic_present() || madt->ioapic_count == 0)
+        return FALSE;
+
+    flags = irq_save();
+    pic_mask = pic8259_get_mask();
+    for (uint8 irq = 0; irq < IOAPIC_ISA_IRQS; irq++) {
+        if (irq == IRQ2_CASCADE || !irq_setup(madt, irq))
+            continue;
+        g_irqs[irq].masked = (pic_mask & (1 << irq)) ? TRUE : FALSE;
+        irq_program(irq);
+    }
+    pic8259_disable();
+    lapic_mask_lint0();
+    g_active = TRUE;
+    isr_route_eoi();
+    irq_restore(flags);
+    return TRUE;
+}
+
+/**
+ * TRUE once the I/O APIC delivers the ISA IRQs
+ */
+BOOL ioapic_active() {
+    return g_active;
+}
+
+/**
+ * enable/disable given ISA IRQ(0-15)
+ */
+void ioapic_unmask(uint8 irq) {
+    if (irq >= IOAPIC_ISA_IRQS || g_irqs[irq].base == NULL)
+        return;
+    g_irqs[irq].masked = FALSE;
+    irq_program(irq);
+}
+
+void ioapic_mask(uint8 irq) {
+    if (irq >= IOAPIC_ISA_IRQS || g_irqs[irq].base == NULL)
+        return;
+    g_irqs[irq].masked = TRUE;
+    irq_program(irq);
+}
+
+/**
+ * deliver given ISA IRQ to CPU index, returns -1 for a bad IRQ or CPU
+ */
+int ioapic_set_affinity(uint8 irq, uint32 cpu) {
+    if (irq >= IOAPIC_ISA_IRQS || g_irqs[irq].base == NULL || cpu >= smp_cpu_count())
+        return -1;
+    g_irqs[irq].cpu = cpu;
+    irq_program(irq);
+    return 0;
+}
+
+/**
+ * mask every ISA IRQ and hand the lines back to the 8259, which stays masked,
+ * for a kernel started by kexec that routes them again
+ */
+void ioapic_shutdown() {
+    for (uint8 irq = 0; irq < IOAPIC_ISA_IRQS; irq++)
+        ioapic_mask(irq);
+    pic8259_disable();
+}
+
+/**
+ * print routing of all ISA IRQs
+ */
+void ioapic_list() {
+    printf(" IRQ  GSI  VECTOR  CPU  MODE\n");
+    for (uint8 irq = 0; irq < IOAPIC_ISA_IRQS; irq++) {
+        IOAPIC_IRQ *this = &g_irqs[irq];
+        if (this->base == NULL)
+            continue;
+        printf("%4d  %3d  0x%x    %3d  %s%s%s\n", irq, this->gsi, this->low & 0xFF, this->cpu,
+               (this->low & IOAPIC_LEVEL) ? "level" : "edge",
+               (this->low & IOAPIC_ACTIVE_LOW) ? " low" : "",
+               this->masked ? " masked" : "");
+    }
+}
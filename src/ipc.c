@@ -0,0 +1,252 @@
+/**
+ * Message passing channels
+ * each channel is a ring of message slots under a spinlock, a page sent with a
+ * message leaves the sender's page table when it is queued and only its frame
+ * is kept in the slot until the receiver maps it, sending 64KB costs sixteen
+ * page table entries on each side instead of a 64KB copy
+ * pages are unmapped without a TLB shootdown like the rest of the user window,
+ * the threads using a channel run on one CPU
+ * a destroyed channel is dead until the last thread inside ipc_send() or
+ * ipc_recv() has left it, only then can ipc_channel_create() reuse the slot
+ */
+
+#include "ipc.h"
+#include "user.h"
+#include "thread.h"
+#include "spinlock.h"
+#include "paging.h"
+#include "pmm.h"
+#include "string.h"
+
+typedef struct {
+    uint32 len;
+    uint8 data[IPC_INLINE_SIZE];
+    uint32 page_count;
+    uint32 frames[IPC_MAX_PAGES];
+} IPC_SLOT;
+
+typedef struct {
+    BOOL used;
+    BOOL dead;                          // destroyed, sends and receives fail
+    uint32 users;                       // threads in ipc_send() or ipc_recv(), g_channels_lock protects both
+    SPINLOCK lock;
+    uint32 head, tail;                  // tail - head messages are queued
+    IPC_SLOT slots[IPC_QUEUE_SIZE];
+    THREAD *sender;                     // blocked on a full channel
+    THREAD *receiver;                   // blocked on an empty channel
+} IPC_CHANNEL;
+
+static IPC_CHANNEL g_channels[IPC_MAX_CHANNELS];
+static SPINLOCK g_channels_lock = SPINLOCK_INIT;
+
+// the live channel id names, held until channel_put(), NULL if there is none
+static IPC_CHANNEL *channel_get(int id) {
+    IPC_CHANNEL *channel = NULL;
+    uint32 flags;
+
+    if (id < 0 || id >= IPC_MAX_CHANNELS)
+        return NULL;
+    flags = spin_lock_irqsave(&g_channels_lock);
+    if (g_channels[id].used && !g_channels[id].dead) {
+        channel = &g_channels[id];
+        channel->users++;
+    }
+    spin_unlock_irqrestore(&g_channels_lock, flags);
+    return channel;
+}
+
+// drop a channel from channel_get(), the last user of a dead channel frees its slot
+static void channel_put(IPC_CHANNEL *channel) {
+    uint32 flags = spin_lock_irqsave(&g_channels_lock);
+
+    if (--channel->users == 0 && channel->dead)
+        channel->used = FALSE;
+    spin_unlock_irqrestore(&g_channels_lock, flags);
+}
+
+// TRUE if count pages at addr lie in the user window, with mapped set they must
+// be present writable user pages, otherwise they must not be present
+static BOOL pages_ok(uint32 addr, uint32 count, BOOL mapped) {
+    if (addr % PAGE_SIZE != 0 || addr < USER_BASE || addr >= USER_LIMIT ||
+        count > (USER_LIMIT - addr) / PAGE_SIZE)
+        return FALSE;
+    for (uint32 i = 0; i < count; i++) {
+        uint32 *pte = paging_get_pte(addr + i * PAGE_SIZE, FALSE);
+        BOOL present = pte != NULL && (*pte & PAGE_PRESENT);
+
+        if (mapped && (!present || (*pte & (PAGE_USER | PAGE_WRITE)) != (PAGE_USER | PAGE_WRITE)))
+            return FALSE;
+        if (!mapped && present)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * open a channel, returns its id or -1 when all are in use
+ */
+int ipc_channel_create() {
+    uint32 flags = spin_lock_irqsave(&g_channels_lock);
+    int id = -1;
+
+    for (int i = 0; i < IPC_MAX_CHANNELS; i++) {
+        if (!g_channels[i].used) {
+            memset(&g_channels[i], 0, sizeof(IPC_CHANNEL));
+            g_channels[i].used = TRUE;
+            id = i;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&g_channels_lock, flags);
+    return id;
+}
+
+/**
+ * close a channel and free the pages of messages nobody received,
+ * threads blocked on it wake up and their call fails
+ */
+void ipc_channel_destroy(int id) {
+    IPC_CHANNEL *channel = channel_get(id);
+    THREAD *sender, *receiver;
+    uint32 flags;
+
+    if (channel == NULL)
+        return;
+    flags = spin_lock_irqsave(&g_channels_lock);
+    channel->dead = TRUE;
+    spin_unlock(&g_channels_lock);
+
+    spin_lock(&channel->lock);
+    for (; channel->head != channel->tail; channel->head++) {
+        IPC_SLOT *slot = &channel->slots[channel->head % IPC_QUEUE_SIZE];
+        for (uint32 i = 0; i < slot->page_count; i++)
+            pmm_free_page((void *)slot->frames[i]);
+    }
+    sender = channel->sender;
+    receiver = channel->receiver;
+    channel->sender = NULL;
+    channel->receiver = NULL;
+    spin_unlock_irqrestore(&channel->lock, flags);
+
+    if (sender != NULL)
+        thread_wake(sender);
+    if (receiver != NULL)
+        thread_wake(receiver);
+    channel_put(channel);
+}
+
+/**
+ * queue msg on the channel, blocking while it is full, the page_count
+ * writable pages at msg->pages are unmapped from the sender and travel
+ * with the message, returns -1 on a bad channel, size or page and when
+ * the channel is destroyed
+ */
+int ipc_send(int id, const IPC_MESSAGE *msg) {
+    IPC_CHANNEL *channel;
+    THREAD *receiver;
+    IPC_SLOT *slot;
+    uint32 flags;
+
+    if (msg->len > IPC_INLINE_SIZE || msg->page_count > IPC_MAX_PAGES)
+        return -1;
+    channel = channel_get(id);
+    if (channel == NULL)
+        return -1;
+    // a program may send pages its pager has not filled yet
+    for (uint32 i = 0; i < msg->page_count; i++) {
+        uint32 *pte = paging_get_pte(msg->pages + i * PAGE_SIZE, FALSE);
+        if (pte == NULL || !(*pte & PAGE_PRESENT))
+            user_page_fault(msg->pages + i * PAGE_SIZE, TRUE);
+    }
+
+    flags = spin_lock_irqsave(&channel->lock);
+    while (!channel->dead && channel->tail - channel->head == IPC_QUEUE_SIZE) {
+        channel->sender = thread_current();
+        spin_unlock(&channel->lock);
+        thread_block();
+        spin_lock(&channel->lock);
+    }
+    channel->sender = NULL;
+    if (channel->dead || (msg->page_count > 0 && !pages_ok(msg->pages, msg->page_count, TRUE))) {
+        spin_unlock_irqrestore(&channel->lock, flags);
+        channel_put(channel);
+        return -1;
+    }
+
+    slot = &channel->slots[channel->tail % IPC_QUEUE_SIZE];
+    slot->len = msg->len;
+    memcpy(slot->data, msg->data, msg->len);
+    slot->page_count = msg->page_count;
+    for (uint32 i = 0; i < msg->page_count; i++) {
+        uint32 page = msg->pages + i * PAGE_SIZE;
+        slot->frames[i] = *paging_get_pte(page, FALSE) & PAGE_MASK;
+        paging_unmap_page(page);
+    }
+    channel->tail++;
+    receiver = channel->receiver;
+    spin_unlock_irqrestore(&channel->lock, flags);
+
+    if (receiver != NULL)
+        thread_wake(receiver);
+    channel_put(channel);
+    return 0;
+}
+
+/**
+ * take the next message off the channel, blocking while it is empty,
+ * msg->pages and msg->page_count give the unmapped range to map the pages
+ * at and its size in pages, page_count is set to the pages received,
+ * returns -1 and leaves the message queued when they do not fit, -1 as well
+ * on a bad channel and when the channel is destroyed
+ */
+int ipc_recv(int id, IPC_MESSAGE *msg) {
+    IPC_CHANNEL *channel = channel_get(id);
+    THREAD *sender;
+    IPC_SLOT *slot;
+    uint32 flags;
+
+    if (channel == NULL)
+        return -1;
+    flags = spin_lock_irqsave(&channel->lock);
+    while (!channel->dead && channel->tail == channel->head) {
+        channel->receiver = thread_current();
+        spin_unlock(&channel->lock);
+        thread_block();
+        spin_lock(&channel->lock);
+    }
+    channel->receiver = NULL;
+    if (channel->dead) {
+        spin_unlock_irqrestore(&channel->lock, flags);
+        channel_put(channel);
+        return -1;
+    }
+
+    slot = &channel->slots[channel->head % IPC_QUEUE_SIZE];
+    if (slot->page_count > 0 &&
+        (slot->page_count > msg->page_count || !pages_ok(msg->pages, slot->page_count, FALSE))) {
+        spin_unlock_irqrestore(&channel->lock, flags);
+        channel_put(channel);
+        return -1;
+    }
+    for (uint32 i = 0; i < slot->page_count; i++) {
+        if (paging_map_page(msg->pages + i * PAGE_SIZE, slot->frames[i], PAGE_USER | PAGE_WRITE) < 0) {
+            // out of page tables, the frames stay with the message
+            while (i-- > 0)
+                paging_unmap_page(msg->pages + i * PAGE_SIZE);
+            spin_unlock_irqrestore(&channel->lock, flags);
+            channel_put(channel);
+            return -1;
+        }
+    }
+    msg->len = slot->len;
+    memcpy(msg->data, slot->data, slot->len);
+    msg->page_count = slot->page_count;
+    channel->head++;
+    sender = channel->sender;
+    spin_unlock_irqrestore(&channel->lock, flags);
+
+    if (sender != NULL)
+        thread_wake(sender);
+    channel_put(channel);
+    return 0;
+}
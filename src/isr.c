@@ -2,9 +2,32 @@
 #include "idt.h"
 #include "8259_pic.h"
 #include "console.h"
+#include "thread.h"
+#include "lapic.h"
+#include "ioapic.h"
+#include "smp.h"
+#include "tsc.h"
+#include "serial.h"
+#include "softirq.h"
+#include "rcu.h"
+#include "string.h"
 
-// For both exceptions and irq interrupt
+// For both exceptions and irq interrupt, every vector has a handler so dispatch needs no check,
+// dispatch reads it under RCU, an interrupt handler is a read-side section by itself
 ISR g_interrupt_handlers[NO_INTERRUPT_HANDLERS];
+static ISR_EOI g_interrupt_eoi[NO_INTERRUPT_HANDLERS];
+
+// cycles spent per vector, an IRQ is mostly delivered to one CPU so the locks hardly contend
+typedef struct {
+    SPINLOCK lock;
+    uint32 count;
+    uint32 max;                         // cycles from entry to end of interrupt
+    uint64 total;
+    uint64 dispatch;                    // cycles from entry to handler start
+    uint32 buckets[ISR_STAT_BUCKETS];   // count per floor(log2(cycles))
+} ISR_STAT;
+
+static ISR_STAT g_interrupt_stats[NO_INTERRUPT_HANDLERS];
 
 // for more details, see Intel manual -> Interrupt & Exception Handling
 char *exception_messages[32] = {
@@ -42,55 +65,248 @@ char *exception_messages[32] = {
     "Reserved"
 };
 
+static void isr_ignore(REGISTERS *reg) {
+    (void)reg;
+}
+
+static void eoi_none(int num) {
+    (void)num;
+}
+
+static void eoi_lapic(int num) {
+    (void)num;
+    lapic_eoi();
+}
+
+static void eoi_pic(int num) {
+    pic8259_eoi(num);
+}
+
+static ISR default_handler(int num) {
+    return num < 32 ? isr_exception_halt : isr_ignore;
+}
+
+/**
+ * point every vector at its default handler and acknowledge,
+ * called by idt_init() before interrupts are enabled
+ */
+void isr_init() {
+    for (int i = 0; i < NO_INTERRUPT_HANDLERS; i++)
+        g_interrupt_handlers[i] = default_handler(i);
+    isr_route_eoi();
+}
+
 /**
- * register given handler to interrupt handlers at given num
+ * pick the acknowledge of every hardware vector for the interrupt controllers
+ * in use, called again when the I/O APIC takes over from the 8259 PIC
+ */
+void isr_route_eoi() {
+    // vectors between the PIC and local APIC ranges are software interrupts
+    for (int i = 0; i < NO_INTERRUPT_HANDLERS; i++) {
+        if (i >= LAPIC_VECTOR_BASE)
+            g_interrupt_eoi[i] = eoi_lapic;
+        else if (i >= IRQ_BASE && i < IRQ_BASE + 16)
+            g_interrupt_eoi[i] = ioapic_active() ? eoi_lapic : eoi_pic;
+        else
+            g_interrupt_eoi[i] = eoi_none;
+    }
+}
+
+/**
+ * register given handler to interrupt handlers at given num,
+ * NULL restores the default handler, once it returns no CPU runs
+ * the replaced handler any more and its data may be freed
  */
 void isr_register_interrupt_handler(int num, ISR handler) {
     printf("[KERNEL] IRQ %d registered\n", num);
-    if (num < NO_INTERRUPT_HANDLERS)
-        g_interrupt_handlers[num] = handler;
+    if (num < 0 || num >= NO_INTERRUPT_HANDLERS)
+        return;
+    if (handler == NULL)
+        handler = default_handler(num);
+    if (g_interrupt_handlers[num] != handler) {
+        rcu_assign_pointer(g_interrupt_handlers[num], handler);
+        synchronize_rcu();
+    }
 }
 
 /*
- * turn off current interrupt
+ * turn off current interrupt, with the I/O APIC active this is
+ * a single local APIC write instead of 8259 port writes
 */
 void isr_end_interrupt(int num) {
-    pic8259_eoi(num);
+    g_interrupt_eoi[num](num);
+}
+
+/**
+ * enable given IRQ line(0-15) at whichever controller delivers it
+ */
+void isr_unmask_irq(uint8 irq) {
+    if (ioapic_active())
+        ioapic_unmask(irq);
+    else
+        pic8259_unmask(irq);
+}
+
+/**
+ * disable given IRQ line(0-15) at whichever controller delivers it
+ */
+void isr_mask_irq(uint8 irq) {
+    if (ioapic_active())
+        ioapic_mask(irq);
+    else
+        pic8259_mask(irq);
+}
+
+static void stat_record(uint32 num, uint64 entry, uint64 start, uint64 end) {
+    ISR_STAT *stat = &g_interrupt_stats[num];
+    uint32 cycles = (uint32)(end - entry), bucket = 0;
+
+    if (cycles > 0)
+        asm("bsr %1, %0" : "=r"(bucket) : "rm"(cycles));
+    spin_lock(&stat->lock);
+    stat->count++;
+    stat->total += cycles;
+    stat->dispatch += start - entry;
+    stat->buckets[bucket]++;
+    if (cycles > stat->max)
+        stat->max = cycles;
+    spin_unlock(&stat->lock);
 }
 
 /**
  * invoke isr routine and send eoi to pic,
- * being called in irq.asm
+ * being called in irq.asm, returns the frame to resume which
+ * belongs to another thread when the scheduler switched
+ */
+REGISTERS *isr_irq_handler(REGISTERS *reg) {
+    uint64 start = rdtsc();
+
+    rcu_dereference(g_interrupt_handlers[reg->int_no])(reg);
+    g_interrupt_eoi[reg->int_no](reg->int_no);
+    stat_record(reg->int_no, cpu_self()->irq_entry, start, rdtsc());
+    softirq_run();
+    return thread_switch(reg);
+}
+
+// append a decimal number and a separator to line
+static void stat_append(char *line, uint32 value, const char *separator) {
+    char buf[16];
+
+    itoa(buf, 'u', value);
+    strcat(line, buf);
+    strcat(line, separator);
+}
+
+/**
+ * print count, mean, max and log2 histogram of the cycles from entry to
+ * end of interrupt of every vector that fired
+ */
+void isr_stat_print() {
+    printf(" VEC     COUNT  DISPATCH      MEAN       MAX  cycles\n");
+    for (int i = 0; i < NO_INTERRUPT_HANDLERS; i++) {
+        ISR_STAT *stat = &g_interrupt_stats[i];
+        char line[ISR_STAT_BUCKETS * 16] = "";
+
+        if (stat->count == 0)
+            continue;
+        printf("%4x  %8d  %8d  %8d  %8d\n", i, stat->count, udiv64_32(stat->dispatch, stat->count),
+               udiv64_32(stat->total, stat->count), stat->max);
+        // only the occupied buckets, as 2^bucket:count
+        strcpy(line, "      ");
+        for (int b = 0; b < ISR_STAT_BUCKETS; b++) {
+            if (stat->buckets[b] == 0)
+                continue;
+            strcat(line, " 2^");
+            stat_append(line, b, ":");
+            stat_append(line, stat->buckets[b], "");
+        }
+        printf("%s\n", line);
+    }
+}
+
+/**
+ * write the statistics of isr_stat_print() to the serial port, one
+ * comma separated line per vector, returns FALSE without a serial port
  */
-void isr_irq_handler(REGISTERS *reg) {
-    if (g_interrupt_handlers[reg->int_no] != NULL) {
-        ISR handler = g_interrupt_handlers[reg->int_no];
-        handler(reg);
+BOOL isr_stat_serial() {
+    if (!serial_present())
+        return FALSE;
+    serial_putstr("vector,count,dispatch,mean,max");
+    for (int b = 0; b < ISR_STAT_BUCKETS; b++) {
+        char line[16] = ",log2_";
+        stat_append(line, b, "");
+        serial_putstr(line);
+    }
+    serial_putstr("\n");
+    for (int i = 0; i < NO_INTERRUPT_HANDLERS; i++) {
+        ISR_STAT *stat = &g_interrupt_stats[i];
+        char line[(ISR_STAT_BUCKETS + 5) * 12] = "";
+
+        if (stat->count == 0)
+            continue;
+        stat_append(line, i, ",");
+        stat_append(line, stat->count, ",");
+        stat_append(line, udiv64_32(stat->dispatch, stat->count), ",");
+        stat_append(line, udiv64_32(stat->total, stat->count), ",");
+        stat_append(line, stat->max, "");
+        for (int b = 0; b < ISR_STAT_BUCKETS; b++) {
+            strcat(line, ",");
+            stat_append(line, stat->buckets[b], "");
+        }
+        strcat(line, "\n");
+        serial_putstr(line);
+    }
+    return TRUE;
+}
+
+/**
+ * clear the statistics of all vectors
+ */
+void isr_stat_reset() {
+    for (int i = 0; i < NO_INTERRUPT_HANDLERS; i++) {
+        ISR_STAT *stat = &g_interrupt_stats[i];
+        uint32 flags = spin_lock_irqsave(&stat->lock);
+
+        stat->count = 0;
+        stat->max = 0;
+        stat->total = 0;
+        stat->dispatch = 0;
+        memset(stat->buckets, 0, sizeof(stat->buckets));
+        spin_unlock_irqrestore(&stat->lock, flags);
     }
-    pic8259_eoi(reg->int_no);
 }
 
 static void print_registers(REGISTERS *reg) {
-    printf("REGISTERS:\n");
-    printf("err_code=%d\n", reg->err_code);
-    printf("eax=0x%x, ebx=0x%x, ecx=0x%x, edx=0x%x\n", reg->eax, reg->ebx, reg->ecx, reg->edx);
-    printf("edi=0x%x, esi=0x%x, ebp=0x%x, esp=0x%x\n", reg->edi, reg->esi, reg->ebp, reg->esp);
-    printf("eip=0x%x, cs=0x%x, ss=0x%x, eflags=0x%x, useresp=0x%x\n", reg->eip, reg->ss, reg->eflags, reg->useresp);
+    console_printf("REGISTERS:\n");
+    console_printf("err_code=%d\n", reg->err_code);
+    console_printf("eax=0x%x, ebx=0x%x, ecx=0x%x, edx=0x%x\n", reg->eax, reg->ebx, reg->ecx, reg->edx);
+    console_printf("edi=0x%x, esi=0x%x, ebp=0x%x, esp=0x%x\n", reg->edi, reg->esi, reg->ebp, reg->esp);
+    console_printf("eip=0x%x, cs=0x%x, ss=0x%x, eflags=0x%x, useresp=0x%x\n", reg->eip, reg->ss, reg->eflags, reg->useresp);
+}
+
+/**
+ * print exception message with registers and stop, or end the
+ * thread when it came from ring 3, for faults a registered handler could not resolve
+ */
+void isr_exception_halt(REGISTERS *reg) {
+    console_printf("EXCEPTION: %s\n", exception_messages[reg->int_no]);
+    print_registers(reg);
+    // a fault in ring 3 only ends the thread that caused it
+    if (reg->cs & 3) {
+        console_printf("thread %d killed\n", thread_current()->id);
+        thread_exit();
+    }
+    for (;;)
+        ;
 }
 
 /**
  * invoke exception routine,
  * being called in exception.asm
  */
-void isr_exception_handler(REGISTERS reg) {
-    if (reg.int_no < 32) {
-        printf("EXCEPTION: %s\n", exception_messages[reg.int_no]);
-        print_registers(&reg);
-        for (;;)
-            ;
-    }
-    if (g_interrupt_handlers[reg.int_no] != NULL) {
-        ISR handler = g_interrupt_handlers[reg.int_no];
-        handler(&reg);
-    }
+void isr_exception_handler(REGISTERS *reg) {
+    uint64 start = rdtsc();
+
+    rcu_dereference(g_interrupt_handlers[reg->int_no])(reg);
+    stat_record(reg->int_no, start, start, rdtsc());
 }
\ No newline at end of file
@@ -11,7 +11,40 @@
 #include "ctypes.h"
 #include "qemu.h"
 #include "romfont.h"
+#include "pmm.h"
+#include "paging.h"
+#include "crc32c.h"
+#include "tsc.h"
+#include "pit.h"
+#include "clock.h"
+#include "timer.h"
+#include "serial.h"
+#include "softirq.h"
+#include "seqlock.h"
+#include "rcu.h"
+#include "syscall.h"
+#include "user.h"
+#include "elf.h"
+#include "ipc.h"
+#include "pipe.h"
+#include "vdso.h"
+#include "fpu.h"
+#include "cpu_features.h"
+#include "kexec.h"
+#include "boottime.h"
+#include "mpmc.h"
+#include "thread.h"
+#include "smp.h"
+#include "ioapic.h"
+#include "lapic.h"
 #include "fs/fs.h"
+#include "fs/tmpfs.h"
+#include "fs/vfs.h"
+#include "fs/page_cache.h"
+#include "fs/mmap.h"
+#include "fs/fat_lz4.h"
+#include "fs/fat_log.h"
+#include "fs/fat_crc.h"
 
 #include <string.h>
 #include <stdint.h>
@@ -24,23 +57,59 @@
 #define VERSION "0.05"
 #define MAX_HISTORY 10
 
-#define MAX_FILENAME_LENGTH 20
-#define MAX_FILE_COUNT 100
-#define MAX_FILE_CONTENT_LENGTH 10000
+// shell command lines, the words of a line need at most twice its length
+#define SHELL_LINE_SIZE 255
+#define SHELL_WORDS_SIZE (2 * SHELL_LINE_SIZE)
+#define SHELL_MAX_WORDS 32
+#define SHELL_MAX_STAGES 8
 
-typedef struct {
-    char name[MAX_FILENAME_LENGTH];
-    int size;
-    char content[MAX_FILE_CONTENT_LENGTH];
-} File;
+// lines longer than this are matched by grep in pieces
+#define GREP_LINE_SIZE 256
 
-typedef struct {
-    char name[MAX_FILENAME_LENGTH];
-    int file_count;
-    File files[MAX_FILE_COUNT];
-} Directory;
+// assumed when the bootloader gives us no memory information
+#define DEFAULT_MEM_UPPER_KB (15 * 1024)
+
+// how often fslogd checkpoints the FAT log
+#define FSLOGD_INTERVAL_MS 2000
+
+// 4KB CRC32C passes each smpbench job runs
+#define SMPBENCH_ROUNDS 4096
+
+// interrupt round trips timed by irqbench
+#define IRQBENCH_ROUNDS 10000
+
+// null system calls timed by sysbench on each entry path
+#define SYSBENCH_CALLS 100000
+
+// threads sharing one CPU in fpubench, the ticks each one checks its registers
+// for, and the page copies timed with and without SSE
+#define FPUBENCH_THREADS 4
+#define FPUBENCH_TICKS 50
+#define FPUBENCH_COPIES 256
+
+// clock reads from ring 3 checked by timetest, and how far the time page may
+// be off the kernel clock, 1us of rounding plus the error of the fixed point
+// multiplier, under uptime >> 28 for a TSC up to 16GHz
+#define TIMETEST_READS 1000000
+#define TIMETEST_SLACK_NS 1000
+#define TIMETEST_DRIFT_SHIFT 28
+
+// round trips timed by ipcbench, a bulk round trip moves IPC_MAX_PAGES pages each way
+#define IPCBENCH_ROUNDS 10000
+#define IPCBENCH_BYTES (IPC_MAX_PAGES * PAGE_SIZE)
+#define IPCBENCH_SEND_ADDR (USER_BASE + 0x100000)
+#define IPCBENCH_ECHO_ADDR (USER_BASE + 0x200000)
+
+// default run time of lockstress and the cells of its queue
+#define LOCKSTRESS_MS 1000
+#define LOCKSTRESS_CELLS 256
+
+// timers armed at once by timerbench, and how many of them are left to fire
+#define TIMERBENCH_TIMERS 4096
+#define TIMERBENCH_FIRED 64
+
+void main_loop();
 
-Directory root_directory;
 char command_history[MAX_HISTORY][255];
 int history_count = 0;
 int current_history_index = 0;
@@ -71,60 +140,58 @@ void custom_strcpy(char *dest, const char *src) {
 
 
 void removeFile(const char *filename) {
-    int found = 0;
-    for (int i = 0; i < root_directory.file_count; ++i) {
-        if (strcmp(root_directory.files[i].name, filename) == 0) {
-            found = 1;
-            for (int j = i; j < root_directory.file_count - 1; ++j) {
-                root_directory.files[j] = root_directory.files[j + 1];
-            }
-            root_directory.file_count--;
-            printf("File '%s' removed successfully.\n", filename);
-            break;
-        }
-    }
-    if (!found) {
+    const char *tmp_name = tmpfs_path(filename);
+
+    if (tmp_name == NULL) {
+        fat_removeFile(filename);
+    } else if (tmpfs_unlink(tmp_name) == 0) {
+        printf("File '%s' removed successfully.\n", filename);
+    } else {
         printf("File '%s' not found.\n", filename);
     }
 }
 
-void __cpuid(uint32 type, uint32 *eax, uint32 *ebx, uint32 *ecx, uint32 *edx) {
-    asm volatile("cpuid"
-                 : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
-                 : "0"(type));
+void tmpfs_createFile(const char *name, const char *content) {
+    int ino = tmpfs_create(name);
+
+    if (ino < 0) {
+        printf("Cannot create '%s' in tmpfs.\n", name);
+        return;
+    }
+    tmpfs_truncate(ino, 0);
+    if (tmpfs_write(ino, 0, content, strlen(content)) < 0 && strlen(content) > 0) {
+        printf("Out of memory writing '%s'.\n", name);
+        return;
+    }
+    printf("File '%s' created successfully in tmpfs.\n", name);
+}
+
+void free_command() {
+    uint32 free_pages = pmm_free_pages();
+    uint32 total_pages = pmm_total_pages();
+
+    printf("Memory: %d KB free of %d KB (%d/%d pages)\n",
+           free_pages * (PAGE_SIZE / 1024), total_pages * (PAGE_SIZE / 1024), free_pages, total_pages);
 }
 
 int cpuid_info(int print) {
-    uint32 brand[12];
     uint32 eax, ebx, ecx, edx;
     uint32 type;
 
-    memset(brand, 0, sizeof(brand));
-    __cpuid(0x80000002, (uint32 *)brand + 0x0, (uint32 *)brand + 0x1, (uint32 *)brand + 0x2, (uint32 *)brand + 0x3);
-    __cpuid(0x80000003, (uint32 *)brand + 0x4, (uint32 *)brand + 0x5, (uint32 *)brand + 0x6, (uint32 *)brand + 0x7);
-    __cpuid(0x80000004, (uint32 *)brand + 0x8, (uint32 *)brand + 0x9, (uint32 *)brand + 0xa, (uint32 *)brand + 0xb);
-
     if (print) {
-        printf("Brand: %s\n", (char *)brand);
+        printf("Brand: %s\n", g_cpu_features.brand);
         for (type = 0; type < 4; type++) {
-            __cpuid(type, &eax, &ebx, &ecx, &edx);
+            cpuid(type, 0, &eax, &ebx, &ecx, &edx);
             printf("type:0x%x, eax:0x%x, ebx:0x%x, ecx:0x%x, edx:0x%x\n", type, eax, ebx, ecx, edx);
         }
     }
 
-    if (strstr((char *)brand, "QEMU") != NULL)
+    if (strstr(g_cpu_features.brand, "QEMU") != NULL)
         return BRAND_QEMU;
 
     return BRAND_VBOX;
 }
 
-BOOL is_echo(char *b) {
-    if ((b[0] == 'e') && (b[1] == 'c') && (b[2] == 'h') && (b[3] == 'o'))
-        if (b[4] == ' ' || b[4] == '\0')
-            return TRUE;
-    return FALSE;
-}
-
 void shutdown() {
     int brand = cpuid_info(0);
     if (brand == BRAND_QEMU)
@@ -143,9 +210,62 @@ void unameCommand(const char *arg) {
     }
 }
 
+// the word tokenize() stores for an unquoted |, a quoted "|" is an ordinary
+// word so run_line() tells them apart by address
+static char g_pipe_word[] = "|";
+
+// split line into words at spaces, quotes keep spaces and | inside a word and
+// an unquoted | is g_pipe_word, the other words are copied to words, returns
+// their number or -1 on an unterminated quote, a long line or more than max words
+int tokenize(const char *line, char words[SHELL_WORDS_SIZE], char **argv, int max) {
+    int argc = 0;
+
+    if (strlen(line) >= SHELL_LINE_SIZE)
+        return -1;
+    for (;;) {
+        char quote = 0;
+
+        while (*line == ' ' || *line == '\t')
+            line++;
+        if (*line == '\0')
+            return argc;
+        if (argc == max)
+            return -1;
+        if (*line == '|') {
+            argv[argc++] = g_pipe_word;
+            line++;
+            continue;
+        }
+        argv[argc++] = words;
+        for (; *line != '\0' && (quote || (*line != ' ' && *line != '\t' && *line != '|')); line++) {
+            if (quote != 0 && *line == quote)
+                quote = 0;
+            else if (quote == 0 && (*line == '"' || *line == '\''))
+                quote = *line;
+            else
+                *words++ = *line;
+        }
+        if (quote != 0)
+            return -1;
+        *words++ = '\0';
+    }
+}
+
+// run the ELF program a command line names with the rest as arguments
+void exec_command(const char *line) {
+    char words[SHELL_WORDS_SIZE];
+    char *argv[ELF_MAX_ARGS];
+    int argc = tokenize(line, words, argv, ELF_MAX_ARGS);
+
+    if (argc < 0)
+        printf("exec: unbalanced quotes or more than %d arguments\n", ELF_MAX_ARGS);
+    else if (argc > 0)
+        elf_exec(argv[0], argc, argv);
+}
+
 void new_kernel_instance(char *cmd_to_run) {
     printf("\nRunning Command/Program '%s' in Quantum instance...\n\n", cmd_to_run);
-    printf("Command '%s' not found!!\n", cmd_to_run);
+    exec_command(cmd_to_run);
 }
 
 void vim() {
@@ -161,32 +281,1114 @@ void vim() {
     const char *shell_file_content = "> ";
 
     while (1) {
-        if (strcmp(file_content, ".q vim") == 0) {
-            main_loop();
+        printf("%s", shell_file_content);
+        memset(file_content, 0, sizeof(file_content));
+        getstr_bound(file_content, strlen(shell_file_content));
+        if (strcmp(file_content, ".q vim") == 0)
+            return;
+    }
+
+    createFile(name, file_content);
+}
+
+// where cat, grep and wc read from, a file or the pipe on standard input
+typedef struct {
+    VfsFile *file;
+    uint32 offset;
+    int fd;                 // standard input when file is NULL
+} SHELL_INPUT;
+
+// open path, or standard input when path is NULL, FALSE with a message if there is neither
+static BOOL input_open(SHELL_INPUT *input, const char *path, const char *usage) {
+    input->file = NULL;
+    input->offset = 0;
+    input->fd = STDIO_CONSOLE;
+    if (path != NULL) {
+        input->file = vfs_open(path);
+        if (input->file == NULL) {
+            printf("File '%s' not found.\n", path);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    // reading the keyboard is what the shell itself does
+    input->fd = thread_current()->in_fd;
+    if (input->fd == STDIO_CONSOLE) {
+        printf("usage: %s, or after a |\n", usage);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// read the next bytes, 0 at the end
+static int input_read(SHELL_INPUT *input, char *buf, uint32 len) {
+    int n;
+
+    if (input->file == NULL)
+        return stdio_read(input->fd, buf, len);
+    n = vfs_read(input->file, input->offset, buf, len);
+    if (n > 0)
+        input->offset += n;
+    return n;
+}
+
+static void input_close(SHELL_INPUT *input) {
+    vfs_close(input->file);
+}
+
+// copy standard input to standard output
+void cat_input() {
+    SHELL_INPUT input;
+    char buf[256];
+    int n;
+
+    if (!input_open(&input, NULL, "cat <filename>"))
+        return;
+    // stop once nobody reads standard output anymore
+    while ((n = input_read(&input, buf, sizeof(buf))) > 0) {
+        if (stdio_write(thread_current()->out_fd, buf, n) < 0)
+            break;
+    }
+    input_close(&input);
+}
+
+// print the lines of a file or of standard input that contain text
+void grep_command(int argc, char **argv) {
+    SHELL_INPUT input;
+    char buf[256], line[GREP_LINE_SIZE];
+    uint32 len = 0;
+    int n;
+
+    if (argc < 2 || argc > 3) {
+        printf("usage: grep <text> [filename]\n");
+        return;
+    }
+    if (!input_open(&input, argc == 3 ? argv[2] : NULL, "grep <text> <filename>"))
+        return;
+    // only one line is held at a time, whatever the size of the input
+    while ((n = input_read(&input, buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (buf[i] != '\n')
+                line[len++] = buf[i];
+            if (buf[i] == '\n' || len == sizeof(line) - 1) {
+                line[len] = '\0';
+                if (strstr(line, argv[1]) != NULL)
+                    printf("%s\n", line);
+                len = 0;
+            }
+        }
+    }
+    line[len] = '\0';
+    if (len > 0 && strstr(line, argv[1]) != NULL)
+        printf("%s\n", line);
+    input_close(&input);
+}
+
+typedef struct {
+    uint32 lines, words, bytes;
+    BOOL in_word;
+} WC_COUNT;
+
+static void wc_count(WC_COUNT *count, const char *data, uint32 size) {
+    for (uint32 i = 0; i < size; i++) {
+        if (data[i] == '\n')
+            count->lines++;
+        if (isspace(data[i])) {
+            count->in_word = FALSE;
+        } else if (!count->in_word) {
+            count->in_word = TRUE;
+            count->words++;
+        }
+    }
+    count->bytes += size;
+}
+
+// count lines, words and bytes by scanning the file in place through mmap,
+// or standard input when path is NULL
+void wc_command(const char *path) {
+    WC_COUNT count = {0, 0, 0, FALSE};
+    VfsFile *file;
+    uint32 size;
+    const char *data;
+
+    if (path == NULL) {
+        SHELL_INPUT input;
+        char buf[256];
+        int n;
+
+        if (!input_open(&input, NULL, "wc <filename>"))
+            return;
+        while ((n = input_read(&input, buf, sizeof(buf))) > 0)
+            wc_count(&count, buf, n);
+        input_close(&input);
+        printf("%d %d %d\n", count.lines, count.words, count.bytes);
+        return;
+    }
+    file = vfs_open(path);
+    if (file == NULL) {
+        printf("File '%s' not found.\n", path);
+        return;
+    }
+    size = vfs_size(file);
+    if (size > 0) {
+        data = mmap(file, 0, size, PROT_READ);
+        if (data == NULL) {
+            printf("Cannot map '%s'.\n", path);
+            vfs_close(file);
+            return;
+        }
+        wc_count(&count, data, size);
+        munmap((void *)data, size);
+    }
+    vfs_close(file);
+    printf("%d %d %d %s\n", count.lines, count.words, size, path);
+}
+
+// switch a FAT file between plain and LZ4 compressed storage
+void compress_command(const char *filename, BOOL compress) {
+    int index = fat_lookup(filename);
+    int result;
+
+    if (index < 0) {
+        printf("File '%s' not found.\n", filename);
+        return;
+    }
+    result = compress ? fat_lz4_compress(index) : fat_lz4_decompress(index);
+    if (result < 0) {
+        printf("Cannot %s '%s', volume full or data corrupt.\n", compress ? "compress" : "decompress", filename);
+    } else if (compress) {
+        printf("'%s': %d bytes stored as %d\n", filename, fat_size(index), fat_lz4_stored_size(index));
+    }
+}
+
+// switch the FAT volume log mode or show its state
+void fslog_command(const char *arg) {
+    if (strcmp(arg, "on") == 0) {
+        if (fat_log_enable() < 0)
+            printf("Cannot enable log mode, the last %d clusters are in use.\n", FAT_LOG_SECTORS);
+    } else if (strcmp(arg, "off") == 0) {
+        page_cache_sync_all();
+        if (fat_log_disable() < 0)
+            printf("Cannot disable log mode now.\n");
+    } else if (strlen(arg) > 0) {
+        printf("usage: fslog [on|off]\n");
+        return;
+    }
+    fat_log_stats();
+}
+
+#define CRASHSIM_FILE       "CRASHSIM"
+#define CRASHSIM_COMMITTED  "committed"
+#define CRASHSIM_TORN       "torn data"
+
+// write the volume twice in log mode, cut the second transaction off before
+// its commit record and remount, only the first write may come back
+void crashsim_command() {
+    char data[sizeof(CRASHSIM_COMMITTED)];
+    int index;
+
+    if (!fat_log_active()) {
+        printf("crashsim needs log mode, run 'fslog on' first.\n");
+        return;
+    }
+    // start from an empty log so the replay below is only what follows
+    page_cache_sync_all();
+    fat_log_checkpoint();
+
+    if (fat_lookup(CRASHSIM_FILE) < 0)
+        createFile(CRASHSIM_FILE, "");
+    index = fat_lookup(CRASHSIM_FILE);
+    if (index < 0 || fat_write(index, 0, CRASHSIM_COMMITTED, strlen(CRASHSIM_COMMITTED)) < 0) {
+        printf("Cannot write '%s'.\n", CRASHSIM_FILE);
+        return;
+    }
+    fat_log_begin();
+    fat_write(index, 0, CRASHSIM_TORN, strlen(CRASHSIM_TORN));
+    printf("crash before the commit record of '%s'\n", CRASHSIM_TORN);
+
+    fat_remount();
+    memset(data, 0, sizeof(data));
+    fat_read(index, 0, data, sizeof(data) - 1);
+    printf("'%s' after replay: '%s', %s\n", CRASHSIM_FILE, data,
+           strcmp(data, CRASHSIM_COMMITTED) == 0 ? "ok" : "FAILED");
+    fat_log_stats();
+}
+
+// checkpoint the FAT log in the background so foreground writes rarely have to
+void fslogd(void *arg) {
+    (void)arg;
+    while (1) {
+        thread_sleep(FSLOGD_INTERVAL_MS);
+        fat_log_background_checkpoint();
+    }
+}
+
+// run a program in its own thread and wait for it to return,
+// console and file system code is not SMP safe yet so it stays on the boot CPU
+void run_program(const char *name, THREAD_FUNC func) {
+    THREAD *thread = thread_spawn_on(name, func, NULL, SMP_BOOT_CPU);
+
+    if (thread == NULL) {
+        printf("Cannot start '%s', out of threads or memory.\n", name);
+        return;
+    }
+    thread_join(thread->id);
+}
+
+// parse a decimal number at *arg and skip the spaces after it, FALSE if there is none
+static BOOL parse_number(char **arg, uint32 *value) {
+    char *p = *arg;
+
+    if (*p < '0' || *p > '9')
+        return FALSE;
+    for (*value = 0; *p >= '0' && *p <= '9'; p++)
+        *value = *value * 10 + (*p - '0');
+    while (*p == ' ')
+        p++;
+    *arg = p;
+    return TRUE;
+}
+
+// list IRQ routing, or deliver an IRQ to another CPU
+void irqaffinity_command(int argc, char **argv) {
+    uint32 irq, cpu;
+
+    if (!ioapic_active()) {
+        printf("IRQs are delivered by the 8259 PIC to CPU 0 only.\n");
+        return;
+    }
+    if (argc > 1) {
+        char *irq_arg = argv[1], *cpu_arg = argc == 3 ? argv[2] : "";
+
+        if (argc != 3 || !parse_number(&irq_arg, &irq) || *irq_arg != '\0' ||
+            !parse_number(&cpu_arg, &cpu) || *cpu_arg != '\0') {
+            printf("usage: irqaffinity [<irq> <cpu>]\n");
+            return;
+        }
+        if (ioapic_set_affinity(irq, cpu) < 0) {
+            printf("Bad IRQ or CPU.\n");
+            return;
+        }
+    }
+    ioapic_list();
+}
+
+typedef struct {
+    const uint8 *buf;
+    uint32 crc;
+} SMPBENCH_JOB;
+
+// CPU-bound job, checksums a shared read-only page over and over
+static void smpbench_job(void *arg) {
+    SMPBENCH_JOB *job = arg;
+
+    job->crc = 0;
+    for (int i = 0; i < SMPBENCH_ROUNDS; i++)
+        job->crc = crc32c_sw(job->crc, job->buf, PAGE_SIZE);
+}
+
+// run jobs CPU-bound threads at once, returns elapsed milliseconds
+static uint32 smpbench_run(const uint8 *buf, uint32 jobs) {
+    SMPBENCH_JOB job[SMP_MAX_CPUS * 2];
+    uint32 ids[SMP_MAX_CPUS * 2];
+    uint32 start = clock_ticks(), spawned = 0;
+
+    for (uint32 i = 0; i < jobs; i++) {
+        THREAD *thread;
+        job[i].buf = buf;
+        thread = thread_spawn("smpbench", smpbench_job, &job[i]);
+        if (thread == NULL)
+            break;
+        ids[spawned++] = thread->id;
+    }
+    for (uint32 i = 0; i < spawned; i++)
+        thread_join(ids[i]);
+    return (clock_ticks() - start) * 1000 / CLOCK_HZ;
+}
+
+// compare one CPU-bound job against one per CPU, they should take about as long
+void smpbench_command(char *arg) {
+    uint8 *buf = pmm_alloc_page();
+    uint32 jobs = smp_cpu_count(), single, parallel;
+
+    if (strlen(arg) > 0 && (!parse_number(&arg, &jobs) || *arg != '\0'))
+        jobs = 0;
+    if (jobs < 1 || jobs > SMP_MAX_CPUS * 2) {
+        printf("usage: smpbench [1-%d]\n", SMP_MAX_CPUS * 2);
+        pmm_free_page(buf);
+        return;
+    }
+    if (buf == NULL) {
+        printf("Out of memory.\n");
+        return;
+    }
+    for (uint32 i = 0; i < PAGE_SIZE; i++)
+        buf[i] = (uint8)(i * 2654435761U >> 24);
+
+    single = smpbench_run(buf, 1);
+    parallel = smpbench_run(buf, jobs);
+    printf("%d CPUs online\n", smp_cpu_count());
+    printf("1 job: %d ms, %d jobs: %d ms\n", single, jobs, parallel);
+    if (parallel > 0)
+        printf("throughput: %d.%02d x one job\n", jobs * single / parallel, jobs * single * 100 / parallel % 100);
+    pmm_free_page(buf);
+}
+
+static volatile uint32 g_irqbench_count;
+
+static void irqbench_handler(REGISTERS *reg) {
+    (void)reg;
+    g_irqbench_count++;
+}
+
+// fastest and average cycles from raising an interrupt to being back after its iret
+static void irqbench_run(const char *name, BOOL ipi) {
+    uint8 apic_id = cpu_self()->apic_id;
+    uint32 best = 0xFFFFFFFF, cycles;
+    uint64 total = 0, start;
+
+    for (int i = 0; i < IRQBENCH_ROUNDS; i++) {
+        uint32 count = g_irqbench_count;
+        start = rdtsc();
+        if (ipi) {
+            lapic_send_ipi(apic_id, LAPIC_BENCH_VECTOR);
+            while (g_irqbench_count == count)
+                ;
         } else {
-            printf("%s", shell_file_content);
-            memset(file_content, 0, sizeof(file_content));
-            getstr_bound(file_content, strlen(shell_file_content));
+            asm volatile("int %0" :: "i"(ISR_BENCH_VECTOR) : "memory");
         }
+        cycles = (uint32)(rdtsc() - start);
+        total += cycles;
+        if (cycles < best)
+            best = cycles;
+    }
+    printf("%s: %d cycles best, %d average\n", name, best, udiv64_32(total, IRQBENCH_ROUNDS));
+}
+
+// show interrupt cost per vector, or write it to the serial port
+void irqstat_command(char *arg) {
+    if (strcmp(arg, "reset") == 0) {
+        isr_stat_reset();
+    } else if (strcmp(arg, "serial") == 0) {
+        if (!isr_stat_serial())
+            printf("No serial port.\n");
+    } else if (strlen(arg) > 0) {
+        printf("usage: irqstat [serial|reset]\n");
+    } else {
+        isr_stat_print();
     }
+}
 
-    createFile(name, file_content);
+void boottime_command(char *arg) {
+    if (strcmp(arg, "serial") == 0) {
+        if (!boottime_serial())
+            printf("No serial port.\n");
+    } else if (strlen(arg) > 0) {
+        printf("usage: boottime [serial]\n");
+    } else {
+        boottime_print();
+    }
+}
+
+// time the interrupt entry and exit path with software interrupts and self IPIs
+void irqbench_command() {
+    isr_register_interrupt_handler(ISR_BENCH_VECTOR, irqbench_handler);
+    isr_register_interrupt_handler(LAPIC_BENCH_VECTOR, irqbench_handler);
+    irqbench_run("int", FALSE);
+    if (lapic_present())
+        irqbench_run("self IPI", TRUE);
+    else
+        printf("self IPI: no local APIC\n");
+    isr_register_interrupt_handler(ISR_BENCH_VECTOR, NULL);
+    isr_register_interrupt_handler(LAPIC_BENCH_VECTOR, NULL);
+}
+
+// top of the user stack of the sysbench program, see user_sysbench in syscall.asm
+typedef struct {
+    uint32 calls;
+    uint32 sysenter;                // run the SYSENTER loop too
+    uint64 int_cycles;
+    uint64 sysenter_cycles;
+} SYSBENCH_FRAME;
+
+// defined in syscall.asm
+extern uint8 user_sysbench[];
+extern uint8 user_sysbench_end[];
+
+static void sysbench_thread(void *arg) {
+    user_enter(USER_BASE, (uint32)arg);
+}
+
+// time null system calls from ring 3 through int 0x80 and SYSENTER
+void sysbench_command(char *arg) {
+    uint32 calls = SYSBENCH_CALLS;
+    SYSBENCH_FRAME *frame = (SYSBENCH_FRAME *)(USER_BASE + 2 * PAGE_SIZE) - 1;
+    THREAD *thread;
+
+    if (strlen(arg) > 0 && (!parse_number(&arg, &calls) || *arg != '\0'))
+        calls = 0;
+    if (calls < 1) {
+        printf("usage: sysbench [calls]\n");
+        return;
+    }
+    // code page and stack page
+    if (!user_map(USER_BASE, 2 * PAGE_SIZE)) {
+        printf("Out of memory.\n");
+        return;
+    }
+    memcpy((void *)USER_BASE, user_sysbench, user_sysbench_end - user_sysbench);
+    frame->calls = calls;
+    frame->sysenter = syscall_has_sysenter();
+
+    // stays on this CPU, pages of the user window are unmapped without a TLB shootdown
+    thread = thread_spawn_on("sysbench", sysbench_thread, frame, cpu_self()->index);
+    if (thread == NULL) {
+        printf("Cannot create thread.\n");
+    } else {
+        thread_join(thread->id);
+        printf("int 0x80: %d cycles per call\n", udiv64_32(frame->int_cycles, calls));
+        if (frame->sysenter)
+            printf("SYSENTER: %d cycles per call\n", udiv64_32(frame->sysenter_cycles, calls));
+        else
+            printf("SYSENTER: not supported\n");
+    }
+    user_unmap(USER_BASE, 2 * PAGE_SIZE);
+}
+
+// top of the user stack of the timetest program, see user_timetest in syscall.asm
+typedef struct {
+    uint32 reads;
+    uint32 page;                    // USER_TIME_PAGE
+    uint32 backwards;               // reads earlier than the one before
+    uint32 pad;
+    uint64 first_ns;
+    uint64 last_ns;
+    uint64 cycles;
+    uint32 left;                    // used by the program
+} TIMETEST_FRAME;
+
+// defined in syscall.asm
+extern uint8 user_timetest[];
+extern uint8 user_timetest_end[];
+
+// read the time page from ring 3 in a tight loop, check that it never goes
+// backwards and stays with the kernel clock read before and after the run
+void timetest_command(char *arg) {
+    uint32 reads = TIMETEST_READS;
+    TIMETEST_FRAME *frame = (TIMETEST_FRAME *)(USER_BASE + 2 * PAGE_SIZE) - 1;
+    const VDSO_TIME *time = vdso_time();
+    uint64 before, after, now;
+    uint32 slack;
+    sint32 ahead;
+    THREAD *thread;
+    BOOL ok;
+
+    if (strlen(arg) > 0 && (!parse_number(&arg, &reads) || *arg != '\0'))
+        reads = 0;
+    if (reads < 1) {
+        printf("usage: timetest [reads]\n");
+        return;
+    }
+    if (time == NULL || time->mult == 0) {
+        printf("No time page, the TSC is not calibrated.\n");
+        return;
+    }
+    // the kernel reads the page through the same code ring 3 inlines
+    before = clock_ns();
+    now = vdso_time_ns(time);
+    after = clock_ns();
+    ahead = (sint32)(now - before);
+    slack = TIMETEST_SLACK_NS + (uint32)(after >> TIMETEST_DRIFT_SHIFT);
+    ok = now + slack >= before && now <= after + slack;
+    printf("time page: %d.%09d s, %d ns after the kernel clock, %d MHz TSC\n",
+           udiv64_32(now, 1000000000), (uint32)(now - (uint64)udiv64_32(now, 1000000000) * 1000000000),
+           ahead, time->tsc_khz / 1000);
+
+    if (!user_map(USER_BASE, 2 * PAGE_SIZE)) {
+        printf("Out of memory.\n");
+        return;
+    }
+    memcpy((void *)USER_BASE, user_timetest, user_timetest_end - user_timetest);
+    frame->reads = reads;
+    frame->page = USER_TIME_PAGE;
+    frame->backwards = 0;
+
+    before = clock_ns();
+    thread = thread_spawn_on("timetest", sysbench_thread, frame, cpu_self()->index);
+    if (thread == NULL) {
+        printf("Cannot create thread.\n");
+        user_unmap(USER_BASE, 2 * PAGE_SIZE);
+        return;
+    }
+    thread_join(thread->id);
+    after = clock_ns();
+
+    slack = TIMETEST_SLACK_NS + (uint32)(after >> TIMETEST_DRIFT_SHIFT);
+    ok = ok && frame->backwards == 0 && frame->first_ns + slack >= before &&
+         frame->last_ns <= after + slack && frame->first_ns <= frame->last_ns;
+    printf("%d reads from ring 3, %d cycles per read, %d went backwards\n",
+           reads, udiv64_32(frame->cycles, reads + 1), frame->backwards);
+    printf("run: %d us by the kernel clock, %d us by the time page\n",
+           udiv64_32(after - before, 1000), udiv64_32(frame->last_ns - frame->first_ns, 1000));
+    printf("time page %s\n", ok ? "ok" : "FAILED, not monotonic or off the kernel clock");
+    user_unmap(USER_BASE, 2 * PAGE_SIZE);
+}
+
+typedef struct {
+    uint32 rounds;
+    int request, reply;             // channels to and from the echo thread
+    uint64 inline_cycles;
+    uint64 remap_cycles;
+    uint64 copy_cycles;
+    BOOL intact;                    // the buffer came back unchanged
+} IPCBENCH;
+
+// send every message back, the pages received at IPCBENCH_ECHO_ADDR go with it
+static void ipcbench_echo(void *arg) {
+    IPCBENCH *bench = arg;
+    IPC_MESSAGE msg;
+
+    for (;;) {
+        msg.pages = IPCBENCH_ECHO_ADDR;
+        msg.page_count = IPC_MAX_PAGES;
+        if (ipc_recv(bench->request, &msg) < 0 || msg.len == 0)
+            break;
+        if (ipc_send(bench->reply, &msg) < 0)
+            break;
+    }
+}
+
+static void ipcbench_client(void *arg) {
+    IPCBENCH *bench = arg;
+    uint32 *buf = (uint32 *)IPCBENCH_SEND_ADDR;
+    IPC_MESSAGE msg;
+    uint64 start;
+    uint32 i;
+
+    msg.len = sizeof(uint32);
+    msg.pages = 0;
+    start = rdtsc();
+    for (i = 0; i < bench->rounds; i++) {
+        msg.page_count = 0;
+        if (ipc_send(bench->request, &msg) < 0 || ipc_recv(bench->reply, &msg) < 0)
+            break;
+    }
+    bench->inline_cycles = rdtsc() - start;
+
+    start = rdtsc();
+    for (i = 0; i < bench->rounds; i++) {
+        msg.pages = IPCBENCH_SEND_ADDR;
+        msg.page_count = IPC_MAX_PAGES;
+        if (ipc_send(bench->request, &msg) < 0)
+            break;
+        msg.page_count = IPC_MAX_PAGES;
+        if (ipc_recv(bench->reply, &msg) < 0 || msg.page_count != IPC_MAX_PAGES)
+            break;
+    }
+    bench->remap_cycles = rdtsc() - start;
+    bench->intact = i == bench->rounds;
+    for (i = 0; bench->intact && i < IPCBENCH_BYTES / sizeof(uint32); i++)
+        bench->intact = buf[i] == i;
+
+    // the copies the same traffic would cost without remapping
+    if (user_map(IPCBENCH_ECHO_ADDR, IPCBENCH_BYTES)) {
+        start = rdtsc();
+        for (i = 0; i < bench->rounds; i++) {
+            memcpy((void *)IPCBENCH_ECHO_ADDR, buf, IPCBENCH_BYTES);
+            memcpy(buf, (void *)IPCBENCH_ECHO_ADDR, IPCBENCH_BYTES);
+        }
+        bench->copy_cycles = rdtsc() - start;
+        user_unmap(IPCBENCH_ECHO_ADDR, IPCBENCH_BYTES);
+    }
+
+    msg.len = 0;
+    msg.page_count = 0;
+    ipc_send(bench->request, &msg);
+}
+
+// time inline messages and page transfers between two threads against memcpy
+void ipcbench_command(char *arg) {
+    IPCBENCH bench = {.rounds = IPCBENCH_ROUNDS};
+    uint32 kb = IPCBENCH_BYTES / 1024, inline_trip, remap_trip, copy_trip;
+    THREAD *echo, *client;
+
+    if (strlen(arg) > 0 && (!parse_number(&arg, &bench.rounds) || *arg != '\0'))
+        bench.rounds = 0;
+    if (bench.rounds < 1) {
+        printf("usage: ipcbench [rounds]\n");
+        return;
+    }
+    bench.request = ipc_channel_create();
+    bench.reply = ipc_channel_create();
+    if (bench.request < 0 || bench.reply < 0 || !user_map(IPCBENCH_SEND_ADDR, IPCBENCH_BYTES)) {
+        printf("Out of channels or memory.\n");
+        ipc_channel_destroy(bench.request);
+        ipc_channel_destroy(bench.reply);
+        return;
+    }
+    for (uint32 i = 0; i < IPCBENCH_BYTES / sizeof(uint32); i++)
+        ((uint32 *)IPCBENCH_SEND_ADDR)[i] = i;
+
+    // both ends on this CPU, pages move between them without a TLB shootdown
+    echo = thread_spawn_on("ipcecho", ipcbench_echo, &bench, cpu_self()->index);
+    client = echo ? thread_spawn_on("ipcbench", ipcbench_client, &bench, cpu_self()->index) : NULL;
+    if (client == NULL) {
+        printf("Cannot create thread.\n");
+        if (echo != NULL) {
+            IPC_MESSAGE stop = {.len = 0};
+            ipc_send(bench.request, &stop);
+            thread_join(echo->id);
+        }
+    } else {
+        thread_join(client->id);
+        thread_join(echo->id);
+        inline_trip = udiv64_32(bench.inline_cycles, bench.rounds);
+        remap_trip = udiv64_32(bench.remap_cycles, bench.rounds);
+        copy_trip = udiv64_32(bench.copy_cycles, bench.rounds) + inline_trip;
+        printf("inline message: %d cycles per round trip\n", inline_trip);
+        printf("%dKB each way by remapping: %d cycles per round trip, %d per KB\n",
+               kb, remap_trip, remap_trip / (2 * kb));
+        if (bench.copy_cycles > 0)
+            printf("%dKB each way by memcpy: %d cycles per round trip, %d per KB\n",
+                   kb, copy_trip, copy_trip / (2 * kb));
+        if (!bench.intact)
+            printf("the transferred pages did not come back intact\n");
+    }
+    ipc_channel_destroy(bench.request);
+    ipc_channel_destroy(bench.reply);
+    user_unmap(IPCBENCH_ECHO_ADDR, IPCBENCH_BYTES);
+    user_unmap(IPCBENCH_SEND_ADDR, IPCBENCH_BYTES);
+}
+
+// state hammered by lockstress from one thread per CPU and a timer interrupt
+typedef struct {
+    SPINLOCK lock;
+    uint32 counter;                 // incremented under lock
+    SEQLOCK seq;
+    uint32 seq_a, seq_b;            // seq_b is always ~seq_a outside a write
+    MPMC_QUEUE queue;
+    uint64 pushed, popped;          // sums of the values, per side under lock
+    uint32 end;                     // clock tick to stop at
+    uint32 torn;
+    // rounds counted outside the lock, by each worker and by the timer
+    uint32 worker_rounds[SMP_MAX_CPUS];
+    uint32 tick_rounds;
+} LOCKSTRESS;
+
+static LOCKSTRESS g_lockstress = {.lock = SPINLOCK_INIT, .seq = SEQLOCK_INIT};
+static MPMC_CELL g_lockstress_cells[LOCKSTRESS_CELLS];
+static TIMER g_lockstress_timer;
+
+// one round of every primitive, in_irq when called from the timer interrupt
+static void lockstress_round(uint32 value, BOOL in_irq) {
+    LOCKSTRESS *s = &g_lockstress;
+    uint32 flags, seq, a, b;
+    void *data;
+
+    flags = spin_lock_irqsave(&s->lock);
+    s->counter++;
+    spin_unlock_irqrestore(&s->lock, flags);
+
+    // writers disable interrupts, a reader interrupted on the same CPU only retries
+    if (in_irq || value % 64 == 0) {
+        flags = irq_save();
+        write_seqlock(&s->seq);
+        s->seq_a = value;
+        s->seq_b = ~value;
+        write_sequnlock(&s->seq);
+        irq_restore(flags);
+    }
+    do {
+        seq = read_seqbegin(&s->seq);
+        a = s->seq_a;
+        b = s->seq_b;
+    } while (read_seqretry(&s->seq, seq));
+    if (a != ~b)
+        __sync_fetch_and_add(&s->torn, 1);
+
+    if (mpmc_push(&s->queue, (void *)value)) {
+        flags = spin_lock_irqsave(&s->lock);
+        s->pushed += value;
+        spin_unlock_irqrestore(&s->lock, flags);
+    }
+    if (mpmc_pop(&s->queue, &data)) {
+        flags = spin_lock_irqsave(&s->lock);
+        s->popped += (uint32)data;
+        spin_unlock_irqrestore(&s->lock, flags);
+    }
+}
+
+// the timer function never runs twice at once, tick_rounds needs no lock
+static void lockstress_tick(void *arg) {
+    (void)arg;
+    lockstress_round(clock_ticks(), TRUE);
+    g_lockstress.tick_rounds++;
+    if ((sint32)(g_lockstress.end - clock_ticks()) > 0)
+        timer_add(&g_lockstress_timer, clock_ticks() + 1);
+}
+
+static void lockstress_worker(void *arg) {
+    uint32 worker = (uint32)arg, value = worker << 24, rounds = 0;
+
+    while ((sint32)(g_lockstress.end - clock_ticks()) > 0) {
+        lockstress_round(++value, FALSE);
+        rounds++;
+    }
+    g_lockstress.worker_rounds[worker - 1] = rounds;
+}
+
+// hammer a ticket lock, a seqlock and the MPMC queue from every CPU and an interrupt, then check them
+void lockstress_command(char *arg) {
+    LOCKSTRESS *s = &g_lockstress;
+    uint32 ms = LOCKSTRESS_MS, ids[SMP_MAX_CPUS], spawned = 0, rounds;
+    void *data;
+
+    if (strlen(arg) > 0 && (!parse_number(&arg, &ms) || *arg != '\0'))
+        ms = 0;
+    if (ms < 1 || ms > 60000) {
+        printf("usage: lockstress [1-60000 ms]\n");
+        return;
+    }
+    s->counter = 0;
+    memset(s->worker_rounds, 0, sizeof(s->worker_rounds));
+    s->tick_rounds = 0;
+    s->torn = 0;
+    s->pushed = 0;
+    s->popped = 0;
+    s->seq.retries = 0;
+    s->lock.acquired = s->lock.contended = s->lock.max_hold = 0;
+    s->lock.hold_cycles = 0;
+    mpmc_init(&s->queue, g_lockstress_cells, LOCKSTRESS_CELLS);
+    s->end = clock_ticks() + clock_ms_to_ticks(ms);
+
+    timer_setup(&g_lockstress_timer, lockstress_tick, NULL);
+    timer_add(&g_lockstress_timer, clock_ticks() + 1);
+    for (uint32 i = 0; i < smp_cpu_count(); i++) {
+        THREAD *thread = thread_spawn_on("lockstress", lockstress_worker, (void *)(i + 1), i);
+        if (thread != NULL)
+            ids[spawned++] = thread->id;
+    }
+    for (uint32 i = 0; i < spawned; i++)
+        thread_join(ids[i]);
+    // the tick may be running and arm itself again, the next run sets the timer up anew
+    timer_del_sync(&g_lockstress_timer);
+    while (mpmc_pop(&s->queue, &data))
+        s->popped += (uint32)data;
+    rounds = s->tick_rounds;
+    for (uint32 i = 0; i < SMP_MAX_CPUS; i++)
+        rounds += s->worker_rounds[i];
+
+    printf("%d threads and a timer for %d ms\n", spawned, ms);
+    printf("ticket lock: %d acquired, %d contended, hold %d cycles mean, %d max, counter %s\n",
+           s->lock.acquired, s->lock.contended, udiv64_32(s->lock.hold_cycles, s->lock.acquired ? s->lock.acquired : 1),
+           s->lock.max_hold, s->counter == rounds ? "ok" : "LOST UPDATES");
+    printf("seqlock: %d retries, %d torn reads\n", s->seq.retries, s->torn);
+    printf("mpmc queue: %d full, %d retries, sums %s\n", s->queue.full, s->queue.retries,
+           s->pushed == s->popped ? "match" : "MISMATCH");
+}
+
+static TIMER g_timerbench[TIMERBENCH_TIMERS];
+static volatile uint32 g_timerbench_fired, g_timerbench_late;
+
+static void timerbench_fire(void *arg) {
+    TIMER *timer = arg;
+    uint32 late = clock_ticks() - timer->expires;
+
+    g_timerbench_fired++;
+    if (late > g_timerbench_late)
+        g_timerbench_late = late;
+}
+
+// cycles per call of op on every timer, spread from 10 seconds to about a day ahead
+static uint32 timerbench_op(BOOL (*op)(TIMER *, uint32), uint32 count, uint32 seed) {
+    uint32 now = clock_ticks();
+    uint64 start = rdtsc();
+
+    for (uint32 i = 0; i < count; i++)
+        op(&g_timerbench[i], now + 1000 + ((i + seed) * 2654435761U >> 8) % (CLOCK_HZ * 86400));
+    return udiv64_32(rdtsc() - start, count);
+}
+
+static BOOL timerbench_add(TIMER *timer, uint32 expires) {
+    timer_add(timer, expires);
+    return TRUE;
+}
+
+static BOOL timerbench_del(TIMER *timer, uint32 expires) {
+    (void)expires;
+    return timer_del(timer);
+}
+
+// arm, move and cancel many timers, then let some fire and check how late they were
+void timerbench_command(char *arg) {
+    uint32 count = TIMERBENCH_TIMERS, add, mod, del, now;
+
+    if (strlen(arg) > 0 && (!parse_number(&arg, &count) || *arg != '\0'))
+        count = 0;
+    if (count < TIMERBENCH_FIRED || count > TIMERBENCH_TIMERS) {
+        printf("usage: timerbench [%d-%d]\n", TIMERBENCH_FIRED, TIMERBENCH_TIMERS);
+        return;
+    }
+    for (uint32 i = 0; i < count; i++)
+        timer_setup(&g_timerbench[i], timerbench_fire, &g_timerbench[i]);
+
+    add = timerbench_op(timerbench_add, count, 0);
+    mod = timerbench_op(timer_mod, count, 1);
+    del = timerbench_op(timerbench_del, count, 0);
+    printf("%d timers: add %d, mod %d, del %d cycles\n", count, add, mod, del);
+
+    // a few ticks apart, the later ones cascade down from the second level
+    g_timerbench_fired = 0;
+    g_timerbench_late = 0;
+    now = clock_ticks();
+    for (uint32 i = 0; i < TIMERBENCH_FIRED; i++)
+        timer_add(&g_timerbench[i], now + 1 + i * 5);
+    thread_sleep((TIMERBENCH_FIRED * 5 + 10) * 1000 / CLOCK_HZ);
+    for (uint32 i = 0; i < TIMERBENCH_FIRED; i++)
+        timer_del(&g_timerbench[i]);
+    printf("%d of %d fired, at most %d ticks late\n", g_timerbench_fired, TIMERBENCH_FIRED, g_timerbench_late);
+    timer_stats();
+}
+
+// cycles per KB of one CRC32C kernel over a 4KB buffer, 256KB in total
+static uint32 crc_bench_kernel(uint32 (*kernel)(uint32, const void *, uint32), const uint8 *buf, uint32 *crc) {
+    uint64 start;
+    uint32 cycles;
+
+    *crc = 0;
+    start = rdtsc();
+    for (int i = 0; i < 64; i++)
+        *crc = kernel(*crc, buf, PAGE_SIZE);
+    cycles = (uint32)(rdtsc() - start);
+    return cycles / 256;
+}
+
+// compare the slicing-by-8 and SSE4.2 checksum throughput
+void crcbench_command() {
+    uint8 *buf = pmm_alloc_page();
+    uint32 crc_sw, crc_hw, cycles;
+
+    if (buf == NULL) {
+        printf("Out of memory.\n");
+        return;
+    }
+    for (uint32 i = 0; i < PAGE_SIZE; i++)
+        buf[i] = (uint8)(i * 2654435761U >> 24);
+
+    cycles = crc_bench_kernel(crc32c_sw, buf, &crc_sw);
+    printf("slicing-by-8: %d cycles/KB, crc 0x%x\n", cycles, crc_sw);
+    if (crc32c_has_hw()) {
+        cycles = crc_bench_kernel(crc32c_hw, buf, &crc_hw);
+        printf("sse4.2 crc32: %d cycles/KB, crc 0x%x%s\n", cycles, crc_hw, crc_hw == crc_sw ? "" : " MISMATCH");
+    } else {
+        printf("sse4.2 crc32: not supported by this CPU\n");
+    }
+    pmm_free_page(buf);
+}
+
+typedef struct {
+    uint32 seed;
+    uint32 checks;
+    uint32 corrupt;
+} FPUBENCH_JOB;
+
+// keep seed in st(0) and, with SSE, a pattern in xmm0 while being preempted
+// by the other jobs, no compiled code between the asm statements uses them
+static void fpubench_job(void *arg) {
+    FPUBENCH_JOB *job = arg;
+    uint32 in[4] = {job->seed, ~job->seed, job->seed * 3, job->seed ^ 0x5A5A5A5A};
+    uint32 out[4], x87;
+    uint32 end = clock_ticks() + FPUBENCH_TICKS;
+    BOOL sse = fpu_has_sse();
+
+    asm volatile("fildl %0" :: "m"(job->seed));
+    if (sse)
+        asm volatile("movups %0, %%xmm0" :: "m"(in));
+    while ((sint32)(clock_ticks() - end) < 0) {
+        asm volatile("fistl %0" : "=m"(x87));
+        if (x87 != job->seed)
+            job->corrupt++;
+        if (sse) {
+            asm volatile("movups %%xmm0, %0" : "=m"(out));
+            if (!memcmp((uint8 *)in, (uint8 *)out, sizeof(in)))
+                job->corrupt++;
+        }
+        job->checks++;
+    }
+    asm volatile("fstp %st(0)");
+}
+
+// copy a page 64 bytes at a time through xmm0-xmm3, both pages are 16 byte aligned
+static void sse_copy_page(void *dst, const void *src) {
+    kernel_fpu_begin();
+    for (uint32 i = 0; i < PAGE_SIZE; i += 64) {
+        asm volatile("movaps (%0), %%xmm0\n"
+                     "movaps 16(%0), %%xmm1\n"
+                     "movaps 32(%0), %%xmm2\n"
+                     "movaps 48(%0), %%xmm3\n"
+                     "movaps %%xmm0, (%1)\n"
+                     "movaps %%xmm1, 16(%1)\n"
+                     "movaps %%xmm2, 32(%1)\n"
+                     "movaps %%xmm3, 48(%1)\n"
+                     :: "r"((const uint8 *)src + i), "r"((uint8 *)dst + i) : "memory");
+    }
+    kernel_fpu_end();
 }
 
-void boot() {
-    char buffer[255];
-    gdt_init();
-    idt_init();
+// check that FPU and SSE registers survive preemption with lazy switching,
+// then time a page copy in a kernel FPU section against memcpy
+void fpubench_command() {
+    FPUBENCH_JOB jobs[FPUBENCH_THREADS];
+    uint32 ids[FPUBENCH_THREADS], spawned = 0, checks = 0, corrupt = 0;
+    CPU *cpu = cpu_self();
+    uint32 traps = cpu->fpu_traps, saves = cpu->fpu_saves;
+    uint8 *src, *dst;
+    uint64 start;
+    uint32 plain, sse;
 
-    console_init(COLOR_WHITE, COLOR_BLUE);
-    keyboard_init();
+    if (!fpu_enabled()) {
+        printf("FPU switching is off, the CPU has no FXSAVE.\n");
+        return;
+    }
+    // pinned to this CPU so they preempt each other and the counters are its own
+    for (uint32 i = 0; i < FPUBENCH_THREADS; i++) {
+        THREAD *thread;
+        jobs[i].seed = (i + 1) * 1000003;
+        jobs[i].checks = 0;
+        jobs[i].corrupt = 0;
+        thread = thread_spawn_on("fpubench", fpubench_job, &jobs[i], cpu->index);
+        if (thread == NULL)
+            break;
+        ids[spawned++] = thread->id;
+    }
+    for (uint32 i = 0; i < spawned; i++) {
+        thread_join(ids[i]);
+        checks += jobs[i].checks;
+        corrupt += jobs[i].corrupt;
+    }
+    printf("%d threads: %d register checks, %d corrupted\n", spawned, checks, corrupt);
+    printf("%d Device Not Available traps, %d states saved\n", cpu->fpu_traps - traps, cpu->fpu_saves - saves);
+
+    if (!fpu_has_sse()) {
+        printf("SSE copy: not supported by this CPU\n");
+        return;
+    }
+    src = pmm_alloc_page();
+    dst = pmm_alloc_page();
+    if (src == NULL || dst == NULL) {
+        printf("Out of memory.\n");
+        pmm_free_page(src);
+        pmm_free_page(dst);
+        return;
+    }
+    for (uint32 i = 0; i < PAGE_SIZE; i++)
+        src[i] = (uint8)(i * 2654435761U >> 24);
+
+    start = rdtsc();
+    for (int i = 0; i < FPUBENCH_COPIES; i++)
+        memcpy(dst, src, PAGE_SIZE);
+    plain = udiv64_32(rdtsc() - start, FPUBENCH_COPIES);
+    memset(dst, 0, PAGE_SIZE);
+    start = rdtsc();
+    for (int i = 0; i < FPUBENCH_COPIES; i++)
+        sse_copy_page(dst, src);
+    sse = udiv64_32(rdtsc() - start, FPUBENCH_COPIES);
+    printf("4KB copy: memcpy %d cycles, SSE with kernel_fpu_begin/end %d cycles%s\n", plain, sse,
+           memcmp(dst, src, PAGE_SIZE) ? "" : " MISMATCH");
+    pmm_free_page(src);
+    pmm_free_page(dst);
+}
+
+// set up paging and the page frame allocator from multiboot memory info
+void memory_init(uint32 magic, multiboot_info_t *mbi) {
+    uint32 mem_upper_kb = DEFAULT_MEM_UPPER_KB;
+
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && (mbi->flags & MULTIBOOT_INFO_MEMORY))
+        mem_upper_kb = mbi->mem_upper;
+    if (mem_upper_kb > (PMM_MAX_MEMORY - 0x100000) / 1024)
+        mem_upper_kb = (PMM_MAX_MEMORY - 0x100000) / 1024;
+
+    paging_init(0x100000 + mem_upper_kb * 1024);
+    pmm_init(mem_upper_kb);
+
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+        pmm_reserve_region((uint32)mbi, sizeof(multiboot_info_t));
+        if (mbi->flags & MULTIBOOT_INFO_MODS) {
+            multiboot_module_t *mods = (multiboot_module_t *)mbi->mods_addr;
+            pmm_reserve_region(mbi->mods_addr, mbi->mods_count * sizeof(multiboot_module_t));
+            for (uint32 i = 0; i < mbi->mods_count; i++)
+                pmm_reserve_region(mods[i].mod_start, mods[i].mod_end - mods[i].mod_start);
+        }
+    }
+}
+
+// copy the GRUB modules into /tmp under the last part of their path, so that
+// programs given as "module /boot/hello" can be run with "exec /tmp/hello"
+void modules_init(uint32 magic, multiboot_info_t *mbi) {
+    multiboot_module_t *mods;
+
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || !(mbi->flags & MULTIBOOT_INFO_MODS))
+        return;
+    mods = (multiboot_module_t *)mbi->mods_addr;
+    for (uint32 i = 0; i < mbi->mods_count; i++) {
+        const char *path = mods[i].cmdline ? (const char *)mods[i].cmdline : "module";
+        const char *name = path;
+        char buf[TMPFS_MAX_NAME];
+        uint32 len = 0, size = mods[i].mod_end - mods[i].mod_start;
+        int ino;
+
+        for (const char *p = path; *p != '\0' && *p != ' '; p++) {
+            if (*p == '/')
+                name = p + 1;
+        }
+        while (name[len] != '\0' && name[len] != ' ' && len < TMPFS_MAX_NAME - 1) {
+            buf[len] = name[len];
+            len++;
+        }
+        buf[len] = '\0';
+        ino = tmpfs_create(buf);
+        if (ino < 0 || tmpfs_write(ino, 0, (const void *)mods[i].mod_start, size) != (int)size)
+            printf("[KERNEL] module %s could not be copied to /tmp\n", path);
+    }
+}
+
+void boot(uint32 magic, multiboot_info_t *mbi) {
+    boottime_mark("entry.asm");
+    BOOTTIME_STEP(cpu_features_init());
+    BOOTTIME_STEP(string_init());
+    BOOTTIME_STEP(gdt_init());
+    BOOTTIME_STEP(idt_init());
+    BOOTTIME_STEP(syscall_init());
+    BOOTTIME_STEP(crc32c_init());
+    BOOTTIME_STEP(kexec_init(magic, mbi));
+    BOOTTIME_STEP(memory_init(magic, mbi));
+    BOOTTIME_STEP(vdso_init());
+    BOOTTIME_STEP(page_cache_init());
+    BOOTTIME_STEP(mmap_init());
+    BOOTTIME_STEP(tmpfs_init());
+    BOOTTIME_STEP(modules_init(magic, mbi));
+
+    BOOTTIME_STEP(console_init(COLOR_WHITE, COLOR_BLUE));
+    BOOTTIME_STEP(serial_init());
+    BOOTTIME_STEP(keyboard_init());
     printf("EdgeOS Operating System\n");
     printf("\n");
     printf("Loading Kernel...\n");
 
-    for (volatile int i = 0; i < 200000000; i++);
-
-    main_loop();
+    BOOTTIME_STEP(fpu_init());
+    BOOTTIME_STEP(thread_init());
+    BOOTTIME_STEP(stdio_init());
+    BOOTTIME_STEP(pit_init(PIT_HZ));
+    BOOTTIME_STEP(smp_init());
+    if (ioapic_init())
+        printf("[KERNEL] IRQs routed through the I/O APIC%s\n", lapic_x2apic() ? ", x2APIC" : "");
+    boottime_mark("ioapic_init()");
+    BOOTTIME_STEP(clock_init());
+    BOOTTIME_STEP(softirq_init());
+    // console and file system code is not SMP safe yet, keep their users on the boot CPU
+    thread_spawn_on("shell", (THREAD_FUNC)main_loop, NULL, SMP_BOOT_CPU);
+    thread_spawn_on("fslogd", fslogd, NULL, SMP_BOOT_CPU);
+    thread_idle();
 }
 
 void calculator() {
@@ -263,21 +1465,292 @@ void getstr_bound_shell(char *buffer, uint8 bound) {
 
 
 
+// TRUE for the commands that take more than one argument
+static BOOL takes_words(const char *cmd) {
+    return strcmp(cmd, "grep") == 0 || strcmp(cmd, "echo") == 0 || strcmp(cmd, "exec") == 0 ||
+           strcmp(cmd, "kexec") == 0 || strcmp(cmd, "irqaffinity") == 0;
+}
+
+// run one command, argv[0] names it and the other words are its arguments as
+// tokenize() left them, with the quotes removed
+void run_command(int argc, char **argv) {
+    const char *cmd = argv[0];
+    char *arg = argc > 1 ? argv[1] : "";
+
+    if (argc > 2 && !takes_words(cmd)) {
+        printf("%s: too many arguments\n", cmd);
+        return;
+    }
+    if (strcmp(cmd, "cpuid") == 0) {
+        cpuid_info(1);
+    } else if (strcmp(cmd, "cpuinfo") == 0) {
+        cpu_features_print();
+    } else if (strcmp(cmd, "help") == 0) {
+        printf("EdgeOS Operating System\n");
+        printf("Commands:\n\n"
+               " help\n"
+               " cpuid\n"
+               " cpuinfo (CPU features and the routines bound to them)\n"
+               " clear\n"
+               " uname [-a]\n"
+               " touch <filename>\n"
+               " ls [/tmp]\n"
+               " cat [filename] (Show file content)\n"
+               " grep <text> [filename] (Show lines containing text)\n"
+               " rm <filename>\n"
+               " wc [filename] (Count lines, words, bytes)\n"
+               " compress <filename> (Store file LZ4 compressed)\n"
+               " decompress <filename>\n"
+               " sync (Write cached file pages back)\n"
+               " fslog [on|off] (Log-structured FAT writes)\n"
+               " remount (Drop cached FAT state and mount the volume again)\n"
+               " crashsim (Cut a logged write off and replay the log)\n"
+               " fsck (Verify FAT and directory checksums)\n"
+               " crcbench (CRC32C throughput)\n"
+               " fpubench (Lazy FPU switching and SSE copy)\n"
+               " pcache (Show page cache statistics)\n"
+               " free (Show memory usage)\n"
+               " ps (List kernel threads)\n"
+               " cpus (List processors)\n"
+               " smpbench [jobs] (CPU-bound jobs on all processors)\n"
+               " irqaffinity [<irq> <cpu>] (Show or set IRQ routing)\n"
+               " timerbench [timers] (Kernel timer wheel costs)\n"
+               " irqbench (Interrupt round trip cycles)\n"
+               " lockstress [ms] (Stress spinlock, seqlock and MPMC queue)\n"
+               " sysbench [calls] (Null system call costs from ring 3)\n"
+               " ipcbench [rounds] (Message and page transfer costs)\n"
+               " timetest [reads] (Check clock reads from the time page in ring 3)\n"
+               " irqstat [serial|reset] (Interrupt cycle histograms)\n"
+               " boottime [serial] (Time of every boot phase since _start)\n"
+               " whoami\n"
+               " echo\n"
+               " exec [file args...] (Run a built-in program, or an ELF32 file in ring 3)\n"
+               " kexec <file> [args...] (Boot another kernel image without the firmware)\n"
+               " shutdown\n"
+               " cmd1 | cmd2 (Stream the output of cmd1 into cmd2)\n\n");
+
+        printf("Important Info: 'MAX FILES: 224', files under /tmp are kept in RAM and have no size limit\n\n");
+    } else if (strcmp(cmd, "touch") == 0 && argc == 2) {
+        char *filename = arg;
+        char file_content[255];
+        const char *shell_file_content = "File Content> ";
+        printf("%s", shell_file_content);
+        memset(file_content, 0, sizeof(file_content));
+        getstr_bound(file_content, strlen(shell_file_content));
+        if (tmpfs_path(filename) != NULL)
+            tmpfs_createFile(tmpfs_path(filename), file_content);
+        else
+            createFile(filename, file_content);
+    } else if (strcmp(cmd, "rm") == 0 && argc == 2) {
+        removeFile(arg);
+    } else if (strcmp(cmd, "ls") == 0 && argc == 1) {
+        listFiles();
+    } else if (strcmp(cmd, "ls") == 0 && tmpfs_path(arg) != NULL) {
+        tmpfs_listFiles();
+    } else if (strcmp(cmd, "cat") == 0 && argc == 1) {
+        cat_input();
+    } else if (strcmp(cmd, "grep") == 0) {
+        grep_command(argc, argv);
+    } else if (strcmp(cmd, "wc") == 0) {
+        wc_command(argc == 2 ? arg : NULL);
+    } else if (strcmp(cmd, "cat") == 0) {
+        vfs_catFile(arg);
+    } else if (strcmp(cmd, "compress") == 0 && argc == 2) {
+        compress_command(arg, TRUE);
+    } else if (strcmp(cmd, "decompress") == 0 && argc == 2) {
+        compress_command(arg, FALSE);
+    } else if (strcmp(cmd, "sync") == 0) {
+        page_cache_sync_all();
+        fat_log_checkpoint();
+    } else if (strcmp(cmd, "fslog") == 0) {
+        fslog_command(arg);
+    } else if (strcmp(cmd, "remount") == 0) {
+        page_cache_sync_all();
+        fat_remount();
+        fat_log_stats();
+    } else if (strcmp(cmd, "crashsim") == 0) {
+        crashsim_command();
+    } else if (strcmp(cmd, "fsck") == 0) {
+        int errors = fat_crc_verify_all();
+        if (errors > 0)
+            printf("%d damaged sectors.\n", errors);
+        fat_crc_stats();
+    } else if (strcmp(cmd, "crcbench") == 0) {
+        crcbench_command();
+    } else if (strcmp(cmd, "fpubench") == 0) {
+        fpubench_command();
+    } else if (strcmp(cmd, "pcache") == 0) {
+        page_cache_stats();
+    } else if (strcmp(cmd, "free") == 0) {
+        free_command();
+    } else if (strcmp(cmd, "ps") == 0) {
+        thread_list();
+    } else if (strcmp(cmd, "cpus") == 0) {
+        smp_list();
+        clock_stats();
+        rcu_stats();
+    } else if (strcmp(cmd, "smpbench") == 0) {
+        smpbench_command(arg);
+    } else if (strcmp(cmd, "irqstat") == 0) {
+        irqstat_command(arg);
+    } else if (strcmp(cmd, "boottime") == 0) {
+        boottime_command(arg);
+    } else if (strcmp(cmd, "sysbench") == 0) {
+        sysbench_command(arg);
+    } else if (strcmp(cmd, "timetest") == 0) {
+        timetest_command(arg);
+    } else if (strcmp(cmd, "ipcbench") == 0) {
+        ipcbench_command(arg);
+    } else if (strcmp(cmd, "lockstress") == 0) {
+        lockstress_command(arg);
+    } else if (strcmp(cmd, "irqbench") == 0) {
+        irqbench_command();
+    } else if (strcmp(cmd, "timerbench") == 0) {
+        timerbench_command(arg);
+    } else if (strcmp(cmd, "irqaffinity") == 0) {
+        irqaffinity_command(argc, argv);
+    } else if (strcmp(cmd, "uname") == 0) {
+        unameCommand(arg);
+    } else if (strcmp(cmd, "exec") == 0 && argc > 1) {
+        elf_exec(argv[1], argc - 1, argv + 1);
+    } else if (strcmp(cmd, "exec") == 0) {
+        char program_name[255];
+        const char *prompt = "Run a Program> ";
+        printf("Available Programs/Commands to execute:\n");
+        printf_color(COLOR_GREEN, " - VIM (Text Editor)\n - calc (Simple Calculator)\n\n");
+
+        printf("%s", prompt);
+        memset(program_name, 0, sizeof(program_name));
+        getstr_bound(program_name, strlen(prompt));
+        if (strcmp(program_name, "vim") == 0) {
+            run_program("vim", (THREAD_FUNC)vim);
+        } else if (strcmp(program_name, "calc") == 0) {
+            run_program("calc", (THREAD_FUNC)calculator);
+        } else {
+            printf("ERROR: Command '%s' not found :(\n\n", program_name);
+        }
+    } else if (strcmp(cmd, "whoami") == 0) {
+        printf("root\n");
+    } else if (strcmp(cmd, "clear") == 0) {
+        console_clear(COLOR_WHITE, COLOR_BLACK);
+    } else if (strcmp(cmd, "echo") == 0) {
+        for (int i = 1; i < argc; i++)
+            printf(i + 1 < argc ? "%s " : "%s", argv[i]);
+        printf("\n");
+    } else if (strcmp(cmd, "kexec") == 0 && argc > 1) {
+        kexec(argv[1], argc - 1, argv + 1);
+    } else if (strcmp(cmd, "shutdown") == 0) {
+        shutdown();
+    } else {
+        printf("%s: command not found\n", cmd);
+    }
+}
+
+typedef struct {
+    int argc;
+    char **argv;
+    PIPE *in, *out;
+    BOOL started;
+    uint32 id;
+} SHELL_STAGE;
+
+// thread of one command in a pipeline, its ends are closed when it returns
+static void shell_stage(void *arg) {
+    SHELL_STAGE *stage = arg;
+    THREAD *thread = thread_current();
+
+    thread->in_fd = stage->in != NULL ? pipe_fd(stage->in) : STDIO_CONSOLE;
+    thread->out_fd = stage->out != NULL ? pipe_fd(stage->out) : STDIO_CONSOLE;
+    run_command(stage->argc, stage->argv);
+    thread->in_fd = STDIO_CONSOLE;
+    thread->out_fd = STDIO_CONSOLE;
+    if (stage->out != NULL)
+        pipe_close_write(stage->out);
+    if (stage->in != NULL)
+        pipe_close_read(stage->in);
+}
+
+// run the words of a command line, in cmd1 | cmd2 | ... every command runs in
+// a thread of its own and its output streams into the next through a pipe
+void run_line(int argc, char **argv) {
+    SHELL_STAGE stages[SHELL_MAX_STAGES];
+    int count = 0, first = 0, i;
+
+    for (i = 0; i <= argc; i++) {
+        if (i < argc && argv[i] != g_pipe_word)
+            continue;
+        if (i == first) {
+            printf("syntax error near '|'\n");
+            return;
+        }
+        if (count == SHELL_MAX_STAGES) {
+            printf("more than %d commands in a pipeline\n", SHELL_MAX_STAGES);
+            return;
+        }
+        memset(&stages[count], 0, sizeof(SHELL_STAGE));
+        stages[count].argc = i - first;
+        stages[count].argv = argv + first;
+        count++;
+        first = i + 1;
+    }
+    if (count == 1) {
+        run_command(argc, argv);
+        return;
+    }
+
+    for (i = 0; i + 1 < count; i++) {
+        PIPE *pipe = pipe_create();
+        if (pipe == NULL) {
+            printf("Out of pipes or memory.\n");
+            while (i-- > 0) {
+                pipe_close_write(stages[i].out);
+                pipe_close_read(stages[i].out);
+            }
+            return;
+        }
+        stages[i].out = pipe;
+        stages[i + 1].in = pipe;
+    }
+    // console and file system code is not SMP safe, the whole pipeline shares the boot CPU
+    for (i = 0; i < count; i++) {
+        THREAD *thread = thread_spawn_on(stages[i].argv[0], shell_stage, &stages[i], SMP_BOOT_CPU);
+        if (thread == NULL) {
+            printf("Cannot start '%s', out of threads or memory.\n", stages[i].argv[0]);
+            break;
+        }
+        stages[i].started = TRUE;
+        stages[i].id = thread->id;
+    }
+    // the ends of the commands that did not start
+    for (; i < count; i++) {
+        if (stages[i].out != NULL)
+            pipe_close_write(stages[i].out);
+        if (stages[i].in != NULL)
+            pipe_close_read(stages[i].in);
+    }
+    for (i = 0; i < count; i++) {
+        if (stages[i].started)
+            thread_join(stages[i].id);
+    }
+}
+
 void main_loop() {
-    char buffer[255];
+    char buffer[SHELL_LINE_SIZE];
+    char words[SHELL_WORDS_SIZE];
+    char *argv[SHELL_MAX_WORDS];
+    int argc;
     const char *shell_root = "root";
     const char *shell_at = "@";
     const char *shell_edgeos = "edgeos";
     const char *shell_prompt = "~$ ";
-    gdt_init();
-    idt_init();
-    initFileSystem();
+    BOOTTIME_STEP(fat_mount());
 
-    console_init(COLOR_WHITE, COLOR_BLACK);
-    keyboard_init();
+    BOOTTIME_STEP(console_init(COLOR_WHITE, COLOR_BLACK));
+    BOOTTIME_STEP(keyboard_init());
 
     printf("Welcome to EdgeOS %s\n", VERSION);
     printf("Type 'help' for a list of commands.\n");
+    boottime_mark("shell prompt");
 
     while (1) {
 
@@ -293,75 +1766,14 @@ void main_loop() {
         if (strlen(buffer) == 0)
             continue;
 
-        if (strcmp(buffer, "cpuid") == 0) {
-            cpuid_info(1);
-        } else if (strcmp(buffer, "help") == 0) {
-            printf("EdgeOS Operating System\n");
-            printf("Commands:\n\n"
-                   " help\n"
-                   " cpuid\n"
-                   " clear\n"
-                   " uname [-a]\n"
-                   " touch <filename>\n"
-                   " ls\n"
-                   " cat <filename> (Show file content)\n"
-                   " rm <filename>\n"
-                   " whoami\n"
-                   " echo\n"
-                   " exec (Execute a file/program)\n"
-                   " shutdown\n\n");
-
-            printf("Important Info: 'MAX FILES: 100', 'MAX FILE CONTENT: 10,000'\n\n");
-        } else if (strncmp(buffer, "touch ", 6) == 0) {
-            char *filename = buffer + 6;
-            char file_content[255];
-            const char *shell_file_content = "File Content> ";
-            printf("%s", shell_file_content);
-            memset(file_content, 0, sizeof(file_content));
-            getstr_bound(file_content, strlen(shell_file_content));
-            createFile(filename, file_content);
-        } else if (strncmp(buffer, "rm ", 3) == 0) {
-            char *filename = buffer + 3;
-            removeFile(filename);
-        } else if (strcmp(buffer, "ls") == 0) {
-            listFiles();
-        } else if (strncmp(buffer, "cat ", 4) == 0) {
-            char *filename = buffer + 4;
-            fat_catFile(filename);
-        } else if (strncmp(buffer, "uname", 5) == 0) {
-            char *arg = buffer + 5;
-            while (*arg == ' ') arg++;
-            unameCommand(arg);
-        } else if (strcmp(buffer, "exec") == 0) {
-            char program_name[255];
-            const char *prompt = "Run a Program> ";
-            printf("Available Programs/Commands to execute:\n");
-            printf_color(COLOR_GREEN, " - VIM (Text Editor)\n - calc (Simple Calculator)\n\n");
-
-            printf("%s", prompt);
-            memset(program_name, 0, sizeof(program_name));
-            getstr_bound(program_name, strlen(prompt));
-            if (strcmp(program_name, "vim") == 0) {
-                vim();
-            } else if (strcmp(program_name, "calc") == 0) {
-                calculator();
-            } else {
-                printf("ERROR: Command '%s' not found :(\n\n");
-            }
-        } else if (strcmp(buffer, "whoami") == 0) {
-            printf("root\n");
-        } else if (strcmp(buffer, "clear") == 0) {
-            console_clear(COLOR_WHITE, COLOR_BLACK);
-        } else if (is_echo(buffer)) {
-            printf("%s\n", buffer + 5);
-        } else if (strcmp(buffer, "shutdown") == 0) {
-            shutdown();
-        } else {
-            printf("%s: command not found\n", buffer);
-        }
+        argc = tokenize(buffer, words, argv, SHELL_MAX_WORDS);
+        if (argc < 0)
+            printf("Unbalanced quotes or more than %d words.\n", SHELL_MAX_WORDS);
+        else if (argc > 0)
+            run_line(argc, argv);
     }
 }
 
-void kmain() {
-    boot();
+void kmain(uint32 magic, multiboot_info_t *mbi) {
+    boot(magic, mbi);
 }
@@ -0,0 +1,292 @@
+/**
+ * Warm reboot into a new kernel without the firmware
+ * the image is staged page by page in frames outside every range it loads
+ * to, the copy list, multiboot info and kexec.asm live below 1MB where no
+ * segment may load, so nothing the trampoline reads is overwritten
+ */
+
+#include "kexec.h"
+#include "multiboot.h"
+#include "elf.h"
+#include "pmm.h"
+#include "isr.h"
+#include "smp.h"
+#include "lapic.h"
+#include "ioapic.h"
+#include "8259_pic.h"
+#include "console.h"
+#include "string.h"
+#include "fs/vfs.h"
+
+#define KEXEC_PARAM(label) \
+    (*(volatile uint32 *)(KEXEC_TRAMPOLINE_ADDRESS + ((label) - kexec_start)))
+
+#define KEXEC_LOADER_NAME   "EdgeOS kexec"
+
+typedef struct {
+    uint32 start, end;          // physical range a segment loads to
+} KEXEC_RANGE;
+
+// what the boot loader told us, kept for the next kernel
+static BOOL g_have_memory;
+static uint32 g_mem_lower, g_mem_upper;
+static multiboot_memory_map_t g_mmap[KEXEC_MMAP_MAX];
+static uint32 g_mmap_count;
+
+static KEXEC_RANGE g_ranges[ELF_MAX_SEGMENTS];
+static uint32 g_range_count;
+static KEXEC_CHUNK *const g_chunks = (KEXEC_CHUNK *)KEXEC_CHUNKS_ADDRESS;
+static uint32 g_chunk_count;
+static uint32 g_search[MULTIBOOT_SEARCH / 4];
+
+/**
+ * keep the memory information of the boot loader for the next kernel,
+ * called before anything is written to low memory
+ */
+void kexec_init(uint32 magic, multiboot_info_t *mbi) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || !(mbi->flags & MULTIBOOT_INFO_MEMORY))
+        return;
+    g_have_memory = TRUE;
+    g_mem_lower = mbi->mem_lower;
+    g_mem_upper = mbi->mem_upper;
+    if (!(mbi->flags & MULTIBOOT_INFO_MEM_MAP))
+        return;
+    for (uint32 p = mbi->mmap_addr; p < mbi->mmap_addr + mbi->mmap_length && g_mmap_count < KEXEC_MMAP_MAX;) {
+        multiboot_memory_map_t *entry = (multiboot_memory_map_t *)p;
+
+        g_mmap[g_mmap_count] = *entry;
+        g_mmap[g_mmap_count].size = sizeof(multiboot_memory_map_t) - sizeof(entry->size);
+        g_mmap_count++;
+        p += entry->size + sizeof(entry->size);
+    }
+}
+
+static BOOL kexec_overlaps(uint32 start, uint32 end) {
+    for (uint32 i = 0; i < g_range_count; i++) {
+        if (start < g_ranges[i].end && g_ranges[i].start < end)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// a free frame no segment loads to, frames that do are chained on rejected
+static uint8 *kexec_stage_page(uint32 **rejected) {
+    for (;;) {
+        uint32 *page = pmm_alloc_page();
+
+        if (page == NULL || !kexec_overlaps((uint32)page, (uint32)page + PAGE_SIZE))
+            return (uint8 *)page;
+        *page = (uint32)*rejected;
+        *rejected = page;
+    }
+}
+
+// append to the copy list, pieces that continue the last one in both places are merged
+static BOOL kexec_add_chunk(uint32 dst, uint32 src, uint32 len) {
+    if (g_chunk_count > 0 && src != 0) {
+        KEXEC_CHUNK *last = &g_chunks[g_chunk_count - 1];
+
+        if (last->src != 0 && last->dst + last->len == dst && last->src + last->len == src) {
+            last->len += len;
+            return TRUE;
+        }
+    }
+    if (g_chunk_count == KEXEC_MAX_CHUNKS)
+        return FALSE;
+    g_chunks[g_chunk_count].dst = dst;
+    g_chunks[g_chunk_count].src = src;
+    g_chunks[g_chunk_count].len = len;
+    g_chunk_count++;
+    return TRUE;
+}
+
+static void kexec_release() {
+    for (uint32 i = 0; i < g_chunk_count; i++) {
+        for (uint32 off = 0; g_chunks[i].src != 0 && off < g_chunks[i].len; off += PAGE_SIZE)
+            pmm_free_page((void *)(g_chunks[i].src + off));
+    }
+    g_chunk_count = 0;
+}
+
+// the multiboot header has to be in the first 8KB, 4 byte aligned
+static const char *kexec_check_header(VfsFile *file) {
+    uint32 size = vfs_size(file);
+    int len = vfs_read(file, 0, g_search, size < MULTIBOOT_SEARCH ? size : MULTIBOOT_SEARCH);
+
+    for (int i = 0; i + 3 <= len / 4; i++) {
+        struct multiboot_header *header = (struct multiboot_header *)&g_search[i];
+
+        if (header->magic != MULTIBOOT_HEADER_MAGIC || header->magic + header->flags + header->checksum != 0)
+            continue;
+        // bits 0-15 are requirements, we give memory info and nothing else
+        if (header->flags & 0xFFFC & ~MULTIBOOT_VIDEO_MODE)
+            return "multiboot header asks for unsupported features";
+        return NULL;
+    }
+    return "no multiboot header";
+}
+
+// describe where the PT_LOAD segments go, their file data is staged by kexec_stage()
+static const char *kexec_check_elf(VfsFile *file, ELF_HEADER *header, uint32 *entry) {
+    uint32 mem_end = KEXEC_LOAD_MIN + g_mem_upper * 1024;
+    ELF_PROGRAM_HEADER ph;
+
+    if (vfs_read(file, 0, header, sizeof(*header)) != sizeof(*header) || header->magic != ELF_MAGIC)
+        return "not an ELF file";
+    if (header->class != ELF_CLASS_32 || header->data != ELF_DATA_LSB ||
+        header->type != ELF_TYPE_EXEC || header->machine != ELF_MACHINE_386)
+        return "not an ELF32 i386 executable";
+    if (header->phentsize < sizeof(ph) || header->phnum > ELF_MAX_SEGMENTS)
+        return "bad program headers";
+
+    g_range_count = 0;
+    *entry = 0;
+    for (uint32 i = 0; i < header->phnum; i++) {
+        if (vfs_read(file, header->phoff + i * header->phentsize, &ph, sizeof(ph)) != sizeof(ph))
+            return "truncated program headers";
+        if (ph.type != ELF_PT_LOAD || ph.memsz == 0)
+            continue;
+        if (ph.filesz > ph.memsz || ph.paddr < KEXEC_LOAD_MIN || ph.paddr >= mem_end || ph.memsz > mem_end - ph.paddr)
+            return "segment outside memory or below 1MB";
+        g_ranges[g_range_count].start = ph.paddr;
+        g_ranges[g_range_count].end = ph.paddr + ph.memsz;
+        g_range_count++;
+        // GRUB enters at the physical address of the entry point
+        if (header->entry >= ph.vaddr && header->entry - ph.vaddr < ph.memsz)
+            *entry = header->entry - ph.vaddr + ph.paddr;
+    }
+    if (*entry == 0)
+        return "entry point outside the image";
+    return NULL;
+}
+
+// read the file data of every segment into staging frames and build the copy list
+static const char *kexec_stage(VfsFile *file, ELF_HEADER *header) {
+    uint32 *rejected = NULL;
+    const char *error = NULL;
+    ELF_PROGRAM_HEADER ph;
+
+    g_chunk_count = 0;
+    for (uint32 i = 0; i < header->phnum && error == NULL; i++) {
+        vfs_read(file, header->phoff + i * header->phentsize, &ph, sizeof(ph));
+        if (ph.type != ELF_PT_LOAD || ph.memsz == 0)
+            continue;
+        for (uint32 off = 0; off < ph.filesz; off += PAGE_SIZE) {
+            uint32 len = ph.filesz - off < PAGE_SIZE ? ph.filesz - off : PAGE_SIZE;
+            uint8 *page = kexec_stage_page(&rejected);
+
+            if (page == NULL) {
+                error = "out of memory";
+                break;
+            }
+            if (!kexec_add_chunk(ph.paddr + off, (uint32)page, len)) {
+                pmm_free_page(page);
+                error = "image too large";
+                break;
+            }
+            if (vfs_read(file, ph.offset + off, page, len) != (int)len) {
+                error = "truncated segment";
+                break;
+            }
+        }
+        if (error == NULL && ph.memsz > ph.filesz && !kexec_add_chunk(ph.paddr + ph.filesz, 0, ph.memsz - ph.filesz))
+            error = "image too large";
+    }
+    while (rejected != NULL) {
+        uint32 *next = (uint32 *)*rejected;
+        pmm_free_page(rejected);
+        rejected = next;
+    }
+    if (error != NULL)
+        kexec_release();
+    return error;
+}
+
+// the multiboot info the new kernel gets in ebx, with the memory map after it
+static uint32 kexec_build_info(int argc, char **argv) {
+    multiboot_info_t *mbi = (multiboot_info_t *)KEXEC_INFO_ADDRESS;
+    multiboot_memory_map_t *mmap = (multiboot_memory_map_t *)(mbi + 1);
+    char *cmdline = (char *)(mmap + KEXEC_MMAP_MAX);
+    char *name = cmdline + KEXEC_CMDLINE_SIZE;
+    uint32 len = 0;
+
+    memset(mbi, 0, sizeof(multiboot_info_t));
+    mbi->flags = MULTIBOOT_INFO_MEMORY | MULTIBOOT_INFO_CMDLINE | MULTIBOOT_INFO_BOOT_LOADER_NAME;
+    mbi->mem_lower = g_mem_lower;
+    mbi->mem_upper = g_mem_upper;
+    if (g_mmap_count > 0) {
+        memcpy(mmap, g_mmap, g_mmap_count * sizeof(multiboot_memory_map_t));
+        mbi->flags |= MULTIBOOT_INFO_MEM_MAP;
+        mbi->mmap_addr = (uint32)mmap;
+        mbi->mmap_length = g_mmap_count * sizeof(multiboot_memory_map_t);
+    }
+
+    // like GRUB, the path followed by the arguments
+    for (int i = 0; i < argc; i++) {
+        uint32 n = strlen(argv[i]);
+        if (len + n + 2 > KEXEC_CMDLINE_SIZE)
+            break;
+        if (i > 0)
+            cmdline[len++] = ' ';
+        memcpy(cmdline + len, argv[i], n);
+        len += n;
+    }
+    cmdline[len] = '\0';
+    mbi->cmdline = (uint32)cmdline;
+    strcpy(name, KEXEC_LOADER_NAME);
+    mbi->boot_loader_name = (uint32)name;
+    return (uint32)mbi;
+}
+
+/**
+ * boot the multiboot ELF kernel at path with argv as its command line,
+ * argv[0] is the path, returns FALSE with a message when it cannot be loaded
+ */
+BOOL kexec(const char *path, int argc, char **argv) {
+    ELF_HEADER header;
+    const char *error;
+    uint32 entry, mbi, size = 0;
+    VfsFile *file;
+
+    if (!g_have_memory) {
+        printf("kexec: no memory information from the boot loader\n");
+        return FALSE;
+    }
+    file = vfs_open(path);
+    if (file == NULL) {
+        printf("kexec: '%s' not found\n", path);
+        return FALSE;
+    }
+    error = kexec_check_header(file);
+    if (error == NULL)
+        error = kexec_check_elf(file, &header, &entry);
+    if (error == NULL)
+        error = kexec_stage(file, &header);
+    vfs_close(file);
+    if (error != NULL) {
+        printf("kexec: %s: %s\n", path, error);
+        return FALSE;
+    }
+    mbi = kexec_build_info(argc, argv);
+    for (uint32 i = 0; i < g_chunk_count; i++)
+        size += g_chunks[i].len;
+    printf("kexec: %s, %d KB in %d chunks, entry 0x%x\n", path, size / 1024, g_chunk_count, entry);
+
+    // nothing may print or take a lock from here, a stopped CPU can hold it
+    irq_save();
+    if (ioapic_active())
+        ioapic_shutdown();
+    else
+        pic8259_disable();
+    if (lapic_present()) {
+        smp_stop_others();
+        lapic_shutdown();
+    }
+    memcpy((void *)KEXEC_TRAMPOLINE_ADDRESS, kexec_start, kexec_end - kexec_start);
+    KEXEC_PARAM(kexec_chunks) = KEXEC_CHUNKS_ADDRESS;
+    KEXEC_PARAM(kexec_count) = g_chunk_count;
+    KEXEC_PARAM(kexec_entry) = entry;
+    KEXEC_PARAM(kexec_mbi) = mbi;
+    ((void (*)())KEXEC_TRAMPOLINE_ADDRESS)();
+    return FALSE;
+}
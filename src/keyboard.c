@@ -5,10 +5,24 @@
 #include "isr.h"
 #include "types.h"
 #include "string.h"
+#include "thread.h"
+#include "softirq.h"
+#include "spinlock.h"
 
 static BOOL g_caps_lock = FALSE;
 static BOOL g_shift_pressed = FALSE;
 char g_ch = 0, g_scan_code = 0;
+static THREAD *volatile g_kb_waiter;   // thread blocked in kb_getchar() or kb_get_scancode()
+
+// scan codes from the interrupt handler to the bottom half, one writer and one reader
+static volatile uint8 g_scan_queue[KEYBOARD_QUEUE_SIZE];
+static volatile uint32 g_scan_head, g_scan_tail;
+static SOFTIRQ_WORK g_kb_work;
+
+// translated characters for kb_getchar(), g_kb_lock protects them
+static SPINLOCK g_kb_lock = SPINLOCK_INIT;
+static char g_chars[KEYBOARD_QUEUE_SIZE];
+static uint32 g_chars_head, g_chars_tail;
 
 // see scan codes defined in keyboard.h for index
 char g_scan_code_chars[128] = {
@@ -63,11 +77,15 @@ char alternate_chars(char ch) {
     }
 }
 
-void keyboard_handler(REGISTERS *r) {
-    int scancode;
+// caller holds g_kb_lock
+static void kb_push_char(char ch) {
+    if (ch > 0 && g_chars_head - g_chars_tail < KEYBOARD_QUEUE_SIZE)
+        g_chars[g_chars_head++ % KEYBOARD_QUEUE_SIZE] = ch;
+}
 
+// update the modifier state for a scan code and queue its character, caller holds g_kb_lock
+static void kb_translate(int scancode) {
     g_ch = 0;
-    scancode = get_scancode();
     g_scan_code = scancode;
     if (scancode & 0x80) {
         // Key release
@@ -117,31 +135,94 @@ void keyboard_handler(REGISTERS *r) {
                 break;
         }
     }
+    kb_push_char(g_ch);
 }
 
+// bottom half, translates the queued scan codes with interrupts enabled
+static void keyboard_work(void *arg) {
+    (void)arg;
+    spin_lock(&g_kb_lock);
+    while (g_scan_tail != g_scan_head)
+        kb_translate(g_scan_queue[g_scan_tail++ % KEYBOARD_QUEUE_SIZE]);
+    spin_unlock(&g_kb_lock);
+    if (g_kb_waiter)
+        thread_wake(g_kb_waiter);
+}
 
+// top half, only takes the scan code off the controller
+void keyboard_handler(REGISTERS *r) {
+    int scancode = get_scancode();
+
+    (void)r;
+    if (g_scan_head - g_scan_tail < KEYBOARD_QUEUE_SIZE) {
+        g_scan_queue[g_scan_head % KEYBOARD_QUEUE_SIZE] = scancode;
+        asm volatile("" ::: "memory");
+        g_scan_head++;
+    }
+    softirq_raise(&g_kb_work);
+}
 
 void keyboard_init() {
+    softirq_work_init(&g_kb_work, keyboard_work, NULL);
     isr_register_interrupt_handler(IRQ_BASE + 1, keyboard_handler);
 }
 
+// queue a character from another input device as if it was typed, from deferred work or threads
+void kb_input(char ch) {
+    uint32 flags = irq_save();
+
+    spin_lock(&g_kb_lock);
+    kb_push_char(ch);
+    spin_unlock(&g_kb_lock);
+    if (g_kb_waiter)
+        thread_wake(g_kb_waiter);
+    irq_restore(flags);
+}
+
+// block until ready() holds, returns with interrupts disabled and g_kb_lock held
+static uint32 kb_wait(BOOL (*ready)()) {
+    uint32 flags = irq_save();
+
+    for (;;) {
+        spin_lock(&g_kb_lock);
+        if (ready())
+            break;
+        g_kb_waiter = thread_current();
+        spin_unlock(&g_kb_lock);
+        thread_block();
+    }
+    g_kb_waiter = NULL;
+    return flags;
+}
+
+static BOOL kb_char_ready() {
+    return g_chars_head != g_chars_tail;
+}
+
+static BOOL kb_scancode_ready() {
+    return g_scan_code > 0;
+}
+
 // A blocking character read
 char kb_getchar() {
+    uint32 flags = kb_wait(kb_char_ready);
     char c;
 
-    while(g_ch <= 0);
-    c = g_ch;
-    g_ch = 0;
+    c = g_chars[g_chars_tail++ % KEYBOARD_QUEUE_SIZE];
     g_scan_code = 0;
+    spin_unlock(&g_kb_lock);
+    irq_restore(flags);
     return c;
 }
 
 char kb_get_scancode() {
+    uint32 flags = kb_wait(kb_scancode_ready);
     char code;
 
-    while(g_scan_code <= 0);
     code = g_scan_code;
-    g_ch = 0;
+    g_chars_tail = g_chars_head;
     g_scan_code = 0;
+    spin_unlock(&g_kb_lock);
+    irq_restore(flags);
     return code;
 }
@@ -0,0 +1,196 @@
+/**
+ * Local APIC, one per CPU, used for inter-processor interrupts and EOIs,
+ * driven through MSRs in x2APIC mode when the CPU has it
+ * for more, see https://wiki.osdev.org/APIC
+ */
+
+#include "lapic.h"
+#include "paging.h"
+#include "pmm.h"
+#include "isr.h"
+#include "msr.h"
+#include "cpu_features.h"
+
+static volatile uint32 *g_lapic;
+static BOOL g_x2apic;
+static BOOL g_tsc_deadline;
+
+static inline uint32 lapic_read(uint32 reg) {
+    if (g_x2apic)
+        return (uint32)rdmsr(LAPIC_X2APIC_MSR + reg / 16);
+    return g_lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32 reg, uint32 value) {
+    if (g_x2apic)
+        wrmsr(LAPIC_X2APIC_MSR + reg / 16, value);
+    else
+        g_lapic[reg / 4] = value;
+}
+
+static void icr_wait() {
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING)
+        asm volatile("pause");
+}
+
+// ICR high and low must not be split by an interrupt sending its own IPI,
+// in x2APIC mode the ICR is one 64 bit MSR without a delivery status bit
+static void icr_send(uint8 apic_id, uint32 command) {
+    uint32 flags = irq_save();
+
+    if (g_x2apic) {
+        wrmsr(LAPIC_X2APIC_MSR + LAPIC_ICR_LOW / 16, ((uint64)apic_id << 32) | command);
+    } else {
+        icr_wait();
+        lapic_write(LAPIC_ICR_HIGH, (uint32)apic_id << 24);
+        lapic_write(LAPIC_ICR_LOW, command);
+        icr_wait();
+    }
+    irq_restore(flags);
+}
+
+/**
+ * map the local APIC registers at given physical address and enable the boot CPU's
+ */
+void lapic_init(uint32 base) {
+    g_x2apic = cpu_has(CPU_FEATURE_X2APIC);
+    g_tsc_deadline = cpu_has(CPU_FEATURE_TSC_DEADLINE);
+    if (base == 0)
+        base = LAPIC_DEFAULT_BASE;
+    if (paging_identity_map(base, PAGE_SIZE, PAGE_WRITE | PAGE_CACHE_DISABLE) < 0)
+        return;
+    g_lapic = (volatile uint32 *)base;
+    lapic_enable();
+}
+
+/**
+ * TRUE once lapic_init() ran
+ */
+BOOL lapic_present() {
+    return g_lapic != NULL;
+}
+
+/**
+ * TRUE when the local APICs are driven in x2APIC mode
+ */
+BOOL lapic_x2apic() {
+    return g_x2apic;
+}
+
+/**
+ * software enable the local APIC of the calling CPU
+ */
+void lapic_enable() {
+    if (g_x2apic)
+        wrmsr(LAPIC_MSR_APIC_BASE, rdmsr(LAPIC_MSR_APIC_BASE) | LAPIC_BASE_ENABLE | LAPIC_BASE_X2APIC);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+/**
+ * APIC ID of the calling CPU
+ */
+uint8 lapic_id() {
+    if (g_x2apic)
+        return lapic_read(LAPIC_ID);
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/**
+ * signal end of interrupt for a vector delivered by the local APIC,
+ * one register write
+ */
+void lapic_eoi() {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/**
+ * mask the LINT0 virtual wire input the 8259 is connected to
+ */
+void lapic_mask_lint0() {
+    lapic_write(LAPIC_LVT_LINT0, lapic_read(LAPIC_LVT_LINT0) | LAPIC_LVT_MASKED);
+}
+
+/**
+ * TRUE when the local APIC timer supports TSC-deadline mode
+ */
+BOOL lapic_tsc_deadline() {
+    return g_tsc_deadline;
+}
+
+/**
+ * set up the timer of the calling CPU for one-shot interrupts at vector,
+ * counting the bus clock divided by 16 or in TSC-deadline mode
+ */
+void lapic_timer_setup(uint8 vector, BOOL tsc_deadline) {
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, vector | (tsc_deadline ? LAPIC_TIMER_TSC_DEADLINE : 0));
+}
+
+/**
+ * fire once after count timer ticks, 0 stops the timer
+ */
+void lapic_timer_oneshot(uint32 count) {
+    lapic_write(LAPIC_TIMER_INITIAL, count);
+}
+
+/**
+ * fire once when the TSC reaches deadline, 0 stops the timer
+ */
+void lapic_timer_deadline(uint64 deadline) {
+    wrmsr(LAPIC_MSR_TSC_DEADLINE, deadline);
+}
+
+/**
+ * remaining count of the timer
+ */
+uint32 lapic_timer_current() {
+    return lapic_read(LAPIC_TIMER_CURRENT);
+}
+
+/**
+ * stop the timer of the calling CPU and put LINT0 and LINT1 back in the
+ * virtual wire mode the firmware leaves, for a kernel started by kexec
+ */
+void lapic_shutdown() {
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+    if (g_tsc_deadline)
+        wrmsr(LAPIC_MSR_TSC_DEADLINE, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_EXTINT);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_TPR, 0);
+}
+
+/**
+ * send an INIT IPI, the target waits for a startup IPI afterwards
+ */
+void lapic_send_init(uint8 apic_id) {
+    icr_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    // deassert, only needed by old CPUs and not supported in x2APIC mode
+    if (!g_x2apic)
+        icr_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+}
+
+/**
+ * send a startup IPI, the target starts in real mode at page * 4KB
+ */
+void lapic_send_startup(uint8 apic_id, uint8 page) {
+    icr_send(apic_id, LAPIC_ICR_STARTUP | page);
+}
+
+/**
+ * interrupt the CPU with given APIC ID at vector
+ */
+void lapic_send_ipi(uint8 apic_id, uint8 vector) {
+    icr_send(apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+}
+
+/**
+ * interrupt all other CPUs at vector
+ */
+void lapic_broadcast_ipi(uint8 vector) {
+    icr_send(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | vector);
+}
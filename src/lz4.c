@@ -0,0 +1,207 @@
+/**
+ * LZ4 block format compression
+ * greedy single-pass compressor and a decoder that copies 8 bytes per step
+ */
+
+#include "lz4.h"
+#include "string.h"
+
+typedef uint32 __attribute__((__may_alias__, aligned(1))) unaligned_uint32;
+
+static inline uint32 read32(const uint8 *p) {
+    return *(const unaligned_uint32 *)p;
+}
+
+static inline void copy8(uint8 *dst, const uint8 *src) {
+    ((unaligned_uint32 *)dst)[0] = ((const unaligned_uint32 *)src)[0];
+    ((unaligned_uint32 *)dst)[1] = ((const unaligned_uint32 *)src)[1];
+}
+
+static inline uint32 lz4_hash(uint32 sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+// write length extension bytes for a 4 bit token field that overflowed
+static inline uint8 *write_length(uint8 *op, uint32 len) {
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8)len;
+    return op;
+}
+
+/**
+ * compress src_len(at most 64KB) bytes of src into dst,
+ * workmem must point to LZ4_WORKMEM_SIZE bytes,
+ * returns compressed size or 0 if it does not fit into dst_capacity
+ */
+uint32 lz4_compress(const uint8 *src, uint32 src_len, uint8 *dst, uint32 dst_capacity, void *workmem) {
+    uint16 *table = workmem;
+    const uint8 *ip = src;
+    const uint8 *anchor = src;
+    const uint8 *iend = src + src_len;
+    const uint8 *mflimit = iend - LZ4_MFLIMIT;
+    const uint8 *matchlimit = iend - LZ4_LASTLITERALS;
+    uint8 *op = dst;
+    uint8 *oend = dst + dst_capacity;
+    uint32 lit, len;
+
+    memset(table, 0, LZ4_WORKMEM_SIZE);
+    if (src_len < LZ4_MFLIMIT + 1)
+        goto last_literals;
+
+    table[lz4_hash(read32(ip))] = 0;
+    ip++;
+
+    for (;;) {
+        const uint8 *ref;
+        uint8 *token;
+
+        // find next match
+        for (;;) {
+            uint32 h;
+            if (ip > mflimit)
+                goto last_literals;
+            h = lz4_hash(read32(ip));
+            ref = src + table[h];
+            table[h] = (uint16)(ip - src);
+            if (ref < ip && ip - ref <= LZ4_MAX_OFFSET && read32(ref) == read32(ip))
+                break;
+            ip++;
+        }
+
+        // extend match backwards over pending literals
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+
+        lit = ip - anchor;
+        if (op + 1 + lit / 255 + 1 + lit + 2 + 1 + LZ4_LASTLITERALS > oend)
+            return 0;
+        token = op++;
+        if (lit >= 15) {
+            *token = 15 << 4;
+            op = write_length(op, lit - 15);
+        } else {
+            *token = lit << 4;
+        }
+        memcpy(op, anchor, lit);
+        op += lit;
+
+        // offset, little endian
+        *op++ = (uint8)(ip - ref);
+        *op++ = (uint8)((ip - ref) >> 8);
+
+        // extend match forward
+        ip += LZ4_MINMATCH;
+        ref += LZ4_MINMATCH;
+        while (ip < matchlimit && *ip == *ref) {
+            ip++;
+            ref++;
+        }
+        len = ip - anchor - lit - LZ4_MINMATCH;
+        if (op + len / 255 + 1 + 1 + LZ4_LASTLITERALS > oend)
+            return 0;
+        if (len >= 15) {
+            *token |= 15;
+            op = write_length(op, len - 15);
+        } else {
+            *token |= len;
+        }
+        anchor = ip;
+
+        if (ip > mflimit)
+            goto last_literals;
+        table[lz4_hash(read32(ip - 2))] = (uint16)(ip - 2 - src);
+    }
+
+last_literals:
+    lit = iend - anchor;
+    if (op + 1 + lit / 255 + 1 + lit > oend)
+        return 0;
+    if (lit >= 15) {
+        *op++ = 15 << 4;
+        op = write_length(op, lit - 15);
+    } else {
+        *op++ = lit << 4;
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+    return op - dst;
+}
+
+// read a length extension, returns -1 on truncated input
+static inline int read_length(const uint8 **ip, const uint8 *iend, uint32 *len) {
+    uint8 b;
+    do {
+        if (*ip >= iend)
+            return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/**
+ * decompress an LZ4 block into dst, copying literals and matches a word at a time,
+ * returns decompressed size or -1 on malformed input or dst overflow
+ */
+int lz4_decompress(const uint8 *src, uint32 src_len, uint8 *dst, uint32 dst_capacity) {
+    const uint8 *ip = src;
+    const uint8 *iend = src + src_len;
+    uint8 *op = dst;
+    uint8 *oend = dst + dst_capacity;
+
+    while (ip < iend) {
+        uint8 token = *ip++;
+        uint32 lit = token >> 4;
+        uint32 len, offset, i;
+        const uint8 *match;
+
+        if (lit == 15 && read_length(&ip, iend, &lit) < 0)
+            return -1;
+        if (lit > (uint32)(iend - ip) || lit > (uint32)(oend - op))
+            return -1;
+
+        // literals, 8 bytes per step while both buffers have room for the overrun
+        if (lit + 8 <= (uint32)(iend - ip) && lit + 8 <= (uint32)(oend - op)) {
+            for (i = 0; i < lit; i += 8)
+                copy8(op + i, ip + i);
+        } else {
+            for (i = 0; i < lit; i++)
+                op[i] = ip[i];
+        }
+        op += lit;
+        ip += lit;
+
+        // block ends with literals only
+        if (ip >= iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32)(op - dst))
+            return -1;
+
+        len = token & 15;
+        if (len == 15 && read_length(&ip, iend, &len) < 0)
+            return -1;
+        len += LZ4_MINMATCH;
+        if (len > (uint32)(oend - op))
+            return -1;
+
+        // matches at least 8 bytes back never read bytes this step writes
+        match = op - offset;
+        if (offset >= 8 && len + 8 <= (uint32)(oend - op)) {
+            for (i = 0; i < len; i += 8)
+                copy8(op + i, match + i);
+        } else {
+            for (i = 0; i < len; i++)
+                op[i] = match[i];
+        }
+        op += len;
+    }
+    return op - dst;
+}
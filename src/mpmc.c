@@ -0,0 +1,88 @@
+/**
+ * Bounded lock-free multi-producer multi-consumer queue
+ * cell i starts with sequence i, a producer at position pos waits for sequence pos
+ * and publishes pos + 1, the consumer at pos waits for pos + 1 and frees the cell
+ * for the next round with pos + size
+ */
+
+#include "mpmc.h"
+
+/**
+ * set up a queue on size cells, size must be a power of two,
+ * returns FALSE otherwise
+ */
+BOOL mpmc_init(MPMC_QUEUE *queue, MPMC_CELL *cells, uint32 size) {
+    if (size < 2 || (size & (size - 1)) != 0)
+        return FALSE;
+    for (uint32 i = 0; i < size; i++) {
+        cells[i].sequence = i;
+        cells[i].data = NULL;
+    }
+    queue->cells = cells;
+    queue->mask = size - 1;
+    queue->enqueue_pos = 0;
+    queue->dequeue_pos = 0;
+    queue->full = 0;
+    queue->retries = 0;
+    return TRUE;
+}
+
+/**
+ * append data, returns FALSE when the queue is full,
+ * safe from any CPU and from interrupt handlers
+ */
+BOOL mpmc_push(MPMC_QUEUE *queue, void *data) {
+    uint32 pos = queue->enqueue_pos;
+    MPMC_CELL *cell;
+
+    for (;;) {
+        sint32 diff;
+
+        cell = &queue->cells[pos & queue->mask];
+        diff = (sint32)(cell->sequence - pos);
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&queue->enqueue_pos, pos, pos + 1))
+                break;
+            __sync_fetch_and_add(&queue->retries, 1);
+            pos = queue->enqueue_pos;
+        } else if (diff < 0) {
+            // the consumer of the previous round has not freed the cell
+            __sync_fetch_and_add(&queue->full, 1);
+            return FALSE;
+        } else {
+            pos = queue->enqueue_pos;
+        }
+    }
+    cell->data = data;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+/**
+ * take the oldest entry into *data, returns FALSE when the queue is empty,
+ * safe from any CPU and from interrupt handlers
+ */
+BOOL mpmc_pop(MPMC_QUEUE *queue, void **data) {
+    uint32 pos = queue->dequeue_pos;
+    MPMC_CELL *cell;
+
+    for (;;) {
+        sint32 diff;
+
+        cell = &queue->cells[pos & queue->mask];
+        diff = (sint32)(cell->sequence - (pos + 1));
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&queue->dequeue_pos, pos, pos + 1))
+                break;
+            __sync_fetch_and_add(&queue->retries, 1);
+            pos = queue->dequeue_pos;
+        } else if (diff < 0) {
+            return FALSE;
+        } else {
+            pos = queue->dequeue_pos;
+        }
+    }
+    *data = cell->data;
+    __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
@@ -0,0 +1,152 @@
+/**
+ * Paging setup, builds on the page directory created in entry.asm
+ */
+
+#include "paging.h"
+#include "pmm.h"
+#include "string.h"
+#include "spinlock.h"
+#include "isr.h"
+
+// page tables are shared by all CPUs
+static SPINLOCK g_paging_lock = SPINLOCK_INIT;
+
+static inline uint32 read_cr4() {
+    uint32 val;
+    asm volatile("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr4(uint32 val) {
+    asm volatile("mov %0, %%cr4" :: "r"(val));
+}
+
+static inline uint32 read_cr0() {
+    uint32 val;
+    asm volatile("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr0(uint32 val) {
+    asm volatile("mov %0, %%cr0" :: "r"(val) : "memory");
+}
+
+static inline void write_cr3(uint32 val) {
+    asm volatile("mov %0, %%cr3" :: "r"(val) : "memory");
+}
+
+/**
+ * identity map physical memory up to mem_end with 4MB pages,
+ * the first 4MB keeps the 4KB page table from entry.asm,
+ * read-only user pages stay read-only for the kernel as well
+ */
+void paging_init(uint32 mem_end) {
+    uint32 *page_directory = (uint32 *)PAGE_DIRECTORY_ADDRESS;
+    uint32 i;
+
+    if (mem_end > PMM_MAX_MEMORY)
+        mem_end = PMM_MAX_MEMORY;
+
+    write_cr4(read_cr4() | CR4_PSE);
+    // the identity mapping is writable, so only pages mapped without PAGE_WRITE are affected
+    write_cr0(read_cr0() | CR0_WP);
+    for (i = 1; i < (mem_end + LARGE_PAGE_SIZE - 1) / LARGE_PAGE_SIZE; i++)
+        page_directory[i] = (i * LARGE_PAGE_SIZE) | PAGE_LARGE | PAGE_WRITE | PAGE_PRESENT;
+    // flush whole TLB
+    write_cr3(PAGE_DIRECTORY_ADDRESS);
+}
+
+/**
+ * return page table entry for given virtual address,
+ * a page table is allocated when create is set and none exists,
+ * NULL if address is covered by a 4MB page or no table exists
+ */
+uint32 *paging_get_pte(uint32 virt, BOOL create) {
+    uint32 *page_directory = (uint32 *)PAGE_DIRECTORY_ADDRESS;
+    uint32 *pde = &page_directory[virt >> 22];
+    uint32 *page_table;
+
+    if (*pde & PAGE_LARGE)
+        return NULL;
+    if (!(*pde & PAGE_PRESENT)) {
+        if (!create)
+            return NULL;
+        page_table = pmm_alloc_page();
+        if (page_table == NULL)
+            return NULL;
+        memset(page_table, 0, PAGE_SIZE);
+        // the page table entries decide whether ring 3 may access a page
+        *pde = (uint32)page_table | PAGE_USER | PAGE_WRITE | PAGE_PRESENT;
+    }
+    page_table = (uint32 *)(*pde & PAGE_MASK);
+    return &page_table[(virt >> 12) & 0x3FF];
+}
+
+/**
+ * map 4KB page at virt to phys with given flags, returns -1 when
+ * no page table could be allocated
+ */
+int paging_map_page(uint32 virt, uint32 phys, uint32 flags) {
+    uint32 irq_flags = spin_lock_irqsave(&g_paging_lock);
+    uint32 *pte = paging_get_pte(virt, TRUE);
+
+    if (pte != NULL)
+        *pte = (phys & PAGE_MASK) | flags | PAGE_PRESENT;
+    spin_unlock_irqrestore(&g_paging_lock, irq_flags);
+
+    if (pte == NULL)
+        return -1;
+    paging_invalidate(virt);
+    return 0;
+}
+
+/**
+ * identity map the physical range base..base+size, pages that are
+ * already mapped(including 4MB pages) are left alone, returns -1 when
+ * no page table could be allocated
+ */
+int paging_identity_map(uint32 base, uint32 size, uint32 flags) {
+    uint32 *page_directory = (uint32 *)PAGE_DIRECTORY_ADDRESS;
+    uint32 page = base & PAGE_MASK;
+    uint32 end = base + size;
+
+    for (; page < end && page >= (base & PAGE_MASK); page += PAGE_SIZE) {
+        uint32 *pte;
+        if (page_directory[page >> 22] & PAGE_LARGE)
+            continue;
+        pte = paging_get_pte(page, FALSE);
+        if (pte != NULL && (*pte & PAGE_PRESENT))
+            continue;
+        if (paging_map_page(page, page, flags) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * remove mapping of 4KB page at virt
+ */
+void paging_unmap_page(uint32 virt) {
+    uint32 *pte = paging_get_pte(virt, FALSE);
+
+    if (pte == NULL)
+        return;
+    *pte = 0;
+    paging_invalidate(virt);
+}
+
+/**
+ * flush TLB entry of given virtual address
+ */
+void paging_invalidate(uint32 virt) {
+    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+}
+
+/**
+ * faulting address of the last page fault
+ */
+uint32 paging_fault_address() {
+    uint32 val;
+    asm volatile("mov %%cr2, %0" : "=r"(val));
+    return val;
+}
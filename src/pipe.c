@@ -0,0 +1,178 @@
+/**
+ * Pipes between the commands of a shell pipeline
+ * the writer publishes data with a release store of tail and the reader frees
+ * space with a release store of head, a blocked end parks itself in reader or
+ * writer and checks the ring again, the other end swaps the field to NULL
+ * after its store, both sides are full barriers so no wakeup is lost
+ */
+
+#include "pipe.h"
+#include "thread.h"
+#include "spinlock.h"
+#include "pmm.h"
+#include "string.h"
+#include "stdio.h"
+
+// descriptors of pipes follow STDIO_CONSOLE in the order of g_pipes
+#define PIPE_FD_BASE            (STDIO_CONSOLE + 1)
+
+static PIPE g_pipes[PIPE_MAX];
+static SPINLOCK g_pipes_lock = SPINLOCK_INIT;
+
+static BOOL pipe_writable(PIPE *pipe) {
+    return pipe->read_closed || pipe->tail - __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE) < PIPE_SIZE;
+}
+
+static BOOL pipe_readable(PIPE *pipe) {
+    return pipe->write_closed || __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE) != pipe->head;
+}
+
+// block until ready(pipe) holds, parked in *waiter meanwhile
+static void pipe_wait(PIPE *pipe, struct THREAD *volatile *waiter, BOOL (*ready)(PIPE *)) {
+    uint32 flags = irq_save();
+
+    __atomic_store_n(waiter, thread_current(), __ATOMIC_SEQ_CST);
+    if (!ready(pipe))
+        thread_block();
+    __atomic_store_n(waiter, NULL, __ATOMIC_SEQ_CST);
+    irq_restore(flags);
+}
+
+// wake the thread parked in *waiter, if any
+static void pipe_kick(struct THREAD *volatile *waiter) {
+    THREAD *thread = __atomic_exchange_n(waiter, NULL, __ATOMIC_SEQ_CST);
+
+    if (thread != NULL)
+        thread_wake(thread);
+}
+
+static void pipe_release(PIPE *pipe) {
+    uint32 flags;
+
+    if (__sync_sub_and_fetch(&pipe->ends, 1) > 0)
+        return;
+    pmm_free_page(pipe->buffer);
+    flags = spin_lock_irqsave(&g_pipes_lock);
+    pipe->used = FALSE;
+    spin_unlock_irqrestore(&g_pipes_lock, flags);
+}
+
+/**
+ * open a pipe with both ends, NULL when out of pipes or memory
+ */
+PIPE *pipe_create() {
+    uint8 *buffer = pmm_alloc_page();
+    PIPE *pipe = NULL;
+    uint32 flags;
+
+    if (buffer == NULL)
+        return NULL;
+    flags = spin_lock_irqsave(&g_pipes_lock);
+    for (int i = 0; i < PIPE_MAX; i++) {
+        if (!g_pipes[i].used) {
+            pipe = &g_pipes[i];
+            memset(pipe, 0, sizeof(PIPE));
+            pipe->used = TRUE;
+            pipe->buffer = buffer;
+            pipe->ends = 2;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&g_pipes_lock, flags);
+    if (pipe == NULL)
+        pmm_free_page(buffer);
+    return pipe;
+}
+
+/**
+ * write len bytes, blocking while the pipe is full, returns the bytes
+ * written or -1 when the read end is closed
+ */
+int pipe_write(PIPE *pipe, const void *buf, uint32 len) {
+    const uint8 *src = buf;
+    uint32 done = 0;
+
+    while (done < len) {
+        uint32 tail = pipe->tail, count;
+
+        if (pipe->read_closed)
+            return -1;
+        count = PIPE_SIZE - (tail - __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE));
+        if (count == 0) {
+            pipe_wait(pipe, &pipe->writer, pipe_writable);
+            continue;
+        }
+        // up to the end of the ring, the rest goes in the next round
+        if (count > PIPE_SIZE - tail % PIPE_SIZE)
+            count = PIPE_SIZE - tail % PIPE_SIZE;
+        if (count > len - done)
+            count = len - done;
+        memcpy(pipe->buffer + tail % PIPE_SIZE, src + done, count);
+        __atomic_store_n(&pipe->tail, tail + count, __ATOMIC_RELEASE);
+        done += count;
+        pipe_kick(&pipe->reader);
+    }
+    return done;
+}
+
+/**
+ * read up to len bytes, blocking while the pipe is empty,
+ * returns 0 at the end of the data once the write end is closed
+ */
+int pipe_read(PIPE *pipe, void *buf, uint32 len) {
+    uint32 head = pipe->head, count;
+
+    if (len == 0)
+        return 0;
+    while ((count = __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE) - head) == 0) {
+        if (pipe->write_closed) {
+            // the writer may have written its last bytes right before closing
+            if (__atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE) != head)
+                continue;
+            return 0;
+        }
+        pipe_wait(pipe, &pipe->reader, pipe_readable);
+    }
+    if (count > PIPE_SIZE - head % PIPE_SIZE)
+        count = PIPE_SIZE - head % PIPE_SIZE;
+    if (count > len)
+        count = len;
+    memcpy(buf, pipe->buffer + head % PIPE_SIZE, count);
+    __atomic_store_n(&pipe->head, head + count, __ATOMIC_RELEASE);
+    pipe_kick(&pipe->writer);
+    return count;
+}
+
+/**
+ * close the write end, the reader sees the end of the data after what is buffered
+ */
+void pipe_close_write(PIPE *pipe) {
+    __atomic_store_n(&pipe->write_closed, TRUE, __ATOMIC_SEQ_CST);
+    pipe_kick(&pipe->reader);
+    pipe_release(pipe);
+}
+
+/**
+ * close the read end, later writes fail and buffered data is dropped
+ */
+void pipe_close_read(PIPE *pipe) {
+    __atomic_store_n(&pipe->read_closed, TRUE, __ATOMIC_SEQ_CST);
+    pipe_kick(&pipe->writer);
+    pipe_release(pipe);
+}
+
+/**
+ * descriptor naming pipe as a thread's standard input or output, see stdio.h
+ */
+int pipe_fd(PIPE *pipe) {
+    return PIPE_FD_BASE + (pipe - g_pipes);
+}
+
+/**
+ * pipe a descriptor from pipe_fd() names, NULL for any other descriptor
+ */
+PIPE *pipe_from_fd(int fd) {
+    if (fd < PIPE_FD_BASE || fd >= PIPE_FD_BASE + PIPE_MAX)
+        return NULL;
+    return &g_pipes[fd - PIPE_FD_BASE];
+}
@@ -0,0 +1,61 @@
+/**
+ * 8253/8254 Programmable Interval Timer(PIT)
+ * for more, see https://wiki.osdev.org/Programmable_Interval_Timer
+ */
+
+#include "pit.h"
+#include "isr.h"
+#include "io_ports.h"
+#include "thread.h"
+#include "timer.h"
+
+static volatile uint32 g_ticks;
+static uint32 g_hz;
+
+static void pit_handler(REGISTERS *reg) {
+    (void)reg;
+    g_ticks++;
+    timer_run();
+    thread_tick();
+}
+
+/**
+ * program channel 0 to interrupt hz times a second and hook IRQ0
+ */
+void pit_init(uint32 hz) {
+    uint32 divisor = PIT_FREQUENCY / hz;
+
+    g_hz = hz;
+    isr_register_interrupt_handler(IRQ_BASE + IRQ0_TIMER, pit_handler);
+    outportb(PIT_COMMAND, PIT_MODE_SQUARE);
+    outportb(PIT_CHANNEL0, divisor & 0xFF);
+    outportb(PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+    isr_unmask_irq(IRQ0_TIMER);
+}
+
+/**
+ * interrupt once after count input clocks, for one-shot use after pit_init()
+ */
+void pit_oneshot(uint32 count) {
+    if (count == 0)
+        count = 1;
+    if (count > PIT_MAX_COUNT)
+        count = PIT_MAX_COUNT;
+    outportb(PIT_COMMAND, PIT_MODE_ONESHOT);
+    outportb(PIT_CHANNEL0, count & 0xFF);
+    outportb(PIT_CHANNEL0, (count >> 8) & 0xFF);
+}
+
+/**
+ * timer interrupts since pit_init()
+ */
+uint32 pit_ticks() {
+    return g_ticks;
+}
+
+/**
+ * convert milliseconds to ticks, rounded up
+ */
+uint32 pit_ms_to_ticks(uint32 ms) {
+    return (ms * g_hz + 999) / 1000;
+}
@@ -0,0 +1,130 @@
+/**
+ * Physical Memory Manager(PMM), 4KB page frame allocator
+ * one bit per frame, set bit means used
+ */
+
+#include "pmm.h"
+#include "kernel.h"
+#include "string.h"
+#include "spinlock.h"
+#include "isr.h"
+
+static uint32 g_frame_bitmap[PMM_MAX_FRAMES / 32];
+static uint32 g_total_frames;
+static uint32 g_free_frames;
+// next-fit search hint, index of a frame that was recently free
+static uint32 g_next_frame;
+static SPINLOCK g_pmm_lock = SPINLOCK_INIT;
+
+static inline void frame_set(uint32 frame) {
+    g_frame_bitmap[frame / 32] |= (1 << (frame % 32));
+}
+
+static inline void frame_clear(uint32 frame) {
+    g_frame_bitmap[frame / 32] &= ~(1 << (frame % 32));
+}
+
+static inline BOOL frame_test(uint32 frame) {
+    return (g_frame_bitmap[frame / 32] & (1 << (frame % 32))) ? TRUE : FALSE;
+}
+
+/**
+ * initialize frame bitmap from the amount of memory above 1MB(multiboot mem_upper),
+ * everything below the end of the kernel image stays reserved
+ */
+void pmm_init(uint32 mem_upper_kb) {
+    uint32 mem_end = 0x100000 + mem_upper_kb * 1024;
+    uint32 kernel_end = ((uint32)&__kernel_bss_section_end + PAGE_SIZE - 1) & PAGE_MASK;
+    uint32 frame;
+
+    if (mem_upper_kb > (PMM_MAX_MEMORY - 0x100000) / 1024)
+        mem_end = PMM_MAX_MEMORY;
+
+    // start with everything used, then free what we actually have
+    memset(g_frame_bitmap, (char)0xFF, sizeof(g_frame_bitmap));
+    g_total_frames = mem_end / PAGE_SIZE;
+    g_free_frames = 0;
+    for (frame = kernel_end / PAGE_SIZE; frame < g_total_frames; frame++) {
+        frame_clear(frame);
+        g_free_frames++;
+    }
+    g_next_frame = kernel_end / PAGE_SIZE;
+}
+
+/**
+ * mark given physical range as used so it is never handed out
+ */
+void pmm_reserve_region(uint32 base, uint32 length) {
+    uint32 frame = base / PAGE_SIZE;
+    uint32 end = (base + length + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    for (; frame < end && frame < g_total_frames; frame++) {
+        if (!frame_test(frame)) {
+            frame_set(frame);
+            g_free_frames--;
+        }
+    }
+}
+
+// next-fit search for a free frame, caller holds g_pmm_lock
+static void *frame_alloc() {
+    uint32 i, frame;
+
+    if (g_free_frames == 0)
+        return NULL;
+
+    for (i = 0; i < g_total_frames; i++) {
+        frame = (g_next_frame + i) % g_total_frames;
+        // skip fully used words quickly
+        if (frame % 32 == 0 && g_frame_bitmap[frame / 32] == 0xFFFFFFFF) {
+            i += 31;
+            continue;
+        }
+        if (!frame_test(frame)) {
+            frame_set(frame);
+            g_free_frames--;
+            g_next_frame = frame + 1;
+            return (void *)(frame * PAGE_SIZE);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * allocate one 4KB page frame, returns NULL when out of memory
+ * returned address is both physical and virtual(identity mapped)
+ */
+void *pmm_alloc_page() {
+    uint32 flags = spin_lock_irqsave(&g_pmm_lock);
+    void *page = frame_alloc();
+
+    spin_unlock_irqrestore(&g_pmm_lock, flags);
+    return page;
+}
+
+/**
+ * return a page frame allocated by pmm_alloc_page()
+ */
+void pmm_free_page(void *page) {
+    uint32 frame = (uint32)page / PAGE_SIZE;
+    uint32 flags;
+
+    if (page == NULL || frame >= g_total_frames)
+        return;
+    flags = spin_lock_irqsave(&g_pmm_lock);
+    if (frame_test(frame)) {
+        frame_clear(frame);
+        g_free_frames++;
+        if (frame < g_next_frame)
+            g_next_frame = frame;
+    }
+    spin_unlock_irqrestore(&g_pmm_lock, flags);
+}
+
+uint32 pmm_free_pages() {
+    return g_free_frames;
+}
+
+uint32 pmm_total_pages() {
+    return g_total_frames;
+}
@@ -0,0 +1,67 @@
+/**
+ * Read-copy-update(RCU), quiescent state based
+ * a grace period snapshots the quiescent state counter of every CPU and ends once
+ * each other CPU moved its counter, the calling CPU runs no reader while it waits
+ */
+
+#include "rcu.h"
+#include "spinlock.h"
+#include "tsc.h"
+#include "console.h"
+
+static SPINLOCK g_rcu_lock = SPINLOCK_INIT;    // protects the statistics
+static uint32 g_grace_periods;
+static uint64 g_grace_cycles;
+static uint32 g_grace_max;
+
+/**
+ * wait until every read-side section that may have started before the call
+ * has ended, must not be called from interrupt handlers or inside a read-side section
+ */
+void synchronize_rcu() {
+    uint32 snapshot[SMP_MAX_CPUS];
+    uint32 count = smp_cpu_count(), waiting;
+    CPU *self = cpu_self();
+    uint64 start = rdtsc();
+    uint32 cycles;
+
+    // the new version has to be visible before the counters are read, or a reader
+    // passing a quiescent state right after the snapshot could still load the old one
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (uint32 i = 0; i < count; i++)
+        snapshot[i] = smp_cpu(i)->rcu_qs;
+    do {
+        waiting = 0;
+        for (uint32 i = 0; i < count; i++) {
+            CPU *cpu = smp_cpu(i);
+            if (cpu == self || !cpu->online || cpu->rcu_qs != snapshot[i])
+                continue;
+            // a halted or long running CPU may not return from an interrupt for a while
+            smp_resched(cpu);
+            waiting++;
+        }
+        if (waiting)
+            asm volatile("pause");
+    } while (waiting);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    cycles = (uint32)(rdtsc() - start);
+    spin_lock(&g_rcu_lock);
+    g_grace_periods++;
+    g_grace_cycles += cycles;
+    if (cycles > g_grace_max)
+        g_grace_max = cycles;
+    spin_unlock(&g_rcu_lock);
+}
+
+/**
+ * print grace period statistics
+ */
+void rcu_stats() {
+    uint32 periods = g_grace_periods;
+
+    printf("RCU: %u grace periods", periods);
+    if (periods)
+        printf(", mean %u max %u cycles", udiv64_32(g_grace_cycles, periods), g_grace_max);
+    printf("\n");
+}
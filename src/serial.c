@@ -0,0 +1,102 @@
+/**
+ * 16550 UART serial port, COM1 for exporting kernel statistics,
+ * received characters are typed into the console like keyboard input
+ * for more, see https://wiki.osdev.org/Serial_Ports
+ */
+
+#include "serial.h"
+#include "io_ports.h"
+#include "isr.h"
+#include "keyboard.h"
+#include "softirq.h"
+
+static BOOL g_present;
+
+// received bytes from the interrupt handler to the bottom half, one writer and one reader
+static volatile uint8 g_rx_queue[SERIAL_QUEUE_SIZE];
+static volatile uint32 g_rx_head, g_rx_tail;
+static SOFTIRQ_WORK g_rx_work;
+
+// bottom half, hands received characters to the console input
+static void serial_rx_work(void *arg) {
+    (void)arg;
+    while (g_rx_tail != g_rx_head) {
+        char ch = g_rx_queue[g_rx_tail++ % SERIAL_QUEUE_SIZE];
+        if (ch == '\r')
+            ch = '\n';
+        else if (ch == 0x7F)
+            ch = '\b';
+        kb_input(ch);
+    }
+}
+
+// top half, empties the receive FIFO
+static void serial_handler(REGISTERS *reg) {
+    (void)reg;
+    while (inportb(SERIAL_LSR(SERIAL_COM1)) & SERIAL_LSR_DATA_READY) {
+        uint8 ch = inportb(SERIAL_DATA(SERIAL_COM1));
+        if (g_rx_head - g_rx_tail < SERIAL_QUEUE_SIZE) {
+            g_rx_queue[g_rx_head % SERIAL_QUEUE_SIZE] = ch;
+            asm volatile("" ::: "memory");
+            g_rx_head++;
+        }
+    }
+    softirq_raise(&g_rx_work);
+}
+
+/**
+ * set up COM1 at SERIAL_BAUD 8N1 with receive interrupts,
+ * returns FALSE when no UART answers
+ */
+BOOL serial_init() {
+    uint16 port = SERIAL_COM1;
+    uint16 divisor = SERIAL_CLOCK / SERIAL_BAUD;
+
+    outportb(SERIAL_IER(port), 0x00);
+    outportb(SERIAL_LCR(port), SERIAL_LCR_DLAB);
+    outportb(SERIAL_DIVISOR_LOW(port), divisor & 0xFF);
+    outportb(SERIAL_DIVISOR_HIGH(port), (divisor >> 8) & 0xFF);
+    outportb(SERIAL_LCR(port), SERIAL_LCR_8N1);
+    outportb(SERIAL_FCR(port), SERIAL_FCR_ENABLE);
+
+    // a byte sent in loopback mode must come back
+    outportb(SERIAL_MCR(port), SERIAL_MCR_LOOPBACK);
+    outportb(SERIAL_DATA(port), 0xAE);
+    g_present = inportb(SERIAL_DATA(port)) == 0xAE;
+    outportb(SERIAL_MCR(port), SERIAL_MCR_NORMAL);
+    if (g_present) {
+        softirq_work_init(&g_rx_work, serial_rx_work, NULL);
+        isr_register_interrupt_handler(IRQ_BASE + IRQ4_SERIAL_PORT1, serial_handler);
+        outportb(SERIAL_IER(port), SERIAL_IER_RX);
+        isr_unmask_irq(IRQ4_SERIAL_PORT1);
+    }
+    return g_present;
+}
+
+/**
+ * TRUE when serial_init() found a UART
+ */
+BOOL serial_present() {
+    return g_present;
+}
+
+/**
+ * write a character, waiting for room in the transmitter, "\n" is sent as "\r\n"
+ */
+void serial_putchar(char ch) {
+    if (!g_present)
+        return;
+    if (ch == '\n')
+        serial_putchar('\r');
+    while (!(inportb(SERIAL_LSR(SERIAL_COM1)) & SERIAL_LSR_THR_EMPTY))
+        ;
+    outportb(SERIAL_DATA(SERIAL_COM1), ch);
+}
+
+/**
+ * write a string
+ */
+void serial_putstr(const char *str) {
+    while (*str)
+        serial_putchar(*str++);
+}
@@ -0,0 +1,190 @@
+/**
+ * Symmetric multiprocessing, starts the application processors(APs)
+ * listed in the ACPI MADT with INIT-SIPI-SIPI and keeps per-CPU data
+ * for more, see https://wiki.osdev.org/Symmetric_Multiprocessing
+ */
+
+#include "smp.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "syscall.h"
+#include "fpu.h"
+#include "isr.h"
+#include "pit.h"
+#include "clock.h"
+#include "tsc.h"
+#include "paging.h"
+#include "thread.h"
+#include "console.h"
+#include "string.h"
+
+#define TRAMPOLINE_PARAM(label) \
+    (*(volatile uint32 *)(SMP_TRAMPOLINE_ADDRESS + ((label) - trampoline_start)))
+
+static CPU g_cpus[SMP_MAX_CPUS];
+static volatile uint32 g_cpu_count = 1;
+// index of the AP being started, read by smp_ap_main()
+static volatile uint32 g_starting;
+
+// busy wait on the PIT, interrupts must be enabled
+static void smp_delay_ms(uint32 ms) {
+    uint32 start = pit_ticks();
+
+    while (pit_ticks() - start <= pit_ms_to_ticks(ms))
+        asm volatile("pause");
+}
+
+static void smp_resched_handler(REGISTERS *reg) {
+    (void)reg;
+    cpu_self()->need_resched = TRUE;
+}
+
+// C entry of an AP, called by trampoline.asm on the stack of its idle thread
+static void smp_ap_main() {
+    CPU *cpu = &g_cpus[g_starting];
+
+    gdt_init_cpu(cpu->index, cpu, sizeof(CPU));
+    idt_load();
+    syscall_init_cpu();
+    fpu_init_cpu();
+    lapic_enable();
+    cpu->online = TRUE;
+    thread_idle();
+}
+
+static BOOL smp_start_ap(uint8 apic_id) {
+    CPU *cpu = smp_cpu_init(g_cpu_count);
+    THREAD *idle;
+
+    cpu->apic_id = apic_id;
+    idle = thread_init_cpu(cpu);
+    if (idle == NULL)
+        return FALSE;
+
+    TRAMPOLINE_PARAM(trampoline_cr3) = PAGE_DIRECTORY_ADDRESS;
+    TRAMPOLINE_PARAM(trampoline_stack) = idle->stack_top;
+    TRAMPOLINE_PARAM(trampoline_entry) = (uint32)smp_ap_main;
+    g_starting = cpu->index;
+
+    lapic_send_init(apic_id);
+    smp_delay_ms(SMP_INIT_DELAY_MS);
+    // the second startup IPI is only needed when the first one got lost
+    for (int i = 0; i < 2 && !cpu->online; i++) {
+        uint32 start = pit_ticks();
+        lapic_send_startup(apic_id, SMP_TRAMPOLINE_ADDRESS >> 12);
+        while (!cpu->online && pit_ticks() - start <= pit_ms_to_ticks(SMP_STARTUP_TIMEOUT_MS))
+            asm volatile("pause");
+    }
+    if (!cpu->online) {
+        // slot and stack are reused by the next thread_spawn()
+        idle->state = THREAD_UNUSED;
+        return FALSE;
+    }
+    g_cpu_count++;
+    return TRUE;
+}
+
+/**
+ * prepare per-CPU data of CPU index before it loads its GDT
+ */
+CPU *smp_cpu_init(uint32 index) {
+    CPU *cpu = &g_cpus[index];
+
+    memset(cpu, 0, sizeof(CPU));
+    cpu->self = cpu;
+    cpu->index = index;
+    cpu->event_tick = CLOCK_NEVER;
+    cpu->online = TRUE;
+    if (index != SMP_BOOT_CPU)
+        cpu->online = FALSE;
+    return cpu;
+}
+
+/**
+ * per-CPU data of CPU index
+ */
+CPU *smp_cpu(uint32 index) {
+    return &g_cpus[index];
+}
+
+/**
+ * number of CPUs that are online, they have index 0 to smp_cpu_count() - 1
+ */
+uint32 smp_cpu_count() {
+    return g_cpu_count;
+}
+
+/**
+ * parse the MADT and start all application processors, called by the
+ * boot CPU after thread_init() and pit_init()
+ */
+void smp_init() {
+    const ACPI_MADT_INFO *madt;
+
+    if (!acpi_init()) {
+        printf("[KERNEL] no ACPI MADT, using one CPU\n");
+        return;
+    }
+    madt = acpi_madt();
+    lapic_init(madt->lapic_address);
+    if (!lapic_present()) {
+        printf("[KERNEL] cannot map local APIC, using one CPU\n");
+        return;
+    }
+    g_cpus[SMP_BOOT_CPU].apic_id = lapic_id();
+    isr_register_interrupt_handler(LAPIC_RESCHED_VECTOR, smp_resched_handler);
+    memcpy((void *)SMP_TRAMPOLINE_ADDRESS, trampoline_start, trampoline_end - trampoline_start);
+
+    for (uint32 i = 0; i < madt->cpu_count && g_cpu_count < SMP_MAX_CPUS; i++) {
+        uint8 apic_id = madt->cpu_apic_ids[i];
+        if (apic_id == g_cpus[SMP_BOOT_CPU].apic_id)
+            continue;
+        if (!smp_start_ap(apic_id))
+            printf("[KERNEL] CPU with APIC ID %d did not start\n", apic_id);
+    }
+    printf("[KERNEL] %d of %d CPUs online\n", g_cpu_count, madt->cpu_count);
+}
+
+/**
+ * make an other CPU run its scheduler soon
+ */
+void smp_resched(CPU *cpu) {
+    if (cpu->kicked || !lapic_present())
+        return;
+    cpu->kicked = TRUE;
+    lapic_send_ipi(cpu->apic_id, LAPIC_RESCHED_VECTOR);
+}
+
+/**
+ * send an INIT to every other CPU, they wait for a startup IPI like at power on,
+ * for kexec, whatever locks they held stay taken
+ */
+void smp_stop_others() {
+    CPU *self = cpu_self();
+
+    for (uint32 i = 0; i < g_cpu_count; i++) {
+        if (&g_cpus[i] == self || !g_cpus[i].online)
+            continue;
+        lapic_send_init(g_cpus[i].apic_id);
+        g_cpus[i].online = FALSE;
+    }
+}
+
+/**
+ * print all CPUs
+ */
+void smp_list() {
+    uint64 now = rdtsc();
+
+    printf(" CPU  APIC  QUEUED  STEALS  EVENTS  SOFTIRQ  IDLE ms  RUNNING\n");
+    for (uint32 i = 0; i < g_cpu_count; i++) {
+        CPU *cpu = &g_cpus[i];
+        uint64 idle = cpu->idle_cycles;
+        if (cpu->current == cpu->idle)
+            idle += now - cpu->idle_since;
+        printf("%4d  %4d  %6d  %6d  %6d  %7d  %7d  %s\n", cpu->index, cpu->apic_id, cpu->nr_ready, cpu->steals,
+               cpu->timer_events, cpu->softirq_done, clock_cycles_to_ms(idle), cpu->current ? cpu->current->name : "-");
+    }
+}
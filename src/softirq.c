@@ -0,0 +1,110 @@
+/**
+ * Deferred interrupt work(bottom halves)
+ * the queues are lock-free stacks pushed with cmpxchg from any context and
+ * taken whole with xchg by their CPU, which reverses them into raise order
+ * a CPU never switches threads while it runs work items on an interrupted
+ * stack, see thread_switch()
+ */
+
+#include "softirq.h"
+#include "thread.h"
+#include "isr.h"
+#include "console.h"
+
+static void softirqd(void *arg) {
+    CPU *cpu = arg;
+
+    for (;;) {
+        uint32 flags = irq_save();
+        if (cpu->softirq_head == NULL)
+            thread_block();
+        softirq_run();
+        irq_restore(flags);
+    }
+}
+
+/**
+ * prepare a work item calling func(arg)
+ */
+void softirq_work_init(SOFTIRQ_WORK *work, SOFTIRQ_FUNC func, void *arg) {
+    work->next = NULL;
+    work->func = func;
+    work->arg = arg;
+    work->pending = FALSE;
+}
+
+/**
+ * queue a work item on the calling CPU from an interrupt handler, returns FALSE
+ * when it is already pending, its function then runs once for both raises
+ */
+BOOL softirq_raise(SOFTIRQ_WORK *work) {
+    uint32 flags;
+    CPU *cpu;
+    SOFTIRQ_WORK *head;
+
+    if (__sync_lock_test_and_set(&work->pending, TRUE))
+        return FALSE;
+    flags = irq_save();
+    cpu = cpu_self();
+    do {
+        head = cpu->softirq_head;
+        work->next = head;
+    } while (!__sync_bool_compare_and_swap(&cpu->softirq_head, head, work));
+    irq_restore(flags);
+    return TRUE;
+}
+
+/**
+ * run queued work with interrupts enabled, batch by batch until SOFTIRQ_BUDGET
+ * items ran, being called with interrupts disabled on interrupt exit and by softirqd
+ */
+void softirq_run() {
+    CPU *cpu = cpu_self();
+    uint32 done = 0;
+    SOFTIRQ_WORK *list, *work;
+
+    // nested interrupts leave the queue to the outer run
+    if (cpu->in_softirq || cpu->softirq_head == NULL)
+        return;
+    cpu->in_softirq = TRUE;
+
+    while (done < SOFTIRQ_BUDGET && cpu->softirq_head != NULL) {
+        SOFTIRQ_WORK *fifo = NULL;
+
+        list = __sync_lock_test_and_set(&cpu->softirq_head, NULL);
+        while (list) {
+            work = list;
+            list = list->next;
+            work->next = fifo;
+            fifo = work;
+        }
+
+        asm volatile("sti" ::: "memory");
+        while (fifo) {
+            work = fifo;
+            fifo = fifo->next;
+            // raising it again from now on queues another run
+            __sync_lock_release(&work->pending);
+            work->func(work->arg);
+            cpu->softirq_done++;
+            done++;
+        }
+        asm volatile("cli" ::: "memory");
+    }
+
+    cpu->in_softirq = FALSE;
+    if (cpu->softirq_head != NULL && cpu->softirqd != NULL)
+        thread_wake(cpu->softirqd);
+}
+
+/**
+ * start a softirqd thread on every CPU, called by the boot CPU after smp_init()
+ */
+void softirq_init() {
+    for (uint32 i = 0; i < smp_cpu_count(); i++) {
+        CPU *cpu = smp_cpu(i);
+        cpu->softirqd = thread_spawn_on("softirqd", softirqd, cpu, i);
+        if (cpu->softirqd == NULL)
+            printf("[KERNEL] no softirqd for CPU %d\n", i);
+    }
+}
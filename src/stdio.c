@@ -1,4 +1,8 @@
 #include "stdio.h"
+#include "console.h"
+#include "keyboard.h"
+#include "thread.h"
+#include "pipe.h"
 
 int sscanf(const char *str, const char *format, int *num1, char *op, int *num2) {
     const char *p = str;
@@ -39,3 +43,91 @@ int sscanf(const char *str, const char *format, int *num1, char *op, int *num2)
 
     return 3;
 }
+
+// Read string from console, but no backing
+void getstr(char *buffer) {
+    if (!buffer) return;
+    while(1) {
+        char ch = kb_getchar();
+        if (ch == '\n') {
+            printf("\n");
+            return ;
+        } else {
+            *buffer++ = ch;
+            printf("%c", ch);
+        }
+    }
+}
+
+// Read string from console, and erase or go back until bound occurs
+void getstr_bound(char *buffer, uint8 bound) {
+    if (!buffer) return;
+    while(1) {
+        char ch = kb_getchar();
+        if (ch == '\n') {
+            printf("\n");
+            return ;
+        } else if(ch == '\b') {
+            if (buffer > 0) {
+                console_ungetchar_bound(1);
+                buffer--;
+                *buffer = '\0';
+            }
+        } else {
+            if (buffer - buffer < bound) {
+                *buffer++ = ch;
+                printf("%c", ch);
+            }
+        }
+    }
+}
+
+/**
+ * write len bytes to descriptor fd, returns the bytes written or -1
+ * when nobody reads the pipe anymore
+ */
+int stdio_write(int fd, const void *buf, uint32 len) {
+    const char *text = buf;
+    PIPE *pipe;
+
+    if (fd == STDIO_CONSOLE) {
+        for (uint32 i = 0; i < len; i++)
+            console_putchar(text[i]);
+        return len;
+    }
+    pipe = pipe_from_fd(fd);
+    return pipe != NULL ? pipe_write(pipe, buf, len) : -1;
+}
+
+/**
+ * read up to len bytes from descriptor fd, the keyboard gives one character
+ * at a time, returns 0 at the end of a pipe and -1 for a bad descriptor
+ */
+int stdio_read(int fd, void *buf, uint32 len) {
+    PIPE *pipe;
+
+    if (len == 0)
+        return 0;
+    if (fd == STDIO_CONSOLE) {
+        *(char *)buf = kb_getchar();
+        return 1;
+    }
+    pipe = pipe_from_fd(fd);
+    return pipe != NULL ? pipe_read(pipe, buf, len) : -1;
+}
+
+// printf() output, before thread_init() there is no thread and it goes to the screen
+static void stdio_putchar(char ch) {
+    THREAD *thread = thread_current();
+
+    // output past a closed reader is dropped
+    stdio_write(thread != NULL ? thread->out_fd : STDIO_CONSOLE, &ch, 1);
+}
+
+/**
+ * send printf() to the standard output of the calling thread, console_printf()
+ * stays on the screen for output from interrupt handlers
+ */
+void stdio_init() {
+    console_set_output(stdio_putchar);
+}
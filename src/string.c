@@ -1,20 +1,93 @@
 #include "string.h"
 
 #include "types.h"
+#include "cpu_features.h"
+
+// memset and memcpy jump to the string instructions string_init() picked
+CPU_DISPATCH(memset, memset_stosd);
+CPU_DISPATCH(memcpy, memcpy_movsd);
+
+// the counts are pointer sized, rep takes the whole of rcx on x86_64
+void *memset_stosd(void *dst, char c, uint32 n) {
+    uint32 fill = (uint8)c * 0x01010101, bytes = n % 4;
+    uintptr words = n / 4;
+    void *d = dst;
+
+    asm volatile("rep stosl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep stosb"
+                 : "+D"(d), "+c"(words) : "a"(fill), "r"(bytes) : "memory");
+    return dst;
+}
+
+void *memset_erms(void *dst, char c, uint32 n) {
+    uintptr count = n;
+    void *d = dst;
+
+    asm volatile("rep stosb" : "+D"(d), "+c"(count) : "a"(c) : "memory");
+    return dst;
+}
 
-void *memset(void *dst, char c, uint32 n) {
-    char *temp = dst;
-    for (; n != 0; n--) *temp++ = c;
+void *memcpy_movsd(void *dst, const void *src, uint32 n) {
+    uintptr words = n / 4;
+    uint32 bytes = n % 4;
+    void *d = dst;
+    const void *s = src;
+
+    asm volatile("rep movsl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsb"
+                 : "+D"(d), "+S"(s), "+c"(words) : "r"(bytes) : "memory");
+    return dst;
+}
+
+void *memcpy_erms(void *dst, const void *src, uint32 n) {
+    uintptr count = n;
+    void *d = dst;
+    const void *s = src;
+
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(count) :: "memory");
+    return dst;
+}
+
+// regions may overlap, below src copies forward like memcpy_movsd, above it backward with DF set
+void *memmove(void *dst, const void *src, uint32 n) {
+    void *d = dst;
+    const void *s = src;
+
+    if ((uintptr)dst <= (uintptr)src || (uintptr)dst >= (uintptr)src + n) {
+        uintptr words = n / 4;
+        uint32 bytes = n % 4;
+
+        asm volatile("rep movsl\n\t"
+                     "mov %3, %%ecx\n\t"
+                     "rep movsb"
+                     : "+D"(d), "+S"(s), "+c"(words) : "r"(bytes) : "memory");
+    } else {
+        uintptr count = n;
+
+        d = (uint8 *)dst + n - 1;
+        s = (const uint8 *)src + n - 1;
+        // an interrupt may arrive while DF is set, irq.asm and exception.asm clear it
+        // on entry and iret restores it, so handlers and softirqs still copy forwards
+        asm volatile("std\n\t"
+                     "rep movsb\n\t"
+                     "cld"
+                     : "+D"(d), "+S"(s), "+c"(count) :: "memory");
+    }
     return dst;
 }
 
-void *memcpy(void *dst, const void *src, uint32 n) {
-    char *ret = dst;
-    char *p = dst;
-    const char *q = src;
-    while (n--)
-        *p++ = *q++;
-    return ret;
+// with ERMS a byte rep is as fast as a dword one and needs no tail, FSRM makes it fast for short copies too
+void string_init() {
+    if (cpu_has(CPU_FEATURE_ERMS) || cpu_has(CPU_FEATURE_FSRM))
+        cpu_dispatch_bind(memcpy, memcpy_erms, "memcpy", cpu_has(CPU_FEATURE_FSRM) ? "rep movsb (fsrm)" : "rep movsb (erms)");
+    else
+        cpu_dispatch_bind(memcpy, memcpy_movsd, "memcpy", "rep movsd");
+    if (cpu_has(CPU_FEATURE_ERMS))
+        cpu_dispatch_bind(memset, memset_erms, "memset", "rep stosb (erms)");
+    else
+        cpu_dispatch_bind(memset, memset_stosd, "memset", "rep stosd");
 }
 
 int memcmp(uint8 *s1, uint8 *s2, uint32 n) {
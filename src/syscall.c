@@ -0,0 +1,158 @@
+/**
+ * System calls from ring 3
+ * both entry paths in syscall.asm end up in syscall_dispatch() on the kernel
+ * stack of the calling thread, which may block and be preempted there
+ */
+
+#include "syscall.h"
+#include "gdt.h"
+#include "msr.h"
+#include "cpu_features.h"
+#include "smp.h"
+#include "thread.h"
+#include "user.h"
+#include "ipc.h"
+#include "elf.h"
+#include "stdio.h"
+#include "string.h"
+
+static BOOL g_sysenter;
+
+static uint32 sys_null(uint32 arg1, uint32 arg2, uint32 arg3) {
+    (void)arg1;
+    (void)arg2;
+    (void)arg3;
+    return 0;
+}
+
+static uint32 sys_exit(uint32 code, uint32 arg2, uint32 arg3) {
+    (void)code;
+    (void)arg2;
+    (void)arg3;
+    thread_exit();
+    return 0;
+}
+
+static uint32 sys_write(uint32 buf, uint32 len, uint32 arg3) {
+    const char *text = (const char *)buf;
+
+    (void)arg3;
+    if (!user_range_ok(text, len))
+        return SYSCALL_ERROR;
+    // output past a closed reader is dropped
+    stdio_write(thread_current()->out_fd, text, len);
+    return len;
+}
+
+static uint32 sys_sleep(uint32 ms, uint32 arg2, uint32 arg3) {
+    (void)arg2;
+    (void)arg3;
+    thread_sleep(ms);
+    return 0;
+}
+
+static uint32 sys_yield(uint32 arg1, uint32 arg2, uint32 arg3) {
+    (void)arg1;
+    (void)arg2;
+    (void)arg3;
+    thread_yield();
+    return 0;
+}
+
+static uint32 sys_ipc_create(uint32 arg1, uint32 arg2, uint32 arg3) {
+    (void)arg1;
+    (void)arg2;
+    (void)arg3;
+    int id = ipc_channel_create();
+
+    elf_note_channel(id, TRUE);
+    return id;
+}
+
+static uint32 sys_ipc_close(uint32 channel, uint32 arg2, uint32 arg3) {
+    (void)arg2;
+    (void)arg3;
+    // a program only closes the channels it opened
+    if (!elf_has_channel(channel))
+        return SYSCALL_ERROR;
+    elf_note_channel(channel, FALSE);
+    ipc_channel_destroy(channel);
+    return 0;
+}
+
+static uint32 sys_ipc_send(uint32 channel, uint32 msg, uint32 arg3) {
+    IPC_MESSAGE copy;
+
+    (void)arg3;
+    if (!user_range_ok((void *)msg, sizeof(IPC_MESSAGE)))
+        return SYSCALL_ERROR;
+    memcpy(&copy, (void *)msg, sizeof(IPC_MESSAGE));
+    return ipc_send(channel, &copy);
+}
+
+static uint32 sys_ipc_recv(uint32 channel, uint32 msg, uint32 arg3) {
+    IPC_MESSAGE copy;
+
+    (void)arg3;
+    if (!user_range_writable((void *)msg, sizeof(IPC_MESSAGE)))
+        return SYSCALL_ERROR;
+    memcpy(&copy, (void *)msg, sizeof(IPC_MESSAGE));
+    if (ipc_recv(channel, &copy) < 0)
+        return SYSCALL_ERROR;
+    elf_note_pages(copy.pages, copy.page_count);
+    // the message buffer may have been unmapped while the call blocked
+    if (!user_range_writable((void *)msg, sizeof(IPC_MESSAGE)))
+        return SYSCALL_ERROR;
+    memcpy((void *)msg, &copy, sizeof(IPC_MESSAGE));
+    return 0;
+}
+
+static const SYSCALL g_syscalls[SYSCALL_COUNT] = {
+    [SYS_NULL] = sys_null,
+    [SYS_EXIT] = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_SLEEP] = sys_sleep,
+    [SYS_YIELD] = sys_yield,
+    [SYS_IPC_CREATE] = sys_ipc_create,
+    [SYS_IPC_CLOSE] = sys_ipc_close,
+    [SYS_IPC_SEND] = sys_ipc_send,
+    [SYS_IPC_RECV] = sys_ipc_recv,
+};
+
+/**
+ * detect SYSENTER and set it up on the boot CPU, called after gdt_init()
+ */
+void syscall_init() {
+    CPU_FEATURES *cpu = &g_cpu_features;
+
+    // the Pentium Pro reports SEP without supporting it
+    g_sysenter = cpu_has(CPU_FEATURE_SEP) && !(cpu->family == 6 && cpu->model < 3 && cpu->stepping < 3);
+    syscall_init_cpu();
+}
+
+/**
+ * point the SYSENTER MSRs of the calling CPU at the kernel entry
+ */
+void syscall_init_cpu() {
+    if (!g_sysenter)
+        return;
+    wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+    wrmsr(MSR_SYSENTER_ESP, (uint32)gdt_kernel_stack(cpu_self()->index));
+    wrmsr(MSR_SYSENTER_EIP, (uint32)syscall_sysenter);
+}
+
+/**
+ * TRUE if user programs may enter through SYSENTER
+ */
+BOOL syscall_has_sysenter() {
+    return g_sysenter;
+}
+
+/**
+ * run system call num, being called from syscall.asm with interrupts enabled
+ */
+uint32 syscall_dispatch(uint32 num, uint32 arg1, uint32 arg2, uint32 arg3) {
+    if (num >= SYSCALL_COUNT)
+        return SYSCALL_ERROR;
+    return g_syscalls[num](arg1, arg2, arg3);
+}
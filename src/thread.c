@@ -0,0 +1,538 @@
+/**
+ * Kernel threads with a timer driven round-robin scheduler
+ * a thread switch returns another thread's saved REGISTERS frame from isr_irq_handler(),
+ * irq.asm loads it as the new stack pointer and irets into that thread
+ * every CPU has its own run queue, a CPU whose queue is empty steals from the
+ * longest queue of the other CPUs before falling back to its idle thread
+ * there is no periodic tick, every switch arms the CPU's one-shot timer event for
+ * the end of the time slice, or for the first sleeper when the CPU goes idle
+ */
+
+#include "thread.h"
+#include "gdt.h"
+#include "clock.h"
+#include "tsc.h"
+#include "timer.h"
+#include "pmm.h"
+#include "paging.h"
+#include "console.h"
+#include "string.h"
+#include "stdio.h"
+
+static THREAD g_threads[THREAD_MAX];
+static SPINLOCK g_threads_lock = SPINLOCK_INIT;   // slot allocation and ids
+static uint32 g_next_id;
+static SPINLOCK g_wake_lock = SPINLOCK_INIT;      // blocked state and wake_pending
+
+static const char *g_state_names[] = {"unused", "ready", "running", "sleeping", "blocked", "dead"};
+
+// caller has interrupts disabled
+static void ready_push(CPU *cpu, THREAD *thread) {
+    spin_lock(&cpu->lock);
+    thread->state = THREAD_READY;
+    thread->cpu = cpu->index;
+    thread->next = NULL;
+    if (cpu->ready_tail)
+        cpu->ready_tail->next = thread;
+    else
+        cpu->ready_head = thread;
+    cpu->ready_tail = thread;
+    cpu->nr_ready++;
+    spin_unlock(&cpu->lock);
+}
+
+// make sure a CPU picks up thread, which was just queued on cpu, caller has interrupts disabled
+static void notify(CPU *cpu, THREAD *thread) {
+    if (cpu->current == cpu->idle) {
+        if (cpu == cpu_self())
+            cpu->need_resched = TRUE;
+        else
+            smp_resched(cpu);
+        return;
+    }
+    if (cpu->current == thread || thread->pinned != THREAD_ANY_CPU)
+        return;
+    // cpu is busy, wake one idle CPU to steal it
+    for (uint32 i = 0; i < smp_cpu_count(); i++) {
+        CPU *other = smp_cpu(i);
+        if (other != cpu && other->online && other->current == other->idle && !other->kicked) {
+            smp_resched(other);
+            return;
+        }
+    }
+}
+
+// take the first thread of cpu's queue that passes the steal check, caller holds cpu->lock
+static THREAD *ready_take(CPU *cpu, BOOL steal) {
+    THREAD *thread, *prev = NULL;
+
+    for (thread = cpu->ready_head; thread; prev = thread, thread = thread->next) {
+        // another CPU may still be on the thread's stack, or it must stay where it is
+        if (!steal || (!thread->on_cpu && thread->pinned == THREAD_ANY_CPU))
+            break;
+    }
+    if (thread == NULL)
+        return NULL;
+
+    if (prev)
+        prev->next = thread->next;
+    else
+        cpu->ready_head = thread->next;
+    if (cpu->ready_tail == thread)
+        cpu->ready_tail = prev;
+    cpu->nr_ready--;
+    return thread;
+}
+
+static THREAD *ready_pop(CPU *cpu) {
+    THREAD *thread;
+
+    if (cpu->nr_ready == 0)
+        return NULL;
+    spin_lock(&cpu->lock);
+    thread = ready_take(cpu, FALSE);
+    spin_unlock(&cpu->lock);
+    return thread;
+}
+
+// steal a thread from the CPU with the longest run queue
+static THREAD *steal(CPU *self) {
+    CPU *victim = NULL;
+    uint32 most = 0;
+    THREAD *thread;
+
+    for (uint32 i = 0; i < smp_cpu_count(); i++) {
+        CPU *cpu = smp_cpu(i);
+        if (cpu != self && cpu->nr_ready > most) {
+            victim = cpu;
+            most = cpu->nr_ready;
+        }
+    }
+    if (victim == NULL || !spin_trylock(&victim->lock))
+        return NULL;
+    thread = ready_take(victim, TRUE);
+    spin_unlock(&victim->lock);
+    if (thread)
+        self->steals++;
+    return thread;
+}
+
+// TRUE when some other CPU has queued threads
+static BOOL work_elsewhere(CPU *self) {
+    for (uint32 i = 0; i < smp_cpu_count(); i++) {
+        CPU *cpu = smp_cpu(i);
+        if (cpu != self && cpu->nr_ready > 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// arm the timer event of cpu for the end of the time slice while a thread runs,
+// or for its first sleeper or kernel timer while it is idle
+static void schedule_event(CPU *cpu) {
+    uint32 now = clock_ticks();
+    uint32 tick = CLOCK_NEVER;
+
+    if (cpu->current != cpu->idle || cpu->nr_ready > 0 || work_elsewhere(cpu)) {
+        // keep polling while queued threads may become stealable
+        tick = now + 1;
+    } else {
+        for (int i = 1; i < THREAD_MAX; i++) {
+            THREAD *thread = &g_threads[i];
+            if (thread->state == THREAD_SLEEPING && thread->cpu == cpu->index &&
+                (tick == CLOCK_NEVER || (sint32)(thread->wake_tick - tick) < 0))
+                tick = thread->wake_tick;
+        }
+        if (cpu->index == TIMER_CPU) {
+            uint32 next = timer_next();
+            if (tick == CLOCK_NEVER || (next != CLOCK_NEVER && (sint32)(next - tick) < 0))
+                tick = next;
+        }
+        if (tick != CLOCK_NEVER && (sint32)(tick - now) <= 0)
+            tick = now + 1;
+    }
+    // an earlier event that is still pending does no harm
+    if (cpu->event_tick != CLOCK_NEVER && tick != CLOCK_NEVER &&
+        (sint32)(cpu->event_tick - now) > 0 && (sint32)(cpu->event_tick - tick) <= 0)
+        return;
+    clock_arm(tick);
+}
+
+static void stack_free(THREAD *thread) {
+    uint32 virt;
+
+    for (virt = thread->stack_top - THREAD_STACK_SIZE; virt < thread->stack_top; virt += PAGE_SIZE) {
+        uint32 *pte = paging_get_pte(virt, FALSE);
+        if (pte && (*pte & PAGE_PRESENT)) {
+            pmm_free_page((void *)(*pte & PAGE_MASK));
+            paging_unmap_page(virt);
+        }
+    }
+    thread->stack_top = 0;
+}
+
+// stacks stay mapped after a thread exits and are reused with its slot,
+// so another CPU never holds a stale TLB entry for a freed stack page
+static BOOL stack_alloc(THREAD *thread) {
+    uint32 top = THREAD_STACK_BASE + (thread - g_threads + 1) * THREAD_STACK_SLOT;
+    uint32 virt;
+
+    if (thread->stack_top == top)
+        return TRUE;
+    thread->stack_top = top;
+    for (virt = top - THREAD_STACK_SIZE; virt < top; virt += PAGE_SIZE) {
+        void *page = pmm_alloc_page();
+        if (page == NULL || paging_map_page(virt, (uint32)page, PAGE_PRESENT | PAGE_WRITE) < 0) {
+            pmm_free_page(page);
+            stack_free(thread);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// claim an unused slot with a stack, returns NULL when none is left
+static THREAD *thread_alloc(const char *name) {
+    THREAD *thread = NULL;
+    uint32 flags = spin_lock_irqsave(&g_threads_lock);
+
+    for (int i = 1; i < THREAD_MAX; i++) {
+        if (g_threads[i].state == THREAD_UNUSED) {
+            thread = &g_threads[i];
+            break;
+        }
+    }
+    if (thread != NULL) {
+        if (stack_alloc(thread)) {
+            thread->state = THREAD_READY;
+            thread->id = g_next_id++;
+            strncpy(thread->name, name, THREAD_NAME_LENGTH - 1);
+            thread->name[THREAD_NAME_LENGTH - 1] = '\0';
+            thread->on_cpu = FALSE;
+            thread->pinned = THREAD_ANY_CPU;
+            thread->fpu_used = FALSE;
+            thread->fpu_cpu = FPU_NO_CPU;
+        } else {
+            thread = NULL;
+        }
+    }
+    spin_unlock_irqrestore(&g_threads_lock, flags);
+    return thread;
+}
+
+// first code of every spawned thread, reached by iret through the frame built in thread_spawn()
+static void thread_entry() {
+    THREAD *thread = thread_current();
+
+    thread->func(thread->arg);
+    thread_exit();
+}
+
+static BOOL thread_alive(uint32 id) {
+    for (int i = 0; i < THREAD_MAX; i++) {
+        THREAD_STATE state = g_threads[i].state;
+        if (g_threads[i].id == id && state != THREAD_UNUSED && state != THREAD_DEAD)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * turn the boot flow into the idle thread of the boot CPU, must be called before pit_init()
+ */
+void thread_init() {
+    CPU *cpu = smp_cpu(SMP_BOOT_CPU);
+    THREAD *idle = &g_threads[0];
+
+    memset(g_threads, 0, sizeof(g_threads));
+    idle->id = 0;
+    strcpy(idle->name, "idle");
+    idle->state = THREAD_RUNNING;
+    idle->cpu = SMP_BOOT_CPU;
+    idle->pinned = SMP_BOOT_CPU;
+    idle->on_cpu = TRUE;
+    cpu->idle = idle;
+    cpu->current = idle;
+    cpu->idle_since = rdtsc();
+    g_next_id = 1;
+}
+
+/**
+ * create the idle thread of an application processor, its stack is the
+ * one the AP starts on, returns NULL when no thread slot or stack memory is left
+ */
+THREAD *thread_init_cpu(CPU *cpu) {
+    THREAD *idle = thread_alloc("idle");
+
+    if (idle == NULL)
+        return NULL;
+    idle->state = THREAD_RUNNING;
+    idle->cpu = cpu->index;
+    idle->pinned = cpu->index;
+    idle->on_cpu = TRUE;
+    cpu->idle = idle;
+    cpu->current = idle;
+    cpu->idle_since = rdtsc();
+    return idle;
+}
+
+/**
+ * create a thread running func(arg) queued on the calling CPU, idle CPUs
+ * may steal it, returns NULL when no thread slot or stack memory is left
+ */
+THREAD *thread_spawn(const char *name, THREAD_FUNC func, void *arg) {
+    return thread_spawn_on(name, func, arg, THREAD_ANY_CPU);
+}
+
+/**
+ * create a thread running func(arg) that only runs on given CPU,
+ * or like thread_spawn() for THREAD_ANY_CPU
+ */
+THREAD *thread_spawn_on(const char *name, THREAD_FUNC func, void *arg, sint32 cpu) {
+    THREAD *thread = thread_alloc(name), *parent = thread_current();
+    REGISTERS *frame;
+    uint32 flags;
+
+    if (thread == NULL)
+        return NULL;
+    thread->func = func;
+    thread->arg = arg;
+    thread->pinned = cpu;
+    // a command's helper threads print where the command does, it joins them before its pipes close
+    thread->in_fd = parent != NULL ? parent->in_fd : STDIO_CONSOLE;
+    thread->out_fd = parent != NULL ? parent->out_fd : STDIO_CONSOLE;
+
+    // frame as if the thread had been interrupted right before thread_entry()
+    frame = (REGISTERS *)(thread->stack_top - sizeof(REGISTERS));
+    memset(frame, 0, sizeof(REGISTERS));
+    frame->ds = GDT_KERNEL_DATA;
+    frame->eip = (uint32)thread_entry;
+    frame->cs = GDT_KERNEL_CODE;
+    frame->eflags = EFLAGS_IF | 0x2;
+    thread->frame = frame;
+
+    flags = irq_save();
+    ready_push(cpu == THREAD_ANY_CPU ? cpu_self() : smp_cpu(cpu), thread);
+    notify(smp_cpu(thread->cpu), thread);
+    irq_restore(flags);
+    return thread;
+}
+
+/**
+ * give the CPU to the next ready thread
+ */
+void thread_yield() {
+    uint32 flags = irq_save();
+
+    cpu_self()->need_resched = TRUE;
+    asm volatile("int %0" :: "i"(THREAD_YIELD_VECTOR) : "memory");
+    irq_restore(flags);
+}
+
+/**
+ * block the current thread for at least ms milliseconds
+ */
+void thread_sleep(uint32 ms) {
+    uint32 flags = irq_save();
+    CPU *cpu = cpu_self();
+
+    if (cpu->current != cpu->idle) {
+        cpu->current->wake_tick = clock_ticks() + clock_ms_to_ticks(ms);
+        cpu->current->state = THREAD_SLEEPING;
+        thread_yield();
+    }
+    irq_restore(flags);
+}
+
+/**
+ * block the current thread until thread_wake(), returns at once when it was woken
+ * since it last blocked, caller has interrupts disabled and checks its condition again
+ */
+void thread_block() {
+    THREAD *thread = thread_current();
+
+    spin_lock(&g_wake_lock);
+    if (thread->wake_pending) {
+        thread->wake_pending = FALSE;
+        spin_unlock(&g_wake_lock);
+        return;
+    }
+    thread->state = THREAD_BLOCKED;
+    spin_unlock(&g_wake_lock);
+    thread_yield();
+}
+
+/**
+ * make a thread blocked in thread_block() ready again, or let its next
+ * thread_block() return at once, may be called from interrupt handlers
+ */
+void thread_wake(THREAD *thread) {
+    uint32 flags = irq_save();
+
+    spin_lock(&g_wake_lock);
+    if (thread->state == THREAD_BLOCKED) {
+        CPU *cpu = smp_cpu(thread->cpu);
+        ready_push(cpu, thread);
+        notify(cpu, thread);
+    } else {
+        thread->wake_pending = TRUE;
+    }
+    spin_unlock(&g_wake_lock);
+    irq_restore(flags);
+}
+
+/**
+ * end the current thread, also called when a thread function returns
+ */
+void thread_exit() {
+    irq_save();
+    cpu_self()->current->state = THREAD_DEAD;
+    thread_yield();
+    for (;;)
+        ;
+}
+
+/**
+ * wait until the thread with given id has exited
+ */
+void thread_join(uint32 id) {
+    while (thread_alive(id))
+        thread_sleep(10);
+}
+
+/**
+ * thread that is running now
+ */
+THREAD *thread_current() {
+    THREAD *thread;
+
+    // one instruction, so a migration cannot split reading the CPU and its thread
+    asm volatile("mov %%gs:%c1, %0" : "=r"(thread) : "i"(CPU_CURRENT_OFFSET));
+    return thread;
+}
+
+/**
+ * idle loop of a CPU's idle thread, runs whenever no other thread is ready
+ */
+void thread_idle() {
+    thread_yield();
+    for (;;) {
+        // an interrupt between the check and the halt would leave the CPU asleep
+        asm volatile("cli");
+        if (cpu_self()->need_resched) {
+            asm volatile("sti");
+            thread_yield();
+        } else {
+            clock_idle();
+        }
+    }
+}
+
+/**
+ * account one timer event, wakes sleepers and preempts at the end of a time slice,
+ * being called from the timer interrupt
+ */
+void thread_tick() {
+    CPU *cpu = cpu_self();
+    uint32 now = clock_ticks();
+
+    if (cpu->current == NULL)
+        return;
+    // sleepers are only woken by the CPU they went to sleep on
+    for (int i = 1; i < THREAD_MAX; i++) {
+        THREAD *thread = &g_threads[i];
+        if (thread->state == THREAD_SLEEPING && thread->cpu == cpu->index &&
+            (sint32)(now - thread->wake_tick) >= 0)
+            ready_push(cpu, thread);
+    }
+
+    if (cpu->current == cpu->idle) {
+        if (cpu->nr_ready > 0 || work_elsewhere(cpu))
+            cpu->need_resched = TRUE;
+    } else {
+        if (++cpu->slice >= THREAD_TIME_SLICE)
+            cpu->need_resched = TRUE;
+    }
+}
+
+/**
+ * pick the frame to return to from an interrupt, the current one unless a
+ * reschedule is pending, being called from isr_irq_handler()
+ */
+REGISTERS *thread_switch(REGISTERS *reg) {
+    CPU *cpu = cpu_self();
+    THREAD *prev = cpu->current, *next;
+
+    // returning to code outside a read-side section is a quiescent state, see rcu.h
+    if (!cpu->in_softirq && cpu->rcu_nesting == 0)
+        cpu->rcu_qs++;
+    if (prev == NULL)
+        return reg;
+    // deferred work running on the interrupted stack has to finish first,
+    // a read-side or kernel FPU section holds on to its CPU until it ends
+    if (!cpu->need_resched || cpu->in_softirq || cpu->rcu_nesting || cpu->fpu_nesting) {
+        schedule_event(cpu);
+        return reg;
+    }
+    cpu->need_resched = FALSE;
+    cpu->kicked = FALSE;
+
+    prev->frame = reg;
+    if (prev->state == THREAD_RUNNING) {
+        if (prev == cpu->idle)
+            prev->state = THREAD_READY;
+        else
+            ready_push(cpu, prev);
+    }
+    next = ready_pop(cpu);
+    if (next == NULL)
+        next = steal(cpu);
+    if (next == NULL)
+        next = cpu->idle;
+
+    next->state = THREAD_RUNNING;
+    next->cpu = cpu->index;
+    next->on_cpu = TRUE;
+    if (next != prev) {
+        cpu->prev = prev;
+        fpu_switch(cpu, prev);
+        // interrupts and system calls from ring 3 start on the top of the thread's stack
+        gdt_set_kernel_stack(cpu->index, next->stack_top);
+        if (next == cpu->idle)
+            cpu->idle_since = rdtsc();
+        else if (prev == cpu->idle)
+            cpu->idle_cycles += rdtsc() - cpu->idle_since;
+    }
+    cpu->current = next;
+    cpu->slice = 0;
+    schedule_event(cpu);
+    return next->frame;
+}
+
+/**
+ * release the thread switched away from once its stack is no longer in use,
+ * being called from irq.asm on the new thread's stack
+ */
+void thread_finish_switch() {
+    CPU *cpu = cpu_self();
+    THREAD *prev = cpu->prev;
+
+    if (prev == NULL)
+        return;
+    cpu->prev = NULL;
+    prev->on_cpu = FALSE;
+    if (prev->state == THREAD_DEAD)
+        prev->state = THREAD_UNUSED;
+}
+
+/**
+ * print all threads
+ */
+void thread_list() {
+    printf(" ID  CPU  STATE     NAME\n");
+    for (int i = 0; i < THREAD_MAX; i++) {
+        THREAD *thread = &g_threads[i];
+        if (thread->state != THREAD_UNUSED)
+            printf("%3d  %3d  %s  %s\n", thread->id, thread->cpu, g_state_names[thread->state], thread->name);
+    }
+}
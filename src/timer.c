@@ -0,0 +1,241 @@
+/**
+ * Kernel timers on a hierarchical timing wheel
+ * the first level has a slot per tick for the next TIMER_ROOT_SIZE ticks,
+ * slot i of level n holds timers a whole level n - 1 further away, when the
+ * first level wraps around the next slot of level 1 is spread over it and so on
+ * timers are on doubly linked slot lists, so arming and cancelling never search
+ */
+
+#include "timer.h"
+#include "clock.h"
+#include "isr.h"
+#include "spinlock.h"
+#include "console.h"
+
+static SPINLOCK g_timer_lock = SPINLOCK_INIT;
+static TIMER *g_root[TIMER_ROOT_SIZE];
+static TIMER *g_levels[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+static uint32 g_root_used[TIMER_ROOT_SIZE / 32];   // bit per root slot that may be non-empty
+static uint32 g_base;         // next tick to run
+static uint32 g_pending;
+static uint32 g_fired;
+static uint32 g_cascaded;
+static TIMER *volatile g_running;   // timer whose function timer_run() is calling
+
+#define LEVEL_INDEX(tick, level)    (((tick) >> (TIMER_ROOT_BITS + (level) * TIMER_LEVEL_BITS)) & TIMER_LEVEL_MASK)
+
+static void slot_insert(TIMER **slot, TIMER *timer) {
+    timer->next = *slot;
+    if (*slot)
+        (*slot)->pprev = &timer->next;
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+static void slot_remove(TIMER *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+// put a timer in the slot for its distance from g_base, caller holds g_timer_lock
+static void wheel_insert(TIMER *timer) {
+    uint32 expires = timer->expires;
+    uint32 delta = expires - g_base;
+    uint32 index;
+
+    if ((sint32)delta < 0) {
+        // already due, run with the next tick
+        index = g_base & TIMER_ROOT_MASK;
+    } else if (delta < TIMER_ROOT_SIZE) {
+        index = expires & TIMER_ROOT_MASK;
+    } else {
+        for (int level = 0; level < TIMER_LEVELS; level++) {
+            if (level == TIMER_LEVELS - 1 || delta < (1U << (TIMER_ROOT_BITS + (level + 1) * TIMER_LEVEL_BITS))) {
+                slot_insert(&g_levels[level][LEVEL_INDEX(expires, level)], timer);
+                return;
+            }
+        }
+    }
+    slot_insert(&g_root[index], timer);
+    g_root_used[index / 32] |= 1U << (index % 32);
+}
+
+// spread slot index of level over the levels below, returns the index
+static uint32 cascade(int level, uint32 index) {
+    TIMER *timer = g_levels[level][index];
+
+    g_levels[level][index] = NULL;
+    while (timer) {
+        TIMER *next = timer->next;
+        wheel_insert(timer);
+        g_cascaded++;
+        timer = next;
+    }
+    return index;
+}
+
+/**
+ * prepare a timer calling func(arg) when it expires
+ */
+void timer_setup(TIMER *timer, TIMER_FUNC func, void *arg) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->func = func;
+    timer->arg = arg;
+}
+
+/**
+ * arm a timer that is not pending to fire at tick expires,
+ * a tick that has passed fires on the next timer event
+ */
+void timer_add(TIMER *timer, uint32 expires) {
+    timer_mod(timer, expires);
+}
+
+/**
+ * move a timer to tick expires whether it is pending or not,
+ * returns TRUE when it was pending
+ */
+BOOL timer_mod(TIMER *timer, uint32 expires) {
+    uint32 flags = spin_lock_irqsave(&g_timer_lock);
+    BOOL pending = timer_pending(timer);
+    CPU *cpu = smp_cpu(TIMER_CPU);
+
+    if (pending)
+        slot_remove(timer);
+    else if (g_pending++ == 0)
+        g_base = clock_ticks();   // idle wheel, nothing to catch up on
+    timer->expires = expires;
+    wheel_insert(timer);
+    spin_unlock(&g_timer_lock);
+
+    // TIMER_CPU may be idle with its event armed later or not at all
+    if (cpu != cpu_self() && (cpu->event_tick == CLOCK_NEVER || (sint32)(expires - cpu->event_tick) < 0))
+        smp_resched(cpu);
+    irq_restore(flags);
+    return pending;
+}
+
+/**
+ * cancel a timer, returns TRUE when it was pending, the function of a timer
+ * that already fired may still be running on TIMER_CPU
+ */
+BOOL timer_del(TIMER *timer) {
+    uint32 flags = spin_lock_irqsave(&g_timer_lock);
+    BOOL pending = timer_pending(timer);
+
+    if (pending) {
+        slot_remove(timer);
+        g_pending--;
+    }
+    spin_unlock_irqrestore(&g_timer_lock, flags);
+    return pending;
+}
+
+/**
+ * cancel a timer and wait until its function is not running anymore, a
+ * function that arms its timer again is cancelled after it returns, must not
+ * be called from the function of the timer, returns TRUE when it was pending
+ */
+BOOL timer_del_sync(TIMER *timer) {
+    BOOL pending = FALSE, running;
+
+    for (;;) {
+        uint32 flags = spin_lock_irqsave(&g_timer_lock);
+
+        if (timer_pending(timer)) {
+            slot_remove(timer);
+            g_pending--;
+            pending = TRUE;
+        }
+        running = g_running == timer;
+        spin_unlock_irqrestore(&g_timer_lock, flags);
+        if (!running)
+            return pending;
+        asm volatile("pause" ::: "memory");
+    }
+}
+
+/**
+ * tick the wheel has to be run at next, CLOCK_NEVER when no timer is pending
+ */
+uint32 timer_next() {
+    uint32 flags = spin_lock_irqsave(&g_timer_lock), next = CLOCK_NEVER;
+
+    if (g_pending > 0) {
+        // next used root slot from g_base on, else the next cascade into the root level
+        next = (g_base + TIMER_ROOT_MASK) & ~TIMER_ROOT_MASK;
+        for (uint32 i = 0; i < TIMER_ROOT_SIZE; i++) {
+            uint32 index = (g_base + i) & TIMER_ROOT_MASK;
+            if (g_root_used[index / 32] == 0) {
+                i += 31 - index % 32;
+                continue;
+            }
+            if (!(g_root_used[index / 32] & (1U << (index % 32))))
+                continue;
+            if (g_root[index]) {
+                next = g_base + i;
+                break;
+            }
+            g_root_used[index / 32] &= ~(1U << (index % 32));
+        }
+    }
+    spin_unlock_irqrestore(&g_timer_lock, flags);
+    return next;
+}
+
+/**
+ * fire all timers up to the current tick, being called from the timer
+ * interrupt of TIMER_CPU
+ */
+void timer_run() {
+    uint32 now = clock_ticks();
+
+    spin_lock(&g_timer_lock);
+    if (g_pending == 0)
+        g_base = now + 1;
+    while ((sint32)(now - g_base) >= 0) {
+        uint32 index = g_base & TIMER_ROOT_MASK;
+        TIMER *list;
+
+        // first level wrapped, refill it from the levels above
+        if (index == 0) {
+            for (int level = 0; level < TIMER_LEVELS; level++) {
+                if (cascade(level, LEVEL_INDEX(g_base, level)) != 0)
+                    break;
+            }
+        }
+        g_base++;
+
+        list = g_root[index];
+        g_root[index] = NULL;
+        g_root_used[index / 32] &= ~(1U << (index % 32));
+        if (list)
+            list->pprev = &list;
+        while (list) {
+            TIMER *timer = list;
+            slot_remove(timer);
+            g_pending--;
+            g_fired++;
+            // the function may arm the timer again
+            g_running = timer;
+            spin_unlock(&g_timer_lock);
+            timer->func(timer->arg);
+            spin_lock(&g_timer_lock);
+            g_running = NULL;
+        }
+    }
+    spin_unlock(&g_timer_lock);
+}
+
+/**
+ * print the state of the wheel
+ */
+void timer_stats() {
+    printf("timers: %d pending, %d fired, %d cascaded, next run at tick %d of %d\n",
+           g_pending, g_fired, g_cascaded, timer_next(), clock_ticks());
+}
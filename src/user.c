@@ -0,0 +1,111 @@
+/**
+ * Ring 3 user mode
+ * the user window shares the kernel's page tables, its pages are the only
+ * ones with PAGE_USER set, kernel memory stays out of reach from ring 3
+ */
+
+#include "user.h"
+#include "paging.h"
+#include "pmm.h"
+#include "isr.h"
+#include "string.h"
+
+static USER_PAGER g_pager;
+
+/**
+ * map zeroed pages for size bytes at virt in the user window,
+ * returns FALSE and maps nothing when out of memory or outside the window
+ */
+BOOL user_map(uint32 virt, uint32 size) {
+    uint32 start = virt & PAGE_MASK, page;
+
+    if (virt < USER_BASE || virt >= USER_LIMIT || size > USER_LIMIT - virt)
+        return FALSE;
+    for (page = start; page < virt + size; page += PAGE_SIZE) {
+        void *frame = pmm_alloc_page();
+        if (frame == NULL || paging_map_page(page, (uint32)frame, PAGE_WRITE | PAGE_USER) < 0) {
+            pmm_free_page(frame);
+            user_unmap(start, page - start);
+            return FALSE;
+        }
+        memset((void *)page, 0, PAGE_SIZE);
+    }
+    return TRUE;
+}
+
+/**
+ * unmap and free the pages mapped by user_map()
+ */
+void user_unmap(uint32 virt, uint32 size) {
+    uint32 page;
+
+    for (page = virt & PAGE_MASK; page < virt + size; page += PAGE_SIZE) {
+        uint32 *pte = paging_get_pte(page, FALSE);
+        if (pte && (*pte & PAGE_PRESENT)) {
+            pmm_free_page((void *)(*pte & PAGE_MASK));
+            paging_unmap_page(page);
+        }
+    }
+}
+
+// TRUE if the len bytes at ptr are user pages, writable ones with write set
+static BOOL user_range_check(const void *ptr, uint32 len, BOOL write) {
+    uint32 start = (uint32)ptr, page;
+
+    if (start < USER_BASE || start >= USER_LIMIT || len > USER_LIMIT - start)
+        return FALSE;
+    // a kernel page fault on a bad user pointer would halt the kernel
+    for (page = start & PAGE_MASK; page < start + len; page += PAGE_SIZE) {
+        uint32 *pte = paging_get_pte(page, FALSE);
+        if (pte == NULL || !(*pte & PAGE_PRESENT)) {
+            if (!user_page_fault(page, write))
+                return FALSE;
+            pte = paging_get_pte(page, FALSE);
+        }
+        if (!(*pte & PAGE_USER) || (write && !(*pte & PAGE_WRITE)))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * TRUE if the len bytes at ptr are readable user pages, pages the pager
+ * has not filled yet are filled, system calls check every pointer
+ * they get from ring 3 with it
+ */
+BOOL user_range_ok(const void *ptr, uint32 len) {
+    return user_range_check(ptr, len, FALSE);
+}
+
+/**
+ * like user_range_ok() for buffers the kernel writes to, a read-only page
+ * is refused here instead of faulting in the middle of the copy
+ */
+BOOL user_range_writable(void *ptr, uint32 len) {
+    return user_range_check(ptr, len, TRUE);
+}
+
+/**
+ * install the pager of the program loaded into the window, NULL removes it
+ */
+void user_set_pager(USER_PAGER pager) {
+    g_pager = pager;
+}
+
+/**
+ * resolve a page fault at addr in the user window through the pager,
+ * FALSE if the access is not allowed, called from the page fault handler
+ */
+BOOL user_page_fault(uint32 addr, BOOL write) {
+    USER_PAGER pager = g_pager;
+    uint32 flags;
+    BOOL ok;
+
+    if (pager == NULL || addr < USER_BASE || addr >= USER_LIMIT)
+        return FALSE;
+    // pagers use the page cache, which expects not to be preempted
+    flags = irq_save();
+    ok = pager(addr, write);
+    irq_restore(flags);
+    return ok;
+}
@@ -0,0 +1,62 @@
+/**
+ * Shared time page
+ * one frame mapped at USER_TIME_PAGE without PAGE_WRITE, the kernel writes it
+ * through its identity mapping, which ring 3 cannot reach
+ */
+
+#include "vdso.h"
+#include "user.h"
+#include "clock.h"
+#include "paging.h"
+#include "pmm.h"
+#include "string.h"
+#include "console.h"
+
+static VDSO_TIME *g_time;
+
+/**
+ * map the time page read-only into the user window, called after paging_init()
+ */
+void vdso_init() {
+    VDSO_TIME *time = pmm_alloc_page();
+
+    if (time == NULL || paging_map_page(USER_TIME_PAGE, (uint32)time, PAGE_USER) < 0) {
+        printf("[VDSO] cannot map the time page\n");
+        pmm_free_page(time);
+        return;
+    }
+    memset(time, 0, PAGE_SIZE);
+    g_time = time;
+}
+
+/**
+ * publish that tsc_base is nanosecond 0 and a tick takes tsc_per_tick
+ * cycles, called by clock_init() inside the write section of its seqlock
+ */
+void vdso_update(uint64 tsc_base, uint32 tsc_per_tick) {
+    uint64 scaled = (uint64)CLOCK_NS_PER_TICK << 32;
+    uint32 shift = 0;
+
+    if (g_time == NULL || tsc_per_tick == 0)
+        return;
+    // nanoseconds per cycle as a 32.32 fixed point number, shifted down until it fits 32 bits
+    while ((scaled >> shift) >> 32 >= tsc_per_tick)
+        shift++;
+
+    g_time->sequence++;
+    asm volatile("" ::: "memory");
+    g_time->shift = shift;
+    g_time->mult = udiv64_32(scaled >> shift, tsc_per_tick);
+    g_time->tsc_khz = tsc_per_tick / 1000 * CLOCK_HZ;
+    g_time->tsc_base = tsc_base;
+    g_time->ns_base = 0;
+    asm volatile("" ::: "memory");
+    g_time->sequence++;
+}
+
+/**
+ * the kernel's view of the time page
+ */
+const VDSO_TIME *vdso_time() {
+    return g_time;
+}
@@ -0,0 +1,206 @@
+/**
+ * x86_64 bring-up kernel
+ * entry.asm switches to long mode with the first 4 GB identity mapped, this
+ * file installs a 64 bit IDT for the exceptions, maps the rest of RAM from
+ * the multiboot memory map with 1 GB pages where the CPU has them and 2 MB
+ * pages otherwise, and runs the console, string, CPU feature and CRC32C code
+ * shared with the i386 kernel
+ * this is all of the port, threads, SMP, user mode, the file systems and the
+ * shell stay i386 only, so printf() goes to the screen and nothing reads the
+ * keyboard, stdio.c which ties them to threads and pipes is not linked here
+ */
+
+#include "types.h"
+#include "console.h"
+#include "string.h"
+#include "cpu_features.h"
+#include "crc32c.h"
+#include "../multiboot.h"
+
+#define ARCH_IDENTITY_GB        4           // mapped by entry.asm
+#define ARCH_MAX_MEMORY_GB      64          // RAM above this stays unmapped
+#define ARCH_EXCEPTIONS         32
+#define ARCH_CODE_SEG           0x08
+#define ARCH_GATE_INTERRUPT     0x8E        // present, ring 0, 64 bit interrupt gate
+
+#define PAGE_PRESENT            (1ULL << 0)
+#define PAGE_WRITE              (1ULL << 1)
+#define PAGE_LARGE              (1ULL << 7)
+#define PAGE_2MB                (1ULL << 21)
+#define PAGE_1GB                (1ULL << 30)
+#define PAGE_SIZE               4096
+
+#define ARCH_CRC32C_CHECK       0xE3069283  // crc32c of "123456789"
+
+// the frame exception.asm builds, the CPU pushed the last five
+typedef struct {
+    uint64 r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64 rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64 vector, err_code;
+    uint64 rip, cs, rflags, rsp, ss;
+} REGISTERS64;
+
+typedef struct {
+    uint16 offset_low;
+    uint16 segment_selector;
+    uint8 ist;
+    uint8 type;
+    uint16 offset_mid;
+    uint32 offset_high;
+    uint32 zero;
+} __attribute__((packed)) IDT64;
+
+typedef struct {
+    uint16 limit;
+    uint64 base_address;
+} __attribute__((packed)) IDT64_PTR;
+
+extern uint64 pml4_table[512];
+extern uint64 pdpt_table[512];
+extern uint64 exception64_table[ARCH_EXCEPTIONS];
+
+static IDT64 g_idt64[ARCH_EXCEPTIONS];
+static IDT64_PTR g_idt64_ptr;
+// page directories for the GBs above the boot mapping when there are no 1 GB pages
+static uint64 g_high_dirs[ARCH_MAX_MEMORY_GB - ARCH_IDENTITY_GB][512] __attribute__((aligned(PAGE_SIZE)));
+
+static void arch_halt() {
+    for (;;)
+        asm volatile("cli; hlt");
+}
+
+// printf only knows 32 bit numbers
+static void print_hex64(uint64 value) {
+    if (value >> 32)
+        printf("0x%x%08x", (uint32)(value >> 32), (uint32)value);
+    else
+        printf("0x%x", (uint32)value);
+}
+
+/**
+ * called by exception.asm for every exception, the bring-up kernel has no
+ * handlers so it reports and halts
+ */
+void arch_exception(REGISTERS64 *reg) {
+    uint64 cr2;
+
+    asm volatile("mov %%cr2, %0" : "=r"(cr2));
+    printf_color(COLOR_BRIGHT_RED, "EXCEPTION %d, error %x, rip ", (uint32)reg->vector, (uint32)reg->err_code);
+    print_hex64(reg->rip);
+    printf_color(COLOR_BRIGHT_RED, ", cr2 ");
+    print_hex64(cr2);
+    printf("\n");
+    arch_halt();
+}
+
+static void idt64_init() {
+    for (uint32 i = 0; i < ARCH_EXCEPTIONS; i++) {
+        uint64 base = exception64_table[i];
+        IDT64 *this = &g_idt64[i];
+
+        this->offset_low = base & 0xFFFF;
+        this->segment_selector = ARCH_CODE_SEG;
+        this->ist = 0;
+        this->type = ARCH_GATE_INTERRUPT;
+        this->offset_mid = (base >> 16) & 0xFFFF;
+        this->offset_high = base >> 32;
+        this->zero = 0;
+    }
+    g_idt64_ptr.limit = sizeof(g_idt64) - 1;
+    g_idt64_ptr.base_address = (uint64)(uintptr)g_idt64;
+    asm volatile("lidt %0" :: "m"(g_idt64_ptr));
+}
+
+// end of the highest available region and the available total, both in bytes
+static void arch_memory_size(uint32 magic, multiboot_info_t *mbi, uint64 *top, uint64 *total) {
+    *top = 0;
+    *total = 0;
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC)
+        return;
+    if (!(mbi->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+            *top = 0x100000 + (uint64)mbi->mem_upper * 1024;
+            *total = *top;
+        }
+        return;
+    }
+    for (uintptr p = mbi->mmap_addr; p < (uintptr)mbi->mmap_addr + mbi->mmap_length;) {
+        multiboot_memory_map_t *entry = (multiboot_memory_map_t *)p;
+
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+            *total += entry->len;
+            if (entry->addr + entry->len > *top)
+                *top = entry->addr + entry->len;
+        }
+        // size does not count itself
+        p += entry->size + sizeof(entry->size);
+    }
+}
+
+/**
+ * identity map RAM from 4 GB up to top, returns the end of the mapping
+ */
+static uint64 arch_map_memory(uint64 top) {
+    uint32 gbs = (top + PAGE_1GB - 1) / PAGE_1GB;
+
+    if (gbs > ARCH_MAX_MEMORY_GB)
+        gbs = ARCH_MAX_MEMORY_GB;
+    if (gbs <= ARCH_IDENTITY_GB)
+        return (uint64)ARCH_IDENTITY_GB * PAGE_1GB;
+
+    for (uint32 gb = ARCH_IDENTITY_GB; gb < gbs; gb++) {
+        uint64 base = (uint64)gb * PAGE_1GB;
+
+        if (cpu_has(CPU_FEATURE_PDPE1GB)) {
+            pdpt_table[gb] = base | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE;
+        } else {
+            uint64 *dir = g_high_dirs[gb - ARCH_IDENTITY_GB];
+            for (uint32 i = 0; i < 512; i++)
+                dir[i] = (base + i * PAGE_2MB) | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE;
+            pdpt_table[gb] = (uint64)(uintptr)dir | PAGE_PRESENT | PAGE_WRITE;
+        }
+    }
+    // the entries were not present before, reloading CR3 drops any cached paging structure
+    asm volatile("mov %0, %%cr3" :: "r"((uint64)(uintptr)pml4_table) : "memory");
+    return (uint64)gbs * PAGE_1GB;
+}
+
+// write and read back the last page below the end of the mapped RAM
+static BOOL arch_test_page(uint64 top, uint64 mapped) {
+    uint64 end = top < mapped ? top : mapped;
+    volatile uint64 *page = (volatile uint64 *)(uintptr)((end - PAGE_SIZE) & ~(uint64)(PAGE_SIZE - 1));
+    uint64 saved = page[0];
+
+    page[0] = 0x0123456789ABCDEFULL;
+    if (page[0] != 0x0123456789ABCDEFULL)
+        return FALSE;
+    page[0] = saved;
+    return TRUE;
+}
+
+void kmain64(uint32 magic, uint32 mbi_addr) {
+    multiboot_info_t *mbi = (multiboot_info_t *)(uintptr)mbi_addr;
+    uint64 top, total, mapped;
+    uint32 crc;
+
+    cpu_features_init();
+    string_init();
+    console_init(COLOR_WHITE, COLOR_BLUE);
+    idt64_init();
+
+    printf("EdgeOS x86_64 long mode, 4-level paging\n");
+    arch_memory_size(magic, mbi, &top, &total);
+    mapped = arch_map_memory(top);
+    printf("Memory: %d MB available, highest address %d MB, %d MB mapped, %s pages above 4 GB\n",
+           (uint32)(total >> 20), (uint32)(top >> 20), (uint32)(mapped >> 20),
+           cpu_has(CPU_FEATURE_PDPE1GB) ? "1 GB" : "2 MB");
+    if (top > 0)
+        printf("Highest page: %s\n", arch_test_page(top, mapped) ? "ok" : "FAILED");
+
+    crc32c_init();
+    crc = crc32c(0, "123456789", 9);
+    printf("crc32c: 0x%x %s\n", crc, crc == ARCH_CRC32C_CHECK ? "ok" : "FAILED");
+    cpu_features_print();
+    printf("halted\n");
+    arch_halt();
+}
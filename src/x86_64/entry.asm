@@ -0,0 +1,165 @@
+; x86_64 entry, GRUB starts us in 32 bit protected mode like the i386 kernel,
+; we build 4-level page tables identity mapping the first 4 GB with 2 MB pages,
+; enable PAE and EFER.LME, turn paging on and far jump into 64 bit code
+
+section .multiboot
+    align 4
+    dd 0x1BADB002               ; magic number
+    dd 0x03                     ; flags, page aligned modules and memory info
+    dd -(0x1BADB002 + 0x03)     ; checksum
+
+PAGE_PRESENT    equ 1 << 0
+PAGE_WRITE      equ 1 << 1
+PAGE_LARGE      equ 1 << 7      ; 2 MB page in a page directory, 1 GB in a PDPT
+EFER_MSR        equ 0xC0000080
+EFER_LME        equ 1 << 8
+CR0_PG          equ 1 << 31
+CR4_PAE         equ 1 << 5
+IDENTITY_GB     equ 4           ; the boot mapping, arch.c maps RAM above it
+VGA_TEXT        equ 0xB8000
+
+section .text
+    global _start
+    global pml4_table
+    global pdpt_table
+    extern kmain64
+
+bits 32
+_start:
+    cli
+    mov esp, stack_top
+    mov edi, eax                ; multiboot magic, kmain64 1st argument
+    mov esi, ebx                ; multiboot info structure, kmain64 2nd argument
+
+    ; long mode is reported in CPUID 0x80000001 edx bit 29
+    mov eax, 0x80000000
+    cpuid
+    cmp eax, 0x80000001
+    jb .no_long_mode
+    mov eax, 0x80000001
+    cpuid
+    test edx, 1 << 29
+    jz .no_long_mode
+
+    ; the tables are in .bss, clear the PML4 and PDPT, the page directories get every entry written
+    mov ebx, edi
+    xor eax, eax
+    mov edi, pml4_table
+    mov ecx, 2 * 4096 / 4
+    rep stosd
+    mov edi, ebx
+
+    mov eax, pdpt_table
+    or eax, PAGE_PRESENT | PAGE_WRITE
+    mov [pml4_table], eax
+
+    ; PDPT entry i points at page directory i, which maps GB i
+    xor ecx, ecx
+.fill_pdpt:
+    mov eax, ecx
+    shl eax, 12
+    add eax, page_dirs
+    or eax, PAGE_PRESENT | PAGE_WRITE
+    mov [pdpt_table + ecx * 8], eax
+    inc ecx
+    cmp ecx, IDENTITY_GB
+    jne .fill_pdpt
+
+    ; 512 * IDENTITY_GB entries of 2 MB, the high dword holds bits 32 and up of the address
+    xor ecx, ecx
+.fill_dirs:
+    mov eax, ecx
+    shl eax, 21
+    or eax, PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE
+    mov [page_dirs + ecx * 8], eax
+    mov dword [page_dirs + ecx * 8 + 4], 0
+    inc ecx
+    cmp ecx, 512 * IDENTITY_GB
+    jne .fill_dirs
+
+    mov eax, pml4_table
+    mov cr3, eax
+
+    mov eax, cr4
+    or eax, CR4_PAE
+    mov cr4, eax
+
+    mov ecx, EFER_MSR
+    rdmsr
+    or eax, EFER_LME
+    wrmsr
+
+    mov eax, cr0
+    or eax, CR0_PG
+    mov cr0, eax
+
+    ; paging with LME set puts us in compatibility mode, the 64 bit code segment finishes the switch
+    lgdt [gdt64_descriptor]
+    jmp CODE_SEG:long_mode_entry
+
+.no_long_mode:
+    mov esi, no_long_mode_msg
+    mov edi, VGA_TEXT
+.print:
+    lodsb
+    test al, al
+    jz .halt
+    mov ah, 0x4F                ; white on red
+    stosw
+    jmp .print
+.halt:
+    hlt
+    jmp .halt
+
+bits 64
+long_mode_entry:
+    mov ax, DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; writing the 32 bit halves clears the upper ones
+    mov edi, edi
+    mov esi, esi
+    mov rsp, stack_top
+    call kmain64
+
+halt:
+    cli
+    hlt
+    jmp halt
+
+section .rodata
+no_long_mode_msg:
+    db "EdgeOS x86_64: this CPU has no long mode", 0
+
+; null, 64 bit code and data, base and limit are ignored in long mode
+align 8
+gdt64:
+    dq 0
+    dq 0x00209A0000000000       ; present, ring 0, code, L bit
+    dq 0x0000920000000000       ; present, ring 0, data
+gdt64_end:
+
+gdt64_descriptor:
+    dw gdt64_end - gdt64 - 1
+    dd gdt64
+
+CODE_SEG equ 0x08
+DATA_SEG equ 0x10
+
+section .bss
+    alignb 4096
+pml4_table:
+    resb 4096
+pdpt_table:
+    resb 4096
+page_dirs:
+    resb 4096 * IDENTITY_GB
+
+    alignb 16
+stack_bottom:
+    resb 16384
+stack_top:
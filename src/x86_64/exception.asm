@@ -0,0 +1,101 @@
+; x86_64 exception stubs, every stub leaves the same frame on the stack,
+; vectors without an error code push a zero in its place
+
+section .text
+    extern arch_exception
+    global exception64_table
+
+%macro EXCEPTION_NO_ERR 1
+exception64_%1:
+    push qword 0
+    push qword %1
+    jmp exception64_common
+%endmacro
+
+%macro EXCEPTION_ERR 1
+exception64_%1:
+    push qword %1
+    jmp exception64_common
+%endmacro
+
+EXCEPTION_NO_ERR 0
+EXCEPTION_NO_ERR 1
+EXCEPTION_NO_ERR 2
+EXCEPTION_NO_ERR 3
+EXCEPTION_NO_ERR 4
+EXCEPTION_NO_ERR 5
+EXCEPTION_NO_ERR 6
+EXCEPTION_NO_ERR 7
+EXCEPTION_ERR    8
+EXCEPTION_NO_ERR 9
+EXCEPTION_ERR    10
+EXCEPTION_ERR    11
+EXCEPTION_ERR    12
+EXCEPTION_ERR    13
+EXCEPTION_ERR    14
+EXCEPTION_NO_ERR 15
+EXCEPTION_NO_ERR 16
+EXCEPTION_ERR    17
+EXCEPTION_NO_ERR 18
+EXCEPTION_NO_ERR 19
+EXCEPTION_NO_ERR 20
+EXCEPTION_ERR    21
+EXCEPTION_NO_ERR 22
+EXCEPTION_NO_ERR 23
+EXCEPTION_NO_ERR 24
+EXCEPTION_NO_ERR 25
+EXCEPTION_NO_ERR 26
+EXCEPTION_NO_ERR 27
+EXCEPTION_NO_ERR 28
+EXCEPTION_ERR    29
+EXCEPTION_ERR    30
+EXCEPTION_NO_ERR 31
+
+; the CPU aligned rsp to 16 before its frame, 5 + 2 + 15 qwords keep it aligned for the call
+exception64_common:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov rdi, rsp                ; REGISTERS64 pointer argument
+    cld
+    call arch_exception
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    add rsp, 16                 ; vector and error code
+    iretq
+
+section .rodata
+align 8
+exception64_table:
+%assign i 0
+%rep 32
+    dq exception64_%+i
+%assign i i + 1
+%endrep